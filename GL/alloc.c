@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#if defined(__APPLE__) || defined(__WIN32__)
+/* Linux + Kos define this, OSX does not, so just use malloc there */
+static inline void* memalign(size_t alignment, size_t size) {
+    return malloc(size);
+}
+#else
+    #include <malloc.h>
+#endif
+
+#include "../include/glkos.h"
+#include "private.h"
+#include "alloc.h"
+
+typedef struct {
+    const char* site;
+    GLuint count;
+    GLuint bytes;
+} AllocationSite;
+
+/* Kept just in front of every heap allocation */
+typedef struct {
+    size_t size;
+    size_t offset;  /* From the start of the block to the allocation */
+} AllocationHeader;
+
+#define HEADER(ptr) ((AllocationHeader*) (ptr) - 1)
+
+static AllocationSite SITES[MAX_ALLOCATION_SITES];
+static GLuint SITE_COUNT = 0;
+
+static const char OTHER_SITES[] = "(other sites)";
+
+static size_t LIVE_ALLOCATIONS = 0;
+static size_t LIVE_BYTES = 0;
+
+static GLenum STEADY_STATE = GL_STEADY_STATE_OFF_KOS;
+
+static void steady_state(const char* what, size_t size, const char* site) {
+    if(STEADY_STATE != GL_STEADY_STATE_OFF_KOS) {
+        fprintf(stderr, "GL %s: %u bytes at %s in steady state\n", what, (unsigned int) size, site);
+        assert(STEADY_STATE != GL_STEADY_STATE_ASSERT_KOS);
+    }
+}
+
+static void count(size_t size, const char* site) {
+    RENDER_COUNTERS.allocations++;
+    RENDER_COUNTERS.allocation_bytes += size;
+
+    /* Sites are string literals, so comparing the pointers is enough */
+    GLuint i = 0;
+    for(; i < SITE_COUNT; ++i) {
+        if(SITES[i].site == site) {
+            break;
+        }
+    }
+
+    if(i == SITE_COUNT) {
+        if(SITE_COUNT < MAX_ALLOCATION_SITES - 1) {
+            SITES[SITE_COUNT].site = site;
+        } else {
+            /* Out of room, so count it (and any other new site) in the last entry */
+            i = MAX_ALLOCATION_SITES - 1;
+
+            if(SITE_COUNT < MAX_ALLOCATION_SITES) {
+                fprintf(stderr, "GL ALLOCATION: more than %d allocation sites, %s and later ones are counted as %s\n",
+                    MAX_ALLOCATION_SITES - 1, site, OTHER_SITES);
+                SITES[i].site = OTHER_SITES;
+            }
+        }
+
+        if(SITE_COUNT < MAX_ALLOCATION_SITES) {
+            SITES[SITE_COUNT].count = 0;
+            SITES[SITE_COUNT].bytes = 0;
+            SITE_COUNT++;
+        }
+    }
+
+    SITES[i].count++;
+    SITES[i].bytes += size;
+
+    steady_state("ALLOCATION", size, site);
+}
+
+/* Fills in the header of a block of size + offset bytes, and returns the
+ * allocation after it */
+static void* track(unsigned char* block, size_t size, size_t offset) {
+    if(!block) {
+        return NULL;
+    }
+
+    void* ptr = block + offset;
+    HEADER(ptr)->size = size;
+    HEADER(ptr)->offset = offset;
+
+    LIVE_ALLOCATIONS++;
+    LIVE_BYTES += size;
+    return ptr;
+}
+
+void* _glAllocMalloc(size_t size, const char* site) {
+    count(size, site);
+    return track((unsigned char*) malloc(sizeof(AllocationHeader) + size), size, sizeof(AllocationHeader));
+}
+
+void* _glAllocRealloc(void* ptr, size_t size, const char* site) {
+    count(size, site);
+
+    if(!ptr) {
+        return track((unsigned char*) realloc(NULL, sizeof(AllocationHeader) + size), size, sizeof(AllocationHeader));
+    }
+
+    /* realloc() can't keep the alignment of a GL_MEMALIGN allocation */
+    assert(HEADER(ptr)->offset == sizeof(AllocationHeader));
+
+    const size_t old_size = HEADER(ptr)->size;
+    unsigned char* block = (unsigned char*) realloc(HEADER(ptr), sizeof(AllocationHeader) + size);
+    if(!block) {
+        return NULL;
+    }
+
+    LIVE_ALLOCATIONS--;
+    LIVE_BYTES -= old_size;
+    return track(block, size, sizeof(AllocationHeader));
+}
+
+void* _glAllocMemalign(size_t alignment, size_t size, const char* site) {
+    count(size, site);
+
+    /* The header goes at the end of a whole alignment in front of the
+     * allocation, so the allocation stays aligned */
+    const size_t offset = (alignment > sizeof(AllocationHeader)) ? alignment : sizeof(AllocationHeader);
+    return track((unsigned char*) memalign(alignment, offset + size), size, offset);
+}
+
+void* _glAllocPVR(size_t size, const char* site) {
+    count(size, site);
+    return pvr_mem_malloc(size);
+}
+
+void _glAllocFree(void* ptr, const char* site) {
+    if(!ptr) {
+        return;
+    }
+
+    const size_t size = HEADER(ptr)->size;
+
+    RENDER_COUNTERS.frees++;
+    LIVE_ALLOCATIONS--;
+    LIVE_BYTES -= size;
+
+    steady_state("FREE", size, site);
+
+    free((unsigned char*) ptr - HEADER(ptr)->offset);
+}
+
+size_t _glLiveAllocations() {
+    return LIVE_ALLOCATIONS;
+}
+
+size_t _glLiveAllocationBytes() {
+    return LIVE_BYTES;
+}
+
+void _glResetAllocationSites() {
+    for(GLuint i = 0; i < SITE_COUNT; ++i) {
+        SITES[i].count = SITES[i].bytes = 0;
+    }
+}
+
+void APIENTRY glKosSetSteadyState(GLenum mode) {
+    TRACE();
+
+    if(mode != GL_STEADY_STATE_OFF_KOS && mode != GL_STEADY_STATE_REPORT_KOS && mode != GL_STEADY_STATE_ASSERT_KOS) {
+        _glKosThrowError(GL_INVALID_ENUM, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    STEADY_STATE = mode;
+}
+
+GLboolean APIENTRY glKosGetAllocationSite(GLuint index, const char** site, GLuint* count, GLuint* bytes) {
+    if(index >= SITE_COUNT) {
+        return GL_FALSE;
+    }
+
+    *site = SITES[index].site;
+    *count = SITES[index].count;
+    *bytes = SITES[index].bytes;
+    return GL_TRUE;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Allocation accounting
+ *
+ * Everything GLdc (and the containers) allocates goes through these macros,
+ * which count the allocations and bytes against the file and line they were
+ * made from. See glKosSetSteadyState and glKosGetAllocationSite.
+ *
+ * Heap allocations must be freed with GL_FREE (never free()), their size is
+ * kept just in front of them so that the live bytes can be counted. Texture
+ * memory is still freed with pvr_mem_free() and isn't counted as live.
+ */
+
+#define _GL_ALLOC_STRINGIFY2(x) #x
+#define _GL_ALLOC_STRINGIFY(x) _GL_ALLOC_STRINGIFY2(x)
+#define GL_ALLOC_SITE __FILE__ ":" _GL_ALLOC_STRINGIFY(__LINE__)
+
+#define GL_MALLOC(size) _glAllocMalloc((size), GL_ALLOC_SITE)
+#define GL_REALLOC(ptr, size) _glAllocRealloc((ptr), (size), GL_ALLOC_SITE)
+#define GL_MEMALIGN(alignment, size) _glAllocMemalign((alignment), (size), GL_ALLOC_SITE)
+#define GL_PVR_MALLOC(size) _glAllocPVR((size), GL_ALLOC_SITE)
+#define GL_FREE(ptr) _glAllocFree((ptr), GL_ALLOC_SITE)
+
+/* Sites past the first MAX_ALLOCATION_SITES - 1 are counted together in the
+ * last entry */
+#define MAX_ALLOCATION_SITES 64
+
+void* _glAllocMalloc(size_t size, const char* site);
+void* _glAllocRealloc(void* ptr, size_t size, const char* site);
+void* _glAllocMemalign(size_t alignment, size_t size, const char* site);
+void* _glAllocPVR(size_t size, const char* site);
+void _glAllocFree(void* ptr, const char* site);
+
+/* Heap allocations that haven't been freed yet, and their bytes. Not reset
+ * by glKosResetCounters. */
+size_t _glLiveAllocations();
+size_t _glLiveAllocationBytes();
+
+/* Clears the per-site counts, called from glKosResetCounters */
+void _glResetAllocationSites();
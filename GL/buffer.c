@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "private.h"
+#include "config.h"
+#include "../include/glext.h"
+
+static NamedArray BUFFER_OBJECTS;
+
+static BufferObject* ARRAY_BUFFER = NULL;
+static BufferObject* ELEMENT_ARRAY_BUFFER = NULL;
+
+GLubyte _glInitBuffers() {
+    named_array_init_growable(&BUFFER_OBJECTS, sizeof(BufferObject), MAX_BUFFER_COUNT);
+
+    // Reserve zero so that it is never given to anyone as an ID!
+    named_array_reserve(&BUFFER_OBJECTS, 0);
+    return 1;
+}
+
+static void _glInitializeBufferObject(BufferObject* buffer, GLuint id) {
+    buffer->index = id;
+    buffer->usage = GL_STATIC_DRAW_ARB;
+    buffer->size = 0;
+    buffer->data = NULL;
+    buffer->mapped = GL_FALSE;
+    buffer->access = GL_READ_WRITE_ARB;
+    buffer->converted = GL_FALSE;
+    buffer->converted_count = 0;
+
+    aligned_vector_init(&buffer->vertices, sizeof(Vertex));
+    aligned_vector_init(&buffer->extras, sizeof(VertexExtra));
+}
+
+BufferObject* _glGetBufferObject(GLuint buffer) {
+    if(!buffer) {
+        return NULL;
+    }
+
+    return (BufferObject*) named_array_get(&BUFFER_OBJECTS, buffer);
+}
+
+BufferObject* _glGetBoundBuffer(GLenum target) {
+    return (target == GL_ELEMENT_ARRAY_BUFFER_ARB) ? ELEMENT_ARRAY_BUFFER : ARRAY_BUFFER;
+}
+
+/* Returns the buffer bound to target, or NULL (having raised the error) if
+ * target isn't valid or nothing is bound */
+static BufferObject* _glCheckBoundBuffer(GLenum target, const char* func) {
+    if(target != GL_ARRAY_BUFFER_ARB && target != GL_ELEMENT_ARRAY_BUFFER_ARB) {
+        _glKosThrowError(GL_INVALID_ENUM, func);
+        _glKosPrintError();
+        return NULL;
+    }
+
+    BufferObject* buffer = _glGetBoundBuffer(target);
+    if(!buffer) {
+        _glKosThrowError(GL_INVALID_OPERATION, func);
+        _glKosPrintError();
+        return NULL;
+    }
+
+    return buffer;
+}
+
+void APIENTRY glGenBuffersARB(GLsizei n, GLuint* buffers) {
+    TRACE();
+
+    while(n--) {
+        GLuint id = 0;
+        BufferObject* buffer = (BufferObject*) named_array_alloc(&BUFFER_OBJECTS, &id);
+
+        if(!buffer) {
+            _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+            _glKosPrintError();
+            return;
+        }
+
+        assert(id);  // Generated IDs must never be zero
+
+        _glInitializeBufferObject(buffer, id);
+
+        *buffers++ = id;
+    }
+}
+
+void APIENTRY glDeleteBuffersARB(GLsizei n, const GLuint* buffers) {
+    TRACE();
+
+    while(n--) {
+        BufferObject* buffer = _glGetBufferObject(*buffers);
+
+        /* Unused names (and zero) are silently ignored */
+        if(!buffer) {
+            buffers++;
+            continue;
+        }
+
+        if(buffer == ARRAY_BUFFER) {
+            ARRAY_BUFFER = NULL;
+        }
+
+        if(buffer == ELEMENT_ARRAY_BUFFER) {
+            ELEMENT_ARRAY_BUFFER = NULL;
+        }
+
+        _glRebaseBufferPointers(buffer->index, buffer->data, NULL);
+
+        GL_FREE(buffer->data);
+        aligned_vector_cleanup(&buffer->vertices);
+        aligned_vector_cleanup(&buffer->extras);
+
+        named_array_release(&BUFFER_OBJECTS, *buffers++);
+    }
+}
+
+void APIENTRY glBindBufferARB(GLenum target, GLuint buffer) {
+    TRACE();
+
+    if(target != GL_ARRAY_BUFFER_ARB && target != GL_ELEMENT_ARRAY_BUFFER_ARB) {
+        _glKosThrowError(GL_INVALID_ENUM, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    BufferObject* object = NULL;
+
+    if(buffer) {
+        /* If this didn't come from glGenBuffersARB, then we should initialize
+         * the buffer the first time it's bound */
+        object = _glGetBufferObject(buffer);
+        if(!object) {
+            object = (BufferObject*) named_array_reserve(&BUFFER_OBJECTS, buffer);
+            if(!object) {
+                _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+                _glKosPrintError();
+                return;
+            }
+
+            _glInitializeBufferObject(object, buffer);
+        }
+    }
+
+    if(target == GL_ARRAY_BUFFER_ARB) {
+        ARRAY_BUFFER = object;
+    } else {
+        ELEMENT_ARRAY_BUFFER = object;
+    }
+}
+
+GLboolean APIENTRY glIsBufferARB(GLuint buffer) {
+    return (_glGetBufferObject(buffer)) ? GL_TRUE : GL_FALSE;
+}
+
+void APIENTRY glBufferDataARB(GLenum target, GLsizeiptrARB size, const GLvoid* data, GLenum usage) {
+    TRACE();
+
+    GLint usage_values [] = {
+        GL_STREAM_DRAW_ARB, GL_STREAM_READ_ARB, GL_STREAM_COPY_ARB,
+        GL_STATIC_DRAW_ARB, GL_STATIC_READ_ARB, GL_STATIC_COPY_ARB,
+        GL_DYNAMIC_DRAW_ARB, GL_DYNAMIC_READ_ARB, GL_DYNAMIC_COPY_ARB, 0
+    };
+
+    if(_glCheckValidEnum(usage, usage_values, __func__) != 0) {
+        return;
+    }
+
+    if(size < 0) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    BufferObject* buffer = _glCheckBoundBuffer(target, __func__);
+    if(!buffer) {
+        return;
+    }
+
+    /* Respecifying a buffer with the same size (e.g. streaming) keeps the
+     * existing storage */
+    if(size != buffer->size || !buffer->data) {
+        GLubyte* new_data = (size) ? (GLubyte*) GL_MALLOC(size) : NULL;
+        if(size && !new_data) {
+            _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+            _glKosPrintError();
+            return;
+        }
+
+        _glRebaseBufferPointers(buffer->index, buffer->data, new_data);
+
+        GL_FREE(buffer->data);
+        buffer->data = new_data;
+        buffer->size = size;
+    }
+
+    if(data && size) {
+        memcpy(buffer->data, data, size);
+    }
+
+    buffer->usage = usage;
+    buffer->mapped = GL_FALSE;
+    buffer->converted = GL_FALSE;
+
+    /* Only static buffers are converted, so don't hold on to the copy */
+    if(usage != GL_STATIC_DRAW_ARB) {
+        aligned_vector_cleanup(&buffer->vertices);
+        aligned_vector_cleanup(&buffer->extras);
+    }
+}
+
+/* Raises the error and returns GL_FALSE if offset and size don't fit in
+ * the buffer, or the buffer is mapped */
+static GLboolean _glCheckBufferRange(const BufferObject* buffer, GLintptrARB offset, GLsizeiptrARB size, const char* func) {
+    if(offset < 0 || size < 0 || offset + size > buffer->size) {
+        _glKosThrowError(GL_INVALID_VALUE, func);
+        _glKosPrintError();
+        return GL_FALSE;
+    }
+
+    if(buffer->mapped) {
+        _glKosThrowError(GL_INVALID_OPERATION, func);
+        _glKosPrintError();
+        return GL_FALSE;
+    }
+
+    return GL_TRUE;
+}
+
+void APIENTRY glBufferSubDataARB(GLenum target, GLintptrARB offset, GLsizeiptrARB size, const GLvoid* data) {
+    TRACE();
+
+    BufferObject* buffer = _glCheckBoundBuffer(target, __func__);
+    if(!buffer || !_glCheckBufferRange(buffer, offset, size, __func__)) {
+        return;
+    }
+
+    memcpy(buffer->data + offset, data, size);
+    buffer->converted = GL_FALSE;
+}
+
+void APIENTRY glGetBufferSubDataARB(GLenum target, GLintptrARB offset, GLsizeiptrARB size, GLvoid* data) {
+    TRACE();
+
+    BufferObject* buffer = _glCheckBoundBuffer(target, __func__);
+    if(!buffer || !_glCheckBufferRange(buffer, offset, size, __func__)) {
+        return;
+    }
+
+    memcpy(data, buffer->data + offset, size);
+}
+
+GLvoid* APIENTRY glMapBufferARB(GLenum target, GLenum access) {
+    TRACE();
+
+    GLint access_values [] = {GL_READ_ONLY_ARB, GL_WRITE_ONLY_ARB, GL_READ_WRITE_ARB, 0};
+
+    if(_glCheckValidEnum(access, access_values, __func__) != 0) {
+        return NULL;
+    }
+
+    BufferObject* buffer = _glCheckBoundBuffer(target, __func__);
+    if(!buffer) {
+        return NULL;
+    }
+
+    if(buffer->mapped) {
+        _glKosThrowError(GL_INVALID_OPERATION, __func__);
+        _glKosPrintError();
+        return NULL;
+    }
+
+    buffer->mapped = GL_TRUE;
+    buffer->access = access;
+    return buffer->data;
+}
+
+GLboolean APIENTRY glUnmapBufferARB(GLenum target) {
+    TRACE();
+
+    BufferObject* buffer = _glCheckBoundBuffer(target, __func__);
+    if(!buffer) {
+        return GL_FALSE;
+    }
+
+    if(!buffer->mapped) {
+        _glKosThrowError(GL_INVALID_OPERATION, __func__);
+        _glKosPrintError();
+        return GL_FALSE;
+    }
+
+    buffer->mapped = GL_FALSE;
+
+    if(buffer->access != GL_READ_ONLY_ARB) {
+        buffer->converted = GL_FALSE;
+    }
+
+    return GL_TRUE;
+}
+
+void APIENTRY glGetBufferParameterivARB(GLenum target, GLenum pname, GLint* params) {
+    TRACE();
+
+    BufferObject* buffer = _glCheckBoundBuffer(target, __func__);
+    if(!buffer) {
+        return;
+    }
+
+    switch(pname) {
+        case GL_BUFFER_SIZE_ARB:
+            *params = buffer->size;
+        break;
+        case GL_BUFFER_USAGE_ARB:
+            *params = buffer->usage;
+        break;
+        case GL_BUFFER_ACCESS_ARB:
+            *params = buffer->access;
+        break;
+        case GL_BUFFER_MAPPED_ARB:
+            *params = buffer->mapped;
+        break;
+    default:
+        _glKosThrowError(GL_INVALID_ENUM, __func__);
+        _glKosPrintError();
+    }
+}
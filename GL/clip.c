@@ -1,14 +1,9 @@
 #include <float.h>
+#include <math.h>
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
 
-#ifdef _arch_dreamcast
-#include <dc/pvr.h>
-#else
-#define PVR_PACK_COLOR(a, r, g, b) {}
-#endif
-
 #include "profiler.h"
 #include "private.h"
 #include "../containers/aligned_vector.h"
@@ -24,6 +19,90 @@ void _glEnableClipping(unsigned char v) {
     ZCLIP_ENABLED = v;
 }
 
+/* Bounds given for the next draw call, either a box (min then max) or a
+ * sphere (centre then radius) */
+#define BOUNDS_TYPE_NONE   0
+#define BOUNDS_TYPE_BOX    1
+#define BOUNDS_TYPE_SPHERE 2
+
+static GLubyte BOUNDS_TYPE = BOUNDS_TYPE_NONE;
+static GLfloat BOUNDS[6];
+
+void APIENTRY glKosBoundingBox(GLfloat minx, GLfloat miny, GLfloat minz, GLfloat maxx, GLfloat maxy, GLfloat maxz) {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    if(minx > maxx || miny > maxy || minz > maxz) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    BOUNDS[0] = minx;
+    BOUNDS[1] = miny;
+    BOUNDS[2] = minz;
+    BOUNDS[3] = maxx;
+    BOUNDS[4] = maxy;
+    BOUNDS[5] = maxz;
+    BOUNDS_TYPE = BOUNDS_TYPE_BOX;
+}
+
+void APIENTRY glKosBoundingSphere(GLfloat x, GLfloat y, GLfloat z, GLfloat radius) {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    if(radius < 0.0f) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    BOUNDS[0] = x;
+    BOUNDS[1] = y;
+    BOUNDS[2] = z;
+    BOUNDS[3] = radius;
+    BOUNDS_TYPE = BOUNDS_TYPE_SPHERE;
+}
+
+GLubyte _glTakeBounds() {
+    const GLubyte type = BOUNDS_TYPE;
+    BOUNDS_TYPE = BOUNDS_TYPE_NONE;
+
+    /* The list is replayed later under whatever matrices are current then */
+    if(_glIsCompilingList()) {
+        return BOUNDS_UNKNOWN;
+    }
+
+    switch(type) {
+        case BOUNDS_TYPE_BOX:
+            return _glClassifyBox(BOUNDS, BOUNDS + 3);
+        case BOUNDS_TYPE_SPHERE:
+            return _glClassifySphere(BOUNDS, BOUNDS[3]);
+        default:
+            return BOUNDS_UNKNOWN;
+    }
+}
+
+GLboolean _glNeedsClipping(GLubyte bounds) {
+    return ZCLIP_ENABLED && bounds != BOUNDS_IN_FRONT;
+}
+
+static GLboolean REJECTION_ENABLED = GL_FALSE;
+
+GLboolean _glIsTriangleRejectionEnabled() {
+    return REJECTION_ENABLED;
+}
+
+void _glEnableTriangleRejection(GLboolean v) {
+    REJECTION_ENABLED = v;
+}
+
 void _glClipLineToNearZ(const Vertex* v1, const Vertex* v2, Vertex* vout, float* t) __attribute__((optimize("fast-math")));
 void _glClipLineToNearZ(const Vertex* v1, const Vertex* v2, Vertex* vout, float* t) {
     const float NEAR_PLANE = NEAR_PLANE_DISTANCE + 0.0001f;
@@ -91,6 +170,9 @@ void _glClipTriangle(const Triangle* triangle, const uint8_t visible, Submission
     const Vertex* vertices = triangle->vertex;
     const VertexExtra* extras = triangle->extra;
 
+    /* Extras are only generated for lit or multitextured geometry */
+    AlignedVector* targetExtras = target->extras;
+
     /* Used when flat shading is enabled */
     uint32_t finalColour = *((uint32_t*) vertices[2].bgra);
 
@@ -119,8 +201,10 @@ void _glClipTriangle(const Triangle* triangle, const uint8_t visible, Submission
                 interpolateFloat(v1->w, v2->w, t, &next.w);
                 interpolateVec2(v1->uv, v2->uv, t, next.uv);
 
-                interpolateVec3(ve1->nxyz, ve2->nxyz, t, veNext.nxyz);
-                interpolateVec2(ve1->st, ve2->st, t, veNext.st);
+                if(targetExtras) {
+                    interpolateVec3(ve1->nxyz, ve2->nxyz, t, veNext.nxyz);
+                    interpolateVec2(ve1->st, ve2->st, t, veNext.st);
+                }
 
                 if(flatShade) {
                     *((uint32_t*) next.bgra) = finalColour;
@@ -132,7 +216,9 @@ void _glClipTriangle(const Triangle* triangle, const uint8_t visible, Submission
                 last = aligned_vector_push_back(&target->output->vector, &next, 1);
                 last->flags = VERTEX_CMD;
 
-                veLast = aligned_vector_push_back(target->extras, &veNext, 1);
+                if(targetExtras) {
+                    veLast = aligned_vector_push_back(targetExtras, &veNext, 1);
+                }
 
                 ++c;
             }
@@ -142,7 +228,9 @@ void _glClipTriangle(const Triangle* triangle, const uint8_t visible, Submission
             last = aligned_vector_push_back(&target->output->vector, &vertices[thisIndex], 1);
             last->flags = VERTEX_CMD;
 
-            veLast = aligned_vector_push_back(target->extras, &extras[thisIndex], 1);
+            if(targetExtras) {
+                veLast = aligned_vector_push_back(targetExtras, &extras[thisIndex], 1);
+            }
 
             ++c;
         }
@@ -158,11 +246,6 @@ void _glClipTriangle(const Triangle* triangle, const uint8_t visible, Submission
             newVerts[1] = *(last - 1);
             newVerts[2] = *(last);
 
-            VertexExtra newExtras[3];
-            newExtras[0] = *(veLast - 3);
-            newExtras[1] = *(veLast - 1);
-            newExtras[2] = *(veLast);
-
             (last - 1)->flags = VERTEX_CMD_EOL;
             newVerts[0].flags = VERTEX_CMD;
             newVerts[1].flags = VERTEX_CMD;
@@ -171,8 +254,15 @@ void _glClipTriangle(const Triangle* triangle, const uint8_t visible, Submission
             aligned_vector_resize(&target->output->vector, target->output->vector.size - 1);
             aligned_vector_push_back(&target->output->vector, newVerts, 3);
 
-            aligned_vector_resize(target->extras, target->extras->size - 1);
-            aligned_vector_push_back(target->extras, newExtras, 3);
+            if(targetExtras) {
+                VertexExtra newExtras[3];
+                newExtras[0] = *(veLast - 3);
+                newExtras[1] = *(veLast - 1);
+                newExtras[2] = *(veLast);
+
+                aligned_vector_resize(targetExtras, targetExtras->size - 1);
+                aligned_vector_push_back(targetExtras, newExtras, 3);
+            }
         } else {
             last->flags = VERTEX_CMD_EOL;
         }
@@ -183,6 +273,8 @@ void _glClipTriangle(const Triangle* triangle, const uint8_t visible, Submission
 static inline void markDead(Vertex* vert) {
     vert->flags = VERTEX_CMD_EOL;
 
+    RENDER_COUNTERS.vertices_dead++;
+
     // If we're debugging, wipe out the xyz
 #ifndef NDEBUG
     *((uint32_t*) &vert->xyz[0]) = 0xDEADBEEF;
@@ -291,13 +383,11 @@ void _glClipTriangleStrip(SubmissionTarget* target, uint8_t fladeShade) {
                 TO_CLIP[CLIP_COUNT].vertex[1] = *v2;
                 TO_CLIP[CLIP_COUNT].vertex[2] = *v3;
 
-                VertexExtra* ve1 = (VertexExtra*) aligned_vector_at(target->extras, vi1);
-                VertexExtra* ve2 = (VertexExtra*) aligned_vector_at(target->extras, vi2);
-                VertexExtra* ve3 = (VertexExtra*) aligned_vector_at(target->extras, vi3);
-
-                TO_CLIP[CLIP_COUNT].extra[0] = *ve1;
-                TO_CLIP[CLIP_COUNT].extra[1] = *ve2;
-                TO_CLIP[CLIP_COUNT].extra[2] = *ve3;
+                if(target->extras) {
+                    TO_CLIP[CLIP_COUNT].extra[0] = *(VertexExtra*) aligned_vector_at(target->extras, vi1);
+                    TO_CLIP[CLIP_COUNT].extra[1] = *(VertexExtra*) aligned_vector_at(target->extras, vi2);
+                    TO_CLIP[CLIP_COUNT].extra[2] = *(VertexExtra*) aligned_vector_at(target->extras, vi3);
+                }
 
                 TO_CLIP[CLIP_COUNT].visible = visible;
                 ++CLIP_COUNT;
@@ -340,10 +430,11 @@ void _glClipTriangleStrip(SubmissionTarget* target, uint8_t fladeShade) {
                     TO_CLIP[CLIP_COUNT].vertex[1] = *v2;
                     TO_CLIP[CLIP_COUNT].vertex[2] = *v4;
 
-                    VertexExtra* ve4 = (VertexExtra*) aligned_vector_at(target->extras, vi4);
-                    TO_CLIP[CLIP_COUNT].extra[0] = *(VertexExtra*) aligned_vector_at(target->extras, vi3);
-                    TO_CLIP[CLIP_COUNT].extra[1] = *(VertexExtra*) aligned_vector_at(target->extras, vi2);
-                    TO_CLIP[CLIP_COUNT].extra[2] = *ve4;
+                    if(target->extras) {
+                        TO_CLIP[CLIP_COUNT].extra[0] = *(VertexExtra*) aligned_vector_at(target->extras, vi3);
+                        TO_CLIP[CLIP_COUNT].extra[1] = *(VertexExtra*) aligned_vector_at(target->extras, vi2);
+                        TO_CLIP[CLIP_COUNT].extra[2] = *(VertexExtra*) aligned_vector_at(target->extras, vi4);
+                    }
 
                     visible = ((v3->w > 0) ? 4 : 0) | ((v2->w > 0) ? 2 : 0) | ((v4->w > 0) ? 1 : 0);
 
@@ -366,9 +457,14 @@ void _glClipTriangleStrip(SubmissionTarget* target, uint8_t fladeShade) {
                         v4->flags = VERTEX_CMD;
 
                         /* Swap the extra data too */
-                        VertexExtra t = *ve4;
-                        *ve3 = *ve4;
-                        *ve4 = t;
+                        if(target->extras) {
+                            VertexExtra* ve3 = (VertexExtra*) aligned_vector_at(target->extras, vi3);
+                            VertexExtra* ve4 = (VertexExtra*) aligned_vector_at(target->extras, vi4);
+
+                            VertexExtra t = *ve3;
+                            *ve3 = *ve4;
+                            *ve4 = t;
+                        }
                     }
                 }
             break;
@@ -377,9 +473,186 @@ void _glClipTriangleStrip(SubmissionTarget* target, uint8_t fladeShade) {
         }
     }
 
+    RENDER_COUNTERS.triangles_clipped += CLIP_COUNT;
+
     /* Now, clip all the triangles and append them to the output */
     GLushort i;
     for(i = 0; i < CLIP_COUNT; ++i) {
         _glClipTriangle(&TO_CLIP[i], TO_CLIP[i].visible, target, fladeShade);
     }
 }
+
+/* Why _glRejectTriangles can leave a triangle out, REJECT_* - 1 indexes
+ * RENDER_COUNTERS.triangles_rejected */
+#define KEEP             0
+#define REJECT_OFFSCREEN 1
+#define REJECT_SMALL     2
+#define REJECT_BACK      3
+
+#define MIN3(a, b, c) (((a) < (b)) ? (((a) < (c)) ? (a) : (c)) : (((b) < (c)) ? (b) : (c)))
+#define MAX3(a, b, c) (((a) > (b)) ? (((a) > (c)) ? (a) : (c)) : (((b) > (c)) ? (b) : (c)))
+
+/* Whether the PVR would draw none of a triangle, from its screen space
+ * vertices. odd is set for the odd triangles of a strip, which are wound
+ * the other way. */
+static inline GLubyte classifyTriangle(const Vertex* a, const Vertex* b, const Vertex* c, const GLboolean odd, const GLubyte culling) {
+    /* Without near-Z clipping, anything behind the camera was divided into
+     * nonsense, so leave that to the PVR */
+    if(!(a->w > 0 && b->w > 0 && c->w > 0)) {
+        return KEEP;
+    }
+
+    const float minx = MIN3(a->xyz[0], b->xyz[0], c->xyz[0]);
+    const float maxx = MAX3(a->xyz[0], b->xyz[0], c->xyz[0]);
+    const float miny = MIN3(a->xyz[1], b->xyz[1], c->xyz[1]);
+    const float maxy = MAX3(a->xyz[1], b->xyz[1], c->xyz[1]);
+
+    if(maxx < 0.0f || minx > vid_mode->width || maxy < 0.0f || miny > vid_mode->height) {
+        return REJECT_OFFSCREEN;
+    }
+
+    /* If there's no multiple of half a pixel in either range, no pixel is
+     * covered whether it's sampled at its corner or its centre */
+    if(ceilf(minx * 2.0f) > maxx * 2.0f || ceilf(miny * 2.0f) > maxy * 2.0f) {
+        return REJECT_SMALL;
+    }
+
+    /* Screen y points down, so this is positive for clockwise */
+    float area = (b->xyz[0] - a->xyz[0]) * (c->xyz[1] - a->xyz[1]) - (b->xyz[1] - a->xyz[1]) * (c->xyz[0] - a->xyz[0]);
+
+    if(area == 0.0f) {
+        return REJECT_SMALL;
+    }
+
+    if(odd) {
+        area = -area;
+    }
+
+    if((culling == PVR_CULLING_CW && area > 0.0f) || (culling == PVR_CULLING_CCW && area < 0.0f)) {
+        return REJECT_BACK;
+    }
+
+    return KEEP;
+}
+
+static inline void moveVertex(Vertex* vertices, VertexExtra* extras, const GLuint to, const GLuint from) {
+    vertices[to] = vertices[from];
+
+    if(extras) {
+        extras[to] = extras[from];
+    }
+}
+
+/* Moves vertices first to last down to out as a strip of their own, and
+ * returns the new out. If first starts an odd triangle of the original
+ * strip, it's repeated so the rest keep their winding, at the cost of a
+ * degenerate triangle. */
+static GLuint emitStrip(Vertex* vertices, VertexExtra* extras, GLuint out, const GLuint first, const GLuint last, const GLboolean odd) {
+    if(odd) {
+        moveVertex(vertices, extras, out++, first);
+    }
+
+    for(GLuint i = first; i <= last; ++i) {
+        moveVertex(vertices, extras, out, i);
+        vertices[out++].flags = VERTEX_CMD;
+    }
+
+    vertices[out - 1].flags = VERTEX_CMD_EOL;
+    return out;
+}
+
+static inline void countRejected(GLuint pending[4]) {
+    RENDER_COUNTERS.triangles_rejected[0] += pending[REJECT_OFFSCREEN];
+    RENDER_COUNTERS.triangles_rejected[1] += pending[REJECT_SMALL];
+    RENDER_COUNTERS.triangles_rejected[2] += pending[REJECT_BACK];
+}
+
+/* Rejects triangles from the strip of count vertices at start, moving what's
+ * left down to out, and returns the new out.
+ *
+ * Leaving triangles out of the middle of a strip means splitting it, which
+ * repeats two vertices (three if the second half starts on an odd
+ * triangle), so a run of rejected triangles is only left out if that
+ * saves vertices. Otherwise they stay in the strip for the PVR to throw
+ * away. The output never gets ahead of the vertices still to be read, so
+ * this can work in place. */
+static GLuint rejectFromStrip(Vertex* vertices, VertexExtra* extras, const GLuint start, const GLuint count, GLuint out, const GLubyte culling) {
+    /* Dead vertices from clipping end up as strips of their own */
+    if(count < 3) {
+        return out;
+    }
+
+    GLint run = -1;  /* First triangle of the strip being kept, if there is one */
+    GLuint end = 0;  /* and its last kept triangle */
+
+    /* Triangles rejected since the last one that was kept */
+    GLuint pending[4] = {0, 0, 0, 0};
+    GLuint rejected = 0;
+
+    for(GLuint t = 0; t < count - 2; ++t) {
+        const Vertex* v = vertices + start + t;
+        const GLubyte reason = classifyTriangle(v, v + 1, v + 2, t & 1, culling);
+
+        if(reason != KEEP) {
+            pending[reason]++;
+            rejected++;
+            continue;
+        }
+
+        if(run < 0) {
+            /* Starting on the second triangle needs a repeated vertex,
+             * which is no better than keeping the first */
+            if(t > (t & 1)) {
+                countRejected(pending);
+                run = t;
+            } else {
+                run = 0;
+            }
+        } else if(rejected > 2 + (t & 1)) {
+            out = emitStrip(vertices, extras, out, start + run, start + end + 2, run & 1);
+            countRejected(pending);
+            run = t;
+        }
+
+        end = t;
+        pending[REJECT_OFFSCREEN] = pending[REJECT_SMALL] = pending[REJECT_BACK] = 0;
+        rejected = 0;
+    }
+
+    /* Whatever was rejected at the end (or the whole strip) is left out */
+    countRejected(pending);
+
+    if(run < 0) {
+        return out;
+    }
+
+    return emitStrip(vertices, extras, out, start + run, start + end + 2, run & 1);
+}
+
+void _glRejectTriangles(SubmissionTarget* target, GLubyte culling) {
+    Vertex* vertices = _glSubmissionTargetStart(target);
+    VertexExtra* extras = (target->extras) ? aligned_vector_at(target->extras, 0) : NULL;
+    const GLuint count = target->count;
+
+    GLuint out = 0;
+    GLuint first = 0;
+
+    while(first < count) {
+        GLuint last = first;
+        while(last + 1 < count && vertices[last].flags != VERTEX_CMD_EOL) {
+            ++last;
+        }
+
+        out = rejectFromStrip(vertices, extras, first, last - first + 1, out, culling);
+        first = last + 1;
+    }
+
+    RENDER_COUNTERS.vertices_rejected += count - out;
+
+    target->count = out;
+    aligned_vector_resize(&target->output->vector, target->start_offset + out);
+
+    if(extras) {
+        aligned_vector_resize(target->extras, out);
+    }
+}
@@ -2,8 +2,28 @@
 #define CONFIG_H
 
 
-/* This figure is derived from the needs of Quake 1 */
-#define MAX_TEXTURE_COUNT 1088
+/* Texture objects are allocated as they're needed, so this is only an upper
+ * limit on the IDs handed out (or bound). Quake 1 needs 1088. */
+#define MAX_TEXTURE_COUNT 65536
+
+/* Same for buffer objects */
+#define MAX_BUFFER_COUNT 65536
+
+/* And display lists */
+#define MAX_LIST_COUNT 65536
+
+/* How deep glCallList can recurse, the minimum GL allows */
+#define MAX_LIST_NESTING 64
+
+/* Indexed draws convert the whole range of vertices they refer to before
+ * gathering them, unless the range is more than this many times the index
+ * count, in which case each index is read on its own */
+#define INDEX_RANGE_MAX_RATIO 4
+
+/* Vertices are lit, transformed and divided this many at a time, so that
+ * each chunk is still in the cache for the next stage. 64 vertices (and
+ * their extras and eye space data) is about a third of the operand cache. */
+#define VERTEX_CHUNK_SIZE 64
 
 
 #endif // CONFIG_H
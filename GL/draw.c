@@ -4,11 +4,11 @@
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
-#include <dc/vec3f.h>
 
 #include "../include/gl.h"
 #include "../include/glext.h"
 #include "private.h"
+#include "config.h"
 #include "profiler.h"
 
 
@@ -22,6 +22,16 @@ static GLuint ENABLED_VERTEX_ATTRIBUTES = 0;
 static GLubyte ACTIVE_CLIENT_TEXTURE = 0;
 static GLboolean FAST_PATH_ENABLED = GL_FALSE;
 
+/* normals is NULL unless the kernel reads normals and they're needed */
+typedef void (*VertexKernel)(const GLuint first, const GLuint count, Vertex* output, VertexExtra* normals);
+
+/* The specialised reader for the current attribute layout, if there is
+ * one. Picked by _glRecalcFastPath whenever the pointers change. */
+static VertexKernel VERTEX_KERNEL = NULL;
+
+/* Whether VERTEX_KERNEL also reads the normals into the extras */
+static GLboolean VERTEX_KERNEL_NORMALS = GL_FALSE;
+
 #define ITERATE(count) \
     GLuint i = count; \
     while(i--)
@@ -34,26 +44,31 @@ void _glInitAttributePointers() {
     VERTEX_POINTER.stride = 0;
     VERTEX_POINTER.type = GL_FLOAT;
     VERTEX_POINTER.size = 4;
+    VERTEX_POINTER.buffer = 0;
 
     DIFFUSE_POINTER.ptr = NULL;
     DIFFUSE_POINTER.stride = 0;
     DIFFUSE_POINTER.type = GL_FLOAT;
     DIFFUSE_POINTER.size = 4;
+    DIFFUSE_POINTER.buffer = 0;
 
     UV_POINTER.ptr = NULL;
     UV_POINTER.stride = 0;
     UV_POINTER.type = GL_FLOAT;
     UV_POINTER.size = 4;
+    UV_POINTER.buffer = 0;
 
     ST_POINTER.ptr = NULL;
     ST_POINTER.stride = 0;
     ST_POINTER.type = GL_FLOAT;
     ST_POINTER.size = 4;
+    ST_POINTER.buffer = 0;
 
     NORMAL_POINTER.ptr = NULL;
     NORMAL_POINTER.stride = 0;
     NORMAL_POINTER.type = GL_FLOAT;
     NORMAL_POINTER.size = 3;
+    NORMAL_POINTER.buffer = 0;
 }
 
 static GLboolean _glIsVertexDataFastPathCompatible() {
@@ -180,6 +195,17 @@ static void _readVertexData3us3f(const GLushort* input, GLuint count, GLubyte st
     }
 }
 
+static void _readVertexData3s3f(const GLshort* input, GLuint count, GLubyte stride, GLfloat* output) {
+    ITERATE(count) {
+        output[0] = input[0];
+        output[1] = input[1];
+        output[2] = input[2];
+
+        input = (GLshort*) (((GLubyte*) input) + stride);
+        output = (float*) (((GLubyte*) output) + sizeof(Vertex));
+    }
+}
+
 static void _readVertexData3us3fVE(const GLushort* input, GLuint count, GLubyte stride, GLfloat* output) {
     ITERATE(count) {
         output[0] = input[0];
@@ -469,6 +495,12 @@ static void _fillZero2fVE(GLuint count, GLfloat* output) {
     }
 }
 
+/* What _readNormalData and _readSTData give when neither array is enabled */
+static void _fillDefaultExtras(GLuint count, VertexExtra* extras) {
+    _fillWithNegZVE(count, extras->nxyz);
+    _fillZero2fVE(count, extras->st);
+}
+
 static void _readVertexData3usARGB(const GLushort* input, GLuint count, GLubyte stride, GLubyte* output) {
     assert(0 && "Not Implemented");
 }
@@ -528,7 +560,7 @@ static inline GLuint _parseUIntIndex(const GLubyte* in) {
 }
 
 static inline GLuint _parseUShortIndex(const GLubyte* in) {
-    return *((GLshort*) in);
+    return *((GLushort*) in);
 }
 
 
@@ -549,40 +581,6 @@ static inline IndexParseFunc _calcParseIndexFunc(GLenum type) {
 }
 
 
-/* There was a bug in this macro that shipped with Kos
- * which has now been fixed. But just in case...
- */
-#undef mat_trans_single3_nodiv
-#define mat_trans_single3_nodiv(x, y, z) { \
-    register float __x __asm__("fr12") = (x); \
-    register float __y __asm__("fr13") = (y); \
-    register float __z __asm__("fr14") = (z); \
-    __asm__ __volatile__( \
-                          "fldi1 fr15\n" \
-                          "ftrv  xmtrx, fv12\n" \
-                          : "=f" (__x), "=f" (__y), "=f" (__z) \
-                          : "0" (__x), "1" (__y), "2" (__z) \
-                          : "fr15"); \
-    x = __x; y = __y; z = __z; \
-}
-
-
-/* FIXME: Is this right? Shouldn't it be fr12->15? */
-#undef mat_trans_normal3
-#define mat_trans_normal3(x, y, z) { \
-    register float __x __asm__("fr8") = (x); \
-    register float __y __asm__("fr9") = (y); \
-    register float __z __asm__("fr10") = (z); \
-    __asm__ __volatile__( \
-                          "fldi0 fr11\n" \
-                          "ftrv  xmtrx, fv8\n" \
-                          : "=f" (__x), "=f" (__y), "=f" (__z) \
-                          : "0" (__x), "1" (__y), "2" (__z) \
-                          : "fr11"); \
-    x = __x; y = __y; z = __z; \
-}
-
-
 static inline void transformToEyeSpace(GLfloat* point) {
     _glMatrixLoadModelView();
     mat_trans_single3_nodiv(point[0], point[1], point[2]);
@@ -646,6 +644,26 @@ static void genTriangleFan(Vertex* output, GLuint count) {
     }
 }
 
+static void genPrimitives(Vertex* output, GLenum mode, GLuint count) {
+    switch(mode) {
+    case GL_TRIANGLES:
+        genTriangles(output, count);
+        break;
+    case GL_QUADS:
+        genQuads(output, count);
+        break;
+    case GL_TRIANGLE_FAN:
+        genTriangleFan(output, count);
+        break;
+    case GL_TRIANGLE_STRIP:
+        genTriangleStrip(output, count);
+        break;
+    default:
+        fprintf(stderr, "Unhandled mode %d\n", (int) mode);
+        assert(0 && "Not Implemented");
+    }
+}
+
 static inline void _readPositionData(const GLuint first, const GLuint count, Vertex* output) {
     const GLubyte vstride = (VERTEX_POINTER.stride) ? VERTEX_POINTER.stride : VERTEX_POINTER.size * byte_size(VERTEX_POINTER.type);
     const void* vptr = ((GLubyte*) VERTEX_POINTER.ptr + (first * vstride));
@@ -661,6 +679,8 @@ static inline void _readPositionData(const GLuint first, const GLuint count, Ver
                 _readVertexData3ub3f(vptr, count, vstride, output[0].xyz);
             break;
             case GL_SHORT:
+                _readVertexData3s3f(vptr, count, vstride, output[0].xyz);
+            break;
             case GL_UNSIGNED_SHORT:
                 _readVertexData3us3f(vptr, count, vstride, output[0].xyz);
             break;
@@ -767,6 +787,24 @@ static inline void _readSTData(const GLuint first, const GLuint count, VertexExt
     }
 }
 
+static void _normalizeNormals(const GLuint count, VertexExtra* extra) {
+    GLubyte* ptr = (GLubyte*) extra->nxyz;
+    GLfloat l;
+    ITERATE(count) {
+        GLfloat* n = (GLfloat*) ptr;
+
+        vec3f_length(n[0], n[1], n[2], l);
+
+        l = 1.0f / l;
+
+        n[0] *= l;
+        n[1] *= l;
+        n[2] *= l;
+
+        ptr += sizeof(VertexExtra);
+    }
+}
+
 static inline void _readNormalData(const GLuint first, const GLuint count, VertexExtra* extra) {
     if((ENABLED_VERTEX_ATTRIBUTES & NORMAL_ENABLED_FLAG) != NORMAL_ENABLED_FLAG) {
         _fillWithNegZVE(count, extra->nxyz);
@@ -806,21 +844,7 @@ static inline void _readNormalData(const GLuint first, const GLuint count, Verte
     }
 
     if(_glIsNormalizeEnabled()) {
-        GLubyte* ptr = (GLubyte*) extra->nxyz;
-        GLfloat l;
-        ITERATE(count) {
-            GLfloat* n = (GLfloat*) ptr;
-
-            vec3f_length(n[0], n[1], n[2], l);
-
-            l = 1.0f / l;
-
-            n[0] *= l;
-            n[1] *= l;
-            n[2] *= l;
-
-            ptr += sizeof(VertexExtra);
-        }
+        _normalizeNormals(count, extra);
     }
 }
 
@@ -902,8 +926,379 @@ static inline void _readDiffuseData(const GLuint first, const GLuint count, Vert
     }
 }
 
-static void generate(SubmissionTarget* target, const GLenum mode, const GLsizei first, const GLuint count,
-        const GLubyte* indices, const GLenum type, const GLboolean doTexture, const GLboolean doMultitexture, const GLboolean doLighting) {
+/* Specialised readers for the layouts that are common enough to be worth
+ * it. Each reads the position, UV and colour of every vertex in a single
+ * pass, where the readers above take a pass (and a switch on the type) per
+ * attribute. Normals and ST coordinates go to the extras, so are read
+ * separately, except by the kernels for lit layouts which fill in the
+ * normals in the same pass. */
+
+#define _KERNEL_POS_3F(out, in) \
+    out[0] = ((const GLfloat*) in)[0]; \
+    out[1] = ((const GLfloat*) in)[1]; \
+    out[2] = ((const GLfloat*) in)[2]
+
+#define _KERNEL_POS_3S(out, in) \
+    out[0] = ((const GLshort*) in)[0]; \
+    out[1] = ((const GLshort*) in)[1]; \
+    out[2] = ((const GLshort*) in)[2]
+
+#define _KERNEL_UV_2F(out, in) \
+    out[0] = ((const GLfloat*) in)[0]; \
+    out[1] = ((const GLfloat*) in)[1]
+
+#define _KERNEL_UV_NONE(out, in) \
+    out[0] = out[1] = 0.0f
+
+#define _KERNEL_COLOUR_BGRA_UB(out, in) \
+    out[B8IDX] = in[0]; \
+    out[G8IDX] = in[1]; \
+    out[R8IDX] = in[2]; \
+    out[A8IDX] = in[3]
+
+#define _KERNEL_COLOUR_RGBA_UB(out, in) \
+    out[R8IDX] = in[0]; \
+    out[G8IDX] = in[1]; \
+    out[B8IDX] = in[2]; \
+    out[A8IDX] = in[3]
+
+#define _KERNEL_COLOUR_RGBA_F(out, in) \
+    out[R8IDX] = (GLubyte) clamp(((const GLfloat*) in)[0] * 255.0f, 0, 255); \
+    out[G8IDX] = (GLubyte) clamp(((const GLfloat*) in)[1] * 255.0f, 0, 255); \
+    out[B8IDX] = (GLubyte) clamp(((const GLfloat*) in)[2] * 255.0f, 0, 255); \
+    out[A8IDX] = (GLubyte) clamp(((const GLfloat*) in)[3] * 255.0f, 0, 255)
+
+#define _KERNEL_COLOUR_NONE(out, in) \
+    out[R8IDX] = out[G8IDX] = out[B8IDX] = out[A8IDX] = 255
+
+#define _KERNEL_NORMAL_3F(out, in) \
+    out[0] = ((const GLfloat*) in)[0]; \
+    out[1] = ((const GLfloat*) in)[1]; \
+    out[2] = ((const GLfloat*) in)[2]
+
+static inline GLuint _glAttribStride(const AttribPointer* attrib) {
+    const GLuint components = (attrib->size == GL_BGRA) ? 4 : attrib->size;
+    return (attrib->stride) ? (GLuint) attrib->stride : components * byte_size(attrib->type);
+}
+
+#define _VERTEX_KERNEL(name, POS, UV, COLOUR) \
+static void name(const GLuint first, const GLuint count, Vertex* output, VertexExtra* normals) { \
+    const GLuint vstride = _glAttribStride(&VERTEX_POINTER); \
+    const GLuint uvstride = _glAttribStride(&UV_POINTER); \
+    const GLuint cstride = _glAttribStride(&DIFFUSE_POINTER); \
+    const GLubyte* vptr = (const GLubyte*) VERTEX_POINTER.ptr + (first * vstride); \
+    const GLubyte* uvptr = (const GLubyte*) UV_POINTER.ptr + (first * uvstride); \
+    const GLubyte* cptr = (const GLubyte*) DIFFUSE_POINTER.ptr + (first * cstride); \
+    (void) uvptr; (void) cptr; (void) normals; \
+    ITERATE(count) { \
+        output->flags = PVR_CMD_VERTEX; \
+        POS(output->xyz, vptr); \
+        UV(output->uv, uvptr); \
+        COLOUR(output->bgra, cptr); \
+        vptr += vstride; \
+        uvptr += uvstride; \
+        cptr += cstride; \
+        ++output; \
+    } \
+}
+
+_VERTEX_KERNEL(_kernel3f2fBGRAub, _KERNEL_POS_3F, _KERNEL_UV_2F, _KERNEL_COLOUR_BGRA_UB)
+_VERTEX_KERNEL(_kernel3f2fRGBAub, _KERNEL_POS_3F, _KERNEL_UV_2F, _KERNEL_COLOUR_RGBA_UB)
+_VERTEX_KERNEL(_kernel3f2fRGBAf, _KERNEL_POS_3F, _KERNEL_UV_2F, _KERNEL_COLOUR_RGBA_F)
+_VERTEX_KERNEL(_kernel3f2f, _KERNEL_POS_3F, _KERNEL_UV_2F, _KERNEL_COLOUR_NONE)
+_VERTEX_KERNEL(_kernel3fRGBAub, _KERNEL_POS_3F, _KERNEL_UV_NONE, _KERNEL_COLOUR_RGBA_UB)
+_VERTEX_KERNEL(_kernel3fRGBAf, _KERNEL_POS_3F, _KERNEL_UV_NONE, _KERNEL_COLOUR_RGBA_F)
+_VERTEX_KERNEL(_kernel3f, _KERNEL_POS_3F, _KERNEL_UV_NONE, _KERNEL_COLOUR_NONE)
+_VERTEX_KERNEL(_kernel3s2fBGRAub, _KERNEL_POS_3S, _KERNEL_UV_2F, _KERNEL_COLOUR_BGRA_UB)
+_VERTEX_KERNEL(_kernel3s2fRGBAub, _KERNEL_POS_3S, _KERNEL_UV_2F, _KERNEL_COLOUR_RGBA_UB)
+_VERTEX_KERNEL(_kernel3s2f, _KERNEL_POS_3S, _KERNEL_UV_2F, _KERNEL_COLOUR_NONE)
+
+/* As above, and if normals isn't NULL also reads the normals into it */
+#define _VERTEX_KERNEL_NORMAL(name, POS, UV, COLOUR, NORMAL) \
+static void name(const GLuint first, const GLuint count, Vertex* output, VertexExtra* normals) { \
+    const GLuint vstride = _glAttribStride(&VERTEX_POINTER); \
+    const GLuint uvstride = _glAttribStride(&UV_POINTER); \
+    const GLuint cstride = _glAttribStride(&DIFFUSE_POINTER); \
+    const GLuint nstride = _glAttribStride(&NORMAL_POINTER); \
+    const GLubyte* vptr = (const GLubyte*) VERTEX_POINTER.ptr + (first * vstride); \
+    const GLubyte* uvptr = (const GLubyte*) UV_POINTER.ptr + (first * uvstride); \
+    const GLubyte* cptr = (const GLubyte*) DIFFUSE_POINTER.ptr + (first * cstride); \
+    const GLubyte* nptr = (const GLubyte*) NORMAL_POINTER.ptr + (first * nstride); \
+    (void) uvptr; (void) cptr; \
+    if(!normals) { \
+        ITERATE(count) { \
+            output->flags = PVR_CMD_VERTEX; \
+            POS(output->xyz, vptr); \
+            UV(output->uv, uvptr); \
+            COLOUR(output->bgra, cptr); \
+            vptr += vstride; \
+            uvptr += uvstride; \
+            cptr += cstride; \
+            ++output; \
+        } \
+        return; \
+    } \
+    VertexExtra* extra = normals; \
+    ITERATE(count) { \
+        output->flags = PVR_CMD_VERTEX; \
+        POS(output->xyz, vptr); \
+        UV(output->uv, uvptr); \
+        COLOUR(output->bgra, cptr); \
+        NORMAL(extra->nxyz, nptr); \
+        vptr += vstride; \
+        uvptr += uvstride; \
+        cptr += cstride; \
+        nptr += nstride; \
+        ++output; \
+        ++extra; \
+    } \
+    if(_glIsNormalizeEnabled()) { \
+        _normalizeNormals(count, normals); \
+    } \
+}
+
+/* xyz + normal + uv, with or without a colour, i.e. the 32 and 36 byte
+ * vertices most model formats are exported as */
+_VERTEX_KERNEL_NORMAL(_kernel3f2fBGRAub3f, _KERNEL_POS_3F, _KERNEL_UV_2F, _KERNEL_COLOUR_BGRA_UB, _KERNEL_NORMAL_3F)
+_VERTEX_KERNEL_NORMAL(_kernel3f2fRGBAub3f, _KERNEL_POS_3F, _KERNEL_UV_2F, _KERNEL_COLOUR_RGBA_UB, _KERNEL_NORMAL_3F)
+_VERTEX_KERNEL_NORMAL(_kernel3f2f3f, _KERNEL_POS_3F, _KERNEL_UV_2F, _KERNEL_COLOUR_NONE, _KERNEL_NORMAL_3F)
+
+typedef struct {
+    GLenum vertexType;  /* Always three components */
+    GLenum uvType;  /* Two components, or zero if UVs are disabled */
+    GLenum colourType;  /* Zero if colours are disabled */
+    GLint colourSize;
+    GLenum normalType;  /* Three components, or zero if the kernel doesn't read normals */
+    VertexKernel kernel;
+} VertexKernelEntry;
+
+static const VertexKernelEntry VERTEX_KERNELS[] = {
+    {GL_FLOAT, GL_FLOAT, GL_UNSIGNED_BYTE, GL_BGRA, GL_FLOAT, _kernel3f2fBGRAub3f},
+    {GL_FLOAT, GL_FLOAT, GL_UNSIGNED_BYTE, 4, GL_FLOAT, _kernel3f2fRGBAub3f},
+    {GL_FLOAT, GL_FLOAT, 0, 0, GL_FLOAT, _kernel3f2f3f},
+    {GL_FLOAT, GL_FLOAT, GL_UNSIGNED_BYTE, GL_BGRA, 0, _kernel3f2fBGRAub},
+    {GL_FLOAT, GL_FLOAT, GL_UNSIGNED_BYTE, 4, 0, _kernel3f2fRGBAub},
+    {GL_FLOAT, GL_FLOAT, GL_FLOAT, 4, 0, _kernel3f2fRGBAf},
+    {GL_FLOAT, GL_FLOAT, 0, 0, 0, _kernel3f2f},
+    {GL_FLOAT, 0, GL_UNSIGNED_BYTE, 4, 0, _kernel3fRGBAub},
+    {GL_FLOAT, 0, GL_FLOAT, 4, 0, _kernel3fRGBAf},
+    {GL_FLOAT, 0, 0, 0, 0, _kernel3f},
+    {GL_SHORT, GL_FLOAT, GL_UNSIGNED_BYTE, GL_BGRA, 0, _kernel3s2fBGRAub},
+    {GL_SHORT, GL_FLOAT, GL_UNSIGNED_BYTE, 4, 0, _kernel3s2fRGBAub},
+    {GL_SHORT, GL_FLOAT, 0, 0, 0, _kernel3s2f}
+};
+
+#define VERTEX_KERNEL_COUNT (sizeof(VERTEX_KERNELS) / sizeof(VertexKernelEntry))
+
+/* Sets normals if the kernel also reads the normals */
+static VertexKernel _glSelectVertexKernel(GLboolean* normals) {
+    *normals = GL_FALSE;
+
+    if(!(ENABLED_VERTEX_ATTRIBUTES & VERTEX_ENABLED_FLAG) || VERTEX_POINTER.size != 3) {
+        return NULL;
+    }
+
+    GLenum uvType = 0;
+    if(ENABLED_VERTEX_ATTRIBUTES & UV_ENABLED_FLAG) {
+        if(UV_POINTER.size != 2) return NULL;
+        uvType = UV_POINTER.type;
+    }
+
+    GLenum colourType = 0;
+    GLint colourSize = 0;
+    if(ENABLED_VERTEX_ATTRIBUTES & DIFFUSE_ENABLED_FLAG) {
+        colourType = DIFFUSE_POINTER.type;
+        colourSize = DIFFUSE_POINTER.size;
+    }
+
+    /* Kernels that read the normals come first, the others leave them to
+     * _readNormalData */
+    GLenum normalType = 0;
+    if((ENABLED_VERTEX_ATTRIBUTES & NORMAL_ENABLED_FLAG) && NORMAL_POINTER.size == 3) {
+        normalType = NORMAL_POINTER.type;
+    }
+
+    for(GLuint i = 0; i < VERTEX_KERNEL_COUNT; ++i) {
+        const VertexKernelEntry* entry = &VERTEX_KERNELS[i];
+
+        if(entry->vertexType == VERTEX_POINTER.type && entry->uvType == uvType &&
+            entry->colourType == colourType && entry->colourSize == colourSize &&
+            (!entry->normalType || entry->normalType == normalType)) {
+            *normals = (entry->normalType) ? GL_TRUE : GL_FALSE;
+            return entry->kernel;
+        }
+    }
+
+    return NULL;
+}
+
+/* Reads count vertices from first, with the kernel for the current layout
+ * if there is one. If normals isn't NULL the normals are read into it too. */
+static inline void _readVertices(const GLuint first, const GLuint count, Vertex* output, VertexExtra* normals, const GLboolean doTexture) {
+    if(VERTEX_KERNEL) {
+        VERTEX_KERNEL(first, count, output, (VERTEX_KERNEL_NORMALS) ? normals : NULL);
+
+        if(normals && !VERTEX_KERNEL_NORMALS) {
+            _readNormalData(first, count, normals);
+        }
+        return;
+    }
+
+    _readPositionData(first, count, output);
+    _readDiffuseData(first, count, output);
+    if(doTexture) _readUVData(first, count, output);
+    if(normals) _readNormalData(first, count, normals);
+
+    Vertex* it = output;
+    ITERATE(count) {
+        it->flags = PVR_CMD_VERTEX;
+        ++it;
+    }
+}
+
+/* Finds the smallest and largest index used by an indexed draw */
+static void _glIndexRange(const GLubyte* indices, const GLenum type, const GLuint count, GLuint* start, GLuint* end) {
+    GLuint lo = ~0u, hi = 0;
+
+#define _INDEX_RANGE(T) \
+    do { \
+        const T* it = (const T*) indices; \
+        ITERATE(count) { \
+            const GLuint j = *it++; \
+            if(j < lo) lo = j; \
+            if(j > hi) hi = j; \
+        } \
+    } while(0)
+
+    switch(type) {
+        case GL_UNSIGNED_BYTE:
+            _INDEX_RANGE(GLubyte);
+        break;
+        case GL_UNSIGNED_SHORT:
+            _INDEX_RANGE(GLushort);
+        break;
+        default:
+            _INDEX_RANGE(GLuint);
+    }
+
+#undef _INDEX_RANGE
+
+    *start = lo;
+    *end = hi;
+}
+
+static AlignedVector RANGE_VERTICES;
+static AlignedVector RANGE_EXTRAS;
+
+static void lightAndTransform(Vertex* vertex, const VertexExtra* extra, const GLuint count, const GLboolean doLighting);
+
+/* The post-transform cache. Indexed draws light and transform each vertex
+ * in the range they use once, before gathering them into the output, so
+ * that vertices shared between triangles aren't processed again for every
+ * triangle they're in. Clipping and the divide still happen afterwards. */
+static void preTransform(Vertex* vertices, const VertexExtra* extras, const GLuint count, const GLboolean doLighting) {
+    PROFILER_CHECKPOINT("generate");
+
+    lightAndTransform(vertices, extras, count, doLighting);
+}
+
+/* Whether an indexed draw of count indices from start to end should
+ * convert (and maybe transform) the range up front */
+static inline GLboolean _glIndexRangeIsDense(const GLuint start, const GLuint end, const GLuint count) {
+    return (end - start) / INDEX_RANGE_MAX_RATIO < count;
+}
+
+/* Scratch space for count vertices, and if extras isn't NULL their extras */
+static Vertex* _glRangeScratch(const GLuint count, VertexExtra** extras) {
+    static GLboolean initialized = GL_FALSE;
+
+    if(!initialized) {
+        aligned_vector_init_arena(&RANGE_VERTICES, sizeof(Vertex), _glFrameArena());
+        aligned_vector_init_arena(&RANGE_EXTRAS, sizeof(VertexExtra), _glFrameArena());
+        initialized = GL_TRUE;
+    }
+
+    aligned_vector_resize(&RANGE_VERTICES, count);
+
+    if(*extras) {
+        aligned_vector_resize(&RANGE_EXTRAS, count);
+        *extras = aligned_vector_at(&RANGE_EXTRAS, 0);
+    }
+
+    return aligned_vector_at(&RANGE_VERTICES, 0);
+}
+
+/* Not a flag the PVR uses, see _glGatherRange */
+#define RANGE_VERTEX_GATHERED 0x1
+
+/* Gathers the vertices of a transformed range that the indices refer to.
+ * The whole range is transformed (and counted in vertices_transformed)
+ * whether the indices use it all or not, so this counts the indices served
+ * from it and how many of its vertices they used. The range's flags are
+ * all PVR_CMD_VERTEX until a vertex is gathered, when it's marked so that
+ * it's only counted once. */
+static void _glGatherRange(Vertex* vertices, VertexExtra* extras, Vertex* src, const VertexExtra* srcExtras,
+        const GLubyte* indices, const GLenum type, const GLuint count, const GLuint start, const GLuint rangeCount) {
+    const IndexParseFunc indexFunc = _calcParseIndexFunc(type);
+    const GLsizei istride = byte_size(type);
+
+    GLuint referenced = 0;
+
+    ITERATE(count) {
+        GLuint j = indexFunc(indices) - start;
+
+        /* Indices outside the range given to glDrawRangeElements are
+         * undefined, so just don't read out of bounds */
+        if(j >= rangeCount) {
+            j = 0;
+        }
+
+        Vertex* v = src + j;
+        referenced += (v->flags != RANGE_VERTEX_GATHERED);
+
+        *vertices = *v;
+        vertices->flags = PVR_CMD_VERTEX;
+        ++vertices;
+
+        v->flags = RANGE_VERTEX_GATHERED;
+
+        if(extras) {
+            *extras++ = srcExtras[j];
+        }
+
+        indices += istride;
+    }
+
+    RENDER_COUNTERS.indices_served += count;
+    RENDER_COUNTERS.vertices_referenced += referenced;
+}
+
+/* Converts the vertices from start to end in one go, so that each attribute
+ * reader only dispatches once per draw rather than once per index. Returns
+ * the converted vertices (and their extras, if extras is not NULL) */
+static Vertex* _glConvertIndexRange(const GLuint start, const GLuint end, VertexExtra** extras,
+        const GLboolean doTexture, const GLboolean doMultitexture, const GLboolean doLighting) {
+    const GLuint count = end - start + 1;
+
+    Vertex* vertices = _glRangeScratch(count, extras);
+
+    _readVertices(start, count, vertices, (doLighting) ? *extras : NULL, doTexture);
+
+    if(*extras && doTexture && doMultitexture) {
+        _readSTData(start, count, *extras);
+    }
+
+    return vertices;
+}
+
+/* For indexed draws, start and end are the range of indices used. If end is
+ * less than start the range isn't known, and is found if it's needed.
+ *
+ * If cache is set, indexed draws may light and transform the vertices as
+ * they're generated (see preTransform) in which case this returns GL_TRUE */
+static GLboolean generate(SubmissionTarget* target, const GLenum mode, const GLsizei first, const GLuint count,
+        const GLubyte* indices, const GLenum type, GLuint start, GLuint end, const GLboolean cache,
+        const GLboolean doTexture, const GLboolean doMultitexture, const GLboolean doLighting) {
     /* Read from the client buffers and generate an array of ClipVertices */
     TRACE();
 
@@ -911,9 +1306,13 @@ static void generate(SubmissionTarget* target, const GLenum mode, const GLsizei
     const GLsizei istride = byte_size(type);
 
     if(!indices) {
-        profiler_push(__func__);
+        PROFILER_PUSH(__func__);
 
         Vertex* start = _glSubmissionTargetStart(target);
+        VertexExtra* ve = (target->extras) ? aligned_vector_at(target->extras, 0) : NULL;
+
+        /* Cleared if the kernel reads them */
+        VertexExtra* normals = (doLighting) ? ve : NULL;
 
         if(FAST_PATH_ENABLED) {
             /* Copy the pos, uv and color directly in one go */
@@ -925,12 +1324,18 @@ static void generate(SubmissionTarget* target, const GLenum mode, const GLsizei
                 it++;
                 pos += VERTEX_POINTER.stride;
             }
+        } else if(VERTEX_KERNEL) {
+            VERTEX_KERNEL(first, count, start, (VERTEX_KERNEL_NORMALS) ? normals : NULL);
+
+            if(VERTEX_KERNEL_NORMALS) {
+                normals = NULL;
+            }
         } else {
             _readPositionData(first, count, start);
-            profiler_checkpoint("positions");
+            PROFILER_CHECKPOINT("positions");
 
             _readDiffuseData(first, count, start);
-            profiler_checkpoint("diffuse");
+            PROFILER_CHECKPOINT("diffuse");
 
             if(doTexture) _readUVData(first, count, start);
 
@@ -942,42 +1347,71 @@ static void generate(SubmissionTarget* target, const GLenum mode, const GLsizei
             }
         }
 
-        VertexExtra* ve = aligned_vector_at(target->extras, 0);
+        if(normals) _readNormalData(first, count, normals);
+        if(ve && doTexture && doMultitexture) _readSTData(first, count, ve);
 
-        if(doLighting) _readNormalData(first, count, ve);
-        if(doTexture && doMultitexture) _readSTData(first, count, ve);
-        profiler_checkpoint("others");
+        PROFILER_CHECKPOINT("others");
 
         // Drawing arrays
-        switch(mode) {
-        case GL_TRIANGLES:
-            genTriangles(start, count);
-            break;
-        case GL_QUADS:
-            genQuads(start, count);
-            break;
-        case GL_TRIANGLE_FAN:
-            genTriangleFan(start, count);
-            break;
-        case GL_TRIANGLE_STRIP:
-            genTriangleStrip(_glSubmissionTargetStart(target), count);
-            break;
-        default:
-            fprintf(stderr, "Unhandled mode %d\n", (int) mode);
-            assert(0 && "Not Implemented");
-        }
+        genPrimitives(start, mode, count);
+
+        PROFILER_CHECKPOINT("quads");
+        PROFILER_POP();
 
-        profiler_checkpoint("quads");
-        profiler_pop();
+        return GL_FALSE;
     } else {
         const IndexParseFunc indexFunc = _calcParseIndexFunc(type);
         GLuint j;
         const GLubyte* idx = indices;
 
         Vertex* vertices = _glSubmissionTargetStart(target);
-        VertexExtra* extras = aligned_vector_at(target->extras, 0);
 
-        if(FAST_PATH_ENABLED) {
+        /* Only lit or multitextured geometry has extras, the loops below
+         * don't touch them otherwise */
+        VertexExtra* extras = (target->extras) ? aligned_vector_at(target->extras, 0) : NULL;
+        const GLboolean readExtras = doLighting || (doTexture && doMultitexture);
+
+        /* Unless every attribute can be copied straight from the fast path
+         * layout, convert the vertices the indices refer to up front and
+         * then gather them. That's only worth it if most of the range is
+         * actually used. */
+        GLboolean gather = !FAST_PATH_ENABLED || readExtras || cache;
+        GLboolean transformed = GL_FALSE;
+
+        if(gather && end < start) {
+            _glIndexRange(indices, type, count, &start, &end);
+        }
+
+        gather = gather && _glIndexRangeIsDense(start, end, count);
+
+        if(gather) {
+            VertexExtra* srcExtras = extras;
+            Vertex* src = _glConvertIndexRange(start, end, &srcExtras, doTexture, doMultitexture, doLighting);
+            const GLuint rangeCount = end - start + 1;
+
+            if(cache) {
+                preTransform(src, srcExtras, rangeCount, doLighting);
+                _glGatherRange(vertices, extras, src, srcExtras, indices, type, count, start, rangeCount);
+                transformed = GL_TRUE;
+            } else {
+                ITERATE(count) {
+                    j = indexFunc(idx) - start;
+
+                    /* glDrawRangeElements with indices outside the range it was
+                     * given is undefined, so just don't read out of bounds */
+                    if(j >= rangeCount) {
+                        j = 0;
+                    }
+
+                    *vertices++ = src[j];
+                    if(extras) {
+                        *extras++ = srcExtras[j];
+                    }
+
+                    idx += istride;
+                }
+            }
+        } else if(FAST_PATH_ENABLED) {
             typedef struct FastPath {
                 float xyz[3];
                 float uv[2];
@@ -995,80 +1429,241 @@ static void generate(SubmissionTarget* target, const GLenum mode, const GLsizei
                 FastPath* dst = (FastPath*) vertices->xyz;
                 *dst = *srcV;
 
-                if(doLighting) _readNormalData(j, 1, extras);
-                if(readST) _readSTData(j, 1, extras);
+                if(readExtras) {
+                    if(doLighting) _readNormalData(j, 1, extras);
+                    if(readST) _readSTData(j, 1, extras);
+                    ++extras;
+                }
 
                 ++vertices;
-                ++extras;
 
                 idx += istride;
             }
         } else {
             ITERATE(count) {
                 j = indexFunc(idx);
-                vertices->flags = PVR_CMD_VERTEX;
 
-                _readPositionData(j, 1, vertices);
-                _readDiffuseData(j, 1, vertices);
-                if(doTexture) _readUVData(j, 1, vertices);
-                if(doLighting) _readNormalData(j, 1, extras);
-                if(doTexture && doMultitexture) _readSTData(j, 1, extras);
+                _readVertices(j, 1, vertices, (doLighting) ? extras : NULL, doTexture);
+                if(readExtras) {
+                    if(doTexture && doMultitexture) _readSTData(j, 1, extras);
+                    ++extras;
+                }
 
                 ++vertices;
-                ++extras;
 
                 idx += istride;
             }
         }
 
-        Vertex* it = _glSubmissionTargetStart(target);
         // Drawing arrays
-        switch(mode) {
-        case GL_TRIANGLES:
-            genTriangles(it, count);
-            break;
-        case GL_QUADS:
-            genQuads(it, count);
-            break;
-        case GL_TRIANGLE_FAN:
-            genTriangleFan(it, count);
-            break;
-        case GL_TRIANGLE_STRIP:
-            genTriangleStrip(it, count);
-            break;
-        default:
-            assert(0 && "Not Implemented");
-        }
+        genPrimitives(_glSubmissionTargetStart(target), mode, count);
+
+        return transformed;
     }
 }
 
-static void transform(SubmissionTarget* target) {
+static GLboolean _glAttribMatches(const AttribPointer* a, const AttribPointer* b) {
+    return a->ptr == b->ptr && a->type == b->type && a->stride == b->stride && a->size == b->size;
+}
+
+static GLboolean _glLayoutMatches(const VertexLayout* layout) {
+    const GLuint enabled = layout->enabled;
+
+    if(enabled != ENABLED_VERTEX_ATTRIBUTES || layout->normalize != _glIsNormalizeEnabled()) return GL_FALSE;
+    if(!_glAttribMatches(&layout->vertex, &VERTEX_POINTER)) return GL_FALSE;
+    if((enabled & DIFFUSE_ENABLED_FLAG) && !_glAttribMatches(&layout->diffuse, &DIFFUSE_POINTER)) return GL_FALSE;
+    if((enabled & UV_ENABLED_FLAG) && !_glAttribMatches(&layout->uv, &UV_POINTER)) return GL_FALSE;
+    if((enabled & ST_ENABLED_FLAG) && !_glAttribMatches(&layout->st, &ST_POINTER)) return GL_FALSE;
+    if((enabled & NORMAL_ENABLED_FLAG) && !_glAttribMatches(&layout->normal, &NORMAL_POINTER)) return GL_FALSE;
+
+    return GL_TRUE;
+}
+
+/* How many whole elements of attrib fit in buffer */
+static GLuint _glAttribCount(const AttribPointer* attrib, const BufferObject* buffer) {
+    const GLuint components = (attrib->size == GL_BGRA) ? 4 : attrib->size;
+    const GLuint bytes = components * byte_size(attrib->type);
+    const GLuint stride = (attrib->stride) ? attrib->stride : bytes;
+    const GLsizeiptrARB offset = ((const GLubyte*) attrib->ptr) - buffer->data;
+
+    if(offset < 0 || offset + bytes > (GLuint) buffer->size) {
+        return 0;
+    }
+
+    return ((buffer->size - offset - bytes) / stride) + 1;
+}
+
+/* Returns the buffer if every enabled attribute comes from the same
+ * GL_STATIC_DRAW_ARB buffer, converting the whole buffer to Vertex +
+ * VertexExtra if it hasn't been already with the current layout */
+static BufferObject* _glConvertedBuffer() {
+    const GLuint name = VERTEX_POINTER.buffer;
+
+    if(!name) return NULL;
+    if((ENABLED_VERTEX_ATTRIBUTES & DIFFUSE_ENABLED_FLAG) && DIFFUSE_POINTER.buffer != name) return NULL;
+    if((ENABLED_VERTEX_ATTRIBUTES & UV_ENABLED_FLAG) && UV_POINTER.buffer != name) return NULL;
+    if((ENABLED_VERTEX_ATTRIBUTES & ST_ENABLED_FLAG) && ST_POINTER.buffer != name) return NULL;
+    if((ENABLED_VERTEX_ATTRIBUTES & NORMAL_ENABLED_FLAG) && NORMAL_POINTER.buffer != name) return NULL;
+
+    BufferObject* buffer = _glGetBufferObject(name);
+    if(!buffer || buffer->usage != GL_STATIC_DRAW_ARB || buffer->mapped) {
+        return NULL;
+    }
+
+    if(buffer->converted && _glLayoutMatches(&buffer->converted_layout)) {
+        return buffer;
+    }
+
+    GLuint count = _glAttribCount(&VERTEX_POINTER, buffer);
+    GLuint n;
+
+#define _CLAMP_COUNT(flag, attrib) \
+    if((ENABLED_VERTEX_ATTRIBUTES & flag) && (n = _glAttribCount(&attrib, buffer)) < count) count = n
+
+    _CLAMP_COUNT(DIFFUSE_ENABLED_FLAG, DIFFUSE_POINTER);
+    _CLAMP_COUNT(UV_ENABLED_FLAG, UV_POINTER);
+    _CLAMP_COUNT(ST_ENABLED_FLAG, ST_POINTER);
+    _CLAMP_COUNT(NORMAL_ENABLED_FLAG, NORMAL_POINTER);
+
+#undef _CLAMP_COUNT
+
+    if(!count) {
+        return NULL;
+    }
+
+    PROFILER_PUSH(__func__);
+
+    aligned_vector_resize(&buffer->vertices, count);
+
+    /* Without normals or a second set of texture coordinates the extras
+     * would only hold the defaults, which generateFromBuffer fills in */
+    VertexExtra* extras = NULL;
+    if(ENABLED_VERTEX_ATTRIBUTES & (NORMAL_ENABLED_FLAG | ST_ENABLED_FLAG)) {
+        aligned_vector_resize(&buffer->extras, count);
+        extras = aligned_vector_at(&buffer->extras, 0);
+    } else {
+        aligned_vector_clear(&buffer->extras);
+    }
+
+    Vertex* vertices = aligned_vector_at(&buffer->vertices, 0);
+    _readVertices(0, count, vertices, extras, GL_TRUE);
+
+    if(extras) {
+        _readSTData(0, count, extras);
+    }
+
+    VertexLayout* layout = &buffer->converted_layout;
+    layout->enabled = ENABLED_VERTEX_ATTRIBUTES;
+    layout->normalize = _glIsNormalizeEnabled();
+    layout->vertex = VERTEX_POINTER;
+    layout->diffuse = DIFFUSE_POINTER;
+    layout->uv = UV_POINTER;
+    layout->st = ST_POINTER;
+    layout->normal = NORMAL_POINTER;
+
+    buffer->converted = GL_TRUE;
+    buffer->converted_count = count;
+
+    PROFILER_POP();
+    return buffer;
+}
+
+/* Like generate, but copies vertices that were already converted when the
+ * buffer was first drawn from. Indexed draws which reuse vertices go
+ * through the post-transform cache if cache is set, in which case this
+ * returns GL_TRUE */
+static GLboolean generateFromBuffer(SubmissionTarget* target, const BufferObject* buffer, const GLenum mode,
+        const GLsizei first, const GLuint count, const GLubyte* indices, const GLenum type,
+        GLuint start, GLuint end, const GLboolean cache, const GLboolean doLighting) {
     TRACE();
 
-    /* Perform modelview transform, storing W */
-    Vertex* vertex = _glSubmissionTargetStart(target);
+    const Vertex* src = (const Vertex*) aligned_vector_at(&buffer->vertices, 0);
+    const VertexExtra* srcExtras = (buffer->extras.size) ?
+        (const VertexExtra*) aligned_vector_at(&buffer->extras, 0) : NULL;
+
+    Vertex* vertices = _glSubmissionTargetStart(target);
+    VertexExtra* extras = (target->extras) ? aligned_vector_at(target->extras, 0) : NULL;
+
+    GLboolean transformed = GL_FALSE;
+
+    /* The buffer was converted without extras, so they're all the defaults */
+    if(extras && !srcExtras) {
+        _fillDefaultExtras(count, extras);
+        extras = NULL;
+    }
+
+    if(!indices) {
+        memcpy(vertices, src + first, sizeof(Vertex) * count);
+
+        if(extras) {
+            memcpy(extras, srcExtras + first, sizeof(VertexExtra) * count);
+        }
+    } else {
+        const IndexParseFunc indexFunc = _calcParseIndexFunc(type);
+        const GLsizei istride = byte_size(type);
+        const GLubyte* idx = indices;
+
+        const GLuint limit = buffer->converted_count;
+
+        if(cache && end < start) {
+            _glIndexRange(indices, type, count, &start, &end);
+        }
+
+        /* The buffer has to stay untransformed, so this means copying the
+         * range out first. That's only worth it if vertices are shared. */
+        if(cache && end < buffer->converted_count && end - start + 1 < count) {
+            const GLuint rangeCount = end - start + 1;
+
+            VertexExtra* rangeExtras = (target->extras) ? aligned_vector_at(target->extras, 0) : NULL;
+            Vertex* range = _glRangeScratch(rangeCount, &rangeExtras);
+
+            memcpy(range, src + start, sizeof(Vertex) * rangeCount);
+            if(rangeExtras) {
+                if(srcExtras) {
+                    memcpy(rangeExtras, srcExtras + start, sizeof(VertexExtra) * rangeCount);
+                } else {
+                    _fillDefaultExtras(rangeCount, rangeExtras);
+                }
+            }
 
+            preTransform(range, rangeExtras, rangeCount, doLighting);
+            _glGatherRange(vertices, extras, range, rangeExtras, indices, type, count, start, rangeCount);
+            transformed = GL_TRUE;
+        } else {
+            ITERATE(count) {
+                GLuint j = indexFunc(idx);
+
+                /* Indices past the end of the buffer are undefined, don't
+                 * read past it */
+                if(j >= limit) {
+                    j = 0;
+                }
+
+                *vertices++ = src[j];
+                if(extras) {
+                    *extras++ = srcExtras[j];
+                }
+
+                idx += istride;
+            }
+        }
+    }
+
+    genPrimitives(_glSubmissionTargetStart(target), mode, count);
+
+    return transformed;
+}
+
+static void transformVertices(Vertex* vertex, const GLuint count) {
+    /* Perform modelview transform, storing W */
     _glApplyRenderMatrix(); /* Apply the Render Matrix Stack */
 
-    ITERATE(target->count) {
-        register float __x __asm__("fr12") = (vertex->xyz[0]);
-        register float __y __asm__("fr13") = (vertex->xyz[1]);
-        register float __z __asm__("fr14") = (vertex->xyz[2]);
-        register float __w __asm__("fr15") = (vertex->w);
-
-        __asm__ __volatile__(
-            "fldi1 fr15\n"
-            "ftrv   xmtrx,fv12\n"
-            : "=f" (__x), "=f" (__y), "=f" (__z), "=f" (__w)
-            : "0" (__x), "1" (__y), "2" (__z), "3" (__w)
-        );
-
-        vertex->xyz[0] = __x;
-        vertex->xyz[1] = __y;
-        vertex->xyz[2] = __z;
-        vertex->w = __w;
+    ITERATE(count) {
+        transformVertex(vertex->xyz, &vertex->w);
         ++vertex;
     }
+
+    RENDER_COUNTERS.vertices_transformed += count;
 }
 
 static void clip(SubmissionTarget* target) {
@@ -1111,42 +1706,33 @@ static void mat_transform_normal3(const float* xyz, const float* xyzOut, const u
     }
 }
 
-static void light(SubmissionTarget* target) {
-    if(!_glIsLightingEnabled()) {
-        return;
-    }
-
+static void lightVertices(Vertex* vertex, const VertexExtra* extra, const GLuint count) {
+    static AlignedVector eye_space_vector;
     static AlignedVector* eye_space_data = NULL;
 
     if(!eye_space_data) {
-        eye_space_data = (AlignedVector*) malloc(sizeof(AlignedVector));
-        aligned_vector_init(eye_space_data, sizeof(EyeSpaceData));
+        eye_space_data = &eye_space_vector;
+        aligned_vector_init_arena(eye_space_data, sizeof(EyeSpaceData), _glFrameArena());
     }
 
-    aligned_vector_resize(eye_space_data, target->count);
+    aligned_vector_resize(eye_space_data, count);
 
     /* Perform lighting calculations and manipulate the colour */
-    Vertex* vertex = _glSubmissionTargetStart(target);
-    VertexExtra* extra = aligned_vector_at(target->extras, 0);
     EyeSpaceData* eye_space = (EyeSpaceData*) eye_space_data->data;
 
     _glMatrixLoadModelView();
-    mat_transform3(vertex->xyz, eye_space->xyz, target->count, sizeof(Vertex), sizeof(EyeSpaceData));
+    mat_transform3(vertex->xyz, eye_space->xyz, count, sizeof(Vertex), sizeof(EyeSpaceData));
 
     _glMatrixLoadNormal();
-    mat_transform_normal3(extra->nxyz, eye_space->n, target->count, sizeof(VertexExtra), sizeof(EyeSpaceData));
+    mat_transform_normal3(extra->nxyz, eye_space->n, count, sizeof(VertexExtra), sizeof(EyeSpaceData));
 
     EyeSpaceData* ES = aligned_vector_at(eye_space_data, 0);
-    _glPerformLighting(vertex, ES, target->count);
+    _glPerformLighting(vertex, ES, count);
 }
 
-static void divide(SubmissionTarget* target) {
-    TRACE();
-
+static inline void divideVertices(Vertex* vertex, const GLuint count) {
     /* Perform perspective divide on each vertex */
-    Vertex* vertex = _glSubmissionTargetStart(target);
-
-    ITERATE(target->count) {
+    ITERATE(count) {
         float f = 1.0f / vertex->w;
         vertex->xyz[0] *= f;
         vertex->xyz[1] *= f;
@@ -1155,26 +1741,112 @@ static void divide(SubmissionTarget* target) {
     }
 }
 
-static void push(PVRHeader* header, GLboolean multiTextureHeader, PolyList* activePolyList, GLshort textureUnit) {
-    TRACE();
+/* Lights (if doLighting) and transforms count vertices a chunk at a time,
+ * rather than making a pass over all of them for each. Each chunk is
+ * checkpointed so the profiler still splits the time between the light
+ * and transform stages. */
+static void lightAndTransform(Vertex* vertex, const VertexExtra* extra, const GLuint count, const GLboolean doLighting) {
+    for(GLuint i = 0; i < count; i += VERTEX_CHUNK_SIZE) {
+        const GLuint n = (count - i < VERTEX_CHUNK_SIZE) ? count - i : VERTEX_CHUNK_SIZE;
+
+        if(doLighting) {
+            lightVertices(vertex + i, extra + i, n);
+            PROFILER_CHECKPOINT("light");
+        }
+
+        transformVertices(vertex + i, n);
+        PROFILER_CHECKPOINT("transform");
+    }
+}
+
+/* The clipper copies out the triangles either side of a vertex that's
+ * behind the near plane, which reaches back at most this many vertices
+ * before the first such vertex */
+#define CLIP_LOOKBEHIND 2
+
+/* Returns the index of the first of count vertices that's behind the near
+ * plane (w <= 0, or NaN, the same test the clipper uses) or count */
+static inline GLuint findBehindNearPlane(const Vertex* vertex, const GLuint count) {
+    for(GLuint i = 0; i < count; ++i) {
+        if(!(vertex[i].w > 0)) {
+            return i;
+        }
+    }
+
+    return count;
+}
+
+/* Lights and transforms the target's vertices (unless they already were)
+ * a chunk at a time, then divides each chunk while it's still in the cache.
+ * The divide has to wait for clipping if anything is behind the near plane,
+ * so as soon as a vertex is, the rest are only transformed and this returns
+ * how many from the start were divided. Vertices near the end of a chunk
+ * could still be part of a triangle that's clipped in the next one, so
+ * with clipping the divide runs CLIP_LOOKBEHIND vertices behind. */
+static GLuint transformAndDivide(SubmissionTarget* target, GLboolean doLighting, const GLboolean transformed, const GLboolean clipping) {
+    /* List draws record whether lighting was enabled, but are only lit if
+     * it still is when they're called */
+    doLighting = doLighting && _glIsLightingEnabled();
+
+    Vertex* vertex = _glSubmissionTargetStart(target);
+    const VertexExtra* extra = (doLighting) ? aligned_vector_at(target->extras, 0) : NULL;
+    const GLuint count = target->count;
+
+    GLuint divided = 0;
+    GLboolean behind = GL_FALSE;
+
+    for(GLuint i = 0; i < count; i += VERTEX_CHUNK_SIZE) {
+        const GLuint n = (count - i < VERTEX_CHUNK_SIZE) ? count - i : VERTEX_CHUNK_SIZE;
+
+        if(!transformed) {
+            lightAndTransform(vertex + i, (extra) ? extra + i : NULL, n, doLighting);
+        }
+
+        if(behind) {
+            continue;
+        }
 
-    // Compile the header
-    pvr_poly_cxt_t cxt = *_glGetPVRContext();
-    cxt.list_type = activePolyList->list_type;
+        GLuint safe = i + n;
 
-    _glUpdatePVRTextureContext(&cxt, textureUnit);
+        if(clipping) {
+            const GLuint first = findBehindNearPlane(vertex + i, n);
+            behind = first < n;
 
+            PROFILER_CHECKPOINT("clip");
+
+            safe = (i + first > CLIP_LOOKBEHIND) ? i + first - CLIP_LOOKBEHIND : 0;
+
+            if(!behind && i + n == count) {
+                /* Nothing to clip, so the end of the last chunk is safe */
+                safe = count;
+            }
+        }
+
+        if(safe > divided) {
+            divideVertices(vertex + divided, safe - divided);
+            divided = safe;
+
+            PROFILER_CHECKPOINT("divide");
+        }
+    }
+
+    return divided;
+}
+
+static void compileContext(PVRHeader* header, pvr_poly_cxt_t* cxt, GLboolean multiTextureHeader) {
     if(multiTextureHeader) {
-        assert(cxt.list_type == PVR_LIST_TR_POLY);
+        assert(cxt->list_type == PVR_LIST_TR_POLY);
 
-        cxt.gen.alpha = PVR_ALPHA_ENABLE;
-        cxt.txr.alpha = PVR_TXRALPHA_ENABLE;
-        cxt.blend.src = PVR_BLEND_ZERO;
-        cxt.blend.dst = PVR_BLEND_DESTCOLOR;
-        cxt.depth.comparison = PVR_DEPTHCMP_EQUAL;
+        cxt->gen.alpha = PVR_ALPHA_ENABLE;
+        cxt->txr.alpha = PVR_TXRALPHA_ENABLE;
+        cxt->blend.src = PVR_BLEND_ZERO;
+        cxt->blend.dst = PVR_BLEND_DESTCOLOR;
+        cxt->depth.comparison = PVR_DEPTHCMP_EQUAL;
     }
 
-    pvr_poly_compile(&header->hdr, &cxt);
+    pvr_poly_compile(&header->hdr, cxt);
+
+    RENDER_COUNTERS.headers_compiled++;
 
     /* Post-process the vertex list */
     /*
@@ -1190,56 +1862,274 @@ static void push(PVRHeader* header, GLboolean multiTextureHeader, PolyList* acti
     */
 }
 
-#define DEBUG_CLIPPING 0
+/* The headers for the main (unit 0) and multitexture (unit 1) passes of
+ * the last draw, along with the context they were compiled from and what
+ * has changed since */
+typedef struct {
+    pvr_poly_cxt_t cxt;
+    PVRHeader header;
+    GLubyte dirty;
+} HeaderCache;
+
+static HeaderCache HEADER_CACHE[MAX_TEXTURE_UNITS] = {
+    {.dirty = STATE_DIRTY_ALL},
+    {.dirty = STATE_DIRTY_ALL}
+};
 
-static void submitVertices(GLenum mode, GLsizei first, GLuint count, GLenum type, const GLvoid* indices) {
+/* Returns the header for a draw to activePolyList, which is only compiled
+ * again if the state it's compiled from has changed since the last draw */
+static const PVRHeader* cachedHeader(PolyList* activePolyList, GLshort textureUnit) {
     TRACE();
 
-    /* Do nothing if vertices aren't enabled */
-    if(!(ENABLED_VERTEX_ATTRIBUTES & VERTEX_ENABLED_FLAG)) {
-        return;
+    const GLubyte dirty = _glTakeStateDirty();
+    for(GLubyte i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+        HEADER_CACHE[i].dirty |= dirty;
     }
 
-    /* No vertices? Do nothing */
-    if(!count) {
-        return;
+    HeaderCache* cache = &HEADER_CACHE[textureUnit];
+
+    if(!cache->dirty) {
+        return &cache->header;
     }
 
-    if(mode == GL_LINE_STRIP || mode == GL_LINES) {
-        fprintf(stderr, "Line drawing is currently unsupported\n");
-        return;
+    /* The list depends on the blending and alpha test enables, so it can
+     * only change along with the context */
+    if(cache->dirty & STATE_DIRTY_CONTEXT) {
+        cache->cxt = *_glGetPVRContext();
+        cache->cxt.list_type = activePolyList->list_type;
+    }
+
+    /* The texture context depends on blending too, so it's updated either way */
+    _glUpdatePVRTextureContext(&cache->cxt, textureUnit);
+
+    compileContext(&cache->header, &cache->cxt, textureUnit == 1);
+    cache->dirty = 0;
+
+    return &cache->header;
+}
+
+/* Whether a draw with this header can be added to the end of the list
+ * without a header of its own. Strips can't span draws (the last vertex of
+ * each draw is always an EOL) so all that matters is that nothing else has
+ * been added to the list since the last draw with the same header. */
+static GLboolean _glCanBatch(const PolyList* list, const PVRHeader* header) {
+    return list->batch_end && list->batch_end == list->vector.size &&
+        memcmp(&list->batch_header, header, sizeof(PVRHeader)) == 0;
+}
+
+/* Writes the header for target (unless it was batched with the previous
+ * draw), and starts or extends the list's batch */
+static void _glEmitHeader(SubmissionTarget* target, const PVRHeader* header, const GLboolean batched) {
+    PolyList* list = target->output;
+
+    if(batched) {
+        RENDER_COUNTERS.headers_elided++;
+    } else {
+        *_glSubmissionTargetHeader(target) = *header;
+        list->batch_header = *header;
+        RENDER_COUNTERS.headers++;
     }
 
-    static SubmissionTarget* target = NULL;
-    static AlignedVector extras;
+    list->batch_end = list->vector.size;
+}
+
+/*
+   If multitexturing is enabled, we want to send exactly the same vertices again, except:
+   - We want to enable blending, and send them to the TR list
+   - We want to set the depth func to GL_EQUAL
+   - We want to set the second texture ID
+   - We want to set the uv coordinates to the passed st ones
+
+   This makes the copy, and returns the header to compile for it.
+*/
+static PVRHeader* copyForMultitexture(SubmissionTarget* target) {
+    /* Push back a copy of the list to the transparent poly list, including the header
+        (hence the + 1)
+    */
+    Vertex* vertex = aligned_vector_push_back(
+        &_glTransparentPolyList()->vector, (Vertex*) _glSubmissionTargetHeader(target), target->count + 1
+    );
+
+    assert(vertex);
+
+    PVRHeader* mtHeader = (PVRHeader*) vertex++;
+
+    /* Replace the UV coordinates with the ST ones */
+    VertexExtra* ve = aligned_vector_at(target->extras, 0);
+    ITERATE(target->count) {
+        vertex->uv[0] = ve->st[0];
+        vertex->uv[1] = ve->st[1];
+        ++vertex;
+        ++ve;
+    }
+
+    return mtHeader;
+}
+
+#define DEBUG_CLIPPING 0
+
+/* Clips the target, once transformAndDivide found something behind the near
+ * plane, and divides the vertices from divided onwards */
+static void clipAndDivide(SubmissionTarget* target, const GLuint divided) {
+#if DEBUG_CLIPPING
+    uint32_t i = 0;
+    fprintf(stderr, "=========\n");
+
+    for(i = offset; i < activeList->vector.size; ++i) {
+        ClipVertex* v = aligned_vector_at(&activeList->vector, i);
+        if(v->flags == 0xe0000000 || v->flags == 0xf0000000) {
+            fprintf(stderr, "(%f, %f, %f) -> %x\n", v->xyz[0], v->xyz[1], v->xyz[2], v->flags);
+        } else {
+            fprintf(stderr, "%x\n", *((uint32_t*)v));
+        }
+    }
+#endif
+
+    clip(target);
+
+    assert(!target->extras || target->extras->size == target->count);
+
+#if DEBUG_CLIPPING
+    fprintf(stderr, "--------\n");
+    for(i = offset; i < activeList->vector.size; ++i) {
+        ClipVertex* v = aligned_vector_at(&activeList->vector, i);
+        if(v->flags == 0xe0000000 || v->flags == 0xf0000000) {
+            fprintf(stderr, "(%f, %f, %f) -> %x\n", v->xyz[0], v->xyz[1], v->xyz[2], v->flags);
+        } else {
+            fprintf(stderr, "%x\n", *((uint32_t*)v));
+        }
+    }
+#endif
+
+    PROFILER_CHECKPOINT("clip");
+
+    /* Clipping only appends to the target, so the vertices that were
+     * already divided are still at the start */
+    divideVertices((Vertex*) _glSubmissionTargetStart(target) + divided, target->count - divided);
+
+    PROFILER_CHECKPOINT("divide");
+}
+
+/* Everything after generate up to the header: light, transform, clip,
+ * divide and (if it's enabled) triangle rejection. If generate already lit
+ * and transformed the vertices (see preTransform) only clipping and the
+ * divide are left. Unless something is behind the near plane, everything
+ * up to rejection is done in one pass (see transformAndDivide), which
+ * checkpoints each chunk so the profiler still sees the light, transform,
+ * clip (the near plane test) and divide stages. clipping is false if the draw doesn't need
+ * near-Z clipping (see _glNeedsClipping), culling is its PVR_CULLING_*
+ * mode. */
+static void process(SubmissionTarget* target, const GLboolean doLighting, const GLboolean transformed, const GLboolean clipping, const GLubyte culling) {
+    const GLuint divided = transformAndDivide(target, doLighting, transformed, clipping);
+
+    if(divided < target->count) {
+        clipAndDivide(target, divided);
+    }
+
+    if(_glIsTriangleRejectionEnabled()) {
+        _glRejectTriangles(target, culling);
+
+        PROFILER_CHECKPOINT("reject");
+    }
+}
+
+static SubmissionTarget SUBMISSION_TARGET;
+static AlignedVector EXTRAS;
+
+/* Points the target at count vertices after the end of output, with (if
+ * needExtras) as many extras. Unless needHeader is false (the draw is being
+ * batched with the previous one) there's a header before the vertices. */
+static SubmissionTarget* _glPrepareSubmissionTarget(PolyList* output, const GLuint count, const GLboolean needExtras, const GLboolean needHeader) {
+    static GLboolean initialized = GL_FALSE;
+
+    SubmissionTarget* target = &SUBMISSION_TARGET;
 
     /* Initialization of the target and extras */
-    if(!target) {
-        target = (SubmissionTarget*) malloc(sizeof(SubmissionTarget));
+    if(!initialized) {
         target->extras = NULL;
         target->count = 0;
         target->output = NULL;
         target->header_offset = target->start_offset = 0;
 
-        aligned_vector_init(&extras, sizeof(VertexExtra));
-        target->extras = &extras;
+        aligned_vector_init_arena(&EXTRAS, sizeof(VertexExtra), _glFrameArena());
+        initialized = GL_TRUE;
     }
 
-    GLboolean doMultitexture, doTexture, doLighting;
-    GLint activeTexture;
-    glGetIntegerv(GL_ACTIVE_TEXTURE_ARB, &activeTexture);
+    target->output = output;
+    target->count = count;
+    target->header_offset = target->output->vector.size;
+    target->start_offset = target->header_offset + ((needHeader) ? 1 : 0);
+
+    assert(target->count);
+
+    /* Normals and ST coordinates are only needed for lighting and the second
+     * texture pass, so most geometry doesn't need the "extra" data at all */
+    if(needExtras) {
+        target->extras = &EXTRAS;
+        aligned_vector_resize(&EXTRAS, target->count);
+    } else {
+        target->extras = NULL;
+    }
+
+    /* Make room for the vertices and header */
+    aligned_vector_extend(&target->output->vector, target->start_offset - target->header_offset + target->count);
+
+    return target;
+}
+
+/* Snapshots what the headers for this draw are compiled from, see glNewList */
+static void _glRecordDraw(SubmissionTarget* target, const GLboolean doTexture, const GLboolean doMultitexture, const GLboolean doLighting) {
+    DisplayListDraw draw;
+    const TextureObject* texture0 = _glGetTexture0();
+    const TextureObject* texture1 = _glGetTexture1();
+
+    draw.output = target->output;
+    draw.context = *_glGetPVRContext();
+    draw.texture[0] = (doTexture && texture0) ? texture0->index : 0;
+    draw.texture[1] = (doMultitexture && texture1) ? texture1->index : 0;
+    draw.blend = _glIsBlendingEnabled();
+    draw.lighting = doLighting;
+    draw.multitexture = doMultitexture && texture1 && (ENABLED_VERTEX_ATTRIBUTES & ST_ENABLED_FLAG) == ST_ENABLED_FLAG;
+    draw.count = target->count;
+
+    _glRecordListDraw(
+        &draw,
+        _glSubmissionTargetStart(target),
+        (target->extras) ? aligned_vector_at(target->extras, 0) : NULL
+    );
+}
+
+static void submitVertices(GLenum mode, GLsizei first, GLuint count, GLenum type, const GLvoid* indices, GLuint start, GLuint end) {
+    TRACE();
+
+    /* Bounds only apply to the next draw, even if it doesn't draw anything */
+    const GLubyte bounds = _glTakeBounds();
 
-    glActiveTextureARB(GL_TEXTURE0);
-    glGetBooleanv(GL_TEXTURE_2D, &doTexture);
+    /* Do nothing if vertices aren't enabled */
+    if(!(ENABLED_VERTEX_ATTRIBUTES & VERTEX_ENABLED_FLAG)) {
+        return;
+    }
 
-    glActiveTextureARB(GL_TEXTURE1);
-    glGetBooleanv(GL_TEXTURE_2D, &doMultitexture);
+    /* No vertices? Do nothing */
+    if(!count) {
+        return;
+    }
 
-    doLighting = _glIsLightingEnabled();
+    if(mode == GL_LINE_STRIP || mode == GL_LINES) {
+        fprintf(stderr, "Line drawing is currently unsupported\n");
+        return;
+    }
 
-    glActiveTextureARB(activeTexture);
+    if(bounds == BOUNDS_OUTSIDE) {
+        RENDER_COUNTERS.draws_culled++;
+        return;
+    }
 
-    profiler_push(__func__);
+    const GLboolean doTexture = _glIsTextureEnabled(0);
+    const GLboolean doMultitexture = _glIsTextureEnabled(1);
+    const GLboolean doLighting = _glIsLightingEnabled();
+
+    PROFILER_PUSH(__func__);
 
     /* Polygons are treated as triangle fans, the only time this would be a
      * problem is if we supported glPolygonMode(..., GL_LINE) but we don't.
@@ -1258,134 +2148,190 @@ static void submitVertices(GLenum mode, GLsizei first, GLuint count, GLenum type
     // We don't handle this any further, so just make sure we never pass it down */
     assert(mode != GL_POLYGON);
 
-    target->output = _glActivePolyList();
-    target->count = (mode == GL_TRIANGLE_FAN) ? ((count - 2) * 3) : count;
-    target->header_offset = target->output->vector.size;
-    target->start_offset = target->header_offset + 1;
+    PolyList* output = _glActivePolyList();
 
-    assert(target->count);
+    /* The multitexture pass copies the vertices to the TR list along with
+     * their header, so those draws always have one */
+    const TextureObject* texture1 = _glGetTexture1();
+    const GLboolean multitexturePass = doMultitexture && texture1 &&
+        (ENABLED_VERTEX_ATTRIBUTES & ST_ENABLED_FLAG) == ST_ENABLED_FLAG;
 
-    /* Make sure we have enough room for all the "extra" data */
-    aligned_vector_resize(&extras, target->count);
+    /* The header only depends on the state, so get it up front to find
+     * out whether this draw can be added to the last one's batch */
+    const PVRHeader* header = cachedHeader(output, 0);
+    const GLboolean batched = !multitexturePass && _glCanBatch(output, header);
 
-    /* Make room for the vertices and header */
-    aligned_vector_extend(&target->output->vector, target->count + 1);
+    PROFILER_CHECKPOINT("push");
 
-    profiler_checkpoint("allocate");
+    SubmissionTarget* target = _glPrepareSubmissionTarget(
+        output,
+        (mode == GL_TRIANGLE_FAN) ? ((count - 2) * 3) : count,
+        doLighting || doMultitexture,
+        !batched
+    );
 
-    generate(target, mode, first, count, (GLubyte*) indices, type, doTexture, doMultitexture, doLighting);
+    PROFILER_CHECKPOINT("allocate");
 
-    profiler_checkpoint("generate");
+    /* Lists record the vertices before they're transformed, so they can't
+     * go through the post-transform cache */
+    const GLboolean cache = !_glIsCompilingList();
+    GLboolean transformed;
 
-    if(doLighting) {
-        light(target);
+    /* Static buffers skip reading and converting the attributes */
+    const BufferObject* buffer = _glConvertedBuffer();
+    if(buffer && (indices || first + count <= buffer->converted_count)) {
+        transformed = generateFromBuffer(target, buffer, mode, first, count, (GLubyte*) indices, type, start, end, cache, doLighting);
+    } else {
+        transformed = generate(target, mode, first, count, (GLubyte*) indices, type, start, end, cache, doTexture, doMultitexture, doLighting);
     }
 
-    profiler_checkpoint("light");
+    if(_glIsCompilingList()) {
+        _glRecordDraw(target, doTexture, doMultitexture, doLighting);
 
-    transform(target);
+        if(!_glIsExecutingList()) {
+            /* GL_COMPILE, so take the vertices back out of the list */
+            aligned_vector_resize(&target->output->vector, target->header_offset);
+            PROFILER_POP();
+            return;
+        }
+    }
 
-    profiler_checkpoint("transform");
+    RENDER_COUNTERS.draw_calls++;
+    RENDER_COUNTERS.vertices_in += count;
+    RENDER_COUNTERS.vertices_out += target->count;
 
-    if(_glIsClippingEnabled()) {
-#if DEBUG_CLIPPING
-        uint32_t i = 0;
-        fprintf(stderr, "=========\n");
+    PROFILER_CHECKPOINT("generate");
 
-        for(i = offset; i < activeList->vector.size; ++i) {
-            ClipVertex* v = aligned_vector_at(&activeList->vector, i);
-            if(v->flags == 0xe0000000 || v->flags == 0xf0000000) {
-                fprintf(stderr, "(%f, %f, %f) -> %x\n", v->xyz[0], v->xyz[1], v->xyz[2], v->flags);
-            } else {
-                fprintf(stderr, "%x\n", *((uint32_t*)v));
-            }
-        }
-#endif
+    process(target, doLighting, transformed, _glNeedsClipping(bounds), _glGetPVRContext()->gen.culling);
 
-        clip(target);
+    if(!target->count) {
+        /* Every triangle was rejected, so there's nothing to send */
+        aligned_vector_resize(&target->output->vector, target->header_offset);
+        PROFILER_POP();
+        return;
+    }
 
-        assert(extras.size == target->count);
+    _glEmitHeader(target, header, batched);
 
-#if DEBUG_CLIPPING
-        fprintf(stderr, "--------\n");
-        for(i = offset; i < activeList->vector.size; ++i) {
-            ClipVertex* v = aligned_vector_at(&activeList->vector, i);
-            if(v->flags == 0xe0000000 || v->flags == 0xf0000000) {
-                fprintf(stderr, "(%f, %f, %f) -> %x\n", v->xyz[0], v->xyz[1], v->xyz[2], v->flags);
-            } else {
-                fprintf(stderr, "%x\n", *((uint32_t*)v));
-            }
+    PROFILER_CHECKPOINT("push");
+
+    if(!multitexturePass) {
+        PROFILER_POP();
+        return;
+    }
+
+    /* Send the buffer again to the transparent list */
+    *copyForMultitexture(target) = *cachedHeader(_glTransparentPolyList(), 1);
+    RENDER_COUNTERS.headers++;
+
+    PROFILER_POP();
+}
+
+void _glSubmitListDraw(DisplayListDraw* draw, const Vertex* vertices, const VertexExtra* extras, GLubyte bounds) {
+    TRACE();
+
+    PROFILER_PUSH(__func__);
+
+    const TextureObject* texture1 = _glGetTextureObject(draw->texture[1]);
+    const GLboolean multitexturePass = draw->multitexture && texture1;
+
+    /* The headers are compiled from the recorded state, but with the
+     * textures as they are now in case they've been uploaded since, so
+     * they're only compiled again once a texture has changed */
+    const GLuint generation = _glTextureGeneration();
+    if(draw->generation != generation) {
+        pvr_poly_cxt_t cxt = draw->context;
+        cxt.list_type = draw->output->list_type;
+        _glUpdatePVRTextureContextFor(&cxt, _glGetTextureObject(draw->texture[0]), draw->blend);
+        compileContext(&draw->header, &cxt, GL_FALSE);
+
+        if(draw->multitexture) {
+            cxt = draw->context;
+            cxt.list_type = PVR_LIST_TR_POLY;
+            _glUpdatePVRTextureContextFor(&cxt, texture1, draw->blend);
+            compileContext(&draw->multitexture_header, &cxt, GL_TRUE);
         }
-#endif
 
+        draw->generation = generation;
     }
 
-    profiler_checkpoint("clip");
+    const GLboolean batched = !multitexturePass && _glCanBatch(draw->output, &draw->header);
 
-    divide(target);
+    PROFILER_CHECKPOINT("push");
 
-    profiler_checkpoint("divide");
+    SubmissionTarget* target = _glPrepareSubmissionTarget(draw->output, draw->count, extras != NULL, !batched);
 
-    push(_glSubmissionTargetHeader(target), GL_FALSE, target->output, 0);
+    PROFILER_CHECKPOINT("allocate");
 
-    profiler_checkpoint("push");
-    /*
-       Now, if multitexturing is enabled, we want to send exactly the same vertices again, except:
-       - We want to enable blending, and send them to the TR list
-       - We want to set the depth func to GL_EQUAL
-       - We want to set the second texture ID
-       - We want to set the uv coordinates to the passed st ones
-    */
+    /* The recorded vertices were already generated, so this is the whole of
+     * the generate stage */
+    memcpy(_glSubmissionTargetStart(target), vertices, sizeof(Vertex) * draw->count);
 
-    if(!doMultitexture) {
-        /* Multitexture actively disabled */
-        profiler_pop();
-        return;
+    if(extras) {
+        memcpy(aligned_vector_at(target->extras, 0), extras, sizeof(VertexExtra) * draw->count);
     }
 
-    TextureObject* texture1 = _glGetTexture1();
+    RENDER_COUNTERS.draw_calls++;
+    RENDER_COUNTERS.vertices_in += draw->count;
+    RENDER_COUNTERS.vertices_out += draw->count;
+
+    PROFILER_CHECKPOINT("generate");
+
+    process(target, draw->lighting, GL_FALSE, _glNeedsClipping(bounds), draw->context.gen.culling);
 
-    /* Multitexture implicitly disabled */
-    if(!texture1 || ((ENABLED_VERTEX_ATTRIBUTES & ST_ENABLED_FLAG) != ST_ENABLED_FLAG)) {
-        /* Multitexture actively disabled */
-        profiler_pop();
+    if(!target->count) {
+        aligned_vector_resize(&target->output->vector, target->header_offset);
+        PROFILER_POP();
         return;
     }
 
-    /* Push back a copy of the list to the transparent poly list, including the header
-        (hence the + 1)
-    */
-    Vertex* vertex = aligned_vector_push_back(
-        &_glTransparentPolyList()->vector, (Vertex*) _glSubmissionTargetHeader(target), target->count + 1
-    );
+    _glEmitHeader(target, &draw->header, batched);
 
-    assert(vertex);
+    if(multitexturePass) {
+        *copyForMultitexture(target) = draw->multitexture_header;
+        RENDER_COUNTERS.headers++;
+    }
 
-    PVRHeader* mtHeader = (PVRHeader*) vertex++;
+    PROFILER_CHECKPOINT("push");
+    PROFILER_POP();
+}
 
-    /* Replace the UV coordinates with the ST ones */
-    VertexExtra* ve = aligned_vector_at(target->extras, 0);
-    ITERATE(target->count) {
-        vertex->uv[0] = ve->st[0];
-        vertex->uv[1] = ve->st[1];
-        ++vertex;
-        ++ve;
+void APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices) {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
     }
 
-    /* Send the buffer again to the transparent list */
-    push(mtHeader, GL_TRUE, _glTransparentPolyList(), 1);
+    /* With an element buffer bound, indices is an offset into it */
+    const BufferObject* elements = _glGetBoundBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB);
+    if(elements) {
+        indices = elements->data + (uintptr_t) indices;
+    }
 
-    profiler_pop();
+    /* The range is only worked out if generate needs it */
+    submitVertices(mode, 0, count, type, indices, 1, 0);
 }
 
-void APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices) {
+void APIENTRY glDrawRangeElements(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid* indices) {
     TRACE();
 
     if(_glCheckImmediateModeInactive(__func__)) {
         return;
     }
 
-    submitVertices(mode, 0, count, type, indices);
+    if(end < start || count < 0) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    const BufferObject* elements = _glGetBoundBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB);
+    if(elements) {
+        indices = elements->data + (uintptr_t) indices;
+    }
+
+    submitVertices(mode, 0, count, type, indices, start, end);
 }
 
 void APIENTRY glDrawArrays(GLenum mode, GLint first, GLsizei count) {
@@ -1395,7 +2341,7 @@ void APIENTRY glDrawArrays(GLenum mode, GLint first, GLsizei count) {
         return;
     }
 
-    submitVertices(mode, first, count, GL_UNSIGNED_INT, NULL);
+    submitVertices(mode, first, count, GL_UNSIGNED_INT, NULL, 0, 0);
 }
 
 void APIENTRY glEnableClientState(GLenum cap) {
@@ -1467,8 +2413,43 @@ void APIENTRY glClientActiveTextureARB(GLenum texture) {
     ACTIVE_CLIENT_TEXTURE = (texture == GL_TEXTURE1_ARB) ? 1 : 0;
 }
 
+/* With a buffer bound to GL_ARRAY_BUFFER_ARB the pointer is an offset into it */
+static void _glSetAttribData(AttribPointer* attrib, const GLvoid* pointer) {
+    const BufferObject* buffer = _glGetBoundBuffer(GL_ARRAY_BUFFER_ARB);
+
+    attrib->buffer = (buffer) ? buffer->index : 0;
+    attrib->ptr = (buffer) ? buffer->data + (uintptr_t) pointer : pointer;
+}
+
+static void _glRebaseAttrib(AttribPointer* attrib, GLuint buffer, const GLubyte* old_data, const GLubyte* new_data) {
+    if(attrib->buffer != buffer) {
+        return;
+    }
+
+    const uintptr_t offset = ((uintptr_t) attrib->ptr) - ((uintptr_t) old_data);
+
+    if(new_data) {
+        attrib->ptr = new_data + offset;
+    } else {
+        /* The buffer was deleted, so this reverts to a client pointer */
+        attrib->ptr = (const GLvoid*) offset;
+        attrib->buffer = 0;
+    }
+}
+
+void _glRebaseBufferPointers(GLuint buffer, const GLubyte* old_data, const GLubyte* new_data) {
+    _glRebaseAttrib(&VERTEX_POINTER, buffer, old_data, new_data);
+    _glRebaseAttrib(&DIFFUSE_POINTER, buffer, old_data, new_data);
+    _glRebaseAttrib(&UV_POINTER, buffer, old_data, new_data);
+    _glRebaseAttrib(&ST_POINTER, buffer, old_data, new_data);
+    _glRebaseAttrib(&NORMAL_POINTER, buffer, old_data, new_data);
+
+    _glRecalcFastPath();
+}
+
 GLboolean _glRecalcFastPath() {
     FAST_PATH_ENABLED = _glIsVertexDataFastPathCompatible();
+    VERTEX_KERNEL = _glSelectVertexKernel(&VERTEX_KERNEL_NORMALS);
     return FAST_PATH_ENABLED;
 }
 
@@ -1483,7 +2464,7 @@ void APIENTRY glTexCoordPointer(GLint size,  GLenum type,  GLsizei stride,  cons
 
     AttribPointer* tointer = (ACTIVE_CLIENT_TEXTURE == 0) ? &UV_POINTER : &ST_POINTER;
 
-    tointer->ptr = pointer;
+    _glSetAttribData(tointer, pointer);
     tointer->stride = stride;
     tointer->type = type;
     tointer->size = size;
@@ -1500,7 +2481,7 @@ void APIENTRY glVertexPointer(GLint size,  GLenum type,  GLsizei stride,  const
         return;
     }
 
-    VERTEX_POINTER.ptr = pointer;
+    _glSetAttribData(&VERTEX_POINTER, pointer);
     VERTEX_POINTER.stride = stride;
     VERTEX_POINTER.type = type;
     VERTEX_POINTER.size = size;
@@ -1517,7 +2498,7 @@ void APIENTRY glColorPointer(GLint size,  GLenum type,  GLsizei stride,  const G
         return;
     }
 
-    DIFFUSE_POINTER.ptr = pointer;
+    _glSetAttribData(&DIFFUSE_POINTER, pointer);
     DIFFUSE_POINTER.stride = stride;
     DIFFUSE_POINTER.type = type;
     DIFFUSE_POINTER.size = size;
@@ -1528,7 +2509,7 @@ void APIENTRY glColorPointer(GLint size,  GLenum type,  GLsizei stride,  const G
 void APIENTRY glNormalPointer(GLenum type,  GLsizei stride,  const GLvoid * pointer) {
     TRACE();
 
-    NORMAL_POINTER.ptr = pointer;
+    _glSetAttribData(&NORMAL_POINTER, pointer);
     NORMAL_POINTER.stride = stride;
     NORMAL_POINTER.type = type;
     NORMAL_POINTER.size = (type == GL_INT_2_10_10_10_REV) ? 1 : 3;
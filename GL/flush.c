@@ -1,43 +1,16 @@
 
 
-#include <kos.h>
-
 #include "../include/glkos.h"
 #include "../containers/aligned_vector.h"
 #include "private.h"
 #include "profiler.h"
 #include "version.h"
 
-#define TA_SQ_ADDR (unsigned int *)(void *) \
-    (0xe0000000 | (((unsigned long)0x10000000) & 0x03ffffe0))
-
 static PolyList OP_LIST;
 static PolyList PT_LIST;
 static PolyList TR_LIST;
 
-static void pvr_list_submit(void *src, int n) {
-    GLuint *d = TA_SQ_ADDR;
-    GLuint *s = src;
-
-    /* fill/write queues as many times necessary */
-    while(n--) {
-        __asm__("pref @%0" : : "r"(s + 8));  /* prefetch 32 bytes for next loop */
-        d[0] = *(s++);
-        d[1] = *(s++);
-        d[2] = *(s++);
-        d[3] = *(s++);
-        d[4] = *(s++);
-        d[5] = *(s++);
-        d[6] = *(s++);
-        d[7] = *(s++);
-        __asm__("pref @%0" : : "r"(d));
-        d += 8;
-    }
-
-    /* Wait for both store queues to complete */
-    d = (GLuint *)0xe0000000;
-    d[0] = d[8] = 0;
-}
+static Arena FRAME_ARENA;
 
 static void _glInitPVR(GLboolean autosort) {
     pvr_init_params_t params = {
@@ -67,6 +40,10 @@ PolyList *_glTransparentPolyList() {
     return &TR_LIST;
 }
 
+Arena* _glFrameArena() {
+    return &FRAME_ARENA;
+}
+
 void APIENTRY glFlush() {
 
 }
@@ -82,6 +59,7 @@ void APIENTRY glKosInitConfig(GLdcConfig* config) {
     config->initial_pt_capacity = 512;
     config->initial_tr_capacity = 1024;
     config->initial_immediate_capacity = 1024;
+    config->frame_arena_size = 256 * 1024;
     config->internal_palette_format = GL_RGBA4;
 }
 
@@ -102,14 +80,18 @@ void APIENTRY glKosInitEx(GLdcConfig* config) {
     _glSetInternalPaletteFormat(config->internal_palette_format);
 
     _glInitTextures();
+    _glInitBuffers();
+    _glInitLists();
 
     OP_LIST.list_type = PVR_LIST_OP_POLY;
     PT_LIST.list_type = PVR_LIST_PT_POLY;
     TR_LIST.list_type = PVR_LIST_TR_POLY;
 
-    aligned_vector_init(&OP_LIST.vector, sizeof(Vertex));
-    aligned_vector_init(&PT_LIST.vector, sizeof(Vertex));
-    aligned_vector_init(&TR_LIST.vector, sizeof(Vertex));
+    arena_init(&FRAME_ARENA, config->frame_arena_size);
+
+    aligned_vector_init_arena(&OP_LIST.vector, sizeof(Vertex), &FRAME_ARENA);
+    aligned_vector_init_arena(&PT_LIST.vector, sizeof(Vertex), &FRAME_ARENA);
+    aligned_vector_init_arena(&TR_LIST.vector, sizeof(Vertex), &FRAME_ARENA);
 
     aligned_vector_reserve(&OP_LIST.vector, config->initial_op_capacity);
     aligned_vector_reserve(&PT_LIST.vector, config->initial_pt_capacity);
@@ -122,21 +104,18 @@ void APIENTRY glKosInit() {
     glKosInitEx(&config);
 }
 
-#define QACRTA ((((unsigned int)0x10000000)>>26)<<2)&0x1c
-
 void APIENTRY glKosSwapBuffers() {
     static int frame_count = 0;
 
     TRACE();
 
-    profiler_push(__func__);
+    PROFILER_PUSH(__func__);
 
     pvr_wait_ready();
 
-    pvr_scene_begin();
-        QACR0 = QACRTA;
-        QACR1 = QACRTA;
+    PROFILER_CHECKPOINT("wait");
 
+    pvr_scene_begin();
         pvr_list_begin(PVR_LIST_OP_POLY);
         pvr_list_submit(OP_LIST.vector.data, OP_LIST.vector.size);
         pvr_list_finish();
@@ -150,12 +129,34 @@ void APIENTRY glKosSwapBuffers() {
         pvr_list_finish();
     pvr_scene_finish();
 
+    _glRecordFrame(&OP_LIST, &PT_LIST, &TR_LIST);
+
+    const PolyList* lists[3] = {&OP_LIST, &PT_LIST, &TR_LIST};
+    for(int i = 0; i < 3; ++i) {
+        const GLuint size = lists[i]->vector.size;
+        RENDER_COUNTERS.list_bytes[i] += size * 32;
+        if(size > RENDER_COUNTERS.list_high_water[i]) {
+            RENDER_COUNTERS.list_high_water[i] = size;
+        }
+    }
+
     aligned_vector_clear(&OP_LIST.vector);
     aligned_vector_clear(&PT_LIST.vector);
     aligned_vector_clear(&TR_LIST.vector);
 
-    profiler_checkpoint("scene");
-    profiler_pop();
+    OP_LIST.batch_end = PT_LIST.batch_end = TR_LIST.batch_end = 0;
+
+    if(FRAME_ARENA.total > RENDER_COUNTERS.frame_arena_high_water) {
+        RENDER_COUNTERS.frame_arena_high_water = FRAME_ARENA.total;
+    }
+
+    /* Everything allocated this frame is gone after this, the lists (and
+     * anything else using the arena) reallocate on their next use */
+    RENDER_COUNTERS.frame_arena_spills += arena_reset(&FRAME_ARENA);
+
+    PROFILER_CHECKPOINT("scene");
+    PROFILER_POP();
+    profiler_frame();
 
     if(frame_count++ > 100) {
         profiler_print_stats();
@@ -39,6 +39,12 @@ void APIENTRY glGenFramebuffersEXT(GLsizei n, GLuint* framebuffers) {
     while(n--) {
         GLuint id = 0;
         FrameBuffer* fb = (FrameBuffer*) named_array_alloc(&FRAMEBUFFERS, &id);
+        if(!fb) {
+            _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+            _glKosPrintError();
+            return;
+        }
+
         fb->index = id;
         fb->is_complete = GL_FALSE;
         fb->texture_id = 0;
@@ -305,6 +311,7 @@ void APIENTRY glGenerateMipmapEXT(GLenum target) {
 
     /* Make sure there is room for the mipmap data on the texture object */
     _glAllocateSpaceForMipmaps(tex);
+    _glMarkTexturesChanged();
 
     for(i = 1; i < _glGetMipmapLevelCount(tex); ++i) {
         GLubyte* prevData = _glGetMipmapLocation(tex, i - 1);
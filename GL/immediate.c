@@ -233,7 +233,7 @@ void APIENTRY glNormal3fv(const GLfloat* v) {
 }
 
 void APIENTRY glEnd() {
-    profiler_push(__func__);
+    PROFILER_PUSH(__func__);
 
     IMMEDIATE_MODE_ACTIVE = GL_FALSE;
 
@@ -290,6 +290,8 @@ void APIENTRY glEnd() {
 
     *attrs = prevAttrs;
 
+    _glRecalcFastPath();
+
     /* Clear arrays for next polys */
     aligned_vector_clear(&VERTICES);
     aligned_vector_clear(&ST_COORDS);
@@ -301,8 +303,8 @@ void APIENTRY glEnd() {
     *uattr = uvptr;
     *sattr = stptr;
 
-    profiler_checkpoint("restore");
-    profiler_pop();
+    PROFILER_CHECKPOINT("restore");
+    PROFILER_POP();
 }
 
 void APIENTRY glRectf(GLfloat x1, GLfloat y1, GLfloat x2, GLfloat y2) {
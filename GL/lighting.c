@@ -1,7 +1,6 @@
 #include <stdio.h>
 #include <string.h>
 
-#include <dc/vec3f.h>
 #include "private.h"
 
 static GLfloat SCENE_AMBIENT [] = {0.2, 0.2, 0.2, 1.0};
@@ -0,0 +1,502 @@
+#include "private.h"
+#include "config.h"
+
+typedef struct {
+    GLuint call;  /* Non-zero for a glCallList made while compiling */
+    GLint matrix;  /* Into the list's matrices for a matrix operation, otherwise -1 */
+    GLint state;  /* Into the list's states for a state change, otherwise -1 */
+    DisplayListDraw draw;
+} ListEntry;
+
+typedef struct {
+    GLuint index;
+    AlignedVector entries;
+    AlignedVector vertices;
+    AlignedVector extras;
+    AlignedVector matrices;
+    AlignedVector states;
+} DisplayList;
+
+static NamedArray DISPLAY_LISTS;
+
+/* The list being compiled is kept here until glEndList, so that a list
+ * can be replaced while it's still being called */
+static DisplayList COMPILING;
+static GLuint COMPILING_INDEX = 0;
+static GLenum COMPILING_MODE = GL_COMPILE;
+
+/* What glNewList(GL_COMPILE) found, put back by glEndList */
+static ListSavedState SAVED_STATE;
+
+/* Non-zero while glCallList replays a list, so that the state changes it
+ * replays aren't recorded again into a list being compiled */
+static GLuint EXECUTING = 0;
+
+static GLuint LIST_BASE = 0;
+
+static void _glInitializeDisplayList(DisplayList* list, GLuint id) {
+    list->index = id;
+    aligned_vector_init(&list->entries, sizeof(ListEntry));
+    aligned_vector_init(&list->vertices, sizeof(Vertex));
+    aligned_vector_init(&list->extras, sizeof(VertexExtra));
+    aligned_vector_init(&list->matrices, sizeof(ListMatrix));
+    aligned_vector_init(&list->states, sizeof(ListState));
+}
+
+static void _glCleanupDisplayList(DisplayList* list) {
+    aligned_vector_cleanup(&list->entries);
+    aligned_vector_cleanup(&list->vertices);
+    aligned_vector_cleanup(&list->extras);
+    aligned_vector_cleanup(&list->matrices);
+    aligned_vector_cleanup(&list->states);
+}
+
+GLubyte _glInitLists() {
+    named_array_init_growable(&DISPLAY_LISTS, sizeof(DisplayList), MAX_LIST_COUNT);
+
+    // Reserve zero so that it is never given to anyone as an ID!
+    named_array_reserve(&DISPLAY_LISTS, 0);
+
+    _glInitializeDisplayList(&COMPILING, 0);
+    return 1;
+}
+
+GLboolean _glIsCompilingList() {
+    return COMPILING_INDEX != 0;
+}
+
+GLboolean _glIsExecutingList() {
+    return !COMPILING_INDEX || COMPILING_MODE == GL_COMPILE_AND_EXECUTE;
+}
+
+GLuint _glGetListIndex() {
+    return COMPILING_INDEX;
+}
+
+GLenum _glGetListMode() {
+    return COMPILING_MODE;
+}
+
+GLuint _glGetListBase() {
+    return LIST_BASE;
+}
+
+void _glRecordListDraw(const DisplayListDraw* draw, const Vertex* vertices, const VertexExtra* extras) {
+    ListEntry* entry = (ListEntry*) aligned_vector_extend(&COMPILING.entries, 1);
+
+    entry->call = 0;
+    entry->matrix = -1;
+    entry->state = -1;
+    entry->draw = *draw;
+    entry->draw.generation = 0;
+    entry->draw.first_vertex = COMPILING.vertices.size;
+    entry->draw.first_extra = (extras) ? (GLint) COMPILING.extras.size : -1;
+
+    aligned_vector_push_back(&COMPILING.vertices, vertices, draw->count);
+
+    if(extras) {
+        aligned_vector_push_back(&COMPILING.extras, extras, draw->count);
+    }
+}
+
+/* Matrix operations are recorded rather than applied under GL_COMPILE, so
+ * that calling the list moves what it draws from wherever it's called */
+void _glRecordListMatrix(const ListMatrix* matrix) {
+    ListEntry* entry = (ListEntry*) aligned_vector_extend(&COMPILING.entries, 1);
+
+    entry->call = 0;
+    entry->matrix = COMPILING.matrices.size;
+    entry->state = -1;
+
+    aligned_vector_push_back(&COMPILING.matrices, matrix, 1);
+}
+
+/* Called by glEnable, glDisable, glActiveTextureARB, glBindTexture,
+ * glBlendFunc, glDepthFunc, glDepthMask, glShadeModel, glCullFace,
+ * glFrontFace and glAlphaFunc before they change anything. They're applied
+ * under GL_COMPILE too, as the draws recorded after them take a copy of
+ * the state, but glEndList puts back what glNewList found.
+ *
+ * Anything else (lights, materials, fog, glColor outside glBegin, texture
+ * uploads and parameters) isn't recorded, and takes effect when it's
+ * called even under GL_COMPILE. */
+void _glRecordListState(ListStateOp op, GLenum arg0, GLenum arg1, GLfloat ref) {
+    if(!COMPILING_INDEX || EXECUTING) {
+        return;
+    }
+
+    ListEntry* entry = (ListEntry*) aligned_vector_extend(&COMPILING.entries, 1);
+
+    entry->call = 0;
+    entry->matrix = -1;
+    entry->state = COMPILING.states.size;
+
+    ListState* state = (ListState*) aligned_vector_extend(&COMPILING.states, 1);
+    state->op = op;
+    state->args[0] = arg0;
+    state->args[1] = arg1;
+    state->ref = ref;
+}
+
+static void _glApplyListState(const ListState* state) {
+    switch(state->op) {
+        case LIST_STATE_ENABLE:
+            glEnable(state->args[0]);
+        break;
+        case LIST_STATE_DISABLE:
+            glDisable(state->args[0]);
+        break;
+        case LIST_STATE_ACTIVE_TEXTURE:
+            glActiveTextureARB(state->args[0]);
+        break;
+        case LIST_STATE_BIND_TEXTURE:
+            glBindTexture(state->args[0], state->args[1]);
+        break;
+        case LIST_STATE_BLEND_FUNC:
+            glBlendFunc(state->args[0], state->args[1]);
+        break;
+        case LIST_STATE_DEPTH_FUNC:
+            glDepthFunc(state->args[0]);
+        break;
+        case LIST_STATE_DEPTH_MASK:
+            glDepthMask((GLboolean) state->args[0]);
+        break;
+        case LIST_STATE_SHADE_MODEL:
+            glShadeModel(state->args[0]);
+        break;
+        case LIST_STATE_CULL_FACE:
+            glCullFace(state->args[0]);
+        break;
+        case LIST_STATE_FRONT_FACE:
+            glFrontFace(state->args[0]);
+        break;
+        case LIST_STATE_ALPHA_FUNC:
+            glAlphaFunc(state->args[0], state->ref);
+        break;
+    }
+}
+
+static DisplayList* _glGetDisplayList(GLuint list) {
+    if(!list) {
+        return NULL;
+    }
+
+    return (DisplayList*) named_array_get(&DISPLAY_LISTS, list);
+}
+
+/* bounds are the ones given for the glCallList, which cover nested lists
+ * too. Returns GL_TRUE if the list (or one it called) changed a matrix. */
+static GLboolean _glExecuteList(GLuint list, GLuint depth, GLubyte bounds) {
+    if(depth > MAX_LIST_NESTING) {
+        return GL_FALSE;
+    }
+
+    DisplayList* dl = _glGetDisplayList(list);
+    if(!dl) {
+        return GL_FALSE;
+    }
+
+    GLboolean moved = GL_FALSE;
+
+    for(GLuint i = 0; i < dl->entries.size; ++i) {
+        ListEntry* entry = (ListEntry*) aligned_vector_at(&dl->entries, i);
+
+        /* The bounds were classified with the matrices the list was called
+         * with, so don't hold once those change */
+        if(moved) {
+            bounds = BOUNDS_UNKNOWN;
+        }
+
+        if(entry->call) {
+            moved = _glExecuteList(entry->call, depth + 1, bounds) || moved;
+            continue;
+        }
+
+        if(entry->matrix >= 0) {
+            _glApplyListMatrix((const ListMatrix*) aligned_vector_at(&dl->matrices, entry->matrix));
+            moved = GL_TRUE;
+            continue;
+        }
+
+        if(entry->state >= 0) {
+            _glApplyListState((const ListState*) aligned_vector_at(&dl->states, entry->state));
+            continue;
+        }
+
+        DisplayListDraw* draw = &entry->draw;
+
+        _glSubmitListDraw(
+            draw,
+            (const Vertex*) aligned_vector_at(&dl->vertices, draw->first_vertex),
+            (draw->first_extra >= 0) ? (const VertexExtra*) aligned_vector_at(&dl->extras, draw->first_extra) : NULL,
+            bounds
+        );
+    }
+
+    return moved;
+}
+
+GLuint APIENTRY glGenLists(GLsizei range) {
+    TRACE();
+
+    /* GLsizei is unsigned here, so a negative range comes through as a
+     * huge one */
+    if((GLint) range < 0) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return 0;
+    }
+
+    if(!range) {
+        return 0;
+    }
+
+    /* Names have to be contiguous, so look for a long enough run of unused
+     * ones. This only happens at load time, so a linear search is fine. */
+    GLuint start = 1;
+    for(GLuint id = 1; id < MAX_LIST_COUNT; ++id) {
+        if(named_array_used(&DISPLAY_LISTS, id)) {
+            start = id + 1;
+            continue;
+        }
+
+        if(id - start + 1 < (GLuint) range) {
+            continue;
+        }
+
+        for(GLuint i = start; i <= id; ++i) {
+            DisplayList* list = (DisplayList*) named_array_reserve(&DISPLAY_LISTS, i);
+            if(!list) {
+                glDeleteLists(start, i - start);
+
+                _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+                _glKosPrintError();
+                return 0;
+            }
+
+            _glInitializeDisplayList(list, i);
+        }
+
+        return start;
+    }
+
+    return 0;
+}
+
+void APIENTRY glDeleteLists(GLuint list, GLsizei range) {
+    TRACE();
+
+    if((GLint) range < 0) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    /* Names from MAX_LIST_COUNT on are never given out */
+    if(list >= MAX_LIST_COUNT) {
+        return;
+    }
+
+    const GLuint end = (range < MAX_LIST_COUNT - list) ? list + range : MAX_LIST_COUNT;
+
+    for(GLuint i = list; i < end; ++i) {
+        DisplayList* dl = _glGetDisplayList(i);
+
+        /* Unused names (and zero) are silently ignored */
+        if(!dl) {
+            continue;
+        }
+
+        _glCleanupDisplayList(dl);
+        named_array_release(&DISPLAY_LISTS, i);
+    }
+}
+
+GLboolean APIENTRY glIsList(GLuint list) {
+    return (_glGetDisplayList(list)) ? GL_TRUE : GL_FALSE;
+}
+
+void APIENTRY glNewList(GLuint list, GLenum mode) {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    if(!list) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    if(mode != GL_COMPILE && mode != GL_COMPILE_AND_EXECUTE) {
+        _glKosThrowError(GL_INVALID_ENUM, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    if(COMPILING_INDEX) {
+        _glKosThrowError(GL_INVALID_OPERATION, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    aligned_vector_clear(&COMPILING.entries);
+    aligned_vector_clear(&COMPILING.vertices);
+    aligned_vector_clear(&COMPILING.extras);
+    aligned_vector_clear(&COMPILING.matrices);
+    aligned_vector_clear(&COMPILING.states);
+
+    if(mode == GL_COMPILE) {
+        _glSaveListState(&SAVED_STATE);
+    }
+
+    COMPILING_INDEX = list;
+    COMPILING_MODE = mode;
+}
+
+void APIENTRY glEndList() {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    if(!COMPILING_INDEX) {
+        _glKosThrowError(GL_INVALID_OPERATION, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    const GLuint index = COMPILING_INDEX;
+    COMPILING_INDEX = 0;
+
+    if(COMPILING_MODE == GL_COMPILE) {
+        _glRestoreListState(&SAVED_STATE);
+    }
+
+    DisplayList* list = _glGetDisplayList(index);
+
+    if(list) {
+        _glCleanupDisplayList(list);
+    } else {
+        list = (DisplayList*) named_array_reserve(&DISPLAY_LISTS, index);
+        if(!list) {
+            _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+            _glKosPrintError();
+            return;
+        }
+    }
+
+    /* Hand the compiled storage over to the list, and start afresh */
+    *list = COMPILING;
+    list->index = index;
+
+    _glInitializeDisplayList(&COMPILING, 0);
+}
+
+void APIENTRY glCallList(GLuint list) {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    const GLubyte bounds = _glTakeBounds();
+
+    if(COMPILING_INDEX) {
+        ListEntry* entry = (ListEntry*) aligned_vector_extend(&COMPILING.entries, 1);
+        entry->call = list;
+        entry->matrix = -1;
+        entry->state = -1;
+
+        if(COMPILING_MODE == GL_COMPILE) {
+            return;
+        }
+    }
+
+    if(bounds == BOUNDS_OUTSIDE) {
+        RENDER_COUNTERS.draws_culled++;
+        return;
+    }
+
+    EXECUTING++;
+    _glExecuteList(list, 1, bounds);
+    EXECUTING--;
+}
+
+void APIENTRY glCallLists(GLsizei n, GLenum type, const GLvoid* lists) {
+    TRACE();
+
+    GLint type_values [] = {
+        GL_BYTE, GL_UNSIGNED_BYTE, GL_SHORT, GL_UNSIGNED_SHORT, GL_INT, GL_UNSIGNED_INT,
+        GL_FLOAT, GL_2_BYTES, GL_3_BYTES, GL_4_BYTES, 0
+    };
+
+    if(_glCheckValidEnum(type, type_values, __func__) != 0) {
+        return;
+    }
+
+    if((GLint) n < 0) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    const GLubyte* it = (const GLubyte*) lists;
+
+    while(n--) {
+        GLuint list = 0;
+
+        switch(type) {
+            case GL_BYTE:
+                list = *((const GLbyte*) it);
+                it += sizeof(GLbyte);
+            break;
+            case GL_UNSIGNED_BYTE:
+                list = *it;
+                it += sizeof(GLubyte);
+            break;
+            case GL_SHORT:
+                list = *((const GLshort*) it);
+                it += sizeof(GLshort);
+            break;
+            case GL_UNSIGNED_SHORT:
+                list = *((const GLushort*) it);
+                it += sizeof(GLushort);
+            break;
+            case GL_INT:
+                list = *((const GLint*) it);
+                it += sizeof(GLint);
+            break;
+            case GL_UNSIGNED_INT:
+                list = *((const GLuint*) it);
+                it += sizeof(GLuint);
+            break;
+            case GL_FLOAT:
+                list = (GLuint) *((const GLfloat*) it);
+                it += sizeof(GLfloat);
+            break;
+            case GL_2_BYTES:
+                list = (it[0] << 8) | it[1];
+                it += 2;
+            break;
+            case GL_3_BYTES:
+                list = (it[0] << 16) | (it[1] << 8) | it[2];
+                it += 3;
+            break;
+            case GL_4_BYTES:
+                list = (it[0] << 24) | (it[1] << 16) | (it[2] << 8) | it[3];
+                it += 4;
+            break;
+        }
+
+        glCallList(LIST_BASE + list);
+    }
+}
+
+void APIENTRY glListBase(GLuint base) {
+    TRACE();
+
+    LIST_BASE = base;
+}
@@ -1,10 +1,6 @@
 #include <string.h>
 
 #include <stdio.h>
-#include <dc/fmath.h>
-#include <dc/matrix.h>
-#include <dc/matrix3d.h>
-#include <dc/vec3f.h>
 
 #include "private.h"
 #include "../include/gl.h"
@@ -128,16 +124,47 @@ static void recalculateNormalMatrix() {
     transpose((GLfloat*) NORMAL_MATRIX);
 }
 
+/* Inside glNewList matrix operations are recorded into the list, and with
+ * GL_COMPILE not applied, in which case this returns GL_TRUE */
+static GLboolean _glRecordMatrix(ListMatrixOp op, GLenum mode, const GLfloat* m) {
+    if(!_glIsCompilingList()) {
+        return GL_FALSE;
+    }
+
+    ListMatrix entry;
+    entry.op = op;
+    entry.mode = mode;
+
+    if(m) {
+        memcpy(entry.matrix, m, sizeof(Matrix4x4));
+    }
+
+    _glRecordListMatrix(&entry);
+    return !_glIsExecutingList();
+}
+
 void APIENTRY glMatrixMode(GLenum mode) {
+    if(_glRecordMatrix(LIST_MATRIX_MODE, mode, NULL)) {
+        return;
+    }
+
     MATRIX_MODE = mode;
     MATRIX_IDX = mode & 0xF;
 }
 
 void APIENTRY glPushMatrix() {
+    if(_glRecordMatrix(LIST_MATRIX_PUSH, 0, NULL)) {
+        return;
+    }
+
     stack_push(MATRIX_STACKS + MATRIX_IDX, stack_top(MATRIX_STACKS + MATRIX_IDX));
 }
 
 void APIENTRY glPopMatrix() {
+    if(_glRecordMatrix(LIST_MATRIX_POP, 0, NULL)) {
+        return;
+    }
+
     stack_pop(MATRIX_STACKS + MATRIX_IDX);
     if(MATRIX_MODE == GL_MODELVIEW) {
         recalculateNormalMatrix();
@@ -145,6 +172,10 @@ void APIENTRY glPopMatrix() {
 }
 
 void APIENTRY glLoadIdentity() {
+    if(_glRecordMatrix(LIST_MATRIX_LOAD, 0, IDENTITY)) {
+        return;
+    }
+
     stack_replace(MATRIX_STACKS + MATRIX_IDX, IDENTITY);
 }
 
@@ -160,6 +191,10 @@ void APIENTRY glTranslatef(GLfloat x, GLfloat y, GLfloat z) {
     trn[M13] = y;
     trn[M14] = z;
 
+    if(_glRecordMatrix(LIST_MATRIX_MULT, 0, trn)) {
+        return;
+    }
+
     upload_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
     multiply_matrix(&trn);
     download_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
@@ -182,6 +217,10 @@ void APIENTRY glScalef(GLfloat x, GLfloat y, GLfloat z) {
     scale[M5] = y;
     scale[M10] = z;
 
+    if(_glRecordMatrix(LIST_MATRIX_MULT, 0, scale)) {
+        return;
+    }
+
     upload_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
     multiply_matrix(&scale);
     download_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
@@ -225,6 +264,10 @@ void APIENTRY glRotatef(GLfloat angle, GLfloat x, GLfloat  y, GLfloat z) {
     rotate[M9] = yz * invc - xs;
     rotate[M10] = (z * z) * invc + c;
 
+    if(_glRecordMatrix(LIST_MATRIX_MULT, 0, rotate)) {
+        return;
+    }
+
     upload_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
     multiply_matrix(&rotate);
     download_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
@@ -258,6 +301,10 @@ void APIENTRY glLoadMatrixf(const GLfloat *m) {
     TEMP[M14] = m[14];
     TEMP[M15] = m[15];
 
+    if(_glRecordMatrix(LIST_MATRIX_LOAD, 0, TEMP)) {
+        return;
+    }
+
     stack_replace(MATRIX_STACKS + MATRIX_IDX, TEMP);
 
     if(MATRIX_MODE == GL_MODELVIEW) {
@@ -285,6 +332,10 @@ void APIENTRY glOrtho(GLfloat left, GLfloat right,
     OrthoMatrix[M13] = -(top + bottom) / (top - bottom);
     OrthoMatrix[M14] = -(zfar + znear) / (zfar - znear);
 
+    if(_glRecordMatrix(LIST_MATRIX_MULT, 0, OrthoMatrix)) {
+        return;
+    }
+
     upload_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
     multiply_matrix(&OrthoMatrix);
     download_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
@@ -316,6 +367,10 @@ void APIENTRY glFrustum(GLfloat left, GLfloat right,
     FrustumMatrix[M11] = -1.0f;
     FrustumMatrix[M14] = D;
 
+    if(_glRecordMatrix(LIST_MATRIX_MULT, 0, FrustumMatrix)) {
+        return;
+    }
+
     upload_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
     multiply_matrix(&FrustumMatrix);
     download_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
@@ -350,6 +405,10 @@ void glMultMatrixf(const GLfloat *m) {
     TEMP[M14] = m[14];
     TEMP[M15] = m[15];
 
+    if(_glRecordMatrix(LIST_MATRIX_MULT, 0, TEMP)) {
+        return;
+    }
+
     upload_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
     multiply_matrix((Matrix4x4*) &TEMP);
     download_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
@@ -390,6 +449,10 @@ void glLoadTransposeMatrixf(const GLfloat *m) {
     TEMP[M14] = m[11];
     TEMP[M15] = m[15];
 
+    if(_glRecordMatrix(LIST_MATRIX_LOAD, 0, TEMP)) {
+        return;
+    }
+
     stack_replace(MATRIX_STACKS + MATRIX_IDX, TEMP);
 
     if(MATRIX_MODE == GL_MODELVIEW) {
@@ -425,6 +488,10 @@ void glMultTransposeMatrixf(const GLfloat *m) {
     TEMP[M14] = m[11];
     TEMP[M15] = m[15];
 
+    if(_glRecordMatrix(LIST_MATRIX_MULT, 0, TEMP)) {
+        return;
+    }
+
     upload_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
     multiply_matrix(&TEMP);
     download_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
@@ -438,6 +505,40 @@ void glMultTransposeMatrixf(const GLfloat *m) {
     }
 }
 
+/* Replays a matrix operation recorded by _glRecordMatrix, which unlike the
+ * functions it came from always keeps the normal matrix and near plane up
+ * to date */
+void _glApplyListMatrix(const ListMatrix* matrix) {
+    switch(matrix->op) {
+        case LIST_MATRIX_MODE:
+            MATRIX_MODE = matrix->mode;
+            MATRIX_IDX = matrix->mode & 0xF;
+        return;
+        case LIST_MATRIX_PUSH:
+            stack_push(MATRIX_STACKS + MATRIX_IDX, stack_top(MATRIX_STACKS + MATRIX_IDX));
+        return;
+        case LIST_MATRIX_POP:
+            stack_pop(MATRIX_STACKS + MATRIX_IDX);
+        break;
+        case LIST_MATRIX_LOAD:
+            stack_replace(MATRIX_STACKS + MATRIX_IDX, matrix->matrix);
+        break;
+        case LIST_MATRIX_MULT:
+            upload_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
+            multiply_matrix((Matrix4x4*) &matrix->matrix);
+            download_matrix(stack_top(MATRIX_STACKS + MATRIX_IDX));
+        break;
+    }
+
+    if(MATRIX_MODE == GL_MODELVIEW) {
+        recalculateNormalMatrix();
+    }
+
+    if(MATRIX_MODE == GL_PROJECTION) {
+        _glStoreNearPlane();
+    }
+}
+
 /* Set the GL viewport */
 void APIENTRY glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
     gl_viewport_x1 = x;
@@ -464,6 +565,91 @@ GLfloat _glGetNearPlane() {
     return NEAR_PLANE_DISTANCE;
 }
 
+/* The six frustum planes (left, right, bottom, top, near, far) and then
+ * w = 0, which is what the near-Z clipper tests against, in object
+ * coordinates. Each is (a, b, c, d), a point is in front of the plane if
+ * ax + by + cz + d >= 0. They're the sums and differences of the rows of
+ * projection * modelview. */
+#define FRUSTUM_PLANES 6
+
+static void frustumPlanes(GLfloat planes[FRUSTUM_PLANES + 1][4]) {
+    static Matrix4x4 M __attribute__((aligned(32)));
+
+    upload_matrix(_glGetProjectionMatrix());
+    multiply_matrix(_glGetModelViewMatrix());
+    download_matrix(&M);
+
+    for(GLubyte i = 0; i < 4; ++i) {
+        const GLfloat x = M[i * 4 + 0];
+        const GLfloat y = M[i * 4 + 1];
+        const GLfloat z = M[i * 4 + 2];
+        const GLfloat w = M[i * 4 + 3];
+
+        planes[0][i] = w + x;
+        planes[1][i] = w - x;
+        planes[2][i] = w + y;
+        planes[3][i] = w - y;
+        planes[4][i] = w + z;
+        planes[5][i] = w - z;
+        planes[6][i] = w;
+    }
+}
+
+/* Classifies a volume from the nearest and furthest it gets in front of
+ * each plane */
+static GLubyte classify(const GLfloat nearest[FRUSTUM_PLANES + 1], const GLfloat furthest[FRUSTUM_PLANES + 1]) {
+    for(GLubyte i = 0; i < FRUSTUM_PLANES; ++i) {
+        if(furthest[i] < 0.0f) {
+            return BOUNDS_OUTSIDE;
+        }
+    }
+
+    return (nearest[FRUSTUM_PLANES] > 0.0f) ? BOUNDS_IN_FRONT : BOUNDS_CROSSES_W;
+}
+
+GLubyte _glClassifyBox(const GLfloat* min, const GLfloat* max) {
+    GLfloat planes[FRUSTUM_PLANES + 1][4];
+    GLfloat nearest[FRUSTUM_PLANES + 1];
+    GLfloat furthest[FRUSTUM_PLANES + 1];
+
+    frustumPlanes(planes);
+
+    /* The corner furthest along the plane's normal, and the one opposite */
+    for(GLubyte i = 0; i < FRUSTUM_PLANES + 1; ++i) {
+        const GLfloat* p = planes[i];
+        nearest[i] = furthest[i] = p[3];
+
+        for(GLubyte j = 0; j < 3; ++j) {
+            furthest[i] += p[j] * ((p[j] > 0.0f) ? max[j] : min[j]);
+            nearest[i] += p[j] * ((p[j] > 0.0f) ? min[j] : max[j]);
+        }
+    }
+
+    return classify(nearest, furthest);
+}
+
+GLubyte _glClassifySphere(const GLfloat* centre, GLfloat radius) {
+    GLfloat planes[FRUSTUM_PLANES + 1][4];
+    GLfloat nearest[FRUSTUM_PLANES + 1];
+    GLfloat furthest[FRUSTUM_PLANES + 1];
+
+    frustumPlanes(planes);
+
+    /* The planes aren't normalized, so scale the radius instead */
+    for(GLubyte i = 0; i < FRUSTUM_PLANES + 1; ++i) {
+        const GLfloat* p = planes[i];
+        const GLfloat d = p[0] * centre[0] + p[1] * centre[1] + p[2] * centre[2] + p[3];
+
+        GLfloat length;
+        vec3f_length(p[0], p[1], p[2], length);
+
+        nearest[i] = d - radius * length;
+        furthest[i] = d + radius * length;
+    }
+
+    return classify(nearest, furthest);
+}
+
 /* Set the depth range */
 void APIENTRY glDepthRange(GLclampf n, GLclampf f) {
     if(n < 0.0f) n = 0.0f;
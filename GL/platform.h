@@ -0,0 +1,29 @@
+#pragma once
+
+/*
+ * Everything that touches KOS, the PVR or the SH4 FPU goes through here. On the
+ * Dreamcast this just pulls in the KOS headers and a couple of SH4 specific
+ * helpers. Everywhere else (e.g. a Linux host) we use a software stand-in
+ * which implements the small part of the KOS API that GLdc uses and captures
+ * the TA command stream into memory rather than sending it anywhere.
+ */
+
+#ifdef _arch_dreamcast
+#include "platforms/sh4.h"
+#else
+#include "platforms/software.h"
+#endif
+
+/* Submit `n` 32-byte TA parameters to the list opened with pvr_list_begin */
+void pvr_list_submit(void* src, int n);
+
+/* Returns the offset of ptr from the start of video RAM. This is the address
+ * the PVR sees, and what ends up in polygon headers */
+uint32_t _glVRAMOffset(const void* ptr);
+
+/* Hardware performance counters for the profiler. Starts `counter` (0 or 1)
+ * counting the given ProfilerCounter event from zero. Returns 0 if the event
+ * can't be counted, in which case the counter reads as 0 */
+uint8_t _glPerfCounterStart(uint8_t counter, int event);
+void _glPerfCounterStop(uint8_t counter);
+uint64_t _glPerfCounterRead(uint8_t counter);
@@ -0,0 +1,810 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "rasterizer.h"
+
+#define TILE_SIZE RASTERIZER_TILE_SIZE
+#define NO_OWNER 0xFFFFFFFF
+
+/* Same layout as the Vertex struct in private.h, which in turn matches
+ * pvr_vertex_t */
+typedef struct {
+    uint32_t flags;
+    float xyz[3];
+    float uv[2];
+    uint8_t bgra[4];
+    uint32_t oargb;
+} RasterVertex;
+
+typedef struct {
+    uint32_t cmd;
+    uint32_t mode1;
+    uint32_t mode2;
+    uint32_t mode3;
+
+    /* Decoded from the above */
+    uint8_t depth_func;
+    uint8_t depth_write;
+    uint8_t culling;
+    uint8_t gouraud;
+    uint8_t use_alpha;
+    uint8_t textured;
+    uint8_t txr_alpha;
+    uint8_t filter;
+    uint8_t env;
+    uint8_t uv_clamp;
+    uint8_t uv_flip;
+    uint8_t src_blend;
+    uint8_t dst_blend;
+
+    uint32_t txr_width;
+    uint32_t txr_height;
+    uint32_t txr_format;
+    const uint8_t* txr_data;  /* Top mipmap level, or the codebook for VQ */
+    const uint8_t* txr_indices;  /* VQ indices */
+} RasterState;
+
+typedef struct {
+    const RasterState* state;
+
+    float x[3], y[3], z[3];
+    float u[3], v[3];
+    float colour[3][4];
+
+    float inv_area;
+    int minx, miny, maxx, maxy;
+} RasterTriangle;
+
+static inline float clamp01(float v) {
+    return (v < 0.0f) ? 0.0f : (v > 1.0f) ? 1.0f : v;
+}
+
+static inline void unpackARGB8888(uint32_t c, float* out) {
+    out[0] = ((c >> 16) & 0xFF) / 255.0f;
+    out[1] = ((c >> 8) & 0xFF) / 255.0f;
+    out[2] = ((c >> 0) & 0xFF) / 255.0f;
+    out[3] = ((c >> 24) & 0xFF) / 255.0f;
+}
+
+static inline uint32_t packARGB8888(const float* c) {
+    uint32_t r = (uint32_t) (clamp01(c[0]) * 255.0f + 0.5f);
+    uint32_t g = (uint32_t) (clamp01(c[1]) * 255.0f + 0.5f);
+    uint32_t b = (uint32_t) (clamp01(c[2]) * 255.0f + 0.5f);
+    uint32_t a = (uint32_t) (clamp01(c[3]) * 255.0f + 0.5f);
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static inline uint32_t expand5(uint32_t v) { return (v << 3) | (v >> 2); }
+static inline uint32_t expand6(uint32_t v) { return (v << 2) | (v >> 4); }
+static inline uint32_t expand4(uint32_t v) { return (v << 4) | v; }
+
+static uint32_t decode16(uint32_t format, uint16_t t) {
+    switch(format) {
+        case PVR_TXRFMT_ARGB1555:
+            return (((t & 0x8000) ? 0xFFu : 0u) << 24) |
+                   (expand5((t >> 10) & 0x1F) << 16) |
+                   (expand5((t >> 5) & 0x1F) << 8) |
+                   expand5(t & 0x1F);
+        case PVR_TXRFMT_RGB565:
+            return 0xFF000000 |
+                   (expand5((t >> 11) & 0x1F) << 16) |
+                   (expand6((t >> 5) & 0x3F) << 8) |
+                   expand5(t & 0x1F);
+        case PVR_TXRFMT_ARGB4444:
+            return (expand4((t >> 12) & 0xF) << 24) |
+                   (expand4((t >> 8) & 0xF) << 16) |
+                   (expand4((t >> 4) & 0xF) << 8) |
+                   expand4(t & 0xF);
+        default:
+            return 0xFFFFFFFF;
+    }
+}
+
+static uint32_t decodePaletteEntry(const PVRCapture* scene, uint32_t idx) {
+    const uint32_t entry = scene->palette[idx & 1023];
+
+    switch(scene->palette_format) {
+        case PVR_PAL_ARGB1555:
+            return decode16(PVR_TXRFMT_ARGB1555, entry & 0xFFFF);
+        case PVR_PAL_RGB565:
+            return decode16(PVR_TXRFMT_RGB565, entry & 0xFFFF);
+        case PVR_PAL_ARGB4444:
+            return decode16(PVR_TXRFMT_ARGB4444, entry & 0xFFFF);
+        default:
+            return entry;
+    }
+}
+
+static uint32_t decodeYUV(const uint16_t* pair, uint32_t odd) {
+    /* Pairs of texels are stored as (U, Y0), (V, Y1) */
+    const float u = (float) (pair[0] & 0xFF) - 128.0f;
+    const float v = (float) (pair[1] & 0xFF) - 128.0f;
+    const float y = (float) (pair[odd] >> 8);
+
+    float c[4] = {
+        (y + 1.375f * v) / 255.0f,
+        (y - 0.6875f * v - 0.34375f * u) / 255.0f,
+        (y + 1.71875f * u) / 255.0f,
+        1.0f
+    };
+
+    return packARGB8888(c);
+}
+
+static uint32_t log2u(uint32_t v) {
+    uint32_t r = 0;
+    while(v > 1) {
+        v >>= 1;
+        ++r;
+    }
+    return r;
+}
+
+/* Fetches a single texel as ARGB8888. x and y have already been wrapped */
+static uint32_t fetchTexel(const PVRCapture* scene, const RasterState* state, uint32_t x, uint32_t y) {
+    const uint32_t format = state->txr_format & (7 << 27);
+    const uint32_t w = state->txr_width;
+    const uint32_t h = state->txr_height;
+    const int twiddled = !(state->txr_format & PVR_TXRFMT_NONTWIDDLED) ||
+        format == PVR_TXRFMT_PAL4BPP || format == PVR_TXRFMT_PAL8BPP;
+
+    if(state->txr_format & PVR_TXRFMT_VQ_ENABLE) {
+        /* Each index byte selects a 2x2 block of twiddled texels from the codebook */
+        const uint32_t i = (twiddled) ?
+            pvr_twiddled_index(x / 2, y / 2, w / 2, h / 2) :
+            (y / 2) * (w / 2) + (x / 2);
+
+        const uint16_t* code = (const uint16_t*) (state->txr_data + state->txr_indices[i] * 8);
+        return decode16(format, code[((x & 1) << 1) | (y & 1)]);
+    }
+
+    const uint32_t i = (twiddled) ? pvr_twiddled_index(x, y, w, h) : y * w + x;
+
+    switch(format) {
+        case PVR_TXRFMT_PAL8BPP: {
+            const uint32_t bank = (state->txr_format >> 25) & 3;
+            return decodePaletteEntry(scene, bank * 256 + state->txr_data[i]);
+        }
+        case PVR_TXRFMT_PAL4BPP: {
+            const uint32_t bank = (state->txr_format >> 21) & 63;
+            const uint8_t b = state->txr_data[i / 2];
+            return decodePaletteEntry(scene, bank * 16 + ((i & 1) ? (b >> 4) : (b & 0xF)));
+        }
+        case PVR_TXRFMT_YUV422: {
+            const uint16_t* texels = (const uint16_t*) state->txr_data;
+            const uint32_t base = y * w + (x & ~1u);
+            const uint16_t pair[2] = {texels[base], texels[base + 1]};
+            return decodeYUV(pair, x & 1);
+        }
+        case PVR_TXRFMT_BUMP:
+            return 0xFFFFFFFF;
+        default:
+            return decode16(format, ((const uint16_t*) state->txr_data)[i]);
+    }
+}
+
+static inline int32_t wrapCoord(int32_t c, uint32_t size, int clamp, int flip) {
+    if(clamp) {
+        return (c < 0) ? 0 : (c >= (int32_t) size) ? (int32_t) size - 1 : c;
+    }
+
+    if(flip) {
+        const int32_t period = size * 2;
+        int32_t m = c % period;
+        if(m < 0) m += period;
+        return (m >= (int32_t) size) ? period - 1 - m : m;
+    }
+
+    int32_t m = c % (int32_t) size;
+    return (m < 0) ? m + size : m;
+}
+
+static void sampleTexture(Rasterizer* rasterizer, const PVRCapture* scene, const RasterState* state, float u, float v, float* out) {
+    const uint32_t w = state->txr_width;
+    const uint32_t h = state->txr_height;
+
+    const int clampU = (state->uv_clamp & PVR_UVCLAMP_U) != 0;
+    const int clampV = (state->uv_clamp & PVR_UVCLAMP_V) != 0;
+    const int flipU = (state->uv_flip & PVR_UVFLIP_U) != 0;
+    const int flipV = (state->uv_flip & PVR_UVFLIP_V) != 0;
+
+    if(state->filter == PVR_FILTER_NEAREST) {
+        const int32_t x = wrapCoord((int32_t) floorf(u * w), w, clampU, flipU);
+        const int32_t y = wrapCoord((int32_t) floorf(v * h), h, clampV, flipV);
+        unpackARGB8888(fetchTexel(scene, state, x, y), out);
+        rasterizer->stats.texel_fetches++;
+        return;
+    }
+
+    const float fu = u * w - 0.5f;
+    const float fv = v * h - 0.5f;
+    const float x0f = floorf(fu);
+    const float y0f = floorf(fv);
+    const float ax = fu - x0f;
+    const float ay = fv - y0f;
+
+    const int32_t x0 = wrapCoord((int32_t) x0f, w, clampU, flipU);
+    const int32_t x1 = wrapCoord((int32_t) x0f + 1, w, clampU, flipU);
+    const int32_t y0 = wrapCoord((int32_t) y0f, h, clampV, flipV);
+    const int32_t y1 = wrapCoord((int32_t) y0f + 1, h, clampV, flipV);
+
+    float t00[4], t10[4], t01[4], t11[4];
+    unpackARGB8888(fetchTexel(scene, state, x0, y0), t00);
+    unpackARGB8888(fetchTexel(scene, state, x1, y0), t10);
+    unpackARGB8888(fetchTexel(scene, state, x0, y1), t01);
+    unpackARGB8888(fetchTexel(scene, state, x1, y1), t11);
+    rasterizer->stats.texel_fetches += 4;
+
+    for(int i = 0; i < 4; ++i) {
+        const float top = t00[i] + (t10[i] - t00[i]) * ax;
+        const float bottom = t01[i] + (t11[i] - t01[i]) * ax;
+        out[i] = top + (bottom - top) * ay;
+    }
+}
+
+static void decodeHeader(const PVRCapture* scene, const pvr_poly_hdr_t* hdr, RasterState* state) {
+    memset(state, 0, sizeof(RasterState));
+
+    state->cmd = hdr->cmd;
+    state->mode1 = hdr->mode1;
+    state->mode2 = hdr->mode2;
+    state->mode3 = hdr->mode3;
+
+    state->gouraud = (hdr->cmd & PVR_TA_CMD_SHADE_MASK) != 0;
+
+    state->depth_func = (hdr->mode1 & PVR_TA_PM1_DEPTHCMP_MASK) >> PVR_TA_PM1_DEPTHCMP_SHIFT;
+    state->culling = (hdr->mode1 & PVR_TA_PM1_CULLING_MASK) >> PVR_TA_PM1_CULLING_SHIFT;
+    state->depth_write = ((hdr->mode1 & PVR_TA_PM1_DEPTHWRITE_MASK) >> PVR_TA_PM1_DEPTHWRITE_SHIFT) == PVR_DEPTHWRITE_ENABLE;
+    state->textured = (hdr->mode1 & PVR_TA_PM1_TXRENABLE_MASK) != 0;
+
+    state->src_blend = (hdr->mode2 & PVR_TA_PM2_SRCBLEND_MASK) >> PVR_TA_PM2_SRCBLEND_SHIFT;
+    state->dst_blend = (hdr->mode2 & PVR_TA_PM2_DSTBLEND_MASK) >> PVR_TA_PM2_DSTBLEND_SHIFT;
+    state->use_alpha = (hdr->mode2 & PVR_TA_PM2_ALPHA_MASK) != 0;
+
+    if(!state->textured) {
+        return;
+    }
+
+    state->txr_alpha = ((hdr->mode2 & PVR_TA_PM2_TXRALPHA_MASK) >> PVR_TA_PM2_TXRALPHA_SHIFT) == PVR_TXRALPHA_ENABLE;
+    state->uv_flip = (hdr->mode2 & PVR_TA_PM2_UVFLIP_MASK) >> PVR_TA_PM2_UVFLIP_SHIFT;
+    state->uv_clamp = (hdr->mode2 & PVR_TA_PM2_UVCLAMP_MASK) >> PVR_TA_PM2_UVCLAMP_SHIFT;
+    state->filter = (hdr->mode2 & PVR_TA_PM2_FILTER_MASK) >> PVR_TA_PM2_FILTER_SHIFT;
+    state->env = (hdr->mode2 & PVR_TA_PM2_TXRENV_MASK) >> PVR_TA_PM2_TXRENV_SHIFT;
+    state->txr_width = 8 << ((hdr->mode2 & PVR_TA_PM2_USIZE_MASK) >> PVR_TA_PM2_USIZE_SHIFT);
+    state->txr_height = 8 << ((hdr->mode2 & PVR_TA_PM2_VSIZE_MASK) >> PVR_TA_PM2_VSIZE_SHIFT);
+    state->txr_format = hdr->mode3 & ~(PVR_TA_PM3_MIPMAP_MASK | 0x1FFFFF);
+
+    const uint8_t* base = scene->vram + ((hdr->mode3 & 0x1FFFFF) << 3);
+    const int mipmapped = (hdr->mode3 & PVR_TA_PM3_MIPMAP_MASK) != 0;
+    const uint32_t format = state->txr_format & (7 << 27);
+
+    /* Mipmap chains are stored smallest first, so the level we want is at the end.
+     * These offsets match those in texture.c */
+    const uint32_t n = log2u(state->txr_width);
+    const uint32_t level_texels = (n) ? ((1u << (2 * n)) - 1) / 3 : 0;
+
+    if(state->txr_format & PVR_TXRFMT_VQ_ENABLE) {
+        state->txr_data = base;
+        state->txr_indices = base + 2048;
+
+        if(mipmapped && n) {
+            state->txr_indices += 1 + ((1u << (2 * (n - 1))) - 1) / 3;
+        }
+    } else if(format == PVR_TXRFMT_PAL8BPP) {
+        state->txr_data = base + ((mipmapped) ? 3 + level_texels : 0);
+    } else if(format == PVR_TXRFMT_PAL4BPP) {
+        state->txr_data = base + ((mipmapped) ? (3 + level_texels) / 2 : 0);
+    } else {
+        state->txr_data = base + ((mipmapped) ? 6 + level_texels * 2 : 0);
+    }
+}
+
+static inline int depthTest(uint8_t func, float incoming, float stored) {
+    switch(func) {
+        case PVR_DEPTHCMP_NEVER: return 0;
+        case PVR_DEPTHCMP_LESS: return incoming < stored;
+        case PVR_DEPTHCMP_EQUAL: return incoming == stored;
+        case PVR_DEPTHCMP_LEQUAL: return incoming <= stored;
+        case PVR_DEPTHCMP_GREATER: return incoming > stored;
+        case PVR_DEPTHCMP_NOTEQUAL: return incoming != stored;
+        case PVR_DEPTHCMP_GEQUAL: return incoming >= stored;
+        default: return 1;
+    }
+}
+
+static inline float edge(float ax, float ay, float bx, float by, float px, float py) {
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+/* Pixels exactly on an edge belong to only one of the triangles sharing it */
+static inline int edgeOwns(float e, float dx, float dy) {
+    return e > 0.0f || (e == 0.0f && (dy > 0.0f || (dy == 0.0f && dx < 0.0f)));
+}
+
+static void setupTriangle(Rasterizer* rasterizer, const RasterState* state, const RasterVertex* v0, const RasterVertex* v1, const RasterVertex* v2) {
+    float area = edge(v0->xyz[0], v0->xyz[1], v1->xyz[0], v1->xyz[1], v2->xyz[0], v2->xyz[1]);
+
+    /* A positive area here means the polygon is clockwise on screen */
+    if((state->culling == PVR_CULLING_CW && area > 0.0f) ||
+       (state->culling == PVR_CULLING_CCW && area < 0.0f) ||
+       fabsf(area) < 1e-8f || isnan(area)) {
+        rasterizer->stats.triangles_culled++;
+        return;
+    }
+
+    RasterTriangle tri;
+    tri.state = state;
+
+    /* Flat shading uses the colour of the last vertex */
+    const RasterVertex* in[3] = {v0, v1, v2};
+    if(area < 0.0f) {
+        in[1] = v2;
+        in[2] = v1;
+        area = -area;
+    }
+
+    for(int i = 0; i < 3; ++i) {
+        tri.x[i] = in[i]->xyz[0];
+        tri.y[i] = in[i]->xyz[1];
+        tri.z[i] = in[i]->xyz[2];
+        tri.u[i] = in[i]->uv[0];
+        tri.v[i] = in[i]->uv[1];
+
+        const uint8_t* c = (state->gouraud) ? in[i]->bgra : v2->bgra;
+        tri.colour[i][0] = c[2] / 255.0f;
+        tri.colour[i][1] = c[1] / 255.0f;
+        tri.colour[i][2] = c[0] / 255.0f;
+        tri.colour[i][3] = c[3] / 255.0f;
+    }
+
+    tri.inv_area = 1.0f / area;
+
+    float minx = fminf(tri.x[0], fminf(tri.x[1], tri.x[2]));
+    float maxx = fmaxf(tri.x[0], fmaxf(tri.x[1], tri.x[2]));
+    float miny = fminf(tri.y[0], fminf(tri.y[1], tri.y[2]));
+    float maxy = fmaxf(tri.y[0], fmaxf(tri.y[1], tri.y[2]));
+
+    tri.minx = (int) fmaxf(floorf(minx), 0.0f);
+    tri.miny = (int) fmaxf(floorf(miny), 0.0f);
+    tri.maxx = (int) fminf(ceilf(maxx), (float) rasterizer->width - 1);
+    tri.maxy = (int) fminf(ceilf(maxy), (float) rasterizer->height - 1);
+
+    if(tri.minx > tri.maxx || tri.miny > tri.maxy) {
+        rasterizer->stats.triangles_culled++;
+        return;
+    }
+
+    aligned_vector_push_back(&rasterizer->triangles, &tri, 1);
+    rasterizer->stats.triangles++;
+}
+
+static void setupList(Rasterizer* rasterizer, const PVRCapture* scene, const PVRCaptureList* list, AlignedVector* states) {
+    const uint8_t* it = list->commands.data;
+    const uint8_t* end = it + list->commands.size * 32;
+
+    const RasterVertex* strip[2] = {NULL, NULL};
+    uint32_t strip_length = 0;
+    const RasterState* state = NULL;
+
+    for(; it < end; it += 32) {
+        const uint32_t cmd = *((const uint32_t*) it);
+        const uint32_t type = cmd >> 29;
+
+        if(type == 4 || type == 5) {
+            /* Polygon or sprite header. States live until the end of the frame */
+            RasterState* s = (RasterState*) malloc(sizeof(RasterState));
+            decodeHeader(scene, (const pvr_poly_hdr_t*) it, s);
+            aligned_vector_push_back(states, &s, 1);
+            state = s;
+            strip_length = 0;
+        } else if(type == 7) {
+            const RasterVertex* v = (const RasterVertex*) it;
+
+            if(state && strip_length >= 2) {
+                /* Every other triangle in a strip has reversed winding */
+                if(strip_length & 1) {
+                    setupTriangle(rasterizer, state, strip[1], strip[0], v);
+                } else {
+                    setupTriangle(rasterizer, state, strip[0], strip[1], v);
+                }
+            }
+
+            strip[0] = strip[1];
+            strip[1] = v;
+            strip_length++;
+
+            if(cmd & 0x10000000) {
+                /* End of strip */
+                strip_length = 0;
+            }
+        }
+    }
+}
+
+static void binTriangles(Rasterizer* rasterizer, uint32_t first, AlignedVector* tiles) {
+    const uint32_t tiles_x = (rasterizer->width + TILE_SIZE - 1) / TILE_SIZE;
+
+    for(uint32_t i = first; i < rasterizer->triangles.size; ++i) {
+        const RasterTriangle* tri = aligned_vector_at(&rasterizer->triangles, i);
+
+        for(int ty = tri->miny / TILE_SIZE; ty <= tri->maxy / TILE_SIZE; ++ty) {
+            for(int tx = tri->minx / TILE_SIZE; tx <= tri->maxx / TILE_SIZE; ++tx) {
+                aligned_vector_push_back(&tiles[ty * tiles_x + tx], &i, 1);
+                rasterizer->stats.tile_bins++;
+            }
+        }
+    }
+}
+
+typedef struct {
+    float z;
+    float b[3];  /* Perspective corrected barycentrics */
+} Fragment;
+
+/* Returns 1 if the pixel centre of (x, y) is covered */
+static inline int coverage(const RasterTriangle* tri, int x, int y, Fragment* frag) {
+    const float px = x + 0.5f;
+    const float py = y + 0.5f;
+
+    const float e0 = edge(tri->x[1], tri->y[1], tri->x[2], tri->y[2], px, py);
+    const float e1 = edge(tri->x[2], tri->y[2], tri->x[0], tri->y[0], px, py);
+    const float e2 = edge(tri->x[0], tri->y[0], tri->x[1], tri->y[1], px, py);
+
+    if(!edgeOwns(e0, tri->x[2] - tri->x[1], tri->y[2] - tri->y[1]) ||
+       !edgeOwns(e1, tri->x[0] - tri->x[2], tri->y[0] - tri->y[2]) ||
+       !edgeOwns(e2, tri->x[1] - tri->x[0], tri->y[1] - tri->y[0])) {
+        return 0;
+    }
+
+    const float b0 = e0 * tri->inv_area;
+    const float b1 = e1 * tri->inv_area;
+    const float b2 = e2 * tri->inv_area;
+
+    frag->z = b0 * tri->z[0] + b1 * tri->z[1] + b2 * tri->z[2];
+
+    /* The PVR treats Z as 1/w when interpolating */
+    if(frag->z > 0.0f) {
+        const float iz = 1.0f / frag->z;
+        frag->b[0] = b0 * tri->z[0] * iz;
+        frag->b[1] = b1 * tri->z[1] * iz;
+        frag->b[2] = b2 * tri->z[2] * iz;
+    } else {
+        frag->b[0] = b0;
+        frag->b[1] = b1;
+        frag->b[2] = b2;
+    }
+
+    return 1;
+}
+
+static void shade(Rasterizer* rasterizer, const PVRCapture* scene, const RasterTriangle* tri, const Fragment* frag, float* out) {
+    const RasterState* state = tri->state;
+    const float* b = frag->b;
+
+    for(int i = 0; i < 4; ++i) {
+        out[i] = b[0] * tri->colour[0][i] + b[1] * tri->colour[1][i] + b[2] * tri->colour[2][i];
+    }
+
+    if(!state->use_alpha) {
+        out[3] = 1.0f;
+    }
+
+    rasterizer->stats.tsp_fragments++;
+
+    if(!state->textured) {
+        return;
+    }
+
+    float t[4];
+    const float u = b[0] * tri->u[0] + b[1] * tri->u[1] + b[2] * tri->u[2];
+    const float v = b[0] * tri->v[0] + b[1] * tri->v[1] + b[2] * tri->v[2];
+    sampleTexture(rasterizer, scene, state, u, v, t);
+
+    if(!state->txr_alpha) {
+        t[3] = 1.0f;
+    }
+
+    switch(state->env) {
+        case PVR_TXRENV_REPLACE:
+            memcpy(out, t, sizeof(float) * 4);
+        break;
+        case PVR_TXRENV_MODULATE:
+            out[0] *= t[0];
+            out[1] *= t[1];
+            out[2] *= t[2];
+            out[3] = t[3];
+        break;
+        case PVR_TXRENV_DECAL:
+            for(int i = 0; i < 3; ++i) {
+                out[i] = t[i] * t[3] + out[i] * (1.0f - t[3]);
+            }
+        break;
+        case PVR_TXRENV_MODULATEALPHA:
+        default:
+            for(int i = 0; i < 4; ++i) {
+                out[i] *= t[i];
+            }
+        break;
+    }
+}
+
+static inline float blendFactor(uint8_t factor, int is_src, const float* src, const float* dst, int channel) {
+    /* The "colour" factors refer to the *other* colour */
+    const float* other = (is_src) ? dst : src;
+
+    switch(factor) {
+        case PVR_BLEND_ZERO: return 0.0f;
+        case PVR_BLEND_ONE: return 1.0f;
+        case PVR_BLEND_DESTCOLOR: return other[channel];
+        case PVR_BLEND_INVDESTCOLOR: return 1.0f - other[channel];
+        case PVR_BLEND_SRCALPHA: return src[3];
+        case PVR_BLEND_INVSRCALPHA: return 1.0f - src[3];
+        case PVR_BLEND_DESTALPHA: return dst[3];
+        case PVR_BLEND_INVDESTALPHA:
+        default:
+            return 1.0f - dst[3];
+    }
+}
+
+static void renderOpaqueTile(Rasterizer* rasterizer, const PVRCapture* scene, AlignedVector* bin, int x0, int y0, int x1, int y1) {
+    /* The ISP works out which polygon is visible at each pixel, and then
+     * only those pixels get textured */
+    static uint32_t owner[TILE_SIZE * TILE_SIZE];
+    static Fragment fragments[TILE_SIZE * TILE_SIZE];
+
+    for(int i = 0; i < TILE_SIZE * TILE_SIZE; ++i) {
+        owner[i] = NO_OWNER;
+    }
+
+    for(uint32_t i = 0; i < bin->size; ++i) {
+        const uint32_t idx = *((uint32_t*) aligned_vector_at(bin, i));
+        const RasterTriangle* tri = aligned_vector_at(&rasterizer->triangles, idx);
+
+        for(int y = y0; y < y1; ++y) {
+            for(int x = x0; x < x1; ++x) {
+                Fragment frag;
+                if(!coverage(tri, x, y, &frag)) {
+                    continue;
+                }
+
+                rasterizer->stats.isp_fragments++;
+
+                float* depth = &rasterizer->depth[y * rasterizer->width + x];
+                if(!depthTest(tri->state->depth_func, frag.z, *depth)) {
+                    continue;
+                }
+
+                if(tri->state->depth_write) {
+                    *depth = frag.z;
+                }
+
+                const int t = (y - y0) * TILE_SIZE + (x - x0);
+                owner[t] = idx;
+                fragments[t] = frag;
+            }
+        }
+    }
+
+    for(int y = y0; y < y1; ++y) {
+        for(int x = x0; x < x1; ++x) {
+            const int t = (y - y0) * TILE_SIZE + (x - x0);
+            if(owner[t] == NO_OWNER) {
+                continue;
+            }
+
+            float c[4];
+            const RasterTriangle* tri = aligned_vector_at(&rasterizer->triangles, owner[t]);
+            shade(rasterizer, scene, tri, &fragments[t], c);
+            rasterizer->colour[y * rasterizer->width + x] = packARGB8888(c);
+        }
+    }
+}
+
+static void renderTile(Rasterizer* rasterizer, const PVRCapture* scene, AlignedVector* bin, int list, int x0, int y0, int x1, int y1) {
+    const float alpha_ref = scene->pt_alpha_ref / 255.0f;
+
+    for(uint32_t i = 0; i < bin->size; ++i) {
+        const uint32_t idx = *((uint32_t*) aligned_vector_at(bin, i));
+        const RasterTriangle* tri = aligned_vector_at(&rasterizer->triangles, idx);
+        const RasterState* state = tri->state;
+
+        for(int y = y0; y < y1; ++y) {
+            for(int x = x0; x < x1; ++x) {
+                Fragment frag;
+                if(!coverage(tri, x, y, &frag)) {
+                    continue;
+                }
+
+                rasterizer->stats.isp_fragments++;
+
+                const uint32_t p = y * rasterizer->width + x;
+                if(!depthTest(state->depth_func, frag.z, rasterizer->depth[p])) {
+                    continue;
+                }
+
+                float src[4];
+                shade(rasterizer, scene, tri, &frag, src);
+
+                if(list == PVR_LIST_PT_POLY) {
+                    if(src[3] < alpha_ref) {
+                        continue;
+                    }
+
+                    rasterizer->colour[p] = packARGB8888(src);
+                } else {
+                    float dst[4], out[4];
+                    unpackARGB8888(rasterizer->colour[p], dst);
+
+                    for(int c = 0; c < 4; ++c) {
+                        out[c] = src[c] * blendFactor(state->src_blend, 1, src, dst, c) +
+                                 dst[c] * blendFactor(state->dst_blend, 0, src, dst, c);
+                    }
+
+                    rasterizer->colour[p] = packARGB8888(out);
+                    rasterizer->stats.blended_fragments++;
+                }
+
+                if(state->depth_write) {
+                    rasterizer->depth[p] = frag.z;
+                }
+            }
+        }
+    }
+}
+
+void rasterizer_init(Rasterizer* rasterizer, uint32_t width, uint32_t height) {
+    memset(rasterizer, 0, sizeof(Rasterizer));
+
+    rasterizer->width = width;
+    rasterizer->height = height;
+    rasterizer->colour = (uint32_t*) malloc(sizeof(uint32_t) * width * height);
+    rasterizer->depth = (float*) malloc(sizeof(float) * width * height);
+
+    aligned_vector_init(&rasterizer->triangles, sizeof(RasterTriangle));
+
+    const uint32_t tile_count =
+        ((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE);
+
+    for(int l = 0; l < PVR_LIST_COUNT; ++l) {
+        rasterizer->tiles[l] = (AlignedVector*) malloc(sizeof(AlignedVector) * tile_count);
+        for(uint32_t i = 0; i < tile_count; ++i) {
+            aligned_vector_init(&rasterizer->tiles[l][i], sizeof(uint32_t));
+        }
+    }
+}
+
+void rasterizer_cleanup(Rasterizer* rasterizer) {
+    const uint32_t tile_count =
+        ((rasterizer->width + TILE_SIZE - 1) / TILE_SIZE) * ((rasterizer->height + TILE_SIZE - 1) / TILE_SIZE);
+
+    for(int l = 0; l < PVR_LIST_COUNT; ++l) {
+        for(uint32_t i = 0; i < tile_count; ++i) {
+            aligned_vector_cleanup(&rasterizer->tiles[l][i]);
+        }
+        free(rasterizer->tiles[l]);
+    }
+
+    aligned_vector_cleanup(&rasterizer->triangles);
+    free(rasterizer->colour);
+    free(rasterizer->depth);
+}
+
+void rasterizer_render(Rasterizer* rasterizer, const PVRCapture* scene) {
+    const uint32_t tiles_x = (rasterizer->width + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t tiles_y = (rasterizer->height + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t tile_count = tiles_x * tiles_y;
+
+    memset(&rasterizer->stats, 0, sizeof(RasterizerStats));
+
+    float bg[4] = {scene->bg_color[0], scene->bg_color[1], scene->bg_color[2], 1.0f};
+    const uint32_t clear = packARGB8888(bg);
+    for(uint32_t i = 0; i < rasterizer->width * rasterizer->height; ++i) {
+        rasterizer->colour[i] = clear;
+        rasterizer->depth[i] = 0.0f;
+    }
+
+    /* Decode and bin everything first, as the TA would */
+    AlignedVector states;
+    aligned_vector_init(&states, sizeof(RasterState*));
+    aligned_vector_clear(&rasterizer->triangles);
+
+    static const int LISTS[] = {PVR_LIST_OP_POLY, PVR_LIST_PT_POLY, PVR_LIST_TR_POLY};
+
+    for(int l = 0; l < 3; ++l) {
+        const int list = LISTS[l];
+
+        for(uint32_t i = 0; i < tile_count; ++i) {
+            aligned_vector_clear(&rasterizer->tiles[list][i]);
+        }
+
+        const uint32_t first = rasterizer->triangles.size;
+        setupList(rasterizer, scene, &scene->lists[list], &states);
+        binTriangles(rasterizer, first, rasterizer->tiles[list]);
+    }
+
+    for(uint32_t ty = 0; ty < tiles_y; ++ty) {
+        for(uint32_t tx = 0; tx < tiles_x; ++tx) {
+            const uint32_t t = ty * tiles_x + tx;
+            const int x0 = tx * TILE_SIZE;
+            const int y0 = ty * TILE_SIZE;
+            const int x1 = (x0 + TILE_SIZE > (int) rasterizer->width) ? (int) rasterizer->width : x0 + TILE_SIZE;
+            const int y1 = (y0 + TILE_SIZE > (int) rasterizer->height) ? (int) rasterizer->height : y0 + TILE_SIZE;
+
+            AlignedVector* op = &rasterizer->tiles[PVR_LIST_OP_POLY][t];
+            AlignedVector* pt = &rasterizer->tiles[PVR_LIST_PT_POLY][t];
+            AlignedVector* tr = &rasterizer->tiles[PVR_LIST_TR_POLY][t];
+
+            if(op->size || pt->size || tr->size) {
+                rasterizer->stats.tiles_touched++;
+            }
+
+            renderOpaqueTile(rasterizer, scene, op, x0, y0, x1, y1);
+            renderTile(rasterizer, scene, pt, PVR_LIST_PT_POLY, x0, y0, x1, y1);
+            renderTile(rasterizer, scene, tr, PVR_LIST_TR_POLY, x0, y0, x1, y1);
+        }
+    }
+
+    for(uint32_t i = 0; i < states.size; ++i) {
+        free(*((RasterState**) aligned_vector_at(&states, i)));
+    }
+
+    aligned_vector_cleanup(&states);
+}
+
+int rasterizer_write_ppm(const Rasterizer* rasterizer, const char* filename) {
+    FILE* f = fopen(filename, "wb");
+    if(!f) {
+        return -1;
+    }
+
+    fprintf(f, "P6\n%u %u\n255\n", rasterizer->width, rasterizer->height);
+
+    for(uint32_t i = 0; i < rasterizer->width * rasterizer->height; ++i) {
+        const uint32_t c = rasterizer->colour[i];
+        const uint8_t rgb[3] = {(c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF};
+        fwrite(rgb, 1, 3, f);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+int rasterizer_compare_ppm(const Rasterizer* rasterizer, const char* filename, uint8_t tolerance) {
+    FILE* f = fopen(filename, "rb");
+    if(!f) {
+        return -1;
+    }
+
+    uint32_t w, h, max;
+    if(fscanf(f, "P6 %u %u %u", &w, &h, &max) != 3 || w != rasterizer->width || h != rasterizer->height || max != 255) {
+        fclose(f);
+        return -1;
+    }
+
+    /* Single whitespace character before the data */
+    fgetc(f);
+
+    int different = 0;
+    for(uint32_t i = 0; i < w * h; ++i) {
+        uint8_t rgb[3];
+        if(fread(rgb, 1, 3, f) != 3) {
+            fclose(f);
+            return -1;
+        }
+
+        const uint32_t c = rasterizer->colour[i];
+        const int dr = abs((int) ((c >> 16) & 0xFF) - rgb[0]);
+        const int dg = abs((int) ((c >> 8) & 0xFF) - rgb[1]);
+        const int db = abs((int) (c & 0xFF) - rgb[2]);
+
+        if(dr > tolerance || dg > tolerance || db > tolerance) {
+            ++different;
+        }
+    }
+
+    fclose(f);
+    return different;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+ * A reference rasterizer for scenes captured by the software platform.
+ *
+ * This consumes the same 32-byte header/vertex stream that the TA would
+ * receive and renders it roughly the way the PVR does: polygons are binned
+ * into 32x32 tiles, then each tile renders the OP, PT and TR lists in that
+ * order. Opaque polygons are depth sorted before shading (so hidden pixels are
+ * never textured) just like the ISP/TSP split on the hardware.
+ *
+ * It's not cycle accurate, and doesn't try to be pixel-exact with real
+ * hardware, it exists so that changes to the pipeline can be checked against
+ * a known good image and so we can compare the fill cost of different ways
+ * of submitting the same scene.
+ *
+ * Known differences from the hardware:
+ *  - Translucent polygons are rendered in submission order (no autosort)
+ *  - Fog, modifier volumes and the secondary accumulation buffer are ignored
+ *  - Trilinear filtering is treated as bilinear
+ */
+
+#include <stdint.h>
+
+#include "software.h"
+
+#define RASTERIZER_TILE_SIZE 32
+
+typedef struct {
+    /* Number of tiles which had at least one polygon binned */
+    uint32_t tiles_touched;
+
+    /* Triangles which made it through culling and were binned */
+    uint32_t triangles;
+    uint32_t triangles_culled;
+
+    /* Sum over all triangles of the number of tiles they touch */
+    uint32_t tile_bins;
+
+    /* Pixels covered by a triangle, and so depth tested (ISP) */
+    uint64_t isp_fragments;
+
+    /* Pixels which were textured/shaded (TSP) */
+    uint64_t tsp_fragments;
+
+    /* Of those, how many were blended with the framebuffer */
+    uint64_t blended_fragments;
+
+    uint64_t texel_fetches;
+} RasterizerStats;
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+
+    uint32_t* colour;  /* ARGB8888, width * height */
+    float* depth;      /* 1/w, larger is nearer */
+
+    RasterizerStats stats;
+
+    /* Internal: binned triangles */
+    AlignedVector triangles;
+    AlignedVector* tiles[PVR_LIST_COUNT];
+} Rasterizer;
+
+void rasterizer_init(Rasterizer* rasterizer, uint32_t width, uint32_t height);
+void rasterizer_cleanup(Rasterizer* rasterizer);
+
+/* Renders a captured scene, resetting the framebuffer and stats first */
+void rasterizer_render(Rasterizer* rasterizer, const PVRCapture* scene);
+
+/* Writes the colour buffer as a binary (P6) PPM. Returns 0 on success */
+int rasterizer_write_ppm(const Rasterizer* rasterizer, const char* filename);
+
+/* Compares the colour buffer to a PPM previously written by rasterizer_write_ppm.
+ * Returns the number of pixels where any channel differs by more than
+ * tolerance, or -1 if the file couldn't be read or the sizes don't match */
+int rasterizer_compare_ppm(const Rasterizer* rasterizer, const char* filename, uint8_t tolerance);
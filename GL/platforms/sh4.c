@@ -0,0 +1,93 @@
+#include "../platform.h"
+#include "../profiler.h"
+
+#define TA_SQ_ADDR (unsigned int *)(void *) \
+    (0xe0000000 | (((unsigned long)0x10000000) & 0x03ffffe0))
+
+#define QACRTA ((((unsigned int)0x10000000)>>26)<<2)&0x1c
+
+void pvr_list_submit(void *src, int n) {
+    unsigned int *d = TA_SQ_ADDR;
+    unsigned int *s = src;
+
+    /* Point both store queues at the TA */
+    QACR0 = QACRTA;
+    QACR1 = QACRTA;
+
+    /* fill/write queues as many times necessary */
+    while(n--) {
+        __asm__("pref @%0" : : "r"(s + 8));  /* prefetch 32 bytes for next loop */
+        d[0] = *(s++);
+        d[1] = *(s++);
+        d[2] = *(s++);
+        d[3] = *(s++);
+        d[4] = *(s++);
+        d[5] = *(s++);
+        d[6] = *(s++);
+        d[7] = *(s++);
+        __asm__("pref @%0" : : "r"(d));
+        d += 8;
+    }
+
+    /* Wait for both store queues to complete */
+    d = (unsigned int *)0xe0000000;
+    d[0] = d[8] = 0;
+}
+
+uint32_t _glVRAMOffset(const void* ptr) {
+    return ((uint32_t) ptr) & 0x00FFFFFF;
+}
+
+/* SH4 performance counter registers. The counters are 48 bits, split
+ * across a high and low register */
+#define PMCR_CTRL(o)  (*((volatile uint16_t*) (0xFF000084 + ((o) << 2))))
+#define PMCTR_HIGH(o) (*((volatile uint32_t*) (0xFF100004 + ((o) << 3))))
+#define PMCTR_LOW(o)  (*((volatile uint32_t*) (0xFF100008 + ((o) << 3))))
+
+#define PMCR_CLR        0x2000
+#define PMCR_RUN        0xC000
+
+/* Indexed by ProfilerCounter, counting CPU cycles rather than bus cycles */
+static const uint16_t PMCR_MODES[PROFILER_COUNTER_COUNT] = {
+    0x00,   /* None */
+    0x23,   /* Elapsed time */
+    0x13,   /* Instructions issued */
+    0x15,   /* FPU instructions issued */
+    0x0F,   /* Operand cache misses (read and write) */
+    0x08,   /* Instruction cache misses */
+    0x25,   /* Pipeline freeze by operand cache miss */
+    0x29    /* Pipeline freeze by FPU */
+};
+
+uint8_t _glPerfCounterStart(uint8_t counter, int event) {
+    if(counter > 1 || event <= PROFILER_COUNTER_NONE || event >= PROFILER_COUNTER_COUNT) {
+        return 0;
+    }
+
+    PMCR_CTRL(counter) = PMCR_CLR;
+    PMCR_CTRL(counter) = PMCR_RUN | PMCR_MODES[event];
+    return 1;
+}
+
+void _glPerfCounterStop(uint8_t counter) {
+    if(counter > 1) {
+        return;
+    }
+
+    PMCR_CTRL(counter) = 0;
+}
+
+uint64_t _glPerfCounterRead(uint8_t counter) {
+    if(counter > 1) {
+        return 0;
+    }
+
+    /* Re-read the high half in case the low half wrapped in between */
+    uint32_t high, low;
+    do {
+        high = PMCTR_HIGH(counter);
+        low = PMCTR_LOW(counter);
+    } while(high != PMCTR_HIGH(counter));
+
+    return ((uint64_t) (high & 0xFFFF) << 32) | low;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <kos.h>
+#include <dc/matrix.h>
+#include <dc/pvr.h>
+#include <dc/vec3f.h>
+#include <dc/fmath.h>
+#include <dc/matrix3d.h>
+#include <dc/video.h>
+
+/* There was a bug in this macro that shipped with Kos
+ * which has now been fixed. But just in case...
+ */
+#undef mat_trans_single3_nodiv
+#define mat_trans_single3_nodiv(x, y, z) { \
+    register float __x __asm__("fr12") = (x); \
+    register float __y __asm__("fr13") = (y); \
+    register float __z __asm__("fr14") = (z); \
+    __asm__ __volatile__( \
+                          "fldi1 fr15\n" \
+                          "ftrv  xmtrx, fv12\n" \
+                          : "=f" (__x), "=f" (__y), "=f" (__z) \
+                          : "0" (__x), "1" (__y), "2" (__z) \
+                          : "fr15"); \
+    x = __x; y = __y; z = __z; \
+}
+
+
+/* FIXME: Is this right? Shouldn't it be fr12->15? */
+#undef mat_trans_normal3
+#define mat_trans_normal3(x, y, z) { \
+    register float __x __asm__("fr8") = (x); \
+    register float __y __asm__("fr9") = (y); \
+    register float __z __asm__("fr10") = (z); \
+    __asm__ __volatile__( \
+                          "fldi0 fr11\n" \
+                          "ftrv  xmtrx, fv8\n" \
+                          : "=f" (__x), "=f" (__y), "=f" (__z) \
+                          : "0" (__x), "1" (__y), "2" (__z) \
+                          : "fr11"); \
+    x = __x; y = __y; z = __z; \
+}
+
+#define mat_trans_fv12() { \
+        __asm__ __volatile__( \
+                              "fldi1 fr15\n" \
+                              "ftrv	 xmtrx, fv12\n" \
+                              "fldi1 fr14\n" \
+                              "fdiv	 fr15, fr14\n" \
+                              "fmul	 fr14, fr12\n" \
+                              "fmul	 fr14, fr13\n" \
+                              : "=f" (__x), "=f" (__y), "=f" (__z) \
+                              : "0" (__x), "1" (__y), "2" (__z) \
+                              : "fr15" ); \
+    }
+
+/* Transform xyz (with an implicit w of 1) by the loaded matrix, storing W */
+static inline void transformVertex(float* xyz, float* w) {
+    register float __x __asm__("fr12") = (xyz[0]);
+    register float __y __asm__("fr13") = (xyz[1]);
+    register float __z __asm__("fr14") = (xyz[2]);
+    register float __w __asm__("fr15") = (*w);
+
+    __asm__ __volatile__(
+        "fldi1 fr15\n"
+        "ftrv   xmtrx,fv12\n"
+        : "=f" (__x), "=f" (__y), "=f" (__z), "=f" (__w)
+        : "0" (__x), "1" (__y), "2" (__z), "3" (__w)
+    );
+
+    xyz[0] = __x;
+    xyz[1] = __y;
+    xyz[2] = __z;
+    *w = __w;
+}
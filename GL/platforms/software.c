@@ -0,0 +1,441 @@
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "../platform.h"
+#include "../profiler.h"
+
+/* Matches the default 640x480 mode KOS sets up */
+static vid_mode_t VIDEO_MODE = {640, 480};
+vid_mode_t* vid_mode = &VIDEO_MODE;
+
+uint32_t PVR_REGISTERS[PVR_REGISTER_COUNT];
+
+float XMTRX[16] = {
+    1.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f
+};
+
+static uint8_t VRAM[PVR_VRAM_SIZE] __attribute__((aligned(32)));
+static uint32_t PALETTE[1024];
+static uint32_t PALETTE_FORMAT = PVR_PAL_ARGB1555;
+
+static PVRCapture CAPTURE;
+static int CURRENT_LIST = -1;
+static int INITIALIZED = 0;
+
+#define PT_ALPHA_REF 0x011c
+
+static void _initCapture() {
+    if(INITIALIZED) {
+        return;
+    }
+
+    for(int i = 0; i < PVR_LIST_COUNT; ++i) {
+        aligned_vector_init(&CAPTURE.lists[i].commands, 32);
+    }
+
+    CAPTURE.palette = PALETTE;
+    CAPTURE.vram = VRAM;
+    INITIALIZED = 1;
+}
+
+int pvr_init(pvr_init_params_t* params) {
+    (void) params;
+
+    _initCapture();
+    return 0;
+}
+
+int pvr_wait_ready() {
+    return 0;
+}
+
+void pvr_scene_begin() {
+    _initCapture();
+
+    for(int i = 0; i < PVR_LIST_COUNT; ++i) {
+        aligned_vector_clear(&CAPTURE.lists[i].commands);
+    }
+}
+
+int pvr_list_begin(int list) {
+    assert(list >= 0 && list < PVR_LIST_COUNT);
+    CURRENT_LIST = list;
+    return 0;
+}
+
+int pvr_list_finish() {
+    CURRENT_LIST = -1;
+    return 0;
+}
+
+void pvr_list_submit(void* src, int n) {
+    assert(CURRENT_LIST >= 0);
+
+    if(n > 0) {
+        aligned_vector_push_back(&CAPTURE.lists[CURRENT_LIST].commands, src, n);
+    }
+}
+
+int pvr_scene_finish() {
+    CAPTURE.palette_format = PALETTE_FORMAT;
+    CAPTURE.pt_alpha_ref = PVR_GET(PT_ALPHA_REF) & 0xFF;
+    CAPTURE.frame++;
+    return 0;
+}
+
+const PVRCapture* pvr_capture_scene() {
+    _initCapture();
+    return &CAPTURE;
+}
+
+void pvr_set_bg_color(float r, float g, float b) {
+    CAPTURE.bg_color[0] = r;
+    CAPTURE.bg_color[1] = g;
+    CAPTURE.bg_color[2] = b;
+}
+
+void pvr_set_pal_format(int fmt) {
+    PALETTE_FORMAT = fmt;
+}
+
+void pvr_set_pal_entry(uint32_t idx, uint32_t value) {
+    assert(idx < 1024);
+    PALETTE[idx] = value;
+}
+
+/* Fog tables aren't captured (yet) */
+void pvr_fog_table_color(float a, float r, float g, float b) {
+    (void) a; (void) r; (void) g; (void) b;
+}
+
+void pvr_fog_table_linear(float start, float end) {
+    (void) start; (void) end;
+}
+
+void pvr_fog_table_exp(float density) {
+    (void) density;
+}
+
+void pvr_fog_table_exp2(float density) {
+    (void) density;
+}
+
+void pvr_poly_compile(pvr_poly_hdr_t* dst, pvr_poly_cxt_t* src) {
+    /* This is a straight copy of what KOS does, so that the headers
+     * we capture are bit-for-bit what the hardware would receive */
+    int u = 0, v = 0;
+    uint32_t txr_base;
+
+    dst->cmd = PVR_CMD_POLYHDR;
+
+    if(src->txr.enable == PVR_TEXTURE_ENABLE) {
+        dst->cmd |= 8;
+    }
+
+    dst->cmd |= (src->list_type << PVR_TA_CMD_TYPE_SHIFT) & PVR_TA_CMD_TYPE_MASK;
+    dst->cmd |= (src->fmt.color << PVR_TA_CMD_CLRFMT_SHIFT) & PVR_TA_CMD_CLRFMT_MASK;
+    dst->cmd |= (src->gen.shading << PVR_TA_CMD_SHADE_SHIFT) & PVR_TA_CMD_SHADE_MASK;
+    dst->cmd |= (src->fmt.uv << PVR_TA_CMD_UVFMT_SHIFT) & PVR_TA_CMD_UVFMT_MASK;
+    dst->cmd |= (src->gen.clip_mode << PVR_TA_CMD_USERCLIP_SHIFT) & PVR_TA_CMD_USERCLIP_MASK;
+    dst->cmd |= (src->fmt.modifier << PVR_TA_CMD_MODIFIER_SHIFT) & PVR_TA_CMD_MODIFIER_MASK;
+    dst->cmd |= (src->gen.modifier_mode << PVR_TA_CMD_MODIFIERMODE_SHIFT) & PVR_TA_CMD_MODIFIERMODE_MASK;
+    dst->cmd |= (src->gen.specular << PVR_TA_CMD_SPECULAR_SHIFT) & PVR_TA_CMD_SPECULAR_MASK;
+
+    dst->mode1 = ((uint32_t) src->depth.comparison << PVR_TA_PM1_DEPTHCMP_SHIFT) & PVR_TA_PM1_DEPTHCMP_MASK;
+    dst->mode1 |= (src->gen.culling << PVR_TA_PM1_CULLING_SHIFT) & PVR_TA_PM1_CULLING_MASK;
+    dst->mode1 |= (src->depth.write << PVR_TA_PM1_DEPTHWRITE_SHIFT) & PVR_TA_PM1_DEPTHWRITE_MASK;
+    dst->mode1 |= (src->txr.enable << PVR_TA_PM1_TXRENABLE_SHIFT) & PVR_TA_PM1_TXRENABLE_MASK;
+
+    dst->mode2 = ((uint32_t) src->blend.src << PVR_TA_PM2_SRCBLEND_SHIFT) & PVR_TA_PM2_SRCBLEND_MASK;
+    dst->mode2 |= (src->blend.dst << PVR_TA_PM2_DSTBLEND_SHIFT) & PVR_TA_PM2_DSTBLEND_MASK;
+    dst->mode2 |= (src->blend.src_enable << PVR_TA_PM2_SRCENABLE_SHIFT) & PVR_TA_PM2_SRCENABLE_MASK;
+    dst->mode2 |= (src->blend.dst_enable << PVR_TA_PM2_DSTENABLE_SHIFT) & PVR_TA_PM2_DSTENABLE_MASK;
+    dst->mode2 |= (src->gen.fog_type << PVR_TA_PM2_FOG_SHIFT) & PVR_TA_PM2_FOG_MASK;
+    dst->mode2 |= (src->gen.color_clamp << PVR_TA_PM2_CLAMP_SHIFT) & PVR_TA_PM2_CLAMP_MASK;
+    dst->mode2 |= (src->gen.alpha << PVR_TA_PM2_ALPHA_SHIFT) & PVR_TA_PM2_ALPHA_MASK;
+
+    if(src->txr.enable == PVR_TEXTURE_DISABLE) {
+        dst->mode3 = 0;
+    } else {
+        dst->mode2 |= (src->txr.alpha << PVR_TA_PM2_TXRALPHA_SHIFT) & PVR_TA_PM2_TXRALPHA_MASK;
+        dst->mode2 |= (src->txr.uv_flip << PVR_TA_PM2_UVFLIP_SHIFT) & PVR_TA_PM2_UVFLIP_MASK;
+        dst->mode2 |= (src->txr.uv_clamp << PVR_TA_PM2_UVCLAMP_SHIFT) & PVR_TA_PM2_UVCLAMP_MASK;
+        dst->mode2 |= (src->txr.filter << PVR_TA_PM2_FILTER_SHIFT) & PVR_TA_PM2_FILTER_MASK;
+        dst->mode2 |= (src->txr.mipmap_bias << PVR_TA_PM2_MIPBIAS_SHIFT) & PVR_TA_PM2_MIPBIAS_MASK;
+        dst->mode2 |= (src->txr.env << PVR_TA_PM2_TXRENV_SHIFT) & PVR_TA_PM2_TXRENV_MASK;
+
+        /* 8 << n is the texture size */
+        while(u < 7 && (8 << u) < src->txr.width) ++u;
+        while(v < 7 && (8 << v) < src->txr.height) ++v;
+
+        dst->mode2 |= (u << PVR_TA_PM2_USIZE_SHIFT) & PVR_TA_PM2_USIZE_MASK;
+        dst->mode2 |= (v << PVR_TA_PM2_VSIZE_SHIFT) & PVR_TA_PM2_VSIZE_MASK;
+
+        dst->mode3 = ((uint32_t) src->txr.mipmap << PVR_TA_PM3_MIPMAP_SHIFT) & PVR_TA_PM3_MIPMAP_MASK;
+        dst->mode3 |= (src->txr.format << PVR_TA_PM3_TXRFMT_SHIFT) & PVR_TA_PM3_TXRFMT_MASK;
+
+        /* Texture addresses are relative to the start of (our fake) VRAM */
+        txr_base = (src->txr.base) ? _glVRAMOffset(src->txr.base) : 0;
+        txr_base = (txr_base & 0x00fffff8) >> 3;
+        dst->mode3 |= txr_base;
+    }
+
+    dst->d1 = dst->d2 = 0xffffffff;
+    dst->d3 = dst->d4 = 0xffffffff;
+}
+
+uint32_t _glVRAMOffset(const void* ptr) {
+    return (uint32_t) ((const uint8_t*) ptr - VRAM);
+}
+
+/* VRAM allocation. Textures come and go much less often than anything else
+ * so a first-fit list of blocks is plenty. */
+
+typedef struct VRAMBlock {
+    uint32_t offset;
+    uint32_t size;
+    int used;
+    struct VRAMBlock* next;
+} VRAMBlock;
+
+static VRAMBlock* VRAM_BLOCKS = NULL;
+
+pvr_ptr_t pvr_mem_malloc(size_t size) {
+    if(!VRAM_BLOCKS) {
+        VRAM_BLOCKS = (VRAMBlock*) malloc(sizeof(VRAMBlock));
+        VRAM_BLOCKS->offset = 0;
+        VRAM_BLOCKS->size = PVR_VRAM_SIZE;
+        VRAM_BLOCKS->used = 0;
+        VRAM_BLOCKS->next = NULL;
+    }
+
+    /* Texture addresses must be 32-byte aligned */
+    size = (size + 31) & ~31;
+
+    VRAMBlock* it = VRAM_BLOCKS;
+    while(it) {
+        if(!it->used && it->size >= size) {
+            if(it->size > size) {
+                VRAMBlock* rest = (VRAMBlock*) malloc(sizeof(VRAMBlock));
+                rest->offset = it->offset + size;
+                rest->size = it->size - size;
+                rest->used = 0;
+                rest->next = it->next;
+
+                it->size = size;
+                it->next = rest;
+            }
+
+            it->used = 1;
+            return VRAM + it->offset;
+        }
+        it = it->next;
+    }
+
+    return NULL;
+}
+
+void pvr_mem_free(pvr_ptr_t chunk) {
+    if(!chunk) {
+        return;
+    }
+
+    uint32_t offset = (uint8_t*) chunk - VRAM;
+
+    VRAMBlock* it = VRAM_BLOCKS;
+    while(it) {
+        if(it->offset == offset) {
+            assert(it->used);
+            it->used = 0;
+            break;
+        }
+        it = it->next;
+    }
+
+    /* Merge neighbouring free blocks */
+    it = VRAM_BLOCKS;
+    while(it && it->next) {
+        if(!it->used && !it->next->used) {
+            VRAMBlock* next = it->next;
+            it->size += next->size;
+            it->next = next->next;
+            free(next);
+        } else {
+            it = it->next;
+        }
+    }
+}
+
+#define TWIDTAB(x) ( (x&1)|((x&2)<<1)|((x&4)<<2)|((x&8)<<3)|((x&16)<<4)| \
+                     ((x&32)<<5)|((x&64)<<6)|((x&128)<<7)|((x&256)<<8)|((x&512)<<9) )
+#define TWIDOUT(x, y) ( TWIDTAB((y)) | (TWIDTAB((x)) << 1) )
+
+uint32_t pvr_twiddled_index(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    const uint32_t min = (w < h) ? w : h;
+    const uint32_t mask = min - 1;
+    return TWIDOUT(x & mask, y & mask) + (x / min + y / min) * min * min;
+}
+
+void pvr_txr_load_ex(void* src, pvr_ptr_t dst, uint32_t w, uint32_t h, uint32_t flags) {
+    uint32_t x, y;
+
+    if(flags & PVR_TXRLOAD_FMT_NOTWIDDLE) {
+        const uint32_t bpp = ((flags & 3) == PVR_TXRLOAD_16BPP) ? 2 : 1;
+        memcpy(dst, src, w * h * bpp);
+        return;
+    }
+
+    if((flags & 3) == PVR_TXRLOAD_8BPP) {
+        uint8_t* pixels = (uint8_t*) src;
+        uint8_t* vtex = (uint8_t*) dst;
+
+        for(y = 0; y < h; ++y) {
+            for(x = 0; x < w; ++x) {
+                vtex[pvr_twiddled_index(x, y, w, h)] = pixels[y * w + x];
+            }
+        }
+    } else if((flags & 3) == PVR_TXRLOAD_16BPP) {
+        uint16_t* pixels = (uint16_t*) src;
+        uint16_t* vtex = (uint16_t*) dst;
+
+        for(y = 0; y < h; ++y) {
+            for(x = 0; x < w; ++x) {
+                vtex[pvr_twiddled_index(x, y, w, h)] = pixels[y * w + x];
+            }
+        }
+    }
+}
+
+void* sq_cpy(void* dest, const void* src, int n) {
+    return memcpy(dest, src, n);
+}
+
+void mat_load(matrix_t* m) {
+    memcpy(XMTRX, m, sizeof(float) * 16);
+}
+
+void mat_store(matrix_t* m) {
+    memcpy(m, XMTRX, sizeof(float) * 16);
+}
+
+void mat_apply(matrix_t* m) {
+    /* XMTRX = XMTRX * m */
+    const float* b = (const float*) m;
+    float r[16];
+
+    for(int j = 0; j < 4; ++j) {
+        for(int i = 0; i < 4; ++i) {
+            r[i + j * 4] =
+                XMTRX[i + 0] * b[j * 4 + 0] +
+                XMTRX[i + 4] * b[j * 4 + 1] +
+                XMTRX[i + 8] * b[j * 4 + 2] +
+                XMTRX[i + 12] * b[j * 4 + 3];
+        }
+    }
+
+    memcpy(XMTRX, r, sizeof(float) * 16);
+}
+
+uint64_t timer_us_gettime64() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+uint64_t timer_ns_gettime64() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Performance counters are backed by perf_event on Linux, and read as zero
+ * everywhere else */
+static int PERF_COUNTERS[2] = {-1, -1};
+
+uint8_t _glPerfCounterStart(uint8_t counter, int event) {
+    if(counter > 1) {
+        return 0;
+    }
+
+    _glPerfCounterStop(counter);
+
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    switch(event) {
+        case PROFILER_COUNTER_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+        case PROFILER_COUNTER_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+        case PROFILER_COUNTER_OPERAND_CACHE_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+        case PROFILER_COUNTER_INSTRUCTION_CACHE_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1I |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+        case PROFILER_COUNTER_OPERAND_CACHE_STALLS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_STALLED_CYCLES_BACKEND;
+        break;
+        default:
+            /* No portable equivalent for the FPU events */
+            return 0;
+    }
+
+    PERF_COUNTERS[counter] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    return PERF_COUNTERS[counter] >= 0;
+#else
+    (void) event;
+    return 0;
+#endif
+}
+
+void _glPerfCounterStop(uint8_t counter) {
+    if(counter > 1 || PERF_COUNTERS[counter] < 0) {
+        return;
+    }
+
+#ifdef __linux__
+    close(PERF_COUNTERS[counter]);
+#endif
+    PERF_COUNTERS[counter] = -1;
+}
+
+uint64_t _glPerfCounterRead(uint8_t counter) {
+    if(counter > 1 || PERF_COUNTERS[counter] < 0) {
+        return 0;
+    }
+
+    uint64_t value = 0;
+#ifdef __linux__
+    if(read(PERF_COUNTERS[counter], &value, sizeof(value)) != sizeof(value)) {
+        return 0;
+    }
+#endif
+    return value;
+}
@@ -0,0 +1,454 @@
+#pragma once
+
+/*
+ * A software stand-in for the parts of KOS that GLdc uses, so that the library
+ * can be built and run on a development machine (profilers, cachegrind, CI).
+ *
+ * Constants, structures and header bit layouts match KOS so that the TA
+ * command stream produced here is identical to the one sent to the hardware.
+ * Rather than being sent anywhere, each list submitted between
+ * pvr_scene_begin() and pvr_scene_finish() is captured into memory and can
+ * be inspected through pvr_capture_scene().
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "../../containers/aligned_vector.h"
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+typedef int32_t int32;
+
+typedef void* pvr_ptr_t;
+
+#define F_PI 3.1415926f
+
+/* Lists */
+#define PVR_LIST_OP_POLY        0
+#define PVR_LIST_OP_MOD         1
+#define PVR_LIST_TR_POLY        2
+#define PVR_LIST_TR_MOD         3
+#define PVR_LIST_PT_POLY        4
+
+#define PVR_LIST_COUNT          5
+
+#define PVR_BINSIZE_0           0
+#define PVR_BINSIZE_8           8
+#define PVR_BINSIZE_16          16
+#define PVR_BINSIZE_32          32
+
+/* TA commands */
+#define PVR_CMD_POLYHDR         0x80840000
+#define PVR_CMD_VERTEX          0xe0000000
+#define PVR_CMD_VERTEX_EOL      0xf0000000
+#define PVR_CMD_USERCLIP        0x20000000
+#define PVR_CMD_MODIFIER        0x80000000
+#define PVR_CMD_SPRITE          0xA0000000
+
+/* Polygon context values */
+#define PVR_SHADE_FLAT          0
+#define PVR_SHADE_GOURAUD       1
+
+#define PVR_DEPTHCMP_NEVER      0
+#define PVR_DEPTHCMP_LESS       1
+#define PVR_DEPTHCMP_EQUAL      2
+#define PVR_DEPTHCMP_LEQUAL     3
+#define PVR_DEPTHCMP_GREATER    4
+#define PVR_DEPTHCMP_NOTEQUAL   5
+#define PVR_DEPTHCMP_GEQUAL     6
+#define PVR_DEPTHCMP_ALWAYS     7
+
+#define PVR_CULLING_NONE        0
+#define PVR_CULLING_SMALL       1
+#define PVR_CULLING_CCW         2
+#define PVR_CULLING_CW          3
+
+#define PVR_DEPTHWRITE_ENABLE   0
+#define PVR_DEPTHWRITE_DISABLE  1
+
+#define PVR_TEXTURE_DISABLE     0
+#define PVR_TEXTURE_ENABLE      1
+
+#define PVR_BLEND_ZERO          0
+#define PVR_BLEND_ONE           1
+#define PVR_BLEND_DESTCOLOR     2
+#define PVR_BLEND_INVDESTCOLOR  3
+#define PVR_BLEND_SRCALPHA      4
+#define PVR_BLEND_INVSRCALPHA   5
+#define PVR_BLEND_DESTALPHA     6
+#define PVR_BLEND_INVDESTALPHA  7
+
+#define PVR_BLEND_DISABLE       0
+#define PVR_BLEND_ENABLE        1
+
+#define PVR_FOG_TABLE           0
+#define PVR_FOG_VERTEX          1
+#define PVR_FOG_DISABLE         2
+#define PVR_FOG_TABLE2          3
+
+#define PVR_USERCLIP_DISABLE    0
+#define PVR_USERCLIP_INSIDE     2
+#define PVR_USERCLIP_OUTSIDE    3
+
+#define PVR_CLRCLAMP_DISABLE    0
+#define PVR_CLRCLAMP_ENABLE     1
+
+#define PVR_SPECULAR_DISABLE    0
+#define PVR_SPECULAR_ENABLE     1
+
+#define PVR_ALPHA_DISABLE       0
+#define PVR_ALPHA_ENABLE        1
+
+/* Yes, these really are inverted in KOS */
+#define PVR_TXRALPHA_ENABLE     0
+#define PVR_TXRALPHA_DISABLE    1
+
+#define PVR_UVFLIP_NONE         0
+#define PVR_UVFLIP_V            1
+#define PVR_UVFLIP_U            2
+#define PVR_UVFLIP_UV           3
+
+#define PVR_UVCLAMP_NONE        0
+#define PVR_UVCLAMP_V           1
+#define PVR_UVCLAMP_U           2
+#define PVR_UVCLAMP_UV          3
+
+#define PVR_FILTER_NONE         0
+#define PVR_FILTER_NEAREST      0
+#define PVR_FILTER_BILINEAR     2
+#define PVR_FILTER_TRILINEAR1   4
+#define PVR_FILTER_TRILINEAR2   6
+
+#define PVR_MIPBIAS_NORMAL      4
+
+#define PVR_TXRENV_REPLACE          0
+#define PVR_TXRENV_MODULATE         1
+#define PVR_TXRENV_DECAL            2
+#define PVR_TXRENV_MODULATEALPHA    3
+
+#define PVR_MIPMAP_DISABLE      0
+#define PVR_MIPMAP_ENABLE       1
+
+#define PVR_TXRFMT_NONE         0
+#define PVR_TXRFMT_VQ_DISABLE   (0 << 30)
+#define PVR_TXRFMT_VQ_ENABLE    (1 << 30)
+#define PVR_TXRFMT_ARGB1555     (0 << 27)
+#define PVR_TXRFMT_RGB565       (1 << 27)
+#define PVR_TXRFMT_ARGB4444     (2 << 27)
+#define PVR_TXRFMT_YUV422       (3 << 27)
+#define PVR_TXRFMT_BUMP         (4 << 27)
+#define PVR_TXRFMT_PAL4BPP      (5 << 27)
+#define PVR_TXRFMT_PAL8BPP      (6 << 27)
+#define PVR_TXRFMT_TWIDDLED     (0 << 26)
+#define PVR_TXRFMT_NONTWIDDLED  (1 << 26)
+#define PVR_TXRFMT_NOSTRIDE     (0 << 25)
+#define PVR_TXRFMT_STRIDE       (1 << 25)
+
+#define PVR_TXRFMT_8BPP_PAL(x)  ((x) << 25)
+#define PVR_TXRFMT_4BPP_PAL(x)  ((x) << 21)
+
+#define PVR_CLRFMT_ARGBPACKED       0
+#define PVR_CLRFMT_4FLOATS          1
+#define PVR_CLRFMT_INTENSITY        2
+#define PVR_CLRFMT_INTENSITY_PREV   3
+
+#define PVR_UVFMT_32BIT         0
+#define PVR_UVFMT_16BIT         1
+
+#define PVR_MODIFIER_DISABLE    0
+#define PVR_MODIFIER_ENABLE     1
+
+#define PVR_PAL_ARGB1555        0
+#define PVR_PAL_RGB565          1
+#define PVR_PAL_ARGB4444        2
+#define PVR_PAL_ARGB8888        3
+
+#define PVR_TXRLOAD_4BPP            0x01
+#define PVR_TXRLOAD_8BPP            0x02
+#define PVR_TXRLOAD_16BPP           0x03
+#define PVR_TXRLOAD_FMT_TWIDDLED    0x0200
+#define PVR_TXRLOAD_FMT_NOTWIDDLE   0x0800
+
+/* Header bit layout, as written by pvr_poly_compile */
+#define PVR_TA_CMD_TYPE_SHIFT           24
+#define PVR_TA_CMD_TYPE_MASK            (7 << PVR_TA_CMD_TYPE_SHIFT)
+#define PVR_TA_CMD_USERCLIP_SHIFT       16
+#define PVR_TA_CMD_USERCLIP_MASK        (3 << PVR_TA_CMD_USERCLIP_SHIFT)
+#define PVR_TA_CMD_CLRFMT_SHIFT         4
+#define PVR_TA_CMD_CLRFMT_MASK          (7 << PVR_TA_CMD_CLRFMT_SHIFT)
+#define PVR_TA_CMD_MODIFIER_SHIFT       7
+#define PVR_TA_CMD_MODIFIER_MASK        (1 << PVR_TA_CMD_MODIFIER_SHIFT)
+#define PVR_TA_CMD_MODIFIERMODE_SHIFT   6
+#define PVR_TA_CMD_MODIFIERMODE_MASK    (1 << PVR_TA_CMD_MODIFIERMODE_SHIFT)
+#define PVR_TA_CMD_SPECULAR_SHIFT       2
+#define PVR_TA_CMD_SPECULAR_MASK        (1 << PVR_TA_CMD_SPECULAR_SHIFT)
+#define PVR_TA_CMD_SHADE_SHIFT          1
+#define PVR_TA_CMD_SHADE_MASK           (1 << PVR_TA_CMD_SHADE_SHIFT)
+#define PVR_TA_CMD_UVFMT_SHIFT          0
+#define PVR_TA_CMD_UVFMT_MASK           (1 << PVR_TA_CMD_UVFMT_SHIFT)
+
+#define PVR_TA_PM1_DEPTHCMP_SHIFT       29
+#define PVR_TA_PM1_DEPTHCMP_MASK        (7u << PVR_TA_PM1_DEPTHCMP_SHIFT)
+#define PVR_TA_PM1_CULLING_SHIFT        27
+#define PVR_TA_PM1_CULLING_MASK         (3 << PVR_TA_PM1_CULLING_SHIFT)
+#define PVR_TA_PM1_DEPTHWRITE_SHIFT     26
+#define PVR_TA_PM1_DEPTHWRITE_MASK      (1 << PVR_TA_PM1_DEPTHWRITE_SHIFT)
+#define PVR_TA_PM1_TXRENABLE_SHIFT      25
+#define PVR_TA_PM1_TXRENABLE_MASK       (1 << PVR_TA_PM1_TXRENABLE_SHIFT)
+
+#define PVR_TA_PM2_SRCBLEND_SHIFT       29
+#define PVR_TA_PM2_SRCBLEND_MASK        (7u << PVR_TA_PM2_SRCBLEND_SHIFT)
+#define PVR_TA_PM2_DSTBLEND_SHIFT       26
+#define PVR_TA_PM2_DSTBLEND_MASK        (7 << PVR_TA_PM2_DSTBLEND_SHIFT)
+#define PVR_TA_PM2_SRCENABLE_SHIFT      25
+#define PVR_TA_PM2_SRCENABLE_MASK       (1 << PVR_TA_PM2_SRCENABLE_SHIFT)
+#define PVR_TA_PM2_DSTENABLE_SHIFT      24
+#define PVR_TA_PM2_DSTENABLE_MASK       (1 << PVR_TA_PM2_DSTENABLE_SHIFT)
+#define PVR_TA_PM2_FOG_SHIFT            22
+#define PVR_TA_PM2_FOG_MASK             (3 << PVR_TA_PM2_FOG_SHIFT)
+#define PVR_TA_PM2_CLAMP_SHIFT          21
+#define PVR_TA_PM2_CLAMP_MASK           (1 << PVR_TA_PM2_CLAMP_SHIFT)
+#define PVR_TA_PM2_ALPHA_SHIFT          20
+#define PVR_TA_PM2_ALPHA_MASK           (1 << PVR_TA_PM2_ALPHA_SHIFT)
+#define PVR_TA_PM2_TXRALPHA_SHIFT       19
+#define PVR_TA_PM2_TXRALPHA_MASK        (1 << PVR_TA_PM2_TXRALPHA_SHIFT)
+#define PVR_TA_PM2_UVFLIP_SHIFT         17
+#define PVR_TA_PM2_UVFLIP_MASK          (3 << PVR_TA_PM2_UVFLIP_SHIFT)
+#define PVR_TA_PM2_UVCLAMP_SHIFT        15
+#define PVR_TA_PM2_UVCLAMP_MASK         (3 << PVR_TA_PM2_UVCLAMP_SHIFT)
+#define PVR_TA_PM2_FILTER_SHIFT         12
+#define PVR_TA_PM2_FILTER_MASK          (7 << PVR_TA_PM2_FILTER_SHIFT)
+#define PVR_TA_PM2_MIPBIAS_SHIFT        8
+#define PVR_TA_PM2_MIPBIAS_MASK         (15 << PVR_TA_PM2_MIPBIAS_SHIFT)
+#define PVR_TA_PM2_TXRENV_SHIFT         6
+#define PVR_TA_PM2_TXRENV_MASK          (3 << PVR_TA_PM2_TXRENV_SHIFT)
+#define PVR_TA_PM2_USIZE_SHIFT          3
+#define PVR_TA_PM2_USIZE_MASK           (7 << PVR_TA_PM2_USIZE_SHIFT)
+#define PVR_TA_PM2_VSIZE_SHIFT          0
+#define PVR_TA_PM2_VSIZE_MASK           (7 << PVR_TA_PM2_VSIZE_SHIFT)
+
+#define PVR_TA_PM3_MIPMAP_SHIFT         31
+#define PVR_TA_PM3_MIPMAP_MASK          (1u << PVR_TA_PM3_MIPMAP_SHIFT)
+#define PVR_TA_PM3_TXRFMT_SHIFT         0
+#define PVR_TA_PM3_TXRFMT_MASK          0xffffffff
+
+typedef struct {
+    int list_type;
+    struct {
+        int alpha;
+        int shading;
+        int fog_type;
+        int culling;
+        int color_clamp;
+        int clip_mode;
+        int modifier_mode;
+        int specular;
+        int alpha2;
+        int fog_type2;
+        int color_clamp2;
+    } gen;
+    struct {
+        int src, dst;
+        int src_enable, dst_enable;
+        int src2, dst2;
+        int src_enable2, dst_enable2;
+    } blend;
+    struct {
+        int color;
+        int uv;
+        int modifier;
+    } fmt;
+    struct {
+        int comparison;
+        int write;
+    } depth;
+    struct {
+        int enable;
+        int filter;
+        int mipmap;
+        int mipmap_bias;
+        int uv_flip;
+        int uv_clamp;
+        int alpha;
+        int env;
+        int width;
+        int height;
+        int format;
+        pvr_ptr_t base;
+    } txr, txr2;
+} pvr_poly_cxt_t;
+
+typedef struct {
+    uint32_t cmd;
+    uint32_t mode1, mode2, mode3;
+    uint32_t d1, d2, d3, d4;
+} pvr_poly_hdr_t;
+
+typedef struct {
+    int opb_sizes[PVR_LIST_COUNT];
+    int vertex_buf_size;
+    int dma_enabled;
+    int fsaa_enabled;
+    int autosort_disabled;
+} pvr_init_params_t;
+
+typedef struct {
+    int width;
+    int height;
+} vid_mode_t;
+
+extern vid_mode_t* vid_mode;
+
+int pvr_init(pvr_init_params_t* params);
+int pvr_wait_ready();
+void pvr_scene_begin();
+int pvr_list_begin(int list);
+int pvr_list_finish();
+int pvr_scene_finish();
+
+void pvr_poly_compile(pvr_poly_hdr_t* dst, pvr_poly_cxt_t* src);
+
+void pvr_set_bg_color(float r, float g, float b);
+void pvr_set_pal_format(int fmt);
+void pvr_set_pal_entry(uint32_t idx, uint32_t value);
+
+void pvr_fog_table_color(float a, float r, float g, float b);
+void pvr_fog_table_linear(float start, float end);
+void pvr_fog_table_exp(float density);
+void pvr_fog_table_exp2(float density);
+
+pvr_ptr_t pvr_mem_malloc(size_t size);
+void pvr_mem_free(pvr_ptr_t chunk);
+
+void pvr_txr_load_ex(void* src, pvr_ptr_t dst, uint32_t w, uint32_t h, uint32_t flags);
+
+void* sq_cpy(void* dest, const void* src, int n);
+
+uint64_t timer_us_gettime64();
+uint64_t timer_ns_gettime64();
+
+/* PVR registers are just backed by an array */
+#define PVR_REGISTER_COUNT  (0x2000 / 4)
+
+extern uint32_t PVR_REGISTERS[PVR_REGISTER_COUNT];
+
+#define PVR_GET(reg) (PVR_REGISTERS[(reg) / 4])
+#define PVR_SET(reg, value) (PVR_REGISTERS[(reg) / 4] = (value))
+
+#define PVR_PACK_COLOR(a, r, g, b) ( \
+    (((int)((a) * 255)) << 24) | \
+    (((int)((r) * 255)) << 16) | \
+    (((int)((g) * 255)) << 8) | \
+    (((int)((b) * 255)) << 0))
+
+/* Matrix maths. The SH4 keeps one matrix (XMTRX) loaded in the FPU's back bank,
+ * we keep it in a static array instead. Matrices are column major. */
+typedef float matrix_t[4][4];
+
+extern float XMTRX[16];
+
+void mat_load(matrix_t* m);
+void mat_store(matrix_t* m);
+void mat_apply(matrix_t* m);
+
+/* As with KOS, this leaves 1/w in w */
+#define mat_trans_single4(x, y, z, w) { \
+    const float __x = (x), __y = (y), __z = (z), __w = (w); \
+    const float __iw = 1.0f / (XMTRX[3] * __x + XMTRX[7] * __y + XMTRX[11] * __z + XMTRX[15] * __w); \
+    x = (XMTRX[0] * __x + XMTRX[4] * __y + XMTRX[8] * __z + XMTRX[12] * __w) * __iw; \
+    y = (XMTRX[1] * __x + XMTRX[5] * __y + XMTRX[9] * __z + XMTRX[13] * __w) * __iw; \
+    z = (XMTRX[2] * __x + XMTRX[6] * __y + XMTRX[10] * __z + XMTRX[14] * __w) * __iw; \
+    w = __iw; \
+}
+
+#define mat_trans_single3_nodiv(x, y, z) { \
+    const float __x = (x), __y = (y), __z = (z); \
+    x = XMTRX[0] * __x + XMTRX[4] * __y + XMTRX[8] * __z + XMTRX[12]; \
+    y = XMTRX[1] * __x + XMTRX[5] * __y + XMTRX[9] * __z + XMTRX[13]; \
+    z = XMTRX[2] * __x + XMTRX[6] * __y + XMTRX[10] * __z + XMTRX[14]; \
+}
+
+#define mat_trans_single3_nodiv_nomod(x, y, z, x2, y2, z2) { \
+    const float __x = (x), __y = (y), __z = (z); \
+    x2 = XMTRX[0] * __x + XMTRX[4] * __y + XMTRX[8] * __z + XMTRX[12]; \
+    y2 = XMTRX[1] * __x + XMTRX[5] * __y + XMTRX[9] * __z + XMTRX[13]; \
+    z2 = XMTRX[2] * __x + XMTRX[6] * __y + XMTRX[10] * __z + XMTRX[14]; \
+}
+
+#define mat_trans_normal3(x, y, z) { \
+    const float __x = (x), __y = (y), __z = (z); \
+    x = XMTRX[0] * __x + XMTRX[4] * __y + XMTRX[8] * __z; \
+    y = XMTRX[1] * __x + XMTRX[5] * __y + XMTRX[9] * __z; \
+    z = XMTRX[2] * __x + XMTRX[6] * __y + XMTRX[10] * __z; \
+}
+
+#define mat_trans_normal3_nomod(x, y, z, x2, y2, z2) { \
+    const float __x = (x), __y = (y), __z = (z); \
+    x2 = XMTRX[0] * __x + XMTRX[4] * __y + XMTRX[8] * __z; \
+    y2 = XMTRX[1] * __x + XMTRX[5] * __y + XMTRX[9] * __z; \
+    z2 = XMTRX[2] * __x + XMTRX[6] * __y + XMTRX[10] * __z; \
+}
+
+/* Transform xyz (with an implicit w of 1) by the loaded matrix, storing W */
+static inline void transformVertex(float* xyz, float* w) {
+    const float x = xyz[0], y = xyz[1], z = xyz[2];
+    xyz[0] = XMTRX[0] * x + XMTRX[4] * y + XMTRX[8] * z + XMTRX[12];
+    xyz[1] = XMTRX[1] * x + XMTRX[5] * y + XMTRX[9] * z + XMTRX[13];
+    xyz[2] = XMTRX[2] * x + XMTRX[6] * y + XMTRX[10] * z + XMTRX[14];
+    *w = XMTRX[3] * x + XMTRX[7] * y + XMTRX[11] * z + XMTRX[15];
+}
+
+struct vec3f {
+    float x, y, z;
+};
+
+#define vec3f_dot(x1, y1, z1, x2, y2, z2, w) { \
+    w = (x1) * (x2) + (y1) * (y2) + (z1) * (z2); \
+}
+
+#define vec3f_length(x, y, z, w) { \
+    w = sqrtf((x) * (x) + (y) * (y) + (z) * (z)); \
+}
+
+#define vec3f_normalize(x, y, z) { \
+    const float __l = 1.0f / sqrtf((x) * (x) + (y) * (y) + (z) * (z)); \
+    x *= __l; \
+    y *= __l; \
+    z *= __l; \
+}
+
+/* Capture of the TA command stream */
+
+/* The host has no video RAM, so we reserve a block of the same size and
+ * allocate textures from it. Texture addresses in headers are offsets into it */
+#define PVR_VRAM_SIZE (8 * 1024 * 1024)
+
+typedef struct {
+    /* 32-byte TA parameters, exactly as they would be written to the store queues */
+    AlignedVector commands;
+} PVRCaptureList;
+
+typedef struct {
+    /* Incremented each time pvr_scene_finish is called */
+    uint32_t frame;
+
+    PVRCaptureList lists[PVR_LIST_COUNT];
+
+    /* State the ISP/TSP would read while rendering the scene */
+    float bg_color[3];
+    uint32_t palette_format;
+    const uint32_t* palette;  /* 1024 entries */
+    const uint8_t* vram;      /* PVR_VRAM_SIZE bytes */
+    uint8_t pt_alpha_ref;
+} PVRCapture;
+
+/* Returns the most recently finished scene. This remains valid
+ * until the next call to pvr_scene_begin */
+const PVRCapture* pvr_capture_scene();
+
+/* Returns the index of the texel at (x, y) in a twiddled texture */
+uint32_t pvr_twiddled_index(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
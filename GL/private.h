@@ -2,13 +2,13 @@
 #define PRIVATE_H
 
 #include <stdint.h>
-#include <dc/matrix.h>
-#include <dc/pvr.h>
-#include <dc/vec3f.h>
-#include <dc/fmath.h>
-#include <dc/matrix3d.h>
+#include <stdio.h>
+
+#include "platform.h"
+#include "alloc.h"
 
 #include "../include/gl.h"
+#include "../include/glext.h"
 #include "../containers/aligned_vector.h"
 #include "../containers/named_array.h"
 
@@ -94,6 +94,12 @@ typedef struct {
 typedef struct {
     unsigned int list_type;
     AlignedVector vector;
+
+    /* The header of the last draw into this list and the size of the list
+     * after it. A draw with an identical header which starts at batch_end
+     * is appended without a header of its own. Zero if there's no batch. */
+    PVRHeader batch_header;
+    unsigned int batch_end;
 } PolyList;
 
 typedef struct {
@@ -211,7 +217,8 @@ typedef struct {
     uint32_t start_offset; // The offset into the output list
     uint32_t count; // The number of vertices in this output
 
-    /* Pointer to count * VertexExtra; */
+    /* Pointer to count * VertexExtra, or NULL if neither lighting nor
+     * multitexturing is enabled */
     AlignedVector* extras;
 } SubmissionTarget;
 
@@ -219,6 +226,80 @@ PVRHeader* _glSubmissionTargetHeader(SubmissionTarget* target);
 Vertex* _glSubmissionTargetStart(SubmissionTarget* target);
 Vertex* _glSubmissionTargetEnd(SubmissionTarget* target);
 
+/* A draw recorded into a display list. The vertices are stored after
+ * generate (so flags and EOLs are set and fans are expanded) along with
+ * the state that the headers are compiled from */
+typedef struct {
+    PolyList* output;
+    pvr_poly_cxt_t context;
+    GLuint texture[2];  /* 0 if the unit wasn't enabled */
+    GLboolean blend;
+    GLboolean lighting;
+    GLboolean multitexture;
+
+    GLuint count;
+    GLuint first_vertex;  /* Into the list's vertices */
+    GLint first_extra;  /* Into the list's extras, or -1 if there aren't any */
+
+    /* The headers as of the texture generation they were compiled at, or 0
+     * if they haven't been compiled yet */
+    PVRHeader header;
+    PVRHeader multitexture_header;
+    GLuint generation;
+} DisplayListDraw;
+
+/* A matrix operation recorded into a display list. Loads and multiplies,
+ * which include glTranslatef, glRotatef, glScalef, glOrtho and glFrustum,
+ * are stored as the matrix they load or multiply by */
+typedef enum {
+    LIST_MATRIX_MODE,
+    LIST_MATRIX_PUSH,
+    LIST_MATRIX_POP,
+    LIST_MATRIX_LOAD,
+    LIST_MATRIX_MULT
+} ListMatrixOp;
+
+typedef struct {
+    Matrix4x4 matrix;  /* For loads and multiplies */
+    GLenum mode;  /* For LIST_MATRIX_MODE */
+    GLubyte op;
+} ListMatrix;
+
+/* A state change recorded into a display list, which is replayed by
+ * calling the function it came from again. See _glRecordListState for
+ * what's recorded. */
+typedef enum {
+    LIST_STATE_ENABLE,
+    LIST_STATE_DISABLE,
+    LIST_STATE_ACTIVE_TEXTURE,
+    LIST_STATE_BIND_TEXTURE,
+    LIST_STATE_BLEND_FUNC,
+    LIST_STATE_DEPTH_FUNC,
+    LIST_STATE_DEPTH_MASK,
+    LIST_STATE_SHADE_MODEL,
+    LIST_STATE_CULL_FACE,
+    LIST_STATE_FRONT_FACE,
+    LIST_STATE_ALPHA_FUNC
+} ListStateOp;
+
+typedef struct {
+    GLenum args[2];
+    GLfloat ref;  /* For glAlphaFunc */
+    GLubyte op;
+} ListState;
+
+GLubyte _glInitLists();
+GLboolean _glIsCompilingList();
+GLboolean _glIsExecutingList();  /* GL_COMPILE_AND_EXECUTE, or not compiling */
+void _glRecordListDraw(const DisplayListDraw* draw, const Vertex* vertices, const VertexExtra* extras);
+void _glSubmitListDraw(DisplayListDraw* draw, const Vertex* vertices, const VertexExtra* extras, GLubyte bounds);
+void _glRecordListMatrix(const ListMatrix* matrix);
+void _glApplyListMatrix(const ListMatrix* matrix);
+void _glRecordListState(ListStateOp op, GLenum arg0, GLenum arg1, GLfloat ref);
+GLuint _glGetListIndex();
+GLenum _glGetListMode();
+GLuint _glGetListBase();
+
 typedef enum {
     CLIP_RESULT_ALL_IN_FRONT,
     CLIP_RESULT_ALL_BEHIND,
@@ -238,9 +319,16 @@ struct SubmissionTarget;
 void _glClipLineToNearZ(const Vertex* v1, const Vertex* v2, Vertex* vout, float* t);
 void _glClipTriangleStrip(SubmissionTarget* target, uint8_t fladeShade);
 
+/* Removes the triangles the PVR wouldn't draw anything of from the target's
+ * (divided) strips. culling is the draw's PVR_CULLING_* mode. */
+void _glRejectTriangles(SubmissionTarget* target, GLubyte culling);
+
 PolyList *_glActivePolyList();
 PolyList *_glTransparentPolyList();
 
+/* Per-frame vertex storage, reset by glKosSwapBuffers */
+Arena* _glFrameArena();
+
 void _glInitAttributePointers();
 void _glInitContext();
 void _glInitLights();
@@ -265,20 +353,95 @@ GLubyte _glCheckImmediateModeInactive(const char* func);
 pvr_poly_cxt_t* _glGetPVRContext();
 GLubyte _glInitTextures();
 
+/* Draws keep their polygon headers compiled until something they're
+ * compiled from changes, which has to call _glMarkStateDirty */
+#define STATE_DIRTY_CONTEXT 0x1  /* The PVR context, or the enables that pick the list */
+#define STATE_DIRTY_TEXTURE 0x2  /* Texture enables, bindings, parameters, storage or palettes */
+#define STATE_DIRTY_ALL     0x3
+
+void _glMarkStateDirty(GLubyte bits);
+
+/* Returns what has changed since it was last called */
+GLubyte _glTakeStateDirty();
+
+/* For changes to a texture object's parameters, storage or palette, or to
+ * the shared palette, which also marks STATE_DIRTY_TEXTURE. Bindings and
+ * enables don't count, so display lists (which record the textures they
+ * use) only recompile their headers when the generation moves on. */
+void _glMarkTexturesChanged();
+GLuint _glTextureGeneration();
+GLboolean _glIsTextureEnabled(GLubyte unit);
+
 void _glUpdatePVRTextureContext(pvr_poly_cxt_t* context, GLshort textureUnit);
+
+/* Same, but for the given texture (NULL if texturing is disabled) and
+ * blend state rather than the current ones */
+void _glUpdatePVRTextureContextFor(pvr_poly_cxt_t* context, const TextureObject* texture, GLboolean blend);
 void _glAllocateSpaceForMipmaps(TextureObject* active);
 
 extern GLfloat NEAR_PLANE_DISTANCE;
 
 GLfloat _glGetNearPlane();
 
+/* Where a bounding volume is relative to the frustum of the current
+ * projection and modelview matrices */
+#define BOUNDS_UNKNOWN   0  /* No bounds were given */
+#define BOUNDS_OUTSIDE   1  /* Entirely outside one of the frustum planes */
+#define BOUNDS_CROSSES_W 2  /* Partly at or behind w = 0, so may need near-Z clipping */
+#define BOUNDS_IN_FRONT  3  /* Entirely in front of w = 0 */
+
+GLubyte _glClassifyBox(const GLfloat* min, const GLfloat* max);
+GLubyte _glClassifySphere(const GLfloat* centre, GLfloat radius);
+
 typedef struct {
     const void* ptr;
     GLenum type;
     GLsizei stride;
     GLint size;
+
+    /* Non-zero if the pointer was set while a buffer object was bound to
+     * GL_ARRAY_BUFFER_ARB, ptr then points into that buffer's data */
+    GLuint buffer;
 } AttribPointer;
 
+/* The glXPointer state that a buffer's converted vertices were generated with */
+typedef struct {
+    GLuint enabled;
+    GLboolean normalize;
+    AttribPointer vertex;
+    AttribPointer diffuse;
+    AttribPointer uv;
+    AttribPointer st;
+    AttribPointer normal;
+} VertexLayout;
+
+typedef struct {
+    GLuint index;
+    GLenum usage;
+    GLsizeiptrARB size;
+    GLubyte* data;
+
+    GLboolean mapped;
+    GLenum access;
+
+    /* GL_STATIC_DRAW_ARB buffers keep a copy of their data converted to
+     * Vertex + VertexExtra, valid while converted is set and the draw uses
+     * the same layout */
+    GLboolean converted;
+    GLuint converted_count;
+    VertexLayout converted_layout;
+    AlignedVector vertices;
+    AlignedVector extras;
+} BufferObject;
+
+GLubyte _glInitBuffers();
+BufferObject* _glGetBufferObject(GLuint buffer);
+BufferObject* _glGetBoundBuffer(GLenum target);
+
+/* Called when a buffer's data moves, or the buffer is deleted (data is then
+ * NULL), so that attribute pointers into it can be updated */
+void _glRebaseBufferPointers(GLuint buffer, const GLubyte* old_data, const GLubyte* new_data);
+
 GLboolean _glCheckValidEnum(GLint param, GLint* values, const char* func);
 
 GLuint* _glGetEnabledAttributes();
@@ -292,6 +455,7 @@ GLenum _glGetShadeModel();
 TextureObject* _glGetTexture0();
 TextureObject* _glGetTexture1();
 TextureObject* _glGetBoundTexture();
+TextureObject* _glGetTextureObject(GLuint texture);
 GLubyte _glGetActiveTexture();
 GLuint _glGetActiveClientTexture();
 TexturePalette* _glGetSharedPalette(GLshort bank);
@@ -325,27 +489,109 @@ extern void _glPerformLighting(Vertex* vertices, const EyeSpaceData* es, const i
 unsigned char _glIsClippingEnabled();
 void _glEnableClipping(unsigned char v);
 
+/* Classifies the bounds given for the next draw call (BOUNDS_UNKNOWN if
+ * there weren't any, or a list is being compiled) and forgets them */
+GLubyte _glTakeBounds();
+
+/* Whether a draw with the given bounds has to go through the near-Z clipper */
+GLboolean _glNeedsClipping(GLubyte bounds);
+
+GLboolean _glIsTriangleRejectionEnabled();
+void _glEnableTriangleRejection(GLboolean v);
+
 void _glKosThrowError(GLenum error, const char *function);
 void _glKosPrintError();
 GLubyte _glKosHasError();
 
+/* Recording (see record.c), these do nothing unless a recording is in progress */
+GLboolean _glIsRecording();
+void _glRecordFrame(const PolyList* op, const PolyList* pt, const PolyList* tr);
+void _glRecordTextureAlloc(const void* ptr, GLuint size);
+void _glRecordTextureFree(const void* ptr);
+void _glRecordTextureWrite(const void* ptr, GLuint size);
+void _glRecordPaletteFormat(GLuint format);
+void _glRecordPalette(GLuint first, GLuint count, const GLuint* entries);
+void _glRecordBackground(GLfloat r, GLfloat g, GLfloat b);
+void _glRecordAlphaRef(GLuint ref);
+
+void _glRecordTextureState();
+void _glRecordRenderState();
+
+/* Counters read through glGetIntegerv(GL_*_KOS) and reset by
+ * glKosResetCounters, updated as the pipeline runs */
+typedef struct {
+    GLuint draw_calls;
+    GLuint vertices_in;
+    GLuint vertices_out;
+    GLuint triangles_clipped;
+    GLuint vertices_dead;
+    GLuint vertices_transformed;
+
+    /* For indexed draws through the post-transform cache, see
+     * generateFromBuffer. 1 - referenced / served is the hit rate. */
+    GLuint indices_served;
+    GLuint vertices_referenced;
+    GLuint headers;
+    GLuint headers_elided;
+    GLuint headers_compiled;
+    GLuint draws_culled;
+
+    /* Off screen, too small and back facing, see _glRejectTriangles */
+    GLuint triangles_rejected[3];
+    GLuint vertices_rejected;
+    GLuint texture_uploads;
+    GLuint texture_upload_bytes;
+    GLuint palette_entries;
+
+    /* OP, PT and TR */
+    GLuint list_bytes[3];
+    GLuint list_high_water[3];
+
+    GLuint frame_arena_high_water;
+    GLuint frame_arena_spills;
+
+    GLuint allocations;
+    GLuint allocation_bytes;
+    GLuint frees;
+} RenderCounters;
+
+extern RenderCounters RENDER_COUNTERS;
+
 #define PVR_VERTEX_BUF_SIZE 2560 * 256
 #define MAX_TEXTURE_UNITS 2
 #define MAX_LIGHTS 8
 
-#define CLAMP( X, MIN, MAX )  ( (X)<(MIN) ? (MIN) : ((X)>(MAX) ? (MAX) : (X)) )
+/* Everything the state changes recorded into display lists can affect, so
+ * that glNewList(GL_COMPILE) can save it and glEndList put it back */
+typedef struct {
+    pvr_poly_cxt_t context;
+    GLenum cull_face;
+    GLenum front_face;
+    GLenum depth_func;
+    GLenum blend_sfactor;
+    GLenum blend_dfactor;
+    GLboolean culling;
+    GLboolean color_material;
+    GLboolean shared_palette;
+    GLboolean alpha_test;
+    GLboolean normalize;
+    GLboolean depth_test;
+    GLboolean blend;
+    GLboolean lighting;
+    GLboolean clipping;
+    GLboolean rejection;
+    GLboolean lights[MAX_LIGHTS];
+    GLboolean textures[MAX_TEXTURE_UNITS];
+    GLuint bound[MAX_TEXTURE_UNITS];  /* Texture names, 0 if none */
+    GLubyte active_texture;
+    GLubyte alpha_ref;
+} ListSavedState;
+
+void _glSaveListState(ListSavedState* state);
+void _glRestoreListState(const ListSavedState* state);
+void _glSaveTextureBindings(GLuint* names, GLubyte* active);
+void _glRestoreTextureBindings(const GLuint* names, GLubyte active);
 
-#define mat_trans_fv12() { \
-        __asm__ __volatile__( \
-                              "fldi1 fr15\n" \
-                              "ftrv	 xmtrx, fv12\n" \
-                              "fldi1 fr14\n" \
-                              "fdiv	 fr15, fr14\n" \
-                              "fmul	 fr14, fr12\n" \
-                              "fmul	 fr14, fr13\n" \
-                              : "=f" (__x), "=f" (__y), "=f" (__z) \
-                              : "0" (__x), "1" (__y), "2" (__z) \
-                              : "fr15" ); \
-    }
+#define CLAMP( X, MIN, MAX )  ( (X)<(MIN) ? (MIN) : ((X)>(MAX) ? (MAX) : (X)) )
 
 #endif // PRIVATE_H
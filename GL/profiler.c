@@ -1,143 +1,676 @@
-#include <kos.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdio.h>
 
+#include "platform.h"
 #include "profiler.h"
-#include "../containers/aligned_vector.h"
+#include "alloc.h"
 
-#define MAX_PATH 256
+#define MAX_NAME 32
+#define MAX_PATH 128
 
+/* Each distinct stack of pushed names is a node, identified by its parent
+ * node and the name pushed on top of it. Node 0 is the root. */
 typedef struct {
-    char name[MAX_PATH];
+    uint8_t parent;
+    ProfilerId name;
+} ProfilerNode;
 
-    uint64_t total_time_us;
+typedef struct {
+    uint8_t node;
+    uint64_t start_time;
+    uint64_t start_counters[PROFILER_MAX_COUNTERS];
+} ProfilerFrame;
+
+typedef struct {
+    char path[MAX_PATH];
+
+    uint64_t total_time;
     uint64_t total_calls;
+    uint64_t min_time;
+    uint64_t max_time;
+    uint64_t counters[PROFILER_MAX_COUNTERS];
+
+    /* PROFILER_HISTOGRAM_BUCKETS counts, in HISTOGRAMS */
+    uint32_t* histogram;
 } ProfilerResult;
 
-typedef struct {
-    AlignedVector stack;
-    AlignedVector results;
-    uint64_t start_time_in_us;
-} RootProfiler;
+uint8_t PROFILER_ENABLED = 0;
+
+/* Name 0 is used when the table is full */
+static char NAMES[PROFILER_MAX_NAMES][MAX_NAME] = {"?"};
+static uint8_t NAME_COUNT = 1;
+
+static ProfilerNode NODES[PROFILER_MAX_NODES];
+static uint8_t NODE_COUNT = 1;
+
+/* Child node for each node and pushed name, 0 if it doesn't exist yet */
+static uint8_t CHILDREN[PROFILER_MAX_NODES][PROFILER_MAX_NAMES];
+
+/* Result index + 1 for each node and checkpoint name */
+static uint8_t SLOTS[PROFILER_MAX_NODES][PROFILER_MAX_NAMES];
+
+static ProfilerResult RESULTS[PROFILER_MAX_RESULTS];
+static uint8_t RESULT_COUNT = 0;
+
+/* Histograms for every result, allocated by profiler_enable rather than as
+ * results are created, so that a stage which is first reached after the
+ * application enters steady state (see glKosSetSteadyState) doesn't
+ * allocate */
+static uint32_t* HISTOGRAMS = NULL;
 
+static ProfilerFrame STACK[PROFILER_MAX_DEPTH];
+static uint8_t DEPTH = 0;
 
-static RootProfiler* root = NULL;
+/* Pushes beyond PROFILER_MAX_DEPTH, which are ignored */
+static uint32_t OVERFLOW_DEPTH = 0;
 
-static char PROFILER_ENABLED = 0;
+static ProfilerClock CLOCK = profiler_clock_us;
+static uint64_t TICKS_PER_SECOND = 1000000;
+
+/* Result for whole frames, timed from one profiler_frame to the next */
+static ProfilerId FRAME_ID = 0;
+static ProfilerId FRAME_SUFFIX_ID = 0;
+static uint64_t LAST_FRAME_TIME = 0;
+
+static ProfilerCounter COUNTERS[PROFILER_MAX_COUNTERS] = {PROFILER_COUNTER_NONE, PROFILER_COUNTER_NONE};
+static uint8_t COUNTERS_ENABLED = 0;
+
+static const char* COUNTER_NAMES[PROFILER_COUNTER_COUNT] = {
+    "none",
+    "cycles",
+    "instructions",
+    "fpu_instructions",
+    "ocache_misses",
+    "icache_misses",
+    "ocache_stalls",
+    "fpu_stalls"
+};
+
+static inline void read_counters(uint64_t* out) {
+    for(uint8_t i = 0; i < PROFILER_MAX_COUNTERS; ++i) {
+        out[i] = _glPerfCounterRead(i);
+    }
+}
+
+static ProfilerEvent* TIMELINE = NULL;
+static uint32_t TIMELINE_CAPACITY = 0;
+static uint32_t TIMELINE_HEAD = 0;
+static uint32_t TIMELINE_COUNT = 0;
+static uint32_t FRAME = 0;
+
+static inline void record_event(ProfilerEventType type, ProfilerId name, uint64_t time) {
+    if(!TIMELINE) {
+        return;
+    }
+
+    ProfilerEvent* event = &TIMELINE[TIMELINE_HEAD];
+    event->time = time;
+    event->frame = FRAME;
+    event->type = type;
+    event->name = name;
+    event->padding = 0;
+
+    TIMELINE_HEAD = (TIMELINE_HEAD + 1) % TIMELINE_CAPACITY;
+    if(TIMELINE_COUNT < TIMELINE_CAPACITY) {
+        TIMELINE_COUNT++;
+    }
+}
+
+uint64_t profiler_clock_us() {
+    return timer_us_gettime64();
+}
+
+uint64_t profiler_clock_ns() {
+    return timer_ns_gettime64();
+}
+
+void profiler_set_clock(ProfilerClock clock, uint64_t ticks_per_second) {
+    if(!clock || !ticks_per_second) {
+        clock = profiler_clock_us;
+        ticks_per_second = 1000000;
+    }
+
+    CLOCK = clock;
+    TICKS_PER_SECOND = ticks_per_second;
+
+    profiler_clear();
+}
+
+static void reset_stack() {
+    DEPTH = 0;
+    OVERFLOW_DEPTH = 0;
+}
 
 void profiler_enable() {
+    if(!HISTOGRAMS) {
+        HISTOGRAMS = (uint32_t*) GL_MALLOC(sizeof(uint32_t) * PROFILER_HISTOGRAM_BUCKETS * PROFILER_MAX_RESULTS);
+        if(!HISTOGRAMS) {
+            return;
+        }
+    }
+
     PROFILER_ENABLED = 1;
+    reset_stack();
 }
 
 void profiler_disable() {
     PROFILER_ENABLED = 0;
+    reset_stack();
 }
 
-static ProfilerResult* profiler_get_or_create_result(const char* name) {
-    if(!PROFILER_ENABLED) return NULL;
-
-    uint16_t i = 0;
-    for(; i < root->results.size; ++i) {
-        ProfilerResult* result = aligned_vector_at(&root->results, i);
-        if(strcmp(result->name, name) == 0) {
-            return result;
+ProfilerId profiler_intern(const char* name) {
+    ProfilerId i = 1;
+    for(; i < NAME_COUNT; ++i) {
+        if(strcmp(NAMES[i], name) == 0) {
+            return i;
         }
     }
 
-    ProfilerResult newResult;
-    strcpy(newResult.name, name);
-    newResult.total_calls = 0;
-    newResult.total_time_us = 0;
-    aligned_vector_push_back(&root->results, &newResult, 1);
-    return aligned_vector_back(&root->results);
-}
+    if(NAME_COUNT == PROFILER_MAX_NAMES) {
+        return 0;
+    }
 
-static uint64_t current_time_in_us() {
-    return timer_us_gettime64();
+    strncpy(NAMES[NAME_COUNT], name, MAX_NAME - 1);
+    return NAME_COUNT++;
 }
 
-static void profiler_generate_path(const char* suffix, char* path) {
-    uint16_t i = 0;
-    for(; i < root->stack.size; ++i) {
-        Profiler* prof = aligned_vector_at(&root->stack, i);
-        strcat(path, prof->name);
+static void generate_path(uint8_t node, ProfilerId suffix, char* path) {
+    uint8_t chain[PROFILER_MAX_DEPTH];
+    uint8_t count = 0;
+
+    while(node && count < PROFILER_MAX_DEPTH) {
+        chain[count++] = node;
+        node = NODES[node].parent;
+    }
+
+    path[0] = '\0';
 
-        if(i != root->stack.size - 1) {
-            strcat(path, ".");
+    while(count--) {
+        strncat(path, NAMES[NODES[chain[count]].name], MAX_PATH - strlen(path) - 1);
+
+        if(count) {
+            strncat(path, ".", MAX_PATH - strlen(path) - 1);
         }
     }
 
-    if(strlen(suffix)) {
-        strcat(path, ":");
-        strcat(path, suffix);
+    if(NAMES[suffix][0]) {
+        strncat(path, ":", MAX_PATH - strlen(path) - 1);
+        strncat(path, NAMES[suffix], MAX_PATH - strlen(path) - 1);
     }
 }
 
+void profiler_push_id(ProfilerId id) {
+    if(!PROFILER_ENABLED) return;
 
-Profiler* profiler_push(const char* name) {
-    if(!PROFILER_ENABLED) return NULL;
+    if(DEPTH == PROFILER_MAX_DEPTH) {
+        OVERFLOW_DEPTH++;
+        return;
+    }
 
-    if(!root) {
-        root = (RootProfiler*) malloc(sizeof(RootProfiler));
-        aligned_vector_init(
-            &root->stack,
-            sizeof(Profiler)
-        );
+    const uint8_t parent = (DEPTH) ? STACK[DEPTH - 1].node : 0;
 
-        aligned_vector_init(
-            &root->results,
-            sizeof(ProfilerResult)
-        );
+    /* If the node table fills up, results under the missing nodes are dropped */
+    const uint8_t dropped = DEPTH && !parent;
+
+    uint8_t node = 0;
+    if(!dropped) {
+        node = CHILDREN[parent][id];
 
-        aligned_vector_reserve(&root->stack, 32);
-        aligned_vector_reserve(&root->results, 64);
+        if(!node && NODE_COUNT < PROFILER_MAX_NODES) {
+            node = NODE_COUNT++;
+            NODES[node].parent = parent;
+            NODES[node].name = id;
+            CHILDREN[parent][id] = node;
+        }
     }
 
-    Profiler profiler;
-    strncpy(profiler.name, name, 64);
-    profiler.start_time_in_us = current_time_in_us();
+    ProfilerFrame* frame = &STACK[DEPTH++];
+    frame->node = node;
 
-    aligned_vector_push_back(&root->stack, &profiler, 1);
-    return aligned_vector_back(&root->stack);
+    if(COUNTERS_ENABLED) {
+        read_counters(frame->start_counters);
+    }
+
+    frame->start_time = CLOCK();
+
+    record_event(PROFILER_EVENT_PUSH, id, frame->start_time);
 }
 
-void profiler_checkpoint(const char* name) {
-    if(!PROFILER_ENABLED) return;
+/* Buckets are log-linear: eight per power of two, so taking the middle of
+ * a bucket is within about 6% of the real value */
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+
+static inline uint32_t histogram_bucket(uint64_t ticks) {
+    if(ticks < SUB_BUCKETS) {
+        return (uint32_t) ticks;
+    }
 
-    Profiler* prof = aligned_vector_back(&root->stack);
+    const uint32_t e = 63 - __builtin_clzll(ticks);
+    const uint32_t sub = (ticks >> (e - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    const uint32_t bucket = (e - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+    return (bucket < PROFILER_HISTOGRAM_BUCKETS) ? bucket : PROFILER_HISTOGRAM_BUCKETS - 1;
+}
 
-    char path[MAX_PATH];
-    path[0] = '\0';
+static uint64_t histogram_bucket_start(uint32_t bucket) {
+    if(bucket < SUB_BUCKETS) {
+        return bucket;
+    }
 
-    profiler_generate_path(name, path);
+    const uint32_t e = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    return (uint64_t) (SUB_BUCKETS + bucket % SUB_BUCKETS) << (e - SUB_BUCKET_BITS);
+}
 
-    uint64_t now = current_time_in_us();
-    uint64_t diff = now - prof->start_time_in_us;
-    prof->start_time_in_us = now;
+static ProfilerResult* find_or_create_result(uint8_t node, ProfilerId id) {
+    uint8_t slot = SLOTS[node][id];
+    if(!slot) {
+        if(RESULT_COUNT == PROFILER_MAX_RESULTS) {
+            return NULL;
+        }
+
+        ProfilerResult* result = &RESULTS[RESULT_COUNT];
+        result->histogram = HISTOGRAMS + RESULT_COUNT * PROFILER_HISTOGRAM_BUCKETS;
+
+        generate_path(node, id, result->path);
+        result->total_time = 0;
+        result->total_calls = 0;
+        result->min_time = UINT64_MAX;
+        result->max_time = 0;
+        memset(result->counters, 0, sizeof(result->counters));
+        memset(result->histogram, 0, sizeof(uint32_t) * PROFILER_HISTOGRAM_BUCKETS);
+
+        slot = SLOTS[node][id] = ++RESULT_COUNT;
+    }
+
+    return &RESULTS[slot - 1];
+}
 
-    ProfilerResult* result = profiler_get_or_create_result(path);
+static inline void add_sample(ProfilerResult* result, uint64_t ticks) {
     result->total_calls++;
-    result->total_time_us += diff;
+    result->total_time += ticks;
+    result->histogram[histogram_bucket(ticks)]++;
+
+    if(ticks < result->min_time) {
+        result->min_time = ticks;
+    }
+
+    if(ticks > result->max_time) {
+        result->max_time = ticks;
+    }
+}
+
+void profiler_checkpoint_id(ProfilerId id) {
+    if(!PROFILER_ENABLED || !DEPTH || OVERFLOW_DEPTH) return;
+
+    ProfilerFrame* frame = &STACK[DEPTH - 1];
+
+    const uint64_t now = CLOCK();
+    const uint64_t diff = now - frame->start_time;
+    frame->start_time = now;
+
+    record_event(PROFILER_EVENT_CHECKPOINT, id, now);
+
+    if(!frame->node) {
+        return;
+    }
+
+    ProfilerResult* result = find_or_create_result(frame->node, id);
+    if(result) {
+        add_sample(result, diff);
+    }
+
+    if(COUNTERS_ENABLED) {
+        uint64_t counters[PROFILER_MAX_COUNTERS];
+        read_counters(counters);
+
+        for(uint8_t i = 0; i < PROFILER_MAX_COUNTERS; ++i) {
+            if(result) {
+                result->counters[i] += counters[i] - frame->start_counters[i];
+            }
+
+            frame->start_counters[i] = counters[i];
+        }
+    }
 }
 
 void profiler_pop() {
     if(!PROFILER_ENABLED) return;
 
-    aligned_vector_resize(&root->stack, root->stack.size - 1);
+    if(OVERFLOW_DEPTH) {
+        OVERFLOW_DEPTH--;
+    } else if(DEPTH) {
+        DEPTH--;
+
+        if(TIMELINE) {
+            record_event(PROFILER_EVENT_POP, 0, CLOCK());
+        }
+    }
+}
+
+void profiler_push(const char* name) {
+    if(!PROFILER_ENABLED) return;
+
+    profiler_push_id(profiler_intern(name));
+}
+
+void profiler_checkpoint(const char* name) {
+    if(!PROFILER_ENABLED) return;
+
+    profiler_checkpoint_id(profiler_intern(name));
+}
+
+static uint64_t ticks_to_us(uint64_t ticks) {
+    return (ticks / TICKS_PER_SECOND) * 1000000 + ((ticks % TICKS_PER_SECOND) * 1000000) / TICKS_PER_SECOND;
+}
+
+static double ticks_to_ms_f(uint64_t ticks) {
+    return (double) ticks * 1000.0 / (double) TICKS_PER_SECOND;
 }
 
 void profiler_print_stats() {
     if(!PROFILER_ENABLED) return;
 
-    fprintf(stderr, "%-60s%-20s%-20s%-20s\n", "Path", "Average", "Total", "Calls");
+    fprintf(stderr, "%-60s%-12s%-12s%-12s%-12s%-12s%-12s%-12s",
+        "Path", "Average", "p50", "p95", "p99", "Max", "Total", "Calls");
+
+    for(uint8_t c = 0; c < PROFILER_MAX_COUNTERS; ++c) {
+        if(COUNTERS[c] != PROFILER_COUNTER_NONE) {
+            fprintf(stderr, "%-16s", profiler_counter_name(COUNTERS[c]));
+        }
+    }
+
+    fprintf(stderr, "\n");
 
     uint16_t i = 0;
-    for(; i < root->results.size; ++i) {
-        ProfilerResult* result = aligned_vector_at(&root->results, i);
-        float ms = ((float) result->total_time_us) / 1000.0f;
-        float avg = ms / (float) result->total_calls;
+    for(; i < RESULT_COUNT; ++i) {
+        ProfilerResult* result = &RESULTS[i];
+        ProfilerStats stats;
+        profiler_result_stats(i, &stats);
+
+        fprintf(stderr, "%-60s%-12f%-12f%-12f%-12f%-12f%-12f%-12" PRIu64,
+            result->path, stats.mean_us / 1000.0, stats.p50_us / 1000.0, stats.p95_us / 1000.0,
+            stats.p99_us / 1000.0, stats.max_us / 1000.0, ticks_to_ms_f(result->total_time), result->total_calls
+        );
+
+        for(uint8_t c = 0; c < PROFILER_MAX_COUNTERS; ++c) {
+            if(COUNTERS[c] != PROFILER_COUNTER_NONE) {
+                fprintf(stderr, "%-16" PRIu64, result->counters[c]);
+            }
+        }
 
-        fprintf(stderr, "%-60s%-20f%-20f%" PRIu64 "\n", result->name, (double)avg, (double)ms, result->total_calls);
+        fprintf(stderr, "\n");
     }
 }
+
+void profiler_clear() {
+    memset(SLOTS, 0, sizeof(SLOTS));
+    RESULT_COUNT = 0;
+    LAST_FRAME_TIME = 0;
+}
+
+/* Finds the bucket containing the given fraction of samples, and assumes
+ * the samples in it are spread evenly across it. Taking the middle of the
+ * bucket instead would give the same answer for every percentile of a
+ * tight distribution. The result is clamped to the times actually seen,
+ * which also makes it exact when every sample is the same. */
+static double percentile(const ProfilerResult* result, double fraction) {
+    if(!result->total_calls) {
+        return 0.0;
+    }
+
+    const double target = fraction * result->total_calls;
+    uint64_t seen = 0;
+    double value = result->max_time;
+
+    for(uint32_t i = 0; i < PROFILER_HISTOGRAM_BUCKETS; ++i) {
+        const uint32_t count = result->histogram[i];
+        if(count && seen + count >= target) {
+            const double start = histogram_bucket_start(i);
+            const double end = histogram_bucket_start(i + 1);
+            value = start + (end - start) * (target - seen) / count;
+            break;
+        }
+
+        seen += count;
+    }
+
+    if(value < result->min_time) {
+        return result->min_time;
+    }
+
+    return (value < result->max_time) ? value : result->max_time;
+}
+
+uint8_t profiler_result_stats(uint32_t index, ProfilerStats* stats) {
+    if(index >= RESULT_COUNT) {
+        return 0;
+    }
+
+    const ProfilerResult* result = &RESULTS[index];
+    const double us_per_tick = 1000000.0 / (double) TICKS_PER_SECOND;
+
+    stats->calls = result->total_calls;
+    stats->mean_us = (result->total_calls) ? (result->total_time * us_per_tick) / result->total_calls : 0.0;
+    stats->p50_us = percentile(result, 0.50) * us_per_tick;
+    stats->p95_us = percentile(result, 0.95) * us_per_tick;
+    stats->p99_us = percentile(result, 0.99) * us_per_tick;
+    stats->max_us = result->max_time * us_per_tick;
+    return 1;
+}
+
+uint8_t profiler_set_counters(ProfilerCounter counter0, ProfilerCounter counter1) {
+    const ProfilerCounter counters[PROFILER_MAX_COUNTERS] = {counter0, counter1};
+    uint8_t started = 0;
+
+    for(uint8_t i = 0; i < PROFILER_MAX_COUNTERS; ++i) {
+        _glPerfCounterStop(i);
+        COUNTERS[i] = PROFILER_COUNTER_NONE;
+
+        if(counters[i] != PROFILER_COUNTER_NONE && _glPerfCounterStart(i, counters[i])) {
+            COUNTERS[i] = counters[i];
+            started++;
+        }
+    }
+
+    COUNTERS_ENABLED = (started > 0);
+
+    /* Anything on the stack has stale counter values */
+    reset_stack();
+    profiler_clear();
+
+    return started;
+}
+
+uint8_t profiler_result_counters(uint32_t index, uint64_t totals[PROFILER_MAX_COUNTERS]) {
+    if(index >= RESULT_COUNT) {
+        return 0;
+    }
+
+    for(uint8_t i = 0; i < PROFILER_MAX_COUNTERS; ++i) {
+        totals[i] = RESULTS[index].counters[i];
+    }
+
+    return 1;
+}
+
+const char* profiler_counter_name(ProfilerCounter counter) {
+    return (counter < PROFILER_COUNTER_COUNT) ? COUNTER_NAMES[counter] : "none";
+}
+
+const uint32_t* profiler_result_histogram(uint32_t index) {
+    return (index < RESULT_COUNT) ? RESULTS[index].histogram : NULL;
+}
+
+double profiler_histogram_bucket_us(uint32_t bucket) {
+    return histogram_bucket_start(bucket) * 1000000.0 / (double) TICKS_PER_SECOND;
+}
+
+uint8_t profiler_result(uint32_t index, const char** path, uint64_t* total_time_us, uint64_t* total_calls) {
+    if(index >= RESULT_COUNT) {
+        return 0;
+    }
+
+    ProfilerResult* result = &RESULTS[index];
+    *path = result->path;
+    *total_time_us = ticks_to_us(result->total_time);
+    *total_calls = result->total_calls;
+    return 1;
+}
+
+void profiler_timeline_enable(uint32_t max_events) {
+    profiler_timeline_disable();
+
+    if(!max_events) {
+        return;
+    }
+
+    TIMELINE = (ProfilerEvent*) GL_MALLOC(sizeof(ProfilerEvent) * max_events);
+    if(TIMELINE) {
+        TIMELINE_CAPACITY = max_events;
+    }
+}
+
+void profiler_timeline_disable() {
+    GL_FREE(TIMELINE);
+    TIMELINE = NULL;
+    TIMELINE_CAPACITY = 0;
+    TIMELINE_HEAD = 0;
+    TIMELINE_COUNT = 0;
+}
+
+void profiler_frame() {
+    if(!PROFILER_ENABLED) return;
+
+    const uint64_t now = CLOCK();
+
+    if(!FRAME_ID) {
+        FRAME_ID = profiler_intern("frame");
+        FRAME_SUFFIX_ID = profiler_intern("");
+    }
+
+    /* Frames go under a top level node of their own */
+    uint8_t node = CHILDREN[0][FRAME_ID];
+    if(!node && NODE_COUNT < PROFILER_MAX_NODES) {
+        node = NODE_COUNT++;
+        NODES[node].parent = 0;
+        NODES[node].name = FRAME_ID;
+        CHILDREN[0][FRAME_ID] = node;
+    }
+
+    if(node && LAST_FRAME_TIME) {
+        ProfilerResult* result = find_or_create_result(node, FRAME_SUFFIX_ID);
+        if(result) {
+            add_sample(result, now - LAST_FRAME_TIME);
+        }
+    }
+
+    LAST_FRAME_TIME = now;
+
+    record_event(PROFILER_EVENT_FRAME, 0, now);
+    FRAME++;
+}
+
+static ProfilerEvent* timeline_at(uint32_t i) {
+    const uint32_t oldest = (TIMELINE_HEAD + TIMELINE_CAPACITY - TIMELINE_COUNT) % TIMELINE_CAPACITY;
+    return &TIMELINE[(oldest + i) % TIMELINE_CAPACITY];
+}
+
+static double ticks_to_us_f(uint64_t ticks) {
+    return (double) ticks * 1000000.0 / (double) TICKS_PER_SECOND;
+}
+
+uint8_t profiler_timeline_write_json(FILE* out) {
+    if(!TIMELINE || !out) {
+        return 0;
+    }
+
+    /* The oldest frame in the buffer has probably been partly overwritten,
+     * so start after the first frame marker */
+    uint32_t start = 0;
+    while(start < TIMELINE_COUNT && timeline_at(start)->type != PROFILER_EVENT_FRAME) {
+        ++start;
+    }
+
+    ProfilerId names[PROFILER_MAX_DEPTH];
+    uint64_t last[PROFILER_MAX_DEPTH];
+    uint8_t depth = 0;
+    uint8_t first = 1;
+
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+
+    for(uint32_t i = start; i < TIMELINE_COUNT; ++i) {
+        const ProfilerEvent* event = timeline_at(i);
+        const double ts = ticks_to_us_f(event->time);
+
+        switch(event->type) {
+            case PROFILER_EVENT_PUSH:
+                if(depth < PROFILER_MAX_DEPTH) {
+                    names[depth] = event->name;
+                    last[depth] = event->time;
+                }
+                depth++;
+
+                fprintf(out, "%s  {\"name\": \"%s\", \"ph\": \"B\", \"ts\": %.3f, \"pid\": 1, \"tid\": 1}",
+                    (first) ? "" : ",\n", NAMES[event->name], ts);
+            break;
+            case PROFILER_EVENT_POP:
+                if(!depth) {
+                    continue;
+                }
+
+                depth--;
+
+                fprintf(out, "%s  {\"name\": \"%s\", \"ph\": \"E\", \"ts\": %.3f, \"pid\": 1, \"tid\": 1}",
+                    (first) ? "" : ",\n", (depth < PROFILER_MAX_DEPTH) ? NAMES[names[depth]] : "?", ts);
+            break;
+            case PROFILER_EVENT_CHECKPOINT: {
+                /* Checkpoints cover the time since the previous checkpoint
+                 * (or the push) so show them as complete events */
+                if(!depth || depth > PROFILER_MAX_DEPTH) {
+                    continue;
+                }
+
+                const uint64_t previous = last[depth - 1];
+                last[depth - 1] = event->time;
+
+                fprintf(out, "%s  {\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": 1}",
+                    (first) ? "" : ",\n", NAMES[event->name], ticks_to_us_f(previous), ticks_to_us_f(event->time - previous));
+            } break;
+            case PROFILER_EVENT_FRAME:
+                fprintf(out, "%s  {\"name\": \"frame %u\", \"ph\": \"i\", \"s\": \"g\", \"ts\": %.3f, \"pid\": 1, \"tid\": 1}",
+                    (first) ? "" : ",\n", (unsigned) event->frame, ts);
+            break;
+            default:
+                continue;
+        }
+
+        first = 0;
+    }
+
+    fprintf(out, "\n]}\n");
+    return 1;
+}
+
+uint8_t profiler_timeline_write_binary(FILE* out) {
+    if(!TIMELINE || !out) {
+        return 0;
+    }
+
+    const uint32_t header[2] = {PROFILER_TIMELINE_MAGIC, PROFILER_TIMELINE_VERSION};
+    const uint32_t name_count = NAME_COUNT;
+
+    fwrite(header, sizeof(header), 1, out);
+    fwrite(&TICKS_PER_SECOND, sizeof(TICKS_PER_SECOND), 1, out);
+    fwrite(&name_count, sizeof(name_count), 1, out);
+    fwrite(NAMES, MAX_NAME, name_count, out);
+    fwrite(&TIMELINE_COUNT, sizeof(TIMELINE_COUNT), 1, out);
+
+    for(uint32_t i = 0; i < TIMELINE_COUNT; ++i) {
+        fwrite(timeline_at(i), sizeof(ProfilerEvent), 1, out);
+    }
+
+    return 1;
+}
@@ -1,18 +1,174 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
 
-typedef struct {
-    char name[64];
-    uint64_t start_time_in_us;
-} Profiler;
+/* Names are interned into small integer IDs the first time they are seen,
+ * after which pushing and checkpointing is a couple of table lookups and a
+ * clock read. Use the PROFILER_* macros at call sites, they cache the ID in
+ * a static so each name is only looked up once, and cost a single branch
+ * when the profiler is disabled. */
+typedef uint8_t ProfilerId;
 
+#define PROFILER_MAX_NAMES 64
+#define PROFILER_MAX_NODES 64
+#define PROFILER_MAX_DEPTH 16
+#define PROFILER_MAX_RESULTS 128
+#define PROFILER_HISTOGRAM_BUCKETS 256
 
-Profiler* profiler_push(const char* name);
-void profiler_checkpoint(const char* name);
+extern uint8_t PROFILER_ENABLED;
+
+#define PROFILER_PUSH(name) \
+    do { \
+        static ProfilerId _profiler_id = 0; \
+        if(PROFILER_ENABLED) { \
+            if(!_profiler_id) _profiler_id = profiler_intern(name); \
+            profiler_push_id(_profiler_id); \
+        } \
+    } while(0)
+
+#define PROFILER_CHECKPOINT(name) \
+    do { \
+        static ProfilerId _profiler_id = 0; \
+        if(PROFILER_ENABLED) { \
+            if(!_profiler_id) _profiler_id = profiler_intern(name); \
+            profiler_checkpoint_id(_profiler_id); \
+        } \
+    } while(0)
+
+#define PROFILER_POP() \
+    do { \
+        if(PROFILER_ENABLED) profiler_pop(); \
+    } while(0)
+
+/* Returns the ID for name, or 0 if the name table is full */
+ProfilerId profiler_intern(const char* name);
+
+void profiler_push_id(ProfilerId id);
+void profiler_checkpoint_id(ProfilerId id);
 void profiler_pop();
 
+/* Slower versions which intern the name on every call */
+void profiler_push(const char* name);
+void profiler_checkpoint(const char* name);
+
 void profiler_print_stats();
 
+/* Discard all accumulated results */
+void profiler_clear();
+
+/* Returns the result at index, or 0 if there isn't one. Paths are of the
+ * form "glEnd.submitVertices:transform" */
+uint8_t profiler_result(uint32_t index, const char** path, uint64_t* total_time_us, uint64_t* total_calls);
+
+typedef struct {
+    uint64_t calls;
+    double mean_us;
+
+    /* Interpolated within the histogram's buckets (which are about 12%
+     * wide), between the fastest and slowest times seen */
+    double p50_us;
+    double p95_us;
+    double p99_us;
+
+    double max_us;
+} ProfilerStats;
+
+/* Distribution of the times for the result at index, or 0 if there isn't one */
+uint8_t profiler_result_stats(uint32_t index, ProfilerStats* stats);
+
+/* Every result keeps a histogram of PROFILER_HISTOGRAM_BUCKETS counts,
+ * bucket i covers times from profiler_histogram_bucket_us(i) up to the
+ * start of the next bucket. Returns NULL if index is out of range. */
+const uint32_t* profiler_result_histogram(uint32_t index);
+double profiler_histogram_bucket_us(uint32_t bucket);
+
+/* The first call allocates the histograms for every result, so that
+ * profiling doesn't allocate again after that */
 void profiler_enable();
 void profiler_disable();
+
+/* The clock defaults to profiler_clock_us. Changing the clock clears any
+ * results as they would be in different units. Passing NULL restores the
+ * default. */
+typedef uint64_t (*ProfilerClock)();
+
+void profiler_set_clock(ProfilerClock clock, uint64_t ticks_per_second);
+
+/* timer_us_gettime64 */
+uint64_t profiler_clock_us();
+
+/* timer_ns_gettime64, which is derived from the TMU counter on the
+ * Dreamcast and clock_gettime on the host */
+uint64_t profiler_clock_ns();
+
+/* Hardware performance counters. Up to PROFILER_MAX_COUNTERS events can be
+ * counted at once (the SH4 has two counters), and the change in each over
+ * every checkpoint is added to the result alongside the time. Events which
+ * the platform can't count always read zero. On the host these use
+ * perf_event on Linux, where access may need to be granted through
+ * /proc/sys/kernel/perf_event_paranoid. */
+#define PROFILER_MAX_COUNTERS 2
+
+typedef enum {
+    PROFILER_COUNTER_NONE,
+    PROFILER_COUNTER_CYCLES,
+    PROFILER_COUNTER_INSTRUCTIONS,
+    PROFILER_COUNTER_FPU_INSTRUCTIONS,
+    PROFILER_COUNTER_OPERAND_CACHE_MISSES,
+    PROFILER_COUNTER_INSTRUCTION_CACHE_MISSES,
+    PROFILER_COUNTER_OPERAND_CACHE_STALLS,
+    PROFILER_COUNTER_FPU_STALLS,
+    PROFILER_COUNTER_COUNT
+} ProfilerCounter;
+
+/* Returns how many of the counters could be started. Changing the counters
+ * clears any results. */
+uint8_t profiler_set_counters(ProfilerCounter counter0, ProfilerCounter counter1);
+
+/* Totals for each counter for the result at index, or 0 if there isn't one */
+uint8_t profiler_result_counters(uint32_t index, uint64_t totals[PROFILER_MAX_COUNTERS]);
+
+/* Short name for each counter, e.g. "ocache_misses" */
+const char* profiler_counter_name(ProfilerCounter counter);
+
+/* Marks the end of a frame, called from glKosSwapBuffers. The time between
+ * frames is kept as the "frame" result. */
+void profiler_frame();
+
+/* Timeline mode records every push, pop and checkpoint into a ring buffer
+ * of max_events entries, so that individual frames can be inspected rather
+ * than just the averages. Only takes effect while the profiler is enabled. */
+void profiler_timeline_enable(uint32_t max_events);
+void profiler_timeline_disable();
+
+/* Writes the complete frames in the ring buffer as Chrome trace event JSON
+ * (load it in chrome://tracing or Perfetto). Returns 0 on failure. */
+uint8_t profiler_timeline_write_json(FILE* out);
+
+/* Writes the ring buffer in a compact binary form, suitable for dumping
+ * over serial:
+ *
+ *  uint32 magic ("GLPT"), uint32 version, uint64 ticks_per_second
+ *  uint32 name_count, then name_count 32 byte NUL padded names
+ *  uint32 event_count, then event_count ProfilerEvents, oldest first
+ */
+#define PROFILER_TIMELINE_MAGIC 0x54504C47
+#define PROFILER_TIMELINE_VERSION 1
+
+typedef enum {
+    PROFILER_EVENT_PUSH,
+    PROFILER_EVENT_POP,
+    PROFILER_EVENT_CHECKPOINT,
+    PROFILER_EVENT_FRAME
+} ProfilerEventType;
+
+typedef struct {
+    uint64_t time;
+    uint32_t frame;
+    uint8_t type;
+    ProfilerId name;
+    uint16_t padding;
+} ProfilerEvent;
+
+uint8_t profiler_timeline_write_binary(FILE* out);
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/glkos.h"
+#include "private.h"
+#include "record.h"
+
+/* Recording is opt-in and everything here is a no-op unless
+ * glKosStartRecording has been called */
+static FILE* RECORD_FILE = NULL;
+
+/* A failed write (e.g. the disk is full) stops the recording there rather
+ * than carrying on with chunks missing. The replayer ignores a chunk
+ * that was only partly written. */
+static void stopRecording(const char* reason) {
+    fprintf(stderr, "GL RECORDING: %s, recording stopped\n", reason);
+    fclose(RECORD_FILE);
+    RECORD_FILE = NULL;
+}
+
+/* Does nothing once a write has failed */
+static void writeData(const void* data, size_t size, size_t count) {
+    if(!RECORD_FILE || !size || !count) {
+        return;
+    }
+
+    if(fwrite(data, size, count, RECORD_FILE) != count) {
+        stopRecording("write failed");
+    }
+}
+
+static void writeChunk(RecordChunkType type, const void* header, uint32_t header_size, const void* data, uint32_t data_size) {
+    RecordChunkHeader chunk;
+    chunk.type = type;
+    chunk.size = header_size + data_size;
+
+    writeData(&chunk, sizeof(chunk), 1);
+    writeData(header, header_size, 1);
+    writeData(data, data_size, 1);
+}
+
+GLboolean _glIsRecording() {
+    return RECORD_FILE != NULL;
+}
+
+void _glRecordFrame(const PolyList* op, const PolyList* pt, const PolyList* tr) {
+    if(!RECORD_FILE) {
+        return;
+    }
+
+    const uint32_t counts[3] = {op->vector.size, pt->vector.size, tr->vector.size};
+
+    RecordChunkHeader chunk;
+    chunk.type = RECORD_CHUNK_FRAME;
+    chunk.size = sizeof(counts) + (counts[0] + counts[1] + counts[2]) * 32;
+
+    writeData(&chunk, sizeof(chunk), 1);
+    writeData(counts, sizeof(counts), 1);
+    writeData(op->vector.data, 32, counts[0]);
+    writeData(pt->vector.data, 32, counts[1]);
+    writeData(tr->vector.data, 32, counts[2]);
+}
+
+void _glRecordTextureAlloc(const void* ptr, GLuint size) {
+    if(!RECORD_FILE || !ptr) {
+        return;
+    }
+
+    const uint32_t data[2] = {_glVRAMOffset(ptr), size};
+    writeChunk(RECORD_CHUNK_TEXTURE_ALLOC, data, sizeof(data), NULL, 0);
+}
+
+void _glRecordTextureFree(const void* ptr) {
+    if(!RECORD_FILE || !ptr) {
+        return;
+    }
+
+    const uint32_t offset = _glVRAMOffset(ptr);
+    writeChunk(RECORD_CHUNK_TEXTURE_FREE, &offset, sizeof(offset), NULL, 0);
+}
+
+void _glRecordTextureWrite(const void* ptr, GLuint size) {
+    if(!RECORD_FILE || !ptr) {
+        return;
+    }
+
+    /* We record what ended up in VRAM, after any conversion or twiddling */
+    const uint32_t data[2] = {_glVRAMOffset(ptr), size};
+    writeChunk(RECORD_CHUNK_TEXTURE_WRITE, data, sizeof(data), ptr, size);
+}
+
+void _glRecordPaletteFormat(GLuint format) {
+    if(!RECORD_FILE) {
+        return;
+    }
+
+    const uint32_t data = format;
+    writeChunk(RECORD_CHUNK_PALETTE_FORMAT, &data, sizeof(data), NULL, 0);
+}
+
+void _glRecordPalette(GLuint first, GLuint count, const GLuint* entries) {
+    if(!RECORD_FILE || !count) {
+        return;
+    }
+
+    const uint32_t data[2] = {first, count};
+    writeChunk(RECORD_CHUNK_PALETTE, data, sizeof(data), entries, count * sizeof(GLuint));
+}
+
+void _glRecordBackground(GLfloat r, GLfloat g, GLfloat b) {
+    if(!RECORD_FILE) {
+        return;
+    }
+
+    const float data[3] = {r, g, b};
+    writeChunk(RECORD_CHUNK_BACKGROUND, data, sizeof(data), NULL, 0);
+}
+
+void _glRecordAlphaRef(GLuint ref) {
+    if(!RECORD_FILE) {
+        return;
+    }
+
+    const uint32_t data = ref;
+    writeChunk(RECORD_CHUNK_ALPHA_REF, &data, sizeof(data), NULL, 0);
+}
+
+GLboolean APIENTRY glKosStartRecording(const char* filename) {
+    TRACE();
+
+    if(RECORD_FILE) {
+        _glKosThrowError(GL_INVALID_OPERATION, __func__);
+        _glKosPrintError();
+        return GL_FALSE;
+    }
+
+    RECORD_FILE = fopen(filename, "wb");
+    if(!RECORD_FILE) {
+        return GL_FALSE;
+    }
+
+    RecordFileHeader header;
+    header.magic = RECORD_MAGIC;
+    header.version = RECORD_VERSION;
+    writeData(&header, sizeof(header), 1);
+
+    /* Make sure the replay starts from the same state */
+    _glRecordRenderState();
+    _glRecordTextureState();
+
+    /* Flush so that a file that can't be written to fails now */
+    if(RECORD_FILE && fflush(RECORD_FILE) != 0) {
+        stopRecording("write failed");
+    }
+
+    return (RECORD_FILE) ? GL_TRUE : GL_FALSE;
+}
+
+void APIENTRY glKosStopRecording() {
+    TRACE();
+
+    if(!RECORD_FILE) {
+        return;
+    }
+
+    /* Buffered writes can still fail here */
+    if(fflush(RECORD_FILE) != 0 || ferror(RECORD_FILE)) {
+        stopRecording("write failed");
+        return;
+    }
+
+    fclose(RECORD_FILE);
+    RECORD_FILE = NULL;
+}
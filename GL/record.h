@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Recording format written by glKosStartRecording.
+ *
+ * The file starts with a RecordFileHeader and is followed by a series of
+ * chunks, each of which is a RecordChunkHeader followed by `size` bytes of
+ * payload. Everything is little endian, which is what both the SH4 and
+ * the host platforms we care about use.
+ *
+ * Texture addresses are stored as offsets into video RAM, the same as they
+ * appear in polygon headers (mode3 & 0x1FFFFF) << 3, so a replayer can
+ * relocate them.
+ */
+
+#define RECORD_MAGIC 0x52444C47  /* "GLDR" */
+#define RECORD_VERSION 1
+
+typedef enum {
+    /* uint32 op_count, pt_count, tr_count followed by that many
+     * 32 byte TA parameters for each of the lists */
+    RECORD_CHUNK_FRAME = 1,
+
+    /* uint32 offset, uint32 size */
+    RECORD_CHUNK_TEXTURE_ALLOC,
+
+    /* uint32 offset */
+    RECORD_CHUNK_TEXTURE_FREE,
+
+    /* uint32 offset, uint32 size, then size bytes exactly as in video RAM */
+    RECORD_CHUNK_TEXTURE_WRITE,
+
+    /* uint32 format (PVR_PAL_*) */
+    RECORD_CHUNK_PALETTE_FORMAT,
+
+    /* uint32 first, uint32 count, then count uint32 entries */
+    RECORD_CHUNK_PALETTE,
+
+    /* float r, g, b */
+    RECORD_CHUNK_BACKGROUND,
+
+    /* uint32 alpha reference value for the PT list */
+    RECORD_CHUNK_ALPHA_REF
+} RecordChunkType;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} RecordFileHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+} RecordChunkHeader;
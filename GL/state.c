@@ -2,15 +2,12 @@
 #include <string.h>
 #include <stdio.h>
 
-#include <dc/pvr.h>
-#include <dc/vec3f.h>
-#include <dc/video.h>
-
 #include "../include/gl.h"
 #include "../include/glext.h"
 #include "../include/glkos.h"
 
 #include "private.h"
+#include "config.h"
 
 static pvr_poly_cxt_t GL_CONTEXT;
 
@@ -18,6 +15,29 @@ pvr_poly_cxt_t* _glGetPVRContext() {
     return &GL_CONTEXT;
 }
 
+static GLubyte STATE_DIRTY = STATE_DIRTY_ALL;
+
+void _glMarkStateDirty(GLubyte bits) {
+    STATE_DIRTY |= bits;
+}
+
+GLubyte _glTakeStateDirty() {
+    const GLubyte dirty = STATE_DIRTY;
+    STATE_DIRTY = 0;
+    return dirty;
+}
+
+static GLuint TEXTURE_GENERATION = 1;
+
+void _glMarkTexturesChanged() {
+    TEXTURE_GENERATION++;
+    _glMarkStateDirty(STATE_DIRTY_TEXTURE);
+}
+
+GLuint _glTextureGeneration() {
+    return TEXTURE_GENERATION;
+}
+
 
 /* We can't just use the GL_CONTEXT for this state as the two
  * GL states are combined, so we store them separately and then
@@ -152,19 +172,27 @@ GLboolean _glCheckValidEnum(GLint param, GLint* values, const char* func) {
 
 static GLboolean TEXTURES_ENABLED [] = {GL_FALSE, GL_FALSE};
 
+GLboolean _glIsTextureEnabled(GLubyte unit) {
+    return TEXTURES_ENABLED[unit];
+}
+
 void _glUpdatePVRTextureContext(pvr_poly_cxt_t* context, GLshort textureUnit) {
     const TextureObject *tx1 = (textureUnit == 0) ? _glGetTexture0() : _glGetTexture1();
 
+    _glUpdatePVRTextureContextFor(context, (TEXTURES_ENABLED[textureUnit]) ? tx1 : NULL, BLEND_ENABLED);
+}
+
+void _glUpdatePVRTextureContextFor(pvr_poly_cxt_t* context, const TextureObject* tx1, GLboolean blend) {
     /* Disable all texturing to start with */
     context->txr.enable = PVR_TEXTURE_DISABLE;
     context->txr2.enable = PVR_TEXTURE_DISABLE;
     context->txr2.alpha = PVR_TXRALPHA_DISABLE;
 
-    if(!TEXTURES_ENABLED[textureUnit] || !tx1) {
+    if(!tx1) {
         return;
     }
 
-    context->txr.alpha = (BLEND_ENABLED) ? PVR_TXRALPHA_ENABLE : PVR_TXRALPHA_DISABLE;
+    context->txr.alpha = (blend) ? PVR_TXRALPHA_ENABLE : PVR_TXRALPHA_DISABLE;
 
     GLuint filter = PVR_FILTER_NEAREST;
     GLboolean enableMipmaps = GL_FALSE;
@@ -290,40 +318,50 @@ void _glInitContext() {
 }
 
 GLAPI void APIENTRY glEnable(GLenum cap) {
+    _glRecordListState(LIST_STATE_ENABLE, cap, 0, 0);
+
     switch(cap) {
         case GL_TEXTURE_2D:
             TEXTURES_ENABLED[_glGetActiveTexture()] = GL_TRUE;
+            _glMarkStateDirty(STATE_DIRTY_TEXTURE);
         break;
         case GL_CULL_FACE: {
             CULLING_ENABLED = GL_TRUE;
             GL_CONTEXT.gen.culling = _calc_pvr_face_culling();
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         } break;
         case GL_DEPTH_TEST: {
             DEPTH_TEST_ENABLED = GL_TRUE;
             GL_CONTEXT.depth.comparison = _calc_pvr_depth_test();
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         } break;
         case GL_BLEND: {
             BLEND_ENABLED = GL_TRUE;
             _updatePVRBlend(&GL_CONTEXT);
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         } break;
         case GL_SCISSOR_TEST: {
             GL_CONTEXT.gen.clip_mode = PVR_USERCLIP_INSIDE;
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         } break;
         case GL_LIGHTING: {
             LIGHTING_ENABLED = GL_TRUE;
         } break;
         case GL_FOG:
             GL_CONTEXT.gen.fog_type = PVR_FOG_TABLE;
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         break;
         case GL_COLOR_MATERIAL:
             COLOR_MATERIAL_ENABLED = GL_TRUE;
         break;
         case GL_SHARED_TEXTURE_PALETTE_EXT: {
             SHARED_PALETTE_ENABLED = GL_TRUE;
+            _glMarkTexturesChanged();
         }
         break;
         case GL_ALPHA_TEST: {
             ALPHA_TEST_ENABLED = GL_TRUE;
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         } break;
         case GL_LIGHT0:
         case GL_LIGHT1:
@@ -338,6 +376,9 @@ GLAPI void APIENTRY glEnable(GLenum cap) {
         case GL_NEARZ_CLIPPING_KOS:
             _glEnableClipping(GL_TRUE);
         break;
+        case GL_TRIANGLE_REJECTION_KOS:
+            _glEnableTriangleRejection(GL_TRUE);
+        break;
         case GL_NORMALIZE:
             NORMALIZE_ENABLED = GL_TRUE;
         break;
@@ -347,40 +388,50 @@ GLAPI void APIENTRY glEnable(GLenum cap) {
 }
 
 GLAPI void APIENTRY glDisable(GLenum cap) {
+    _glRecordListState(LIST_STATE_DISABLE, cap, 0, 0);
+
     switch(cap) {
         case GL_TEXTURE_2D: {
             TEXTURES_ENABLED[_glGetActiveTexture()] = GL_FALSE;
+            _glMarkStateDirty(STATE_DIRTY_TEXTURE);
         } break;
         case GL_CULL_FACE: {
             CULLING_ENABLED = GL_FALSE;
             GL_CONTEXT.gen.culling = _calc_pvr_face_culling();
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         } break;
         case GL_DEPTH_TEST: {
             DEPTH_TEST_ENABLED = GL_FALSE;
             GL_CONTEXT.depth.comparison = _calc_pvr_depth_test();
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         } break;
         case GL_BLEND:
             BLEND_ENABLED = GL_FALSE;
             _updatePVRBlend(&GL_CONTEXT);
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         break;
         case GL_SCISSOR_TEST: {
             GL_CONTEXT.gen.clip_mode = PVR_USERCLIP_DISABLE;
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         } break;
         case GL_LIGHTING: {
             LIGHTING_ENABLED = GL_FALSE;
         } break;
         case GL_FOG:
             GL_CONTEXT.gen.fog_type = PVR_FOG_DISABLE;
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         break;
         case GL_COLOR_MATERIAL:
             COLOR_MATERIAL_ENABLED = GL_FALSE;
         break;
         case GL_SHARED_TEXTURE_PALETTE_EXT: {
             SHARED_PALETTE_ENABLED = GL_FALSE;
+            _glMarkTexturesChanged();
         }
         break;
         case GL_ALPHA_TEST: {
             ALPHA_TEST_ENABLED = GL_FALSE;
+            _glMarkStateDirty(STATE_DIRTY_CONTEXT);
         } break;
         case GL_LIGHT0:
         case GL_LIGHT1:
@@ -395,6 +446,9 @@ GLAPI void APIENTRY glDisable(GLenum cap) {
         case GL_NEARZ_CLIPPING_KOS:
             _glEnableClipping(GL_FALSE);
         break;
+        case GL_TRIANGLE_REJECTION_KOS:
+            _glEnableTriangleRejection(GL_FALSE);
+        break;
         case GL_NORMALIZE:
             NORMALIZE_ENABLED = GL_FALSE;
         break;
@@ -407,6 +461,7 @@ GLAPI void APIENTRY glDisable(GLenum cap) {
 GLAPI void APIENTRY glClear(GLuint mode) {
     if(mode & GL_COLOR_BUFFER_BIT) {
         pvr_set_bg_color(CLEAR_COLOUR[0], CLEAR_COLOUR[1], CLEAR_COLOUR[2]);
+        _glRecordBackground(CLEAR_COLOUR[0], CLEAR_COLOUR[1], CLEAR_COLOUR[2]);
     }
 }
 
@@ -439,12 +494,18 @@ GLAPI void APIENTRY glReadBuffer(GLenum mode) {
 }
 
 GLAPI void APIENTRY glDepthMask(GLboolean flag) {
+    _glRecordListState(LIST_STATE_DEPTH_MASK, flag, 0, 0);
+
     GL_CONTEXT.depth.write = (flag == GL_TRUE) ? PVR_DEPTHWRITE_ENABLE : PVR_DEPTHWRITE_DISABLE;
+    _glMarkStateDirty(STATE_DIRTY_CONTEXT);
 }
 
 GLAPI void APIENTRY glDepthFunc(GLenum func) {
+    _glRecordListState(LIST_STATE_DEPTH_FUNC, func, 0, 0);
+
     DEPTH_FUNC = func;
     GL_CONTEXT.depth.comparison = _calc_pvr_depth_test();
+    _glMarkStateDirty(STATE_DIRTY_CONTEXT);
 }
 
 /* Hints */
@@ -458,13 +519,19 @@ GLAPI void APIENTRY glHint(GLenum target, GLenum mode) {
 
 /* Culling */
 GLAPI void APIENTRY glFrontFace(GLenum mode) {
+    _glRecordListState(LIST_STATE_FRONT_FACE, mode, 0, 0);
+
     FRONT_FACE = mode;
     GL_CONTEXT.gen.culling = _calc_pvr_face_culling();
+    _glMarkStateDirty(STATE_DIRTY_CONTEXT);
 }
 
 GLAPI void APIENTRY glCullFace(GLenum mode) {
+    _glRecordListState(LIST_STATE_CULL_FACE, mode, 0, 0);
+
     CULL_FACE = mode;
     GL_CONTEXT.gen.culling = _calc_pvr_face_culling();
+    _glMarkStateDirty(STATE_DIRTY_CONTEXT);
 }
 
 GLenum _glGetShadeModel() {
@@ -473,14 +540,20 @@ GLenum _glGetShadeModel() {
 
 /* Shading - Flat or Goraud */
 GLAPI void APIENTRY glShadeModel(GLenum mode) {
+    _glRecordListState(LIST_STATE_SHADE_MODEL, mode, 0, 0);
+
     GL_CONTEXT.gen.shading = (mode == GL_SMOOTH) ? PVR_SHADE_GOURAUD : PVR_SHADE_FLAT;
+    _glMarkStateDirty(STATE_DIRTY_CONTEXT);
 }
 
 /* Blending */
 GLAPI void APIENTRY glBlendFunc(GLenum sfactor, GLenum dfactor) {
+    _glRecordListState(LIST_STATE_BLEND_FUNC, sfactor, dfactor, 0);
+
     BLEND_SFACTOR = sfactor;
     BLEND_DFACTOR = dfactor;
     _updatePVRBlend(&GL_CONTEXT);
+    _glMarkStateDirty(STATE_DIRTY_CONTEXT);
 }
 
 #define PT_ALPHA_REF 0x011c
@@ -495,8 +568,75 @@ GLAPI void APIENTRY glAlphaFunc(GLenum func, GLclampf ref) {
         return;
     }
 
+    _glRecordListState(LIST_STATE_ALPHA_FUNC, func, 0, ref);
+
     GLubyte val = (GLubyte)(ref * 255.0f);
     PVR_SET(PT_ALPHA_REF, val);
+    _glRecordAlphaRef(val);
+}
+
+void _glSaveListState(ListSavedState* state) {
+    state->context = GL_CONTEXT;
+    state->cull_face = CULL_FACE;
+    state->front_face = FRONT_FACE;
+    state->depth_func = DEPTH_FUNC;
+    state->blend_sfactor = BLEND_SFACTOR;
+    state->blend_dfactor = BLEND_DFACTOR;
+    state->culling = CULLING_ENABLED;
+    state->color_material = COLOR_MATERIAL_ENABLED;
+    state->shared_palette = SHARED_PALETTE_ENABLED;
+    state->alpha_test = ALPHA_TEST_ENABLED;
+    state->normalize = NORMALIZE_ENABLED;
+    state->depth_test = DEPTH_TEST_ENABLED;
+    state->blend = BLEND_ENABLED;
+    state->lighting = LIGHTING_ENABLED;
+    state->clipping = _glIsClippingEnabled();
+    state->rejection = _glIsTriangleRejectionEnabled();
+    memcpy(state->lights, LIGHT_ENABLED, sizeof(LIGHT_ENABLED));
+    memcpy(state->textures, TEXTURES_ENABLED, sizeof(TEXTURES_ENABLED));
+    state->alpha_ref = PVR_GET(PT_ALPHA_REF) & 0xFF;
+
+    _glSaveTextureBindings(state->bound, &state->active_texture);
+}
+
+void _glRestoreListState(const ListSavedState* state) {
+    /* Only the functions _glRecordListState is called from change the
+     * context, so it can be put back as a whole */
+    GL_CONTEXT = state->context;
+    CULL_FACE = state->cull_face;
+    FRONT_FACE = state->front_face;
+    DEPTH_FUNC = state->depth_func;
+    BLEND_SFACTOR = state->blend_sfactor;
+    BLEND_DFACTOR = state->blend_dfactor;
+    CULLING_ENABLED = state->culling;
+    COLOR_MATERIAL_ENABLED = state->color_material;
+    ALPHA_TEST_ENABLED = state->alpha_test;
+    NORMALIZE_ENABLED = state->normalize;
+    DEPTH_TEST_ENABLED = state->depth_test;
+    BLEND_ENABLED = state->blend;
+    LIGHTING_ENABLED = state->lighting;
+    _glEnableClipping(state->clipping);
+    _glEnableTriangleRejection(state->rejection);
+    memcpy(LIGHT_ENABLED, state->lights, sizeof(LIGHT_ENABLED));
+    memcpy(TEXTURES_ENABLED, state->textures, sizeof(TEXTURES_ENABLED));
+
+    if(SHARED_PALETTE_ENABLED != state->shared_palette) {
+        SHARED_PALETTE_ENABLED = state->shared_palette;
+        _glMarkTexturesChanged();
+    }
+
+    if((PVR_GET(PT_ALPHA_REF) & 0xFF) != state->alpha_ref) {
+        PVR_SET(PT_ALPHA_REF, state->alpha_ref);
+        _glRecordAlphaRef(state->alpha_ref);
+    }
+
+    _glRestoreTextureBindings(state->bound, state->active_texture);
+    _glMarkStateDirty(STATE_DIRTY_ALL);
+}
+
+void _glRecordRenderState() {
+    _glRecordBackground(CLEAR_COLOUR[0], CLEAR_COLOUR[1], CLEAR_COLOUR[2]);
+    _glRecordAlphaRef(PVR_GET(PT_ALPHA_REF) & 0xFF);
 }
 
 void glLineWidth(GLfloat width) {
@@ -628,14 +768,137 @@ void APIENTRY glGetFloatv(GLenum pname, GLfloat* params) {
     }
 }
 
+RenderCounters RENDER_COUNTERS;
+
+void APIENTRY glKosResetCounters() {
+    memset(&RENDER_COUNTERS, 0, sizeof(RENDER_COUNTERS));
+    _glResetAllocationSites();
+}
+
 void APIENTRY glGetIntegerv(GLenum pname, GLint *params) {
     switch(pname) {
+        case GL_DRAW_CALLS_KOS:
+            *params = RENDER_COUNTERS.draw_calls;
+        break;
+        case GL_VERTICES_SUBMITTED_KOS:
+            *params = RENDER_COUNTERS.vertices_in;
+        break;
+        case GL_VERTICES_GENERATED_KOS:
+            *params = RENDER_COUNTERS.vertices_out;
+        break;
+        case GL_TRIANGLES_CLIPPED_KOS:
+            *params = RENDER_COUNTERS.triangles_clipped;
+        break;
+        case GL_VERTICES_DEAD_KOS:
+            *params = RENDER_COUNTERS.vertices_dead;
+        break;
+        case GL_VERTICES_TRANSFORMED_KOS:
+            *params = RENDER_COUNTERS.vertices_transformed;
+        break;
+        case GL_INDICES_SERVED_KOS:
+            *params = RENDER_COUNTERS.indices_served;
+        break;
+        case GL_VERTICES_REFERENCED_KOS:
+            *params = RENDER_COUNTERS.vertices_referenced;
+        break;
+        case GL_POLYGON_HEADERS_KOS:
+            *params = RENDER_COUNTERS.headers;
+        break;
+        case GL_POLYGON_HEADERS_ELIDED_KOS:
+            *params = RENDER_COUNTERS.headers_elided;
+        break;
+        case GL_POLYGON_HEADERS_COMPILED_KOS:
+            *params = RENDER_COUNTERS.headers_compiled;
+        break;
+        case GL_DRAWS_CULLED_KOS:
+            *params = RENDER_COUNTERS.draws_culled;
+        break;
+        case GL_TRIANGLES_REJECTED_OFFSCREEN_KOS:
+        case GL_TRIANGLES_REJECTED_SMALL_KOS:
+        case GL_TRIANGLES_REJECTED_BACKFACING_KOS:
+            *params = RENDER_COUNTERS.triangles_rejected[pname - GL_TRIANGLES_REJECTED_OFFSCREEN_KOS];
+        break;
+        case GL_VERTICES_REJECTED_KOS:
+            *params = RENDER_COUNTERS.vertices_rejected;
+        break;
+        case GL_OP_LIST_BYTES_KOS:
+        case GL_PT_LIST_BYTES_KOS:
+        case GL_TR_LIST_BYTES_KOS:
+            *params = RENDER_COUNTERS.list_bytes[pname - GL_OP_LIST_BYTES_KOS];
+        break;
+        case GL_TEXTURE_UPLOADS_KOS:
+            *params = RENDER_COUNTERS.texture_uploads;
+        break;
+        case GL_TEXTURE_UPLOAD_BYTES_KOS:
+            *params = RENDER_COUNTERS.texture_upload_bytes;
+        break;
+        case GL_PALETTE_ENTRIES_KOS:
+            *params = RENDER_COUNTERS.palette_entries;
+        break;
+        case GL_OP_LIST_HIGH_WATER_KOS:
+        case GL_PT_LIST_HIGH_WATER_KOS:
+        case GL_TR_LIST_HIGH_WATER_KOS:
+            *params = RENDER_COUNTERS.list_high_water[pname - GL_OP_LIST_HIGH_WATER_KOS];
+        break;
+        case GL_FRAME_ARENA_HIGH_WATER_KOS:
+            *params = RENDER_COUNTERS.frame_arena_high_water;
+        break;
+        case GL_FRAME_ARENA_SPILLS_KOS:
+            *params = RENDER_COUNTERS.frame_arena_spills;
+        break;
+        case GL_ALLOCATIONS_KOS:
+            *params = RENDER_COUNTERS.allocations;
+        break;
+        case GL_ALLOCATION_BYTES_KOS:
+            *params = RENDER_COUNTERS.allocation_bytes;
+        break;
+        case GL_FREES_KOS:
+            *params = RENDER_COUNTERS.frees;
+        break;
+        case GL_LIVE_ALLOCATIONS_KOS:
+            *params = _glLiveAllocations();
+        break;
+        case GL_LIVE_ALLOCATION_BYTES_KOS:
+            *params = _glLiveAllocationBytes();
+        break;
         case GL_MAX_LIGHTS:
             *params = MAX_LIGHTS;
         break;
         case GL_TEXTURE_BINDING_2D:
             *params = _glGetBoundTexture()->index;
         break;
+        case GL_LIST_INDEX:
+            *params = _glGetListIndex();
+        break;
+        case GL_LIST_MODE:
+            *params = _glGetListMode();
+        break;
+        case GL_LIST_BASE:
+            *params = _glGetListBase();
+        break;
+        case GL_MAX_LIST_NESTING:
+            *params = MAX_LIST_NESTING;
+        break;
+        case GL_ARRAY_BUFFER_BINDING_ARB:
+        case GL_ELEMENT_ARRAY_BUFFER_BINDING_ARB: {
+            BufferObject* buffer = _glGetBoundBuffer(
+                (pname == GL_ARRAY_BUFFER_BINDING_ARB) ? GL_ARRAY_BUFFER_ARB : GL_ELEMENT_ARRAY_BUFFER_ARB
+            );
+            *params = (buffer) ? buffer->index : 0;
+        } break;
+        case GL_VERTEX_ARRAY_BUFFER_BINDING_ARB:
+            *params = _glGetVertexAttribPointer()->buffer;
+        break;
+        case GL_NORMAL_ARRAY_BUFFER_BINDING_ARB:
+            *params = _glGetNormalAttribPointer()->buffer;
+        break;
+        case GL_COLOR_ARRAY_BUFFER_BINDING_ARB:
+            *params = _glGetDiffuseAttribPointer()->buffer;
+        break;
+        case GL_TEXTURE_COORD_ARRAY_BUFFER_BINDING_ARB:
+            *params = (_glGetActiveClientTexture()) ?
+                _glGetSTAttribPointer()->buffer : _glGetUVAttribPointer()->buffer;
+        break;
         case GL_DEPTH_FUNC:
             *params = DEPTH_FUNC;
         break;
@@ -682,7 +945,7 @@ const GLubyte *glGetString(GLenum name) {
             return (const GLubyte*) "1.2 (partial) - GLdc 1.1";
 
         case GL_EXTENSIONS:
-            return (const GLubyte*) "GL_ARB_framebuffer_object, GL_ARB_multitexture, GL_ARB_texture_rg, GL_EXT_paletted_texture, GL_EXT_shared_texture_palette, GL_KOS_multiple_shared_palette, GL_ARB_vertex_array_bgra, GL_ARB_vertex_type_2_10_10_10_rev";
+            return (const GLubyte*) "GL_ARB_framebuffer_object, GL_ARB_multitexture, GL_ARB_texture_rg, GL_EXT_paletted_texture, GL_EXT_shared_texture_palette, GL_KOS_multiple_shared_palette, GL_ARB_vertex_array_bgra, GL_ARB_vertex_type_2_10_10_10_rev, GL_ARB_vertex_buffer_object";
     }
 
     return (const GLubyte*) "GL_KOS_ERROR: ENUM Unsupported\n";
@@ -27,8 +27,13 @@ static GLboolean BANKS_USED[4];  // Each time a 256 colour bank is used, this is
 static GLboolean SUBBANKS_USED[4][16]; // 4 counts of the used 16 colour banks within the 256 ones
 static GLenum INTERNAL_PALETTE_FORMAT = GL_RGBA4;
 
+static inline void _glCountTextureUpload(GLuint bytes) {
+    RENDER_COUNTERS.texture_uploads++;
+    RENDER_COUNTERS.texture_upload_bytes += bytes;
+}
+
 static TexturePalette* _initTexturePalette() {
-    TexturePalette* palette = (TexturePalette*) malloc(sizeof(TexturePalette));
+    TexturePalette* palette = (TexturePalette*) GL_MALLOC(sizeof(TexturePalette));
     assert(palette);
 
     memset(palette, 0x0, sizeof(TexturePalette));
@@ -101,9 +106,11 @@ void _glSetInternalPaletteFormat(GLenum val) {
 
     if(INTERNAL_PALETTE_FORMAT == GL_RGBA4) {
         pvr_set_pal_format(PVR_PAL_ARGB4444);
+        _glRecordPaletteFormat(PVR_PAL_ARGB4444);
     } else {
         assert(INTERNAL_PALETTE_FORMAT == GL_RGBA8);
         pvr_set_pal_format(PVR_PAL_ARGB8888);
+        _glRecordPaletteFormat(PVR_PAL_ARGB8888);
     }
 }
 
@@ -119,14 +126,24 @@ void _glApplyColorTable(TexturePalette* src) {
 
     GLushort i;
     GLushort offset = src->size * src->bank;
+    GLuint entries[256];
+
+    assert(src->width <= 256);
+
     for(i = 0; i < src->width; ++i) {
         GLubyte* entry = &src->data[i * 4];
         if(INTERNAL_PALETTE_FORMAT == GL_RGBA8) {
-            pvr_set_pal_entry(offset + i, PACK_ARGB8888(entry[3], entry[0], entry[1], entry[2]));
+            entries[i] = PACK_ARGB8888(entry[3], entry[0], entry[1], entry[2]);
         } else {
-            pvr_set_pal_entry(offset + i, PACK_ARGB4444(entry[3], entry[0], entry[1], entry[2]));
+            entries[i] = PACK_ARGB4444(entry[3], entry[0], entry[1], entry[2]);
         }
+
+        pvr_set_pal_entry(offset + i, entries[i]);
     }
+
+    RENDER_COUNTERS.palette_entries += src->width;
+
+    _glRecordPalette(offset, src->width, entries);
 }
 
 GLubyte _glGetActiveTexture() {
@@ -260,7 +277,7 @@ static GLuint _glGetMipmapDataSize(TextureObject* obj) {
 }
 
 GLubyte _glInitTextures() {
-    named_array_init(&TEXTURE_OBJECTS, sizeof(TextureObject), MAX_TEXTURE_COUNT);
+    named_array_init_growable(&TEXTURE_OBJECTS, sizeof(TextureObject), MAX_TEXTURE_COUNT);
 
     // Reserve zero so that it is never given to anyone as an ID!
     named_array_reserve(&TEXTURE_OBJECTS, 0);
@@ -275,6 +292,40 @@ GLubyte _glInitTextures() {
     return 1;
 }
 
+void _glRecordTextureState() {
+    /* Called when a recording starts, so that anything uploaded beforehand
+     * makes it into the recording */
+    GLuint i;
+
+    _glRecordPaletteFormat(
+        (INTERNAL_PALETTE_FORMAT == GL_RGBA8) ? PVR_PAL_ARGB8888 : PVR_PAL_ARGB4444
+    );
+
+    for(i = 0; i < 4; ++i) {
+        if(SHARED_PALETTES[i]->bank > -1) {
+            _glApplyColorTable(SHARED_PALETTES[i]);
+        }
+    }
+
+    for(i = 1; i < TEXTURE_OBJECTS.capacity; ++i) {
+        if(!named_array_used(&TEXTURE_OBJECTS, i)) {
+            continue;
+        }
+
+        TextureObject* txr = (TextureObject*) named_array_get(&TEXTURE_OBJECTS, i);
+
+        if(txr->palette && txr->palette->bank > -1) {
+            _glApplyColorTable(txr->palette);
+        }
+
+        if(txr->data) {
+            GLuint size = (txr->baseDataOffset) ? _glGetMipmapDataSize(txr) : txr->baseDataSize;
+            _glRecordTextureAlloc(txr->data, size);
+            _glRecordTextureWrite(txr->data, size);
+        }
+    }
+}
+
 TextureObject* _glGetTexture0() {
     return TEXTURE_UNITS[0];
 }
@@ -287,6 +338,33 @@ TextureObject* _glGetBoundTexture() {
     return TEXTURE_UNITS[ACTIVE_TEXTURE];
 }
 
+TextureObject* _glGetTextureObject(GLuint texture) {
+    /* Zero is reserved but isn't a texture */
+    if(!texture) {
+        return NULL;
+    }
+
+    return (TextureObject*) named_array_get(&TEXTURE_OBJECTS, texture);
+}
+
+void _glSaveTextureBindings(GLuint* names, GLubyte* active) {
+    for(GLubyte i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+        names[i] = (TEXTURE_UNITS[i]) ? TEXTURE_UNITS[i]->index : 0;
+    }
+
+    *active = ACTIVE_TEXTURE;
+}
+
+/* Textures deleted since the bindings were saved are left unbound */
+void _glRestoreTextureBindings(const GLuint* names, GLubyte active) {
+    for(GLubyte i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+        TEXTURE_UNITS[i] = (names[i]) ? (TextureObject*) named_array_get(&TEXTURE_OBJECTS, names[i]) : NULL;
+    }
+
+    ACTIVE_TEXTURE = active;
+    _glMarkStateDirty(STATE_DIRTY_TEXTURE);
+}
+
 void APIENTRY glActiveTextureARB(GLenum texture) {
     TRACE();
 
@@ -298,6 +376,8 @@ void APIENTRY glActiveTextureARB(GLenum texture) {
         return;
     }
 
+    _glRecordListState(LIST_STATE_ACTIVE_TEXTURE, texture, 0, 0);
+
     ACTIVE_TEXTURE = texture & 0xF;
 }
 
@@ -333,6 +413,12 @@ void APIENTRY glGenTextures(GLsizei n, GLuint *textures) {
         GLuint id = 0;
         TextureObject* txr = (TextureObject*) named_array_alloc(&TEXTURE_OBJECTS, &id);
 
+        if(!txr) {
+            _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+            _glKosPrintError();
+            return;
+        }
+
         assert(id);  // Generated IDs must never be zero
 
         _glInitializeTextureObject(txr, id);
@@ -349,25 +435,33 @@ void APIENTRY glDeleteTextures(GLsizei n, GLuint *textures) {
     while(n--) {
         TextureObject* txr = (TextureObject*) named_array_get(&TEXTURE_OBJECTS, *textures);
 
+        /* Unused names (and zero) are silently ignored */
+        if(!txr || !*textures) {
+            textures++;
+            continue;
+        }
+
         /* Make sure we update framebuffer objects that have this texture attached */
         _glWipeTextureOnFramebuffers(*textures);
+        _glMarkTexturesChanged();
 
         if(txr == TEXTURE_UNITS[ACTIVE_TEXTURE]) {
             TEXTURE_UNITS[ACTIVE_TEXTURE] = NULL;
         }
 
         if(txr->data) {
+            _glRecordTextureFree(txr->data);
             pvr_mem_free(txr->data);
             txr->data = NULL;
         }
 
         if(txr->palette && txr->palette->data) {
-            free(txr->palette->data);
+            GL_FREE(txr->palette->data);
             txr->palette->data = NULL;
         }
 
         if(txr->palette) {
-            free(txr->palette);
+            GL_FREE(txr->palette);
             txr->palette = NULL;
         }
 
@@ -384,11 +478,19 @@ void APIENTRY glBindTexture(GLenum  target, GLuint texture) {
         return;
     }
 
+    _glRecordListState(LIST_STATE_BIND_TEXTURE, target, texture, 0);
+
     if(texture) {
         /* If this didn't come from glGenTextures, then we should initialize the
          * texture the first time it's bound */
         if(!named_array_used(&TEXTURE_OBJECTS, texture)) {
             TextureObject* txr = named_array_reserve(&TEXTURE_OBJECTS, texture);
+            if(!txr) {
+                _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+                _glKosPrintError();
+                return;
+            }
+
             _glInitializeTextureObject(txr, texture);
         }
 
@@ -396,6 +498,8 @@ void APIENTRY glBindTexture(GLenum  target, GLuint texture) {
     } else {
         TEXTURE_UNITS[ACTIVE_TEXTURE] = NULL;
     }
+
+    _glMarkStateDirty(STATE_DIRTY_TEXTURE);
 }
 
 void APIENTRY glTexEnvi(GLenum target, GLenum pname, GLint param) {
@@ -434,6 +538,8 @@ void APIENTRY glTexEnvi(GLenum target, GLenum pname, GLint param) {
     default:
         break;
     }
+
+    _glMarkTexturesChanged();
 }
 
 void APIENTRY glTexEnvf(GLenum target, GLenum pname, GLfloat param) {
@@ -520,6 +626,7 @@ void APIENTRY glCompressedTexImage2DARB(GLenum target,
     }
 
     TextureObject* active = TEXTURE_UNITS[ACTIVE_TEXTURE];
+    _glMarkTexturesChanged();
 
     /* Set the required mipmap count */
     active->width   = width;
@@ -531,15 +638,22 @@ void APIENTRY glCompressedTexImage2DARB(GLenum target,
     active->mipmapCount = _glGetMipmapLevelCount(active);
     active->mipmap = (mipmapped) ? ~0 : (1 << level);  /* Set only a single bit if this wasn't mipmapped otherwise set all */
     active->isCompressed = GL_TRUE;
+    active->baseDataSize = imageSize;
 
     /* Odds are slim new data is same size as old, so free always */
-    if(active->data)
+    if(active->data) {
+        _glRecordTextureFree(active->data);
         pvr_mem_free(active->data);
+    }
 
-    active->data = pvr_mem_malloc(imageSize);
+    active->data = GL_PVR_MALLOC(imageSize);
+    _glRecordTextureAlloc(active->data, imageSize);
 
-    if(data)
+    if(data) {
         sq_cpy(active->data, data, imageSize);
+        _glRecordTextureWrite(active->data, imageSize);
+        _glCountTextureUpload(imageSize);
+    }
 }
 
 static GLint _cleanInternalFormat(GLint internalFormat) {
@@ -855,26 +969,56 @@ void _glAllocateSpaceForMipmaps(TextureObject* active) {
     GLuint size = active->baseDataSize;
 
     /* Copy the data out of the pvr and back to ram */
-    GLubyte* temp = (GLubyte*) malloc(size);
+    GLubyte* temp = (GLubyte*) GL_MALLOC(size);
     memcpy(temp, active->data, size);
 
     /* Free the PVR data */
+    _glRecordTextureFree(active->data);
     pvr_mem_free(active->data);
     active->data = NULL;
 
     /* Figure out how much room to allocate for mipmaps */
     GLuint bytes = _glGetMipmapDataSize(active);
 
-    active->data = pvr_mem_malloc(bytes);
+    active->data = GL_PVR_MALLOC(bytes);
+    _glRecordTextureAlloc(active->data, bytes);
 
     /* If there was existing data, then copy it where it should go */
     memcpy(_glGetMipmapLocation(active, 0), temp, size);
+    _glRecordTextureWrite(_glGetMipmapLocation(active, 0), size);
+    GL_FREE(temp);
 
     /* Set the data offset depending on whether or not this is a
      * paletted texure */
     active->baseDataOffset = _glGetMipmapDataOffset(active, 0);
 }
 
+/* Uploads that need converting are converted into this buffer first. It's
+ * kept between uploads (as long as it's no bigger than a 256x256 16bpp
+ * texture) so that streaming textures in doesn't go to the heap every time */
+#define CONVERSION_BUFFER_KEEP (256 * 256 * 2)
+
+static GLubyte* CONVERSION_BUFFER = NULL;
+static GLuint CONVERSION_BUFFER_SIZE = 0;
+
+static GLubyte* _conversionBuffer(GLuint bytes) {
+    if(bytes > CONVERSION_BUFFER_SIZE) {
+        GL_FREE(CONVERSION_BUFFER);
+        CONVERSION_BUFFER = (GLubyte*) GL_MALLOC(bytes);
+        CONVERSION_BUFFER_SIZE = (CONVERSION_BUFFER) ? bytes : 0;
+    }
+
+    return CONVERSION_BUFFER;
+}
+
+static void _releaseConversionBuffer() {
+    if(CONVERSION_BUFFER_SIZE > CONVERSION_BUFFER_KEEP) {
+        GL_FREE(CONVERSION_BUFFER);
+        CONVERSION_BUFFER = NULL;
+        CONVERSION_BUFFER_SIZE = 0;
+    }
+}
+
 void APIENTRY glTexImage2D(GLenum target, GLint level, GLint internalFormat,
                            GLsizei width, GLsizei height, GLint border,
                            GLenum format, GLenum type, const GLvoid *data) {
@@ -953,12 +1097,17 @@ void APIENTRY glTexImage2D(GLenum target, GLint level, GLint internalFormat,
 
     assert(active);
 
+    _glMarkTexturesChanged();
+
     if(active->data && level == 0) {
-        /* pre-existing texture - check if changed */
+        /* pre-existing texture - check if changed. The nontwiddled bit is
+         * cleared once the data is twiddled so it's ignored here, otherwise
+         * every reupload would reallocate */
         if(active->width != width ||
            active->height != height ||
-           active->color != pvr_format) {
+           (active->color & ~(1 << 26)) != (pvr_format & ~(1 << 26))) {
             /* changed - free old texture memory */
+            _glRecordTextureFree(active->data);
             pvr_mem_free(active->data);
             active->data = NULL;
             active->mipmap = 0;
@@ -996,12 +1145,16 @@ void APIENTRY glTexImage2D(GLenum target, GLint level, GLint internalFormat,
             /* If we're uploading a mipmap level, we need to allocate the full amount of space */
             _glAllocateSpaceForMipmaps(active);
         } else {
-            active->data = pvr_mem_malloc(active->baseDataSize);
+            active->data = GL_PVR_MALLOC(active->baseDataSize);
+            _glRecordTextureAlloc(active->data, active->baseDataSize);
         }
 
         assert(active->data);
         active->isCompressed = GL_FALSE;
         active->isPaletted = isPaletted;
+    } else if(level == 0) {
+        /* Reusing the existing memory, the twiddled bit is set again below */
+        active->color = pvr_format;
     }
 
     /* We're supplying a mipmap level, but previously we only had
@@ -1062,6 +1215,8 @@ void APIENTRY glTexImage2D(GLenum target, GLint level, GLint internalFormat,
 
         /* No conversion? Just copy the data, and the pvr_format is correct */
         FASTCPY(targetData, data, bytes);
+        _glRecordTextureWrite(targetData, bytes);
+        _glCountTextureUpload(bytes);
         return;
     } else if(needsConversion) {
         TextureConversionFunc convert = _determineConversion(
@@ -1083,7 +1238,12 @@ void APIENTRY glTexImage2D(GLenum target, GLint level, GLint internalFormat,
             return;
         }
 
-        conversionBuffer = malloc(bytes);
+        conversionBuffer = _conversionBuffer(bytes);
+        if(!conversionBuffer) {
+            _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+            _glKosPrintError();
+            return;
+        }
 
         GLubyte* dest = conversionBuffer;
         const GLubyte* source = data;
@@ -1123,8 +1283,11 @@ void APIENTRY glTexImage2D(GLenum target, GLint level, GLint internalFormat,
         FASTCPY(targetData, conversionBuffer, bytes);
     }
 
+    _glRecordTextureWrite(targetData, bytes);
+    _glCountTextureUpload(bytes);
+
     if(conversionBuffer) {
-        free(conversionBuffer);
+        _releaseConversionBuffer();
         conversionBuffer = NULL;
     }
 }
@@ -1201,6 +1364,8 @@ void APIENTRY glTexParameteri(GLenum target, GLenum pname, GLint param) {
             default:
                 break;
         }
+
+        _glMarkTexturesChanged();
     }
 }
 
@@ -1285,7 +1450,7 @@ GLAPI void APIENTRY glColorTableEXT(GLenum target, GLenum internalFormat, GLsize
     assert(palette);
 
     if(target) {
-        free(palette->data);
+        GL_FREE(palette->data);
         palette->data = NULL;
     }
 
@@ -1294,7 +1459,10 @@ GLAPI void APIENTRY glColorTableEXT(GLenum target, GLenum internalFormat, GLsize
         palette->bank = -1;
     }
 
-    palette->data = (GLubyte*) malloc(width * 4);
+    /* The bank is part of the texture format in the header */
+    _glMarkTexturesChanged();
+
+    palette->data = (GLubyte*) GL_MALLOC(width * 4);
     palette->format = format;
     palette->width = width;
     palette->size = (width > 16) ? 256 : 16;
@@ -1307,7 +1475,7 @@ GLAPI void APIENTRY glColorTableEXT(GLenum target, GLenum internalFormat, GLsize
         _glKosThrowError(GL_INVALID_OPERATION, __func__);
         _glKosPrintError();
 
-        free(palette->data);
+        GL_FREE(palette->data);
         palette->format = palette->width = palette->size = 0;
         return;
     }
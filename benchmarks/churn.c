@@ -0,0 +1,96 @@
+/*
+   GLdc texture name churn benchmark
+
+   Creates a pool of live texture objects and then repeatedly deletes a
+   random one and generates a replacement, like a streaming world swapping
+   textures in and out, and prints the cost of each glDeleteTextures +
+   glGenTextures pair as JSON. The cost should stay flat as the number of
+   live textures grows.
+
+   Usage: churn [--output FILE]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <GL/gl.h>
+#include <GL/glkos.h>
+
+#include "../GL/platform.h"
+
+#define CHURN_COUNT 100000
+
+static const GLuint LIVE_COUNTS[] = {100, 1000, 10000, 50000};
+#define LIVE_COUNT_COUNT (sizeof(LIVE_COUNTS) / sizeof(GLuint))
+
+/* rand() differs between newlib and glibc */
+static uint32_t SEED = 12345;
+
+static uint32_t next_rand() {
+    SEED = SEED * 1103515245u + 12345u;
+    return SEED >> 8;
+}
+
+int main(int argc, char* argv[]) {
+    const char* output = NULL;
+
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        }
+    }
+
+    FILE* out = (output) ? fopen(output, "w") : stdout;
+    if(!out) {
+        fprintf(stderr, "Unable to open %s\n", output);
+        return 1;
+    }
+
+    glKosInit();
+
+    GLuint* names = (GLuint*) malloc(sizeof(GLuint) * LIVE_COUNTS[LIVE_COUNT_COUNT - 1]);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"results\": [\n");
+
+    for(uint32_t c = 0; c < LIVE_COUNT_COUNT; ++c) {
+        const GLuint live = LIVE_COUNTS[c];
+
+        uint64_t start = timer_ns_gettime64();
+        glGenTextures(live, names);
+        const uint64_t gen_ns = timer_ns_gettime64() - start;
+
+        if(glGetError() != GL_NO_ERROR) {
+            fprintf(stderr, "Unable to create %u textures\n", live);
+            return 1;
+        }
+
+        start = timer_ns_gettime64();
+
+        for(uint32_t i = 0; i < CHURN_COUNT; ++i) {
+            GLuint* name = &names[next_rand() % live];
+            glDeleteTextures(1, name);
+            glGenTextures(1, name);
+        }
+
+        const uint64_t churn_ns = timer_ns_gettime64() - start;
+
+        glDeleteTextures(live, names);
+
+        fprintf(out, "%s    {\"live\": %u, \"gen_ns\": %.1f, \"churn_ns\": %.1f}",
+            (c) ? ",\n" : "", live, (double) gen_ns / live, (double) churn_ns / CHURN_COUNT);
+    }
+
+    fprintf(out, "\n  ]\n");
+    fprintf(out, "}\n");
+
+    if(out != stdout) {
+        fclose(out);
+    }
+
+    free(names);
+    return 0;
+}
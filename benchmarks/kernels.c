@@ -0,0 +1,434 @@
+/*
+   GLdc kernel micro-benchmarks
+
+   Times the individual stages of the vertex pipeline in GL/draw.c (the
+   attribute readers, the xyz + normal + uv kernel, the primitive
+   generators, lightAndTransform,
+   transformAndDivide and mat_transform3) over a range of input types, strides and vertex counts,
+   and prints ns/vertex for each as JSON. Runs on the host build
+   (make host-benchmarks) and on the Dreamcast.
+
+   bytes_per_vertex is the amount of vertex data the kernel reads and
+   writes per input vertex, so that kernels can be compared against the
+   memory bandwidth available.
+
+   Usage: kernels [--output FILE] [kernel...]
+
+   The kernels are static, so draw.c is compiled straight into this file
+   rather than linking against the copy in the library.
+*/
+
+#include "../GL/draw.c"
+#include "../include/glkos.h"
+
+#define MAX_VERTICES 65536
+
+/* Large enough for the longest interleaved stride we test */
+#define MAX_STRIDE 32
+
+/* Run each measurement over at least this many vertices so that the
+ * microsecond timer has something to measure */
+#define MIN_VERTICES_PER_MEASUREMENT (1 << 20)
+
+static const GLuint COUNTS[] = {1, 4, 16, 64, 256, 1024, 4096, 16384, 65536};
+#define COUNT_COUNT (sizeof(COUNTS) / sizeof(GLuint))
+
+static const GLenum TYPES[] = {GL_FLOAT, GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT};
+#define TYPE_COUNT (sizeof(TYPES) / sizeof(GLenum))
+
+typedef void (*KernelFunc)(GLuint count);
+
+typedef struct {
+    const char* name;
+
+    /* Attribute readers only, the GL_*_ARRAY that's being read */
+    GLenum array;
+    GLint size;
+
+    /* How many of TYPES are implemented */
+    GLuint type_count;
+} Reader;
+
+static const Reader READERS[] = {
+    {"_readPositionData", GL_VERTEX_ARRAY, 3, 4},
+    {"_readPositionData", GL_VERTEX_ARRAY, 2, 4},
+    {"_readDiffuseData", GL_COLOR_ARRAY, 4, 2},
+    {"_readDiffuseData", GL_COLOR_ARRAY, 3, 2},
+    {"_readDiffuseData", GL_COLOR_ARRAY, GL_BGRA, 2},
+    {"_readUVData", GL_TEXTURE_COORD_ARRAY, 2, 4},
+    {"_readNormalData", GL_NORMAL_ARRAY, 3, 4}
+};
+
+#define READER_COUNT (sizeof(READERS) / sizeof(Reader))
+
+static FILE* OUT = NULL;
+static int FIRST_RESULT = 1;
+
+static GLubyte* INPUT = NULL;
+static EyeSpaceData* EYE_SPACE = NULL;
+
+static AlignedVector INPUT_DATA;
+static AlignedVector EYE_SPACE_DATA;
+static AlignedVector EXTRAS;
+static PolyList OUTPUT;
+static SubmissionTarget TARGET;
+
+static Vertex* output_vertices() {
+    return (Vertex*) OUTPUT.vector.data;
+}
+
+static void run_position(GLuint count) {
+    _readPositionData(0, count, output_vertices());
+}
+
+static void run_diffuse(GLuint count) {
+    _readDiffuseData(0, count, output_vertices());
+}
+
+static void run_uv(GLuint count) {
+    _readUVData(0, count, output_vertices());
+}
+
+static void run_normal(GLuint count) {
+    _readNormalData(0, count, (VertexExtra*) EXTRAS.data);
+}
+
+/* xyz + normal + uv, read in one pass by the lit kernel, and as it would be
+ * by the unlit kernel followed by _readNormalData */
+static void run_read_vertices_lit(GLuint count) {
+    _readVertices(0, count, output_vertices(), (VertexExtra*) EXTRAS.data, GL_TRUE);
+}
+
+static void run_read_vertices_lit_separate(GLuint count) {
+    _kernel3f2f(0, count, output_vertices(), NULL);
+    _readNormalData(0, count, (VertexExtra*) EXTRAS.data);
+}
+
+static void run_gen_triangles(GLuint count) {
+    genTriangles(output_vertices(), count);
+}
+
+static void run_gen_quads(GLuint count) {
+    genQuads(output_vertices(), count);
+}
+
+static void run_gen_triangle_strip(GLuint count) {
+    genTriangleStrip(output_vertices(), count);
+}
+
+/* genTriangleFan only handles up to 255 vertices at a time, so bigger
+ * counts are done as a series of fans like submitVertices would */
+#define MAX_FAN 255
+
+static void run_gen_triangle_fan(GLuint count) {
+    Vertex* it = output_vertices();
+
+    while(count >= 3) {
+        const GLuint n = (count > MAX_FAN) ? MAX_FAN : count;
+        genTriangleFan(it, n);
+        it += (n - 2) * 3;
+        count -= n;
+    }
+}
+
+static void run_light_and_transform(GLuint count) {
+    lightAndTransform(output_vertices(), (VertexExtra*) EXTRAS.data, count, _glIsLightingEnabled());
+}
+
+static void run_transform_and_divide(GLuint count) {
+    TARGET.count = count;
+    transformAndDivide(&TARGET, GL_FALSE, GL_FALSE, GL_FALSE);
+}
+
+static void run_mat_transform3(GLuint count) {
+    mat_transform3(output_vertices()->xyz, EYE_SPACE->xyz, count, sizeof(Vertex), sizeof(EyeSpaceData));
+}
+
+/* Fill the input with floats in a sane range so that nothing ends up
+ * with denormals or NaNs, the integer types just see arbitrary values */
+static void reset_input() {
+    float* it = (float*) INPUT;
+    for(GLuint i = 0; i < (MAX_VERTICES * MAX_STRIDE) / sizeof(float); ++i) {
+        it[i] = 0.25f + (float) (i % 64) / 128.0f;
+    }
+}
+
+static void reset_output() {
+    Vertex* it = output_vertices();
+    for(GLuint i = 0; i < OUTPUT.vector.size; ++i) {
+        it[i].flags = PVR_CMD_VERTEX;
+        it[i].xyz[0] = it[i].xyz[1] = it[i].xyz[2] = 0.5f;
+        it[i].w = 1.0f;
+    }
+}
+
+static double measure(KernelFunc func, GLuint count) {
+    GLuint repeats = MIN_VERTICES_PER_MEASUREMENT / count;
+    if(!repeats) {
+        repeats = 1;
+    }
+
+    reset_output();
+
+    /* Warm up the cache and anything lazily initialised */
+    func(count);
+
+    const uint64_t start = timer_us_gettime64();
+
+    for(GLuint i = 0; i < repeats; ++i) {
+        func(count);
+    }
+
+    const uint64_t elapsed_us = timer_us_gettime64() - start;
+    return ((double) elapsed_us * 1000.0) / ((double) repeats * count);
+}
+
+static const char* type_name(GLenum type) {
+    switch(type) {
+        case GL_FLOAT: return "float";
+        case GL_UNSIGNED_BYTE: return "ubyte";
+        case GL_UNSIGNED_SHORT: return "ushort";
+        case GL_UNSIGNED_INT: return "uint";
+        default: return "none";
+    }
+}
+
+static const char* size_name(GLint size) {
+    switch(size) {
+        case 2: return "2";
+        case 3: return "3";
+        case 4: return "4";
+        case GL_BGRA: return "bgra";
+        default: return "none";
+    }
+}
+
+static void print_result(const char* kernel, GLenum type, GLint size, GLuint stride, GLuint count, double ns, double bytes) {
+    fprintf(OUT, "%s    {\"kernel\": \"%s\", \"type\": \"%s\", \"size\": \"%s\", \"stride\": %u, \"count\": %u, "
+        "\"ns_per_vertex\": %.2f, \"bytes_per_vertex\": %.2f}",
+        (FIRST_RESULT) ? "" : ",\n", kernel, type_name(type), size_name(size),
+        stride, count, ns, bytes
+    );
+
+    FIRST_RESULT = 0;
+}
+
+static void run_reader(const Reader* reader, GLenum type, GLsizei stride) {
+    const GLint components = (reader->size == GL_BGRA) ? 4 : reader->size;
+    const GLuint element_size = components * byte_size(type);
+
+    KernelFunc func = NULL;
+    GLuint written = 0;
+
+    /* Pass packed strides explicitly, a zero stride with GL_BGRA would
+     * be calculated from the enum value rather than the component count */
+    if(!stride) {
+        stride = element_size;
+    }
+
+    glEnableClientState(reader->array);
+
+    switch(reader->array) {
+        case GL_VERTEX_ARRAY:
+            glVertexPointer(reader->size, type, stride, INPUT);
+            func = run_position;
+            written = sizeof(float) * 3;
+        break;
+        case GL_COLOR_ARRAY:
+            glColorPointer(reader->size, type, stride, INPUT);
+            func = run_diffuse;
+            written = sizeof(GLubyte) * 4;
+        break;
+        case GL_TEXTURE_COORD_ARRAY:
+            glTexCoordPointer(reader->size, type, stride, INPUT);
+            func = run_uv;
+            written = sizeof(float) * 2;
+        break;
+        case GL_NORMAL_ARRAY:
+            glNormalPointer(type, stride, INPUT);
+            func = run_normal;
+            written = sizeof(float) * 3;
+        break;
+        default:
+            return;
+    }
+
+    for(GLuint i = 0; i < COUNT_COUNT; ++i) {
+        const double ns = measure(func, COUNTS[i]);
+        print_result(reader->name, type, reader->size, stride, COUNTS[i], ns, element_size + written);
+    }
+
+    glDisableClientState(reader->array);
+}
+
+static void run_kernel(const char* name, KernelFunc func, GLuint min_count, double bytes) {
+    for(GLuint i = 0; i < COUNT_COUNT; ++i) {
+        if(COUNTS[i] < min_count) {
+            continue;
+        }
+
+        const double ns = measure(func, COUNTS[i]);
+        print_result(name, 0, 0, sizeof(Vertex), COUNTS[i], ns, bytes);
+    }
+}
+
+static int selected(const char* name, const char** names, int count) {
+    if(!count) {
+        return 1;
+    }
+
+    for(int i = 0; i < count; ++i) {
+        if(strcmp(names[i], name) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* output = NULL;
+    const char* names[32];
+    int name_count = 0;
+
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if(name_count < 32) {
+            names[name_count++] = argv[i];
+        }
+    }
+
+    OUT = (output) ? fopen(output, "w") : stdout;
+    if(!OUT) {
+        fprintf(stderr, "Unable to open %s\n", output);
+        return 1;
+    }
+
+    glKosInit();
+
+    aligned_vector_init(&INPUT_DATA, MAX_STRIDE);
+    aligned_vector_resize(&INPUT_DATA, MAX_VERTICES);
+    INPUT = (GLubyte*) INPUT_DATA.data;
+
+    aligned_vector_init(&EYE_SPACE_DATA, sizeof(EyeSpaceData));
+    aligned_vector_resize(&EYE_SPACE_DATA, MAX_VERTICES);
+    EYE_SPACE = (EyeSpaceData*) EYE_SPACE_DATA.data;
+
+    /* Triangle fans expand to 3 vertices per input vertex */
+    OUTPUT.list_type = PVR_LIST_OP_POLY;
+    aligned_vector_init(&OUTPUT.vector, sizeof(Vertex));
+    aligned_vector_resize(&OUTPUT.vector, MAX_VERTICES * 3);
+
+    aligned_vector_init(&EXTRAS, sizeof(VertexExtra));
+    aligned_vector_resize(&EXTRAS, MAX_VERTICES);
+
+    TARGET.output = &OUTPUT;
+    TARGET.header_offset = 0;
+    TARGET.start_offset = 0;
+    TARGET.extras = &EXTRAS;
+
+    reset_input();
+
+    /* Unit normals for lightAndTransform_lit */
+    VertexExtra* extra = (VertexExtra*) EXTRAS.data;
+    for(GLuint i = 0; i < MAX_VERTICES; ++i) {
+        extra[i].nxyz[0] = extra[i].nxyz[1] = 0.0f;
+        extra[i].nxyz[2] = 1.0f;
+    }
+
+    /* Start with everything off so that each reader is measured alone */
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+
+    fprintf(OUT, "{\n");
+    fprintf(OUT, "  \"version\": 1,\n");
+    fprintf(OUT, "  \"results\": [\n");
+
+    for(GLuint r = 0; r < READER_COUNT; ++r) {
+        const Reader* reader = &READERS[r];
+        if(!selected(reader->name, names, name_count)) {
+            continue;
+        }
+
+        for(GLuint t = 0; t < reader->type_count; ++t) {
+            /* Tightly packed, and interleaved like the fast path layout */
+            run_reader(reader, TYPES[t], 0);
+            run_reader(reader, TYPES[t], MAX_STRIDE);
+        }
+    }
+
+    if(selected("genTriangles", names, name_count)) {
+        run_kernel("genTriangles", run_gen_triangles, 1, sizeof(uint32_t) / 3.0);
+    }
+
+    if(selected("genQuads", names, name_count)) {
+        /* Swaps the last two vertices of each quad */
+        run_kernel("genQuads", run_gen_quads, 1, (sizeof(Vertex) * 4 + sizeof(uint32_t)) / 4.0);
+    }
+
+    if(selected("genTriangleStrip", names, name_count)) {
+        run_kernel("genTriangleStrip", run_gen_triangle_strip, 1, 0);
+    }
+
+    if(selected("genTriangleFan", names, name_count)) {
+        /* Each vertex is copied out to roughly 3 */
+        run_kernel("genTriangleFan", run_gen_triangle_fan, 3, sizeof(Vertex) * 4);
+    }
+
+    if(selected("lightAndTransform", names, name_count)) {
+        run_kernel("lightAndTransform", run_light_and_transform, 1, sizeof(float) * 3 + sizeof(float) * 4);
+    }
+
+    if(selected("lightAndTransform_lit", names, name_count)) {
+        /* One directional light, reading the normal and writing the colour too */
+        glEnable(GL_LIGHTING);
+        glEnable(GL_LIGHT0);
+        run_kernel("lightAndTransform_lit", run_light_and_transform, 1, sizeof(float) * 3 * 2 + sizeof(float) * 4 + sizeof(uint32_t));
+        glDisable(GL_LIGHT0);
+        glDisable(GL_LIGHTING);
+    }
+
+    if(selected("_readVertices_lit", names, name_count) || selected("_readVertices_lit_separate", names, name_count)) {
+        /* 32 byte interleaved vertices, which leaves the normals in EXTRAS
+         * as garbage, so this runs after lightAndTransform_lit */
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 32, INPUT);
+        glNormalPointer(GL_FLOAT, 32, INPUT + 12);
+        glTexCoordPointer(2, GL_FLOAT, 32, INPUT + 24);
+
+        const double bytes = 32 + sizeof(Vertex) + sizeof(float) * 3;
+        if(selected("_readVertices_lit", names, name_count)) {
+            run_kernel("_readVertices_lit", run_read_vertices_lit, 1, bytes);
+        }
+
+        if(selected("_readVertices_lit_separate", names, name_count)) {
+            run_kernel("_readVertices_lit_separate", run_read_vertices_lit_separate, 1, bytes);
+        }
+
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
+
+    if(selected("transformAndDivide", names, name_count)) {
+        run_kernel("transformAndDivide", run_transform_and_divide, 1, sizeof(float) * 3 + sizeof(float) * 4);
+    }
+
+    if(selected("mat_transform3", names, name_count)) {
+        run_kernel("mat_transform3", run_mat_transform3, 1, sizeof(float) * 3 * 2);
+    }
+
+    fprintf(OUT, "\n  ]\n");
+    fprintf(OUT, "}\n");
+
+    if(OUT != stdout) {
+        fclose(OUT);
+    }
+
+    return 0;
+}
@@ -0,0 +1,316 @@
+/*
+   GLdc recording replayer
+
+   Plays back a recording made with glKosStartRecording. The first pass
+   applies everything in the recording in order (texture uploads, palettes
+   and frames), after that the frames are resubmitted as fast as possible
+   for the requested number of passes so that the list submission path can
+   be timed in isolation from whatever produced the frames.
+
+   Usage: replay [--passes N] [--rasterize] [--ppm PREFIX] recording.bin
+
+   --rasterize and --ppm are only available in the host build, and run each
+   frame of the first pass through the reference rasterizer to report bin
+   pressure and fill cost (and optionally write out each frame as an image).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <GL/gl.h>
+#include <GL/glkos.h>
+
+#include "../GL/platform.h"
+#include "../GL/record.h"
+
+#ifndef _arch_dreamcast
+#include "../GL/platforms/rasterizer.h"
+#endif
+
+#define PT_ALPHA_REF 0x011c
+#define MAX_ALLOCATIONS 1024
+
+typedef struct {
+    uint32_t recorded_offset;
+    uint32_t size;
+    pvr_ptr_t ptr;
+} Allocation;
+
+typedef struct {
+    uint32_t counts[3];
+    uint8_t* lists[3];
+} Frame;
+
+static Allocation ALLOCATIONS[MAX_ALLOCATIONS];
+static uint32_t ALLOCATION_COUNT = 0;
+
+static const int LISTS[3] = {PVR_LIST_OP_POLY, PVR_LIST_PT_POLY, PVR_LIST_TR_POLY};
+
+static Allocation* find_allocation(uint32_t offset) {
+    for(uint32_t i = 0; i < ALLOCATION_COUNT; ++i) {
+        Allocation* a = &ALLOCATIONS[i];
+        if(offset >= a->recorded_offset && offset < a->recorded_offset + a->size) {
+            return a;
+        }
+    }
+
+    return NULL;
+}
+
+static void texture_alloc(const uint32_t* data) {
+    if(ALLOCATION_COUNT == MAX_ALLOCATIONS) {
+        fprintf(stderr, "Too many texture allocations\n");
+        exit(1);
+    }
+
+    Allocation* a = &ALLOCATIONS[ALLOCATION_COUNT++];
+    a->recorded_offset = data[0];
+    a->size = data[1];
+    a->ptr = pvr_mem_malloc(data[1]);
+}
+
+static void texture_free(const uint32_t* data) {
+    for(uint32_t i = 0; i < ALLOCATION_COUNT; ++i) {
+        if(ALLOCATIONS[i].recorded_offset == data[0]) {
+            pvr_mem_free(ALLOCATIONS[i].ptr);
+            ALLOCATIONS[i] = ALLOCATIONS[--ALLOCATION_COUNT];
+            return;
+        }
+    }
+}
+
+static void texture_write(const uint32_t* data) {
+    Allocation* a = find_allocation(data[0]);
+    if(!a) {
+        fprintf(stderr, "Texture write outside of any allocation, ignoring\n");
+        return;
+    }
+
+    memcpy((uint8_t*) a->ptr + (data[0] - a->recorded_offset), data + 2, data[1]);
+}
+
+/* Point the texture addresses in any headers at where the textures
+ * ended up this time around */
+static void relocate_headers(uint8_t* list, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i) {
+        pvr_poly_hdr_t* hdr = (pvr_poly_hdr_t*) (list + i * 32);
+        const uint32_t type = hdr->cmd >> 29;
+
+        if((type != 4 && type != 5) || !(hdr->cmd & 8)) {
+            continue;
+        }
+
+        const uint32_t recorded = (hdr->mode3 & 0x1FFFFF) << 3;
+        Allocation* a = find_allocation(recorded);
+        if(!a) {
+            continue;
+        }
+
+        const uint32_t offset = _glVRAMOffset((uint8_t*) a->ptr + (recorded - a->recorded_offset));
+        hdr->mode3 = (hdr->mode3 & ~0x1FFFFF) | ((offset & 0x00fffff8) >> 3);
+    }
+}
+
+static void submit_frame(const Frame* frame) {
+    pvr_wait_ready();
+    pvr_scene_begin();
+
+    for(int i = 0; i < 3; ++i) {
+        pvr_list_begin(LISTS[i]);
+        pvr_list_submit(frame->lists[i], frame->counts[i]);
+        pvr_list_finish();
+    }
+
+    pvr_scene_finish();
+}
+
+static uint32_t count_headers(const uint8_t* list, uint32_t count) {
+    uint32_t headers = 0;
+    for(uint32_t i = 0; i < count; ++i) {
+        const uint32_t type = (*(const uint32_t*) (list + i * 32)) >> 29;
+        headers += (type == 4 || type == 5);
+    }
+    return headers;
+}
+
+int main(int argc, char* argv[]) {
+    int passes = 10;
+    int rasterize = 0;
+    const char* ppm_prefix = NULL;
+    const char* filename = NULL;
+
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--passes") == 0 && i + 1 < argc) {
+            passes = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--rasterize") == 0) {
+            rasterize = 1;
+        } else if(strcmp(argv[i], "--ppm") == 0 && i + 1 < argc) {
+            rasterize = 1;
+            ppm_prefix = argv[++i];
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if(!filename) {
+        fprintf(stderr, "Usage: %s [--passes N] [--rasterize] [--ppm PREFIX] recording.bin\n", argv[0]);
+        return 1;
+    }
+
+#ifdef _arch_dreamcast
+    if(rasterize) {
+        fprintf(stderr, "--rasterize is only available on the host\n");
+        return 1;
+    }
+#else
+    Rasterizer rasterizer;
+    if(rasterize) {
+        rasterizer_init(&rasterizer, vid_mode->width, vid_mode->height);
+    }
+#endif
+
+    FILE* f = fopen(filename, "rb");
+    if(!f) {
+        fprintf(stderr, "Unable to open %s\n", filename);
+        return 1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    const long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* data = (uint8_t*) malloc(file_size);
+    if(!data || fread(data, 1, file_size, f) != (size_t) file_size) {
+        fprintf(stderr, "Unable to read %s\n", filename);
+        return 1;
+    }
+
+    fclose(f);
+
+    const RecordFileHeader* header = (const RecordFileHeader*) data;
+    if(file_size < (long) sizeof(RecordFileHeader) || header->magic != RECORD_MAGIC || header->version != RECORD_VERSION) {
+        fprintf(stderr, "%s is not a GLdc recording\n", filename);
+        return 1;
+    }
+
+    glKosInit();
+
+    Frame* frames = NULL;
+    uint32_t frame_count = 0;
+    uint64_t commands = 0;
+    uint64_t headers = 0;
+
+    uint8_t* it = data + sizeof(RecordFileHeader);
+    uint8_t* end = data + file_size;
+
+    /* First pass, apply everything in order */
+    while(it + sizeof(RecordChunkHeader) <= end) {
+        const RecordChunkHeader* chunk = (const RecordChunkHeader*) it;
+        uint32_t* payload = (uint32_t*) (it + sizeof(RecordChunkHeader));
+
+        it += sizeof(RecordChunkHeader) + chunk->size;
+        if(it > end) {
+            fprintf(stderr, "Recording is truncated\n");
+            break;
+        }
+
+        switch(chunk->type) {
+            case RECORD_CHUNK_FRAME: {
+                frames = (Frame*) realloc(frames, sizeof(Frame) * (frame_count + 1));
+                Frame* frame = &frames[frame_count++];
+
+                uint8_t* list = (uint8_t*) (payload + 3);
+                for(int i = 0; i < 3; ++i) {
+                    frame->counts[i] = payload[i];
+                    frame->lists[i] = list;
+                    relocate_headers(list, payload[i]);
+
+                    commands += payload[i];
+                    headers += count_headers(list, payload[i]);
+                    list += payload[i] * 32;
+                }
+
+                submit_frame(frame);
+
+#ifndef _arch_dreamcast
+                if(rasterize) {
+                    rasterizer_render(&rasterizer, pvr_capture_scene());
+
+                    const RasterizerStats* stats = &rasterizer.stats;
+                    printf("frame %u: tiles %u, triangles %u, tile bins %u, isp %llu, tsp %llu, blended %llu, texels %llu\n",
+                        frame_count - 1, stats->tiles_touched, stats->triangles, stats->tile_bins,
+                        (unsigned long long) stats->isp_fragments, (unsigned long long) stats->tsp_fragments,
+                        (unsigned long long) stats->blended_fragments, (unsigned long long) stats->texel_fetches);
+
+                    if(ppm_prefix) {
+                        char path[256];
+                        snprintf(path, sizeof(path), "%s%04u.ppm", ppm_prefix, frame_count - 1);
+                        rasterizer_write_ppm(&rasterizer, path);
+                    }
+                }
+#endif
+            } break;
+            case RECORD_CHUNK_TEXTURE_ALLOC:
+                texture_alloc(payload);
+            break;
+            case RECORD_CHUNK_TEXTURE_FREE:
+                texture_free(payload);
+            break;
+            case RECORD_CHUNK_TEXTURE_WRITE:
+                texture_write(payload);
+            break;
+            case RECORD_CHUNK_PALETTE_FORMAT:
+                pvr_set_pal_format(payload[0]);
+            break;
+            case RECORD_CHUNK_PALETTE:
+                for(uint32_t i = 0; i < payload[1]; ++i) {
+                    pvr_set_pal_entry(payload[0] + i, payload[2 + i]);
+                }
+            break;
+            case RECORD_CHUNK_BACKGROUND: {
+                const float* rgb = (const float*) payload;
+                pvr_set_bg_color(rgb[0], rgb[1], rgb[2]);
+            } break;
+            case RECORD_CHUNK_ALPHA_REF:
+                PVR_SET(PT_ALPHA_REF, payload[0]);
+            break;
+            default:
+                fprintf(stderr, "Skipping unknown chunk type %u\n", chunk->type);
+        }
+    }
+
+    if(!frame_count) {
+        fprintf(stderr, "No frames in recording\n");
+        return 1;
+    }
+
+    /* Timed passes, only the frames are resubmitted. Note that this uses
+     * the texture state from the end of the recording */
+    const uint64_t start = timer_us_gettime64();
+
+    for(int p = 0; p < passes; ++p) {
+        for(uint32_t i = 0; i < frame_count; ++i) {
+            submit_frame(&frames[i]);
+        }
+    }
+
+    const uint64_t elapsed_us = timer_us_gettime64() - start;
+    const uint64_t submitted = (uint64_t) passes * frame_count;
+
+    printf("frames: %u\n", frame_count);
+    printf("passes: %d\n", passes);
+    printf("average commands per frame: %.1f (%.1f headers)\n",
+        (double) commands / frame_count, (double) headers / frame_count);
+    printf("average bytes per frame: %.0f\n", (double) commands * 32 / frame_count);
+
+    if(submitted) {
+        printf("average submit time per frame: %.2f us\n", (double) elapsed_us / submitted);
+    }
+
+    free(frames);
+    free(data);
+
+    return 0;
+}
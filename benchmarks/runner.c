@@ -0,0 +1,1273 @@
+/*
+   GLdc benchmark runner
+
+   Drives a set of scenes for a fixed number of frames, with a fixed random
+   seed and fixed workload sizes, and prints the results as JSON. Runs on
+   the host build (make host-benchmarks) and on the Dreamcast.
+
+   polymark, trimark and quadmark are the scenes from samples/, and
+   zclipmark, lightmark and palettemark draw what the zclip, lights and
+   paletted samples do. The rest draw a static mesh of trimark-sized
+   triangles through the other submission paths. The scenes are described in SCENES at the bottom of
+   this file, which --help lists.
+
+   Usage: runner [--frames N] [--seed S] [--polys P] [--output FILE] [--trace FILE]
+                 [--counters NAME[,NAME]] [--strict] [--ppm DIR]
+                 [--checksums FILE] [--compare FILE] [--help] [scene...]
+
+   --trace writes a Chrome trace of the last few frames to FILE.
+
+   --counters counts up to two hardware events (e.g. cycles,ocache_misses)
+   and reports the totals for each stage.
+
+   --strict puts GLdc into steady state mode after the untimed warm-up frame
+   of each scene, so any allocation or free it makes during the timed
+   frames is reported, and exits with an error if there were any.
+
+   --ppm, --checksums and --compare are only available in the host build.
+   They run the last frame of each scene through the reference rasterizer,
+   then write it to DIR/<scene>.ppm, write a checksum of it to FILE, or
+   compare that checksum to the one in FILE and exit with an error if it's
+   different. "make host-test" compares against benchmarks/reference.txt,
+   and "make host-reference" updates it.
+
+   Unknown options and scene names are an error, so that a typo can't
+   quietly produce an empty set of results.
+
+   glKosInit prints a banner to stdout, so use --output if you need to
+   parse the results.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GL/glkos.h>
+#include <GL/glu.h>
+
+#include "../GL/platform.h"
+#include "../GL/profiler.h"
+
+#ifndef _arch_dreamcast
+#include "../GL/platforms/rasterizer.h"
+#endif
+
+#define DEFAULT_FRAMES 100
+#define DEFAULT_SEED 12345
+
+/* Enough for the last few frames of even the biggest scene */
+#define TRACE_EVENTS (1 << 18)
+
+/* Same starting point as the samples: 200000 polys/sec at 60fps */
+#define DEFAULT_POLYS (200000 / 60)
+
+typedef struct {
+    const char* name;
+    void (*frame)(int polycnt);
+
+    /* Per polygon */
+    int vertices;
+    int triangles;
+
+    /* Enabled for this scene, see SCENE_CAPS */
+    GLenum caps[7];
+
+    const char* description;
+} Scene;
+
+static const char* STAGES[] = {
+    "allocate", "generate", "light", "transform", "clip", "divide", "reject", "push"
+};
+
+#define STAGE_COUNT (sizeof(STAGES) / sizeof(const char*))
+
+static const struct {
+    const char* name;
+    GLenum pname;
+} COUNTERS[] = {
+    {"draw_calls", GL_DRAW_CALLS_KOS},
+    {"vertices_generated", GL_VERTICES_GENERATED_KOS},
+    {"vertices_transformed", GL_VERTICES_TRANSFORMED_KOS},
+    {"indices_served", GL_INDICES_SERVED_KOS},
+    {"vertices_referenced", GL_VERTICES_REFERENCED_KOS},
+    {"triangles_clipped", GL_TRIANGLES_CLIPPED_KOS},
+    {"polygon_headers", GL_POLYGON_HEADERS_KOS},
+    {"polygon_headers_elided", GL_POLYGON_HEADERS_ELIDED_KOS},
+    {"polygon_headers_compiled", GL_POLYGON_HEADERS_COMPILED_KOS},
+    {"draws_culled", GL_DRAWS_CULLED_KOS},
+    {"triangles_rejected_offscreen", GL_TRIANGLES_REJECTED_OFFSCREEN_KOS},
+    {"triangles_rejected_small", GL_TRIANGLES_REJECTED_SMALL_KOS},
+    {"triangles_rejected_backfacing", GL_TRIANGLES_REJECTED_BACKFACING_KOS},
+    {"vertices_rejected", GL_VERTICES_REJECTED_KOS},
+    {"op_list_bytes", GL_OP_LIST_BYTES_KOS},
+    {"pt_list_bytes", GL_PT_LIST_BYTES_KOS},
+    {"tr_list_bytes", GL_TR_LIST_BYTES_KOS},
+    {"allocations", GL_ALLOCATIONS_KOS},
+    {"allocation_bytes", GL_ALLOCATION_BYTES_KOS},
+    {"frees", GL_FREES_KOS}
+};
+
+#define COUNTER_COUNT (sizeof(COUNTERS) / sizeof(COUNTERS[0]))
+
+/* rand() differs between newlib and glibc, so use our own LCG so that
+ * every platform draws exactly the same scene */
+static uint32_t SEED = DEFAULT_SEED;
+
+static int next_rand() {
+    SEED = SEED * 1103515245u + 12345u;
+    return (SEED >> 16) & 0x7FFF;
+}
+
+/* Every scene places its polygons the way the samples do: a square of
+ * side 2 * size around x, y at depth z, in a random grey */
+typedef struct {
+    int x, y, z;
+    int size;
+    int grey;
+} Square;
+
+static Square next_square() {
+    Square square;
+    square.x = next_rand() % 640;
+    square.y = next_rand() % 480;
+    square.z = next_rand() % 100 + 1;
+    square.size = next_rand() % 50 + 1;
+    square.grey = next_rand() % 255;
+    return square;
+}
+
+static void polymark_frame(int polycnt) {
+    for(int i = 0; i < polycnt; i++) {
+        const Square s = next_square();
+        const float col = s.grey * 0.00391f;
+
+        glBegin(GL_POLYGON);
+        glColor3f(col, col, col);
+        glVertex3f(s.x - s.size, s.y - s.size, s.z);
+        glVertex3f(s.x + s.size, s.y - s.size, s.z);
+        glVertex3f(s.x + s.size, s.y + s.size, s.z);
+        glVertex3f(s.x, s.y + s.size + (s.size / 2), s.z);
+        glVertex3f(s.x - s.size, s.y + s.size, s.z);
+        glEnd();
+    }
+}
+
+static void trimark_frame(int polycnt) {
+    glBegin(GL_TRIANGLES);
+
+    for(int i = 0; i < polycnt; i++) {
+        const Square s = next_square();
+        const float col = s.grey * 0.00391f;
+
+        glColor3f(col, col, col);
+        glVertex3f(s.x - s.size, s.y - s.size, s.z);
+        glVertex3f(s.x + s.size, s.y - s.size, s.z);
+        glVertex3f(s.x + s.size, s.y + s.size, s.z);
+    }
+
+    glEnd();
+}
+
+static void quadmark_frame(int polycnt) {
+    glBegin(GL_QUADS);
+
+    for(int i = 0; i < polycnt; i++) {
+        const Square s = next_square();
+        const float col = s.grey * 0.00391f;
+
+        glColor3f(col, col, col);
+        glVertex3f(s.x - s.size, s.y - s.size, s.z);
+        glVertex3f(s.x + s.size, s.y - s.size, s.z);
+        glVertex3f(s.x + s.size, s.y + s.size, s.z);
+        glVertex3f(s.x - s.size, s.y + s.size, s.z);
+    }
+
+    glEnd();
+}
+
+/* Interleaved, but not in the layout that the fast path can copy directly */
+typedef struct {
+    float xyz[3];
+    float uv[2];
+    uint8_t rgba[4];
+} MeshVertex;
+
+/* One trimark triangle per polygon, built by the first mesh scene to run
+ * and shared by the rest so that they all draw the same thing */
+static MeshVertex* MESH = NULL;
+static GLuint* MESH_INDICES = NULL;
+static int MESH_POLYS = 0;
+static GLuint MESH_BUFFER = 0;
+static GLuint MESH_LIST = 0;
+
+/* What build_mesh generates lies within these bounds */
+static const float MESH_MIN[3] = {-50.0f, -50.0f, 1.0f};
+static const float MESH_MAX[3] = {640.0f + 50.0f, 480.0f + 50.0f, 100.0f};
+
+/* base is either the mesh itself or an offset into the bound buffer */
+static void bind_mesh(const GLubyte* base) {
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), base + offsetof(MeshVertex, xyz));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(MeshVertex), base + offsetof(MeshVertex, uv));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(MeshVertex), base + offsetof(MeshVertex, rgba));
+}
+
+static void unbind_mesh() {
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+}
+
+/* If indices isn't NULL the mesh is drawn with glDrawElements */
+static void draw_mesh(const GLubyte* base, const GLuint* indices, int polycnt) {
+    bind_mesh(base);
+
+    if(indices) {
+        glDrawElements(GL_TRIANGLES, polycnt * 3, GL_UNSIGNED_INT, indices);
+    } else {
+        glDrawArrays(GL_TRIANGLES, 0, polycnt * 3);
+    }
+
+    unbind_mesh();
+}
+
+static void build_mesh(int polycnt) {
+    if(MESH && MESH_POLYS == polycnt) {
+        return;
+    }
+
+    free(MESH);
+    MESH = (MeshVertex*) malloc(sizeof(MeshVertex) * polycnt * 3);
+    MESH_POLYS = polycnt;
+
+    /* Each triangle is drawn back to front, so the indices aren't just a
+     * copy of glDrawArrays */
+    free(MESH_INDICES);
+    MESH_INDICES = (GLuint*) malloc(sizeof(GLuint) * polycnt * 3);
+    for(int i = 0; i < polycnt * 3; i++) {
+        MESH_INDICES[i] = (i / 3) * 3 + (2 - (i % 3));
+    }
+
+    MeshVertex* v = MESH;
+    for(int i = 0; i < polycnt; i++) {
+        const Square s = next_square();
+        const float corners[3][2] = {
+            {s.x - s.size, s.y - s.size}, {s.x + s.size, s.y - s.size}, {s.x + s.size, s.y + s.size}
+        };
+
+        for(int c = 0; c < 3; ++c, ++v) {
+            v->xyz[0] = corners[c][0];
+            v->xyz[1] = corners[c][1];
+            v->xyz[2] = s.z;
+            v->uv[0] = (c == 0) ? 0.0f : 1.0f;
+            v->uv[1] = (c == 2) ? 1.0f : 0.0f;
+            v->rgba[0] = v->rgba[1] = v->rgba[2] = s.grey;
+            v->rgba[3] = 255;
+        }
+    }
+
+    if(!MESH_BUFFER) {
+        glGenBuffers(1, &MESH_BUFFER);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, MESH_BUFFER);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(MeshVertex) * polycnt * 3, MESH, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if(!MESH_LIST) {
+        MESH_LIST = glGenLists(1);
+    }
+
+    glNewList(MESH_LIST, GL_COMPILE);
+    draw_mesh((const GLubyte*) MESH, NULL, polycnt);
+    glEndList();
+}
+
+/* Draws the mesh in parts, each between a glPushMatrix and glPopMatrix */
+typedef void (*DrawPart)(int part, int first, int count);
+
+static void draw_mesh_parts(int polycnt, int parts, DrawPart draw_part) {
+    build_mesh(polycnt);
+    bind_mesh((const GLubyte*) MESH);
+
+    for(int i = 0; i < parts; i++) {
+        const int first = (polycnt * i) / parts;
+        const int last = (polycnt * (i + 1)) / parts;
+
+        glPushMatrix();
+        draw_part(i, first, last - first);
+        glPopMatrix();
+    }
+
+    unbind_mesh();
+}
+
+static void arraymark_frame(int polycnt) {
+    build_mesh(polycnt);
+    draw_mesh((const GLubyte*) MESH, NULL, polycnt);
+}
+
+static void indexmark_frame(int polycnt) {
+    build_mesh(polycnt);
+    draw_mesh((const GLubyte*) MESH, MESH_INDICES, polycnt);
+}
+
+static void buffermark_frame(int polycnt) {
+    build_mesh(polycnt);
+
+    glBindBuffer(GL_ARRAY_BUFFER, MESH_BUFFER);
+    draw_mesh(NULL, NULL, polycnt);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void listmark_frame(int polycnt) {
+    build_mesh(polycnt);
+    glCallList(MESH_LIST);
+}
+
+static void spritemark_frame(int polycnt) {
+    build_mesh(polycnt);
+    bind_mesh((const GLubyte*) MESH);
+
+    for(int i = 0; i < polycnt; i++) {
+        glDrawArrays(GL_TRIANGLES, i * 3, 3);
+    }
+
+    unbind_mesh();
+}
+
+#define CULL_TILES 8
+
+/* Side by side, so only the first is on screen */
+static void cull_part(int part, int first, int count) {
+    glTranslatef((MESH_MAX[0] - MESH_MIN[0]) * part, 0.0f, 0.0f);
+    glKosBoundingBox(MESH_MIN[0], MESH_MIN[1], MESH_MIN[2], MESH_MAX[0], MESH_MAX[1], MESH_MAX[2]);
+    glDrawArrays(GL_TRIANGLES, first * 3, count * 3);
+}
+
+static void cullmark_frame(int polycnt) {
+    draw_mesh_parts(polycnt, CULL_TILES, cull_part);
+}
+
+#define REJECT_PARTS 4
+
+/* As it is, wound the other way, between two half pixels and off screen */
+static void reject_part(int part, int first, int count) {
+    switch(part) {
+        case 1:
+            /* MESH_INDICES winds each triangle the other way */
+            glDrawElements(GL_TRIANGLES, count * 3, GL_UNSIGNED_INT, MESH_INDICES + first * 3);
+            return;
+        case 2:
+            glTranslatef(100.2f, 100.2f, 0.0f);
+            glScalef(0.0001f, 0.0001f, 1.0f);
+        break;
+        case 3:
+            glTranslatef(1000.0f, 0.0f, 0.0f);
+        break;
+    }
+
+    glDrawArrays(GL_TRIANGLES, first * 3, count * 3);
+}
+
+static void rejectmark_frame(int polycnt) {
+    draw_mesh_parts(polycnt, REJECT_PARTS, reject_part);
+}
+
+typedef struct {
+    float xyz[3];
+    float uv[2];
+    uint8_t rgba[4];
+    float n[3];
+} GridVertex;
+
+static GridVertex* GRID = NULL;
+static GLuint* GRID_INDICES = NULL;
+static int GRID_POLYS = 0;
+
+/* A square grid of just enough cells for polycnt triangles, the last row
+ * may be partly drawn */
+static void build_grid(int polycnt) {
+    if(GRID && GRID_POLYS == polycnt) {
+        return;
+    }
+
+    int side = 1;
+    while(side * side * 2 < polycnt) {
+        side++;
+    }
+
+    free(GRID);
+    free(GRID_INDICES);
+    GRID = (GridVertex*) malloc(sizeof(GridVertex) * (side + 1) * (side + 1));
+    GRID_INDICES = (GLuint*) malloc(sizeof(GLuint) * polycnt * 3);
+    GRID_POLYS = polycnt;
+
+    for(int y = 0; y <= side; y++) {
+        for(int x = 0; x <= side; x++) {
+            GridVertex* v = &GRID[y * (side + 1) + x];
+            v->xyz[0] = (640.0f * x) / side;
+            v->xyz[1] = (480.0f * y) / side;
+            v->xyz[2] = next_rand() % 100 + 1;
+            v->uv[0] = (float) x / side;
+            v->uv[1] = (float) y / side;
+            v->rgba[0] = v->rgba[1] = v->rgba[2] = next_rand() % 255;
+            v->rgba[3] = 255;
+            v->n[0] = v->n[1] = 0.0f;
+            v->n[2] = 1.0f;
+        }
+    }
+
+    GLuint* it = GRID_INDICES;
+    for(int i = 0; i < polycnt; i++) {
+        const int cell = i / 2;
+        const GLuint a = (cell / side) * (side + 1) + (cell % side);
+        const GLuint b = a + 1;
+        const GLuint c = a + side + 1;
+        const GLuint d = c + 1;
+
+        if(i % 2 == 0) {
+            *it++ = a; *it++ = b; *it++ = c;
+        } else {
+            *it++ = b; *it++ = d; *it++ = c;
+        }
+    }
+}
+
+static void gridmark_frame(int polycnt) {
+    build_grid(polycnt);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+
+    glVertexPointer(3, GL_FLOAT, sizeof(GridVertex), GRID->xyz);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(GridVertex), GRID->uv);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(GridVertex), GRID->rgba);
+    glNormalPointer(GL_FLOAT, sizeof(GridVertex), GRID->n);
+
+    glDrawElements(GL_TRIANGLES, polycnt * 3, GL_UNSIGNED_INT, GRID_INDICES);
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+}
+
+/* The scenes below follow the samples that use perspective, textures and
+ * lights, in place of their romdisk assets */
+static void perspective() {
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(45.0f, 640.0f / 480.0f, 0.1f, 100.0f);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+}
+
+#define TEXTURE_SIZE 64
+
+static GLuint TEXTURE = 0;
+static GLuint LIGHTMAP = 0;
+static GLuint PALETTED = 0;
+
+static GLuint make_texture(GLenum internal_format, GLenum format, const GLubyte* data) {
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, TEXTURE_SIZE, TEXTURE_SIZE, 0, format, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmapEXT(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return id;
+}
+
+/* A checkerboard, a lightmap that fades out from the middle, and a paletted
+ * texture using the shared palette */
+static void build_textures() {
+    if(TEXTURE) {
+        return;
+    }
+
+    static GLubyte rgba[TEXTURE_SIZE * TEXTURE_SIZE * 4];
+    static GLubyte light[TEXTURE_SIZE * TEXTURE_SIZE * 4];
+    static GLubyte indices[TEXTURE_SIZE * TEXTURE_SIZE];
+    static GLubyte palette[256 * 4];
+
+    for(int y = 0; y < TEXTURE_SIZE; y++) {
+        for(int x = 0; x < TEXTURE_SIZE; x++) {
+            const int i = y * TEXTURE_SIZE + x;
+            const int dx = x - TEXTURE_SIZE / 2;
+            const int dy = y - TEXTURE_SIZE / 2;
+            const int falloff = 255 - (dx * dx + dy * dy) * 255 / (TEXTURE_SIZE * TEXTURE_SIZE / 2);
+
+            rgba[i * 4 + 0] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = ((x / 8 + y / 8) % 2) ? 255 : 64;
+            rgba[i * 4 + 3] = 255;
+
+            light[i * 4 + 0] = light[i * 4 + 1] = light[i * 4 + 2] = (falloff > 0) ? falloff : 0;
+            light[i * 4 + 3] = 255;
+
+            indices[i] = (x ^ y) * 4;
+        }
+    }
+
+    for(int i = 0; i < 256; i++) {
+        palette[i * 4 + 0] = i;
+        palette[i * 4 + 1] = 255 - i;
+        palette[i * 4 + 2] = i / 2;
+        palette[i * 4 + 3] = 255;
+    }
+
+    TEXTURE = make_texture(GL_RGBA, GL_RGBA, rgba);
+    LIGHTMAP = make_texture(GL_RGBA, GL_RGBA, light);
+
+    glColorTableEXT(GL_SHARED_TEXTURE_PALETTE_EXT, GL_RGBA8, 256, GL_RGBA, GL_UNSIGNED_BYTE, palette);
+    PALETTED = make_texture(GL_COLOR_INDEX8_EXT, GL_COLOR_INDEX, indices);
+}
+
+/* Walls near enough to the camera to cross the near plane, however many
+ * polygons there are, as clipping a draw is limited to 255 triangles */
+#define ZCLIP_NEAR_WALLS 32
+
+/* samples/zclip: multitextured walls standing on a floor that runs from
+ * under the camera into the distance */
+static void zclipmark_frame(int polycnt) {
+    build_textures();
+    perspective();
+
+    glTranslatef(0.0f, -5.0f, 0.0f);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, TEXTURE);
+
+    glActiveTexture(GL_TEXTURE1);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, LIGHTMAP);
+
+    const float width = 3.5f;
+
+    glBegin(GL_QUADS);
+
+    glMultiTexCoord2f(GL_TEXTURE0, 0, 0);
+    glMultiTexCoord2f(GL_TEXTURE1, 0, 0);
+    glVertex3f(-100, 0, 0);
+    glMultiTexCoord2f(GL_TEXTURE0, 50, 0);
+    glMultiTexCoord2f(GL_TEXTURE1, 1, 0);
+    glVertex3f(100, 0, 0);
+    glMultiTexCoord2f(GL_TEXTURE0, 50, 100);
+    glMultiTexCoord2f(GL_TEXTURE1, 1, 1);
+    glVertex3f(100, 0, -200);
+    glMultiTexCoord2f(GL_TEXTURE0, 0, 100);
+    glMultiTexCoord2f(GL_TEXTURE1, 0, 1);
+    glVertex3f(-100, 0, -200);
+
+    for(int i = 1; i < polycnt; i++) {
+        const float x = (float) (next_rand() % 40) - 20.0f;
+        const float z = -(float) (next_rand() % 60) - ((i < ZCLIP_NEAR_WALLS) ? 0.0f : width + 1.0f);
+        const float height = (float) (next_rand() % 3 + 1) * 5.0f;
+
+        /* Alternately facing the camera and running away from it */
+        const float dx = (i % 2) ? 0.0f : width;
+        const float dz = (i % 2) ? width : 0.0f;
+
+        glMultiTexCoord2f(GL_TEXTURE0, 0, 0);
+        glMultiTexCoord2f(GL_TEXTURE1, 0, 0);
+        glVertex3f(x - dx, 0, z + dz);
+        glMultiTexCoord2f(GL_TEXTURE0, 1, 0);
+        glMultiTexCoord2f(GL_TEXTURE1, 1, 0);
+        glVertex3f(x + dx, 0, z - dz);
+        glMultiTexCoord2f(GL_TEXTURE0, 1, 1);
+        glMultiTexCoord2f(GL_TEXTURE1, 1, 1);
+        glVertex3f(x + dx, height, z - dz);
+        glMultiTexCoord2f(GL_TEXTURE0, 0, 1);
+        glMultiTexCoord2f(GL_TEXTURE1, 0, 1);
+        glVertex3f(x - dx, height, z + dz);
+    }
+
+    glEnd();
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+static const float CUBE_NORMALS[6][3] = {
+    {0, 0, 1}, {0, 0, -1}, {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}
+};
+
+static const float CUBE[6][4][3] = {
+    {{-1, -1, 1}, {1, -1, 1}, {1, 1, 1}, {-1, 1, 1}},
+    {{1, -1, -1}, {-1, -1, -1}, {-1, 1, -1}, {1, 1, -1}},
+    {{1, -1, 1}, {1, -1, -1}, {1, 1, -1}, {1, 1, 1}},
+    {{-1, -1, -1}, {-1, -1, 1}, {-1, 1, 1}, {-1, 1, -1}},
+    {{-1, 1, 1}, {1, 1, 1}, {1, 1, -1}, {-1, 1, -1}},
+    {{-1, -1, -1}, {1, -1, -1}, {1, -1, 1}, {-1, -1, 1}}
+};
+
+static const float QUAD_UV[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+
+/* Cubes with a glBegin each, six polygons apiece */
+static void draw_cubes(int polycnt) {
+    for(int i = 0; i < polycnt; i += 6) {
+        const float x = (float) (next_rand() % 40) - 20.0f;
+        const float y = (float) (next_rand() % 30) - 15.0f;
+        const float z = -(float) (next_rand() % 60) - 30.0f;
+        const float angle = (float) (next_rand() % 360);
+        const float col = (next_rand() % 255) * 0.00391f;
+
+        glPushMatrix();
+        glTranslatef(x, y, z);
+        glRotatef(angle, 1.0f, 1.0f, 0.0f);
+
+        glBegin(GL_QUADS);
+        glColor3f(col, col, col);
+
+        const int faces = (polycnt - i < 6) ? polycnt - i : 6;
+        for(int f = 0; f < faces; f++) {
+            glNormal3fv(CUBE_NORMALS[f]);
+            for(int c = 0; c < 4; c++) {
+                glTexCoord2fv(QUAD_UV[c]);
+                glVertex3fv(CUBE[f][c]);
+            }
+        }
+
+        glEnd();
+        glPopMatrix();
+    }
+}
+
+/* samples/lights: textured cubes lit by a directional and an attenuated
+ * point light, with glColorMaterial */
+static void lightmark_frame(int polycnt) {
+    build_textures();
+    perspective();
+
+    const GLfloat ambient[] = {0.2f, 0.2f, 0.2f, 1.0f};
+    const GLfloat diffuse[] = {0.8f, 0.8f, 0.8f, 1.0f};
+    const GLfloat specular[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    const GLfloat direction[] = {0.0f, 1.0f, 1.0f, 0.0f};
+    const GLfloat position[] = {0.0f, 0.0f, -50.0f, 1.0f};
+
+    glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+
+    glLightfv(GL_LIGHT0, GL_AMBIENT, ambient);
+    glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuse);
+    glLightfv(GL_LIGHT0, GL_SPECULAR, specular);
+    glLightfv(GL_LIGHT0, GL_POSITION, direction);
+
+    glLightfv(GL_LIGHT1, GL_DIFFUSE, diffuse);
+    glLightfv(GL_LIGHT1, GL_SPECULAR, specular);
+    glLightf(GL_LIGHT1, GL_CONSTANT_ATTENUATION, 1.0f);
+    glLightf(GL_LIGHT1, GL_LINEAR_ATTENUATION, 4.5f / 100);
+    glLightf(GL_LIGHT1, GL_QUADRATIC_ATTENUATION, 75.0f / (100 * 100));
+    glLightfv(GL_LIGHT1, GL_POSITION, position);
+
+    glBindTexture(GL_TEXTURE_2D, TEXTURE);
+    draw_cubes(polycnt);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/* samples/paletted: cubes with a mipmapped texture using the shared palette */
+static void palettemark_frame(int polycnt) {
+    build_textures();
+    perspective();
+
+    glBindTexture(GL_TEXTURE_2D, PALETTED);
+    draw_cubes(polycnt);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+static const Scene SCENES[] = {
+    {"polymark", polymark_frame, 5, 3, {GL_CULL_FACE},
+        "samples/polymark: five sided GL_POLYGONs, one glBegin each"},
+    {"trimark", trimark_frame, 3, 1, {0},
+        "samples/trimark: GL_TRIANGLES in one glBegin"},
+    {"quadmark", quadmark_frame, 4, 2, {0},
+        "samples/quadmark: GL_QUADS in one glBegin"},
+    {"arraymark", arraymark_frame, 3, 1, {0},
+        "the mesh from client arrays with glDrawArrays"},
+    {"buffermark", buffermark_frame, 3, 1, {0},
+        "the mesh from a GL_STATIC_DRAW buffer object"},
+    {"listmark", listmark_frame, 3, 1, {0},
+        "the mesh from a display list"},
+    {"indexmark", indexmark_frame, 3, 1, {0},
+        "the mesh with glDrawElements"},
+    {"spritemark", spritemark_frame, 3, 1, {0},
+        "the mesh one triangle per glDrawArrays, all in the same state"},
+    {"gridmark", gridmark_frame, 3, 1, {GL_LIGHTING, GL_LIGHT0},
+        "a lit grid with glDrawElements, each vertex shared by up to six triangles"},
+    {"cullmark", cullmark_frame, 3, 1, {0},
+        "the mesh in eight tiles with glKosBoundingBox, one on screen"},
+    {"rejectmark", rejectmark_frame, 3, 1, {GL_CULL_FACE, GL_TRIANGLE_REJECTION_KOS},
+        "the mesh in quarters with triangle rejection: visible, back facing, tiny, off screen"},
+    {"zclipmark", zclipmark_frame, 4, 2, {GL_TEXTURE_2D},
+        "samples/zclip: multitextured walls on a floor, in perspective and crossing the near plane"},
+    {"lightmark", lightmark_frame, 4, 2, {GL_TEXTURE_2D, GL_LIGHTING, GL_LIGHT0, GL_LIGHT1, GL_COLOR_MATERIAL, GL_NORMALIZE},
+        "samples/lights: textured cubes lit by two lights, one attenuated"},
+    {"palettemark", palettemark_frame, 4, 2, {GL_TEXTURE_2D, GL_SHARED_TEXTURE_PALETTE_EXT},
+        "samples/paletted: cubes with a mipmapped paletted texture"}
+};
+
+#define SCENE_COUNT (sizeof(SCENES) / sizeof(Scene))
+
+/* Everything a scene might enable, which is disabled for the others */
+static const GLenum SCENE_CAPS[] = {
+    GL_CULL_FACE, GL_LIGHTING, GL_LIGHT0, GL_LIGHT1, GL_COLOR_MATERIAL, GL_NORMALIZE,
+    GL_TEXTURE_2D, GL_SHARED_TEXTURE_PALETTE_EXT, GL_TRIANGLE_REJECTION_KOS
+};
+
+#define SCENE_CAP_COUNT (sizeof(SCENE_CAPS) / sizeof(GLenum))
+
+static void setup_scene(const Scene* scene) {
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glOrtho(0, 640, 0, 480, -100, 100);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+
+    /* Scenes that move parts of the mesh around do it in screen units */
+    glMatrixMode(GL_MODELVIEW);
+
+    /* Scenes that don't give a colour get white, whatever ran before them */
+    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+
+    for(uint32_t i = 0; i < SCENE_CAP_COUNT; ++i) {
+        glDisable(SCENE_CAPS[i]);
+    }
+
+    for(const GLenum* cap = scene->caps; *cap; ++cap) {
+        glEnable(*cap);
+    }
+}
+
+static const Scene* find_scene(const char* name) {
+    for(uint32_t i = 0; i < SCENE_COUNT; ++i) {
+        if(strcmp(SCENES[i].name, name) == 0) {
+            return &SCENES[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void usage(FILE* f) {
+    fprintf(f,
+        "Usage: runner [--frames N] [--seed S] [--polys P] [--output FILE] [--trace FILE]\n"
+        "              [--counters NAME[,NAME]] [--strict] [--ppm DIR]\n"
+        "              [--checksums FILE] [--compare FILE] [--help] [scene...]\n"
+        "\n"
+        "Runs every scene unless some are named:\n"
+    );
+
+    for(uint32_t i = 0; i < SCENE_COUNT; ++i) {
+        fprintf(f, "  %-12s %s\n", SCENES[i].name, SCENES[i].description);
+    }
+}
+
+static ProfilerCounter COUNTERS_SELECTED[PROFILER_MAX_COUNTERS] = {PROFILER_COUNTER_NONE, PROFILER_COUNTER_NONE};
+
+static uint8_t has_suffix(const char* path, const char* suffix) {
+    const size_t len = strlen(path);
+    const size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(path + len - suffix_len, suffix) == 0;
+}
+
+/* Sum the time (and hardware counters) spent in a stage, wherever
+ * submitVertices (or _glSubmitListDraw, for display lists) was called from */
+static uint64_t stage_time_us(const char* stage, uint64_t counters[PROFILER_MAX_COUNTERS]) {
+    char suffix[64], list_suffix[64];
+    snprintf(suffix, sizeof(suffix), "submitVertices:%s", stage);
+    snprintf(list_suffix, sizeof(list_suffix), "_glSubmitListDraw:%s", stage);
+
+    uint64_t total = 0;
+
+    for(uint32_t c = 0; c < PROFILER_MAX_COUNTERS; ++c) {
+        counters[c] = 0;
+    }
+
+    const char* path;
+    uint64_t time_us, calls;
+    uint32_t i = 0;
+    while(profiler_result(i, &path, &time_us, &calls)) {
+        if(has_suffix(path, suffix) || has_suffix(path, list_suffix)) {
+            uint64_t totals[PROFILER_MAX_COUNTERS];
+            profiler_result_counters(i, totals);
+
+            total += time_us;
+            for(uint32_t c = 0; c < PROFILER_MAX_COUNTERS; ++c) {
+                counters[c] += totals[c];
+            }
+        }
+        ++i;
+    }
+
+    return total;
+}
+
+/* Returns -1 unless all of value is a non-negative number */
+static int parse_int(const char* value) {
+    char* end = NULL;
+    const long result = strtol(value, &end, 10);
+    return (end != value && !*end && result >= 0 && result <= 0x7FFFFFFF) ? (int) result : -1;
+}
+
+static ProfilerCounter parse_counter(const char* name, size_t len) {
+    for(uint32_t i = PROFILER_COUNTER_NONE + 1; i < PROFILER_COUNTER_COUNT; ++i) {
+        const char* candidate = profiler_counter_name((ProfilerCounter) i);
+        if(strlen(candidate) == len && strncmp(candidate, name, len) == 0) {
+            return (ProfilerCounter) i;
+        }
+    }
+
+    return PROFILER_COUNTER_NONE;
+}
+
+static uint8_t find_result(const char* name, uint32_t* index) {
+    const char* path;
+    uint64_t time_us, calls;
+    uint32_t i = 0;
+    while(profiler_result(i, &path, &time_us, &calls)) {
+        if(strcmp(path, name) == 0) {
+            *index = i;
+            return 1;
+        }
+        ++i;
+    }
+
+    return 0;
+}
+
+static FILE* OUT = NULL;
+
+static int STRICT = 0;
+
+static const char* PPM_DIR = NULL;
+static const char* CHECKSUMS_PATH = NULL;
+static const char* COMPARE_PATH = NULL;
+
+#ifndef _arch_dreamcast
+#define MAX_REFERENCES 64
+
+typedef struct {
+    char scene[32];
+    unsigned int checksum;
+} Reference;
+
+static Reference REFERENCES[MAX_REFERENCES];
+static uint32_t REFERENCE_COUNT = 0;
+
+static FILE* CHECKSUMS = NULL;
+
+/* Reads the "<scene> <checksum>" lines written by --checksums, skipping
+ * blank lines and comments. Returns 0 if the file couldn't be read. */
+static int read_references(const char* path) {
+    FILE* f = fopen(path, "r");
+    if(!f) {
+        return 0;
+    }
+
+    char line[128];
+    while(fgets(line, sizeof(line), f)) {
+        if(line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+
+        Reference* ref = &REFERENCES[REFERENCE_COUNT];
+        if(REFERENCE_COUNT == MAX_REFERENCES || sscanf(line, "%31s %x", ref->scene, &ref->checksum) != 2) {
+            fclose(f);
+            return 0;
+        }
+
+        REFERENCE_COUNT++;
+    }
+
+    fclose(f);
+    return 1;
+}
+
+static const Reference* find_reference(const char* scene) {
+    for(uint32_t i = 0; i < REFERENCE_COUNT; ++i) {
+        if(strcmp(REFERENCES[i].scene, scene) == 0) {
+            return &REFERENCES[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* FNV-1a of each pixel's red, green and blue */
+static unsigned int image_checksum(const Rasterizer* rasterizer) {
+    uint32_t hash = 2166136261u;
+
+    for(uint32_t i = 0; i < rasterizer->width * rasterizer->height; ++i) {
+        const uint32_t c = rasterizer->colour[i];
+        for(int shift = 16; shift >= 0; shift -= 8) {
+            hash = (hash ^ ((c >> shift) & 0xFF)) * 16777619u;
+        }
+    }
+
+    return hash;
+}
+
+/* Renders the last frame the scene submitted, then writes it to PPM_DIR,
+ * writes its checksum to CHECKSUMS and compares that to the reference.
+ * Returns 1 if it didn't match. */
+static int check_image(const Scene* scene) {
+    static Rasterizer rasterizer;
+    static int initialized = 0;
+
+    if(!initialized) {
+        rasterizer_init(&rasterizer, vid_mode->width, vid_mode->height);
+        initialized = 1;
+    }
+
+    rasterizer_render(&rasterizer, pvr_capture_scene());
+
+    if(PPM_DIR) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s.ppm", PPM_DIR, scene->name);
+        if(rasterizer_write_ppm(&rasterizer, path) != 0) {
+            fprintf(stderr, "Unable to write %s\n", path);
+            return 1;
+        }
+    }
+
+    const unsigned int checksum = image_checksum(&rasterizer);
+
+    if(CHECKSUMS) {
+        fprintf(CHECKSUMS, "%s %08x\n", scene->name, checksum);
+    }
+
+    if(COMPARE_PATH) {
+        const Reference* ref = find_reference(scene->name);
+        if(!ref) {
+            fprintf(stderr, "%s: no checksum in %s\n", scene->name, COMPARE_PATH);
+            return 1;
+        }
+
+        if(ref->checksum != checksum) {
+            fprintf(stderr, "%s: checksum %08x, expected %08x\n", scene->name, checksum, ref->checksum);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+/* Returns the number of allocations and frees made during the timed frames */
+static GLint run_scene(const Scene* scene, int frames, int polycnt, uint32_t seed, int first) {
+    setup_scene(scene);
+
+    SEED = seed;
+
+    /* One untimed frame so that list allocations don't count */
+    scene->frame(polycnt);
+    glKosSwapBuffers();
+
+    profiler_clear();
+    glKosResetCounters();
+
+    if(STRICT) {
+        glKosSetSteadyState(GL_STEADY_STATE_REPORT_KOS);
+    }
+
+    const uint64_t start = timer_us_gettime64();
+
+    for(int i = 0; i < frames; ++i) {
+        scene->frame(polycnt);
+        glKosSwapBuffers();
+    }
+
+    const uint64_t elapsed_us = timer_us_gettime64() - start;
+
+    glKosSetSteadyState(GL_STEADY_STATE_OFF_KOS);
+
+    const double seconds = (elapsed_us) ? elapsed_us / 1000000.0 : 1e-6;
+
+    const uint64_t vertices = (uint64_t) frames * polycnt * scene->vertices;
+    const uint64_t triangles = (uint64_t) frames * polycnt * scene->triangles;
+
+    fprintf(OUT, "%s    {\n", (first) ? "" : ",\n");
+    fprintf(OUT, "      \"name\": \"%s\",\n", scene->name);
+    fprintf(OUT, "      \"frames\": %d,\n", frames);
+    fprintf(OUT, "      \"polygons_per_frame\": %d,\n", polycnt);
+    fprintf(OUT, "      \"seed\": %u,\n", (unsigned) seed);
+    fprintf(OUT, "      \"total_time_us\": %llu,\n", (unsigned long long) elapsed_us);
+    fprintf(OUT, "      \"frame_time_us\": %.2f,\n", (double) elapsed_us / frames);
+
+    ProfilerStats stats;
+    uint32_t frame_result;
+    if(find_result("frame", &frame_result) && profiler_result_stats(frame_result, &stats)) {
+        fprintf(OUT, "      \"frame_time_p50_us\": %.2f,\n", stats.p50_us);
+        fprintf(OUT, "      \"frame_time_p95_us\": %.2f,\n", stats.p95_us);
+        fprintf(OUT, "      \"frame_time_p99_us\": %.2f,\n", stats.p99_us);
+        fprintf(OUT, "      \"frame_time_max_us\": %.2f,\n", stats.max_us);
+    }
+    fprintf(OUT, "      \"vertices_per_second\": %.0f,\n", vertices / seconds);
+    fprintf(OUT, "      \"triangles_per_second\": %.0f,\n", triangles / seconds);
+    fprintf(OUT, "      \"stages_us\": {\n");
+
+    uint64_t stage_counters[STAGE_COUNT][PROFILER_MAX_COUNTERS];
+    for(uint32_t i = 0; i < STAGE_COUNT; ++i) {
+        fprintf(OUT, "        \"%s\": %llu%s\n", STAGES[i], (unsigned long long) stage_time_us(STAGES[i], stage_counters[i]),
+            (i == STAGE_COUNT - 1) ? "" : ",");
+    }
+
+    fprintf(OUT, "      },\n");
+
+    if(COUNTERS_SELECTED[0] != PROFILER_COUNTER_NONE) {
+        fprintf(OUT, "      \"stage_counters\": {\n");
+
+        for(uint32_t i = 0; i < STAGE_COUNT; ++i) {
+            fprintf(OUT, "        \"%s\": {", STAGES[i]);
+            for(uint32_t c = 0; c < PROFILER_MAX_COUNTERS; ++c) {
+                if(COUNTERS_SELECTED[c] == PROFILER_COUNTER_NONE) {
+                    continue;
+                }
+
+                fprintf(OUT, "%s\"%s\": %llu", (c) ? ", " : "", profiler_counter_name(COUNTERS_SELECTED[c]),
+                    (unsigned long long) stage_counters[i][c]);
+            }
+            fprintf(OUT, "}%s\n", (i == STAGE_COUNT - 1) ? "" : ",");
+        }
+
+        fprintf(OUT, "      },\n");
+    }
+
+    GLint arena_high_water = 0;
+    glGetIntegerv(GL_FRAME_ARENA_HIGH_WATER_KOS, &arena_high_water);
+    fprintf(OUT, "      \"frame_arena_high_water_bytes\": %d,\n", arena_high_water);
+
+    GLint live_bytes = 0;
+    glGetIntegerv(GL_LIVE_ALLOCATION_BYTES_KOS, &live_bytes);
+    fprintf(OUT, "      \"live_allocation_bytes\": %d,\n", live_bytes);
+
+    fprintf(OUT, "      \"counters_per_frame\": {\n");
+
+    for(uint32_t i = 0; i < COUNTER_COUNT; ++i) {
+        GLint value = 0;
+        glGetIntegerv(COUNTERS[i].pname, &value);
+        fprintf(OUT, "        \"%s\": %.1f%s\n", COUNTERS[i].name, (double) value / frames,
+            (i == COUNTER_COUNT - 1) ? "" : ",");
+    }
+
+    fprintf(OUT, "      },\n");
+    fprintf(OUT, "      \"allocation_sites\": [");
+
+    const char* site;
+    GLuint count, bytes;
+    GLint allocations = 0;
+    for(GLuint i = 0; glKosGetAllocationSite(i, &site, &count, &bytes); ++i) {
+        if(!count) {
+            continue;
+        }
+
+        fprintf(OUT, "%s\n        {\"site\": \"%s\", \"count\": %u, \"bytes\": %u}",
+            (allocations) ? "," : "", site, count, bytes);
+        allocations += count;
+    }
+
+    fprintf(OUT, "%s]\n", (allocations) ? "\n      " : "");
+    fprintf(OUT, "    }");
+
+    GLint frees = 0;
+    glGetIntegerv(GL_FREES_KOS, &frees);
+
+    return allocations + frees;
+}
+
+int main(int argc, char* argv[]) {
+    int frames = DEFAULT_FRAMES;
+    int polycnt = DEFAULT_POLYS;
+    uint32_t seed = DEFAULT_SEED;
+    uint8_t selected[SCENE_COUNT] = {0};
+    int selected_count = 0;
+    const char* output = NULL;
+    const char* trace = NULL;
+    const char* counters = NULL;
+
+    for(int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+
+        if(strcmp(arg, "--help") == 0) {
+            usage(stdout);
+            return 0;
+        }
+
+        if(strcmp(arg, "--strict") == 0) {
+            STRICT = 1;
+            continue;
+        }
+
+        if(arg[0] != '-') {
+            const Scene* scene = find_scene(arg);
+            if(!scene) {
+                fprintf(stderr, "Unknown scene %s\n", arg);
+                usage(stderr);
+                return 1;
+            }
+
+            selected[scene - SCENES] = 1;
+            selected_count++;
+            continue;
+        }
+
+        /* Everything else takes a value */
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if(strcmp(arg, "--frames") == 0 && value) {
+            frames = parse_int(value);
+        } else if(strcmp(arg, "--seed") == 0 && value) {
+            seed = (uint32_t) parse_int(value);
+        } else if(strcmp(arg, "--polys") == 0 && value) {
+            polycnt = parse_int(value);
+        } else if(strcmp(arg, "--output") == 0 && value) {
+            output = value;
+        } else if(strcmp(arg, "--trace") == 0 && value) {
+            trace = value;
+        } else if(strcmp(arg, "--counters") == 0 && value) {
+            counters = value;
+        } else if(strcmp(arg, "--ppm") == 0 && value) {
+            PPM_DIR = value;
+        } else if(strcmp(arg, "--checksums") == 0 && value) {
+            CHECKSUMS_PATH = value;
+        } else if(strcmp(arg, "--compare") == 0 && value) {
+            COMPARE_PATH = value;
+        } else {
+            fprintf(stderr, (value) ? "Unknown option %s\n" : "Unknown option or missing value for %s\n", arg);
+            usage(stderr);
+            return 1;
+        }
+
+        ++i;
+    }
+
+    if(frames < 1 || polycnt < 1 || (int) seed < 0) {
+        fprintf(stderr, "frames and polys must be positive numbers, and seed a number\n");
+        return 1;
+    }
+
+#ifdef _arch_dreamcast
+    if(PPM_DIR || CHECKSUMS_PATH || COMPARE_PATH) {
+        fprintf(stderr, "--ppm, --checksums and --compare are only available on the host\n");
+        return 1;
+    }
+#else
+    if(COMPARE_PATH && !read_references(COMPARE_PATH)) {
+        fprintf(stderr, "Unable to read the checksums in %s\n", COMPARE_PATH);
+        return 1;
+    }
+
+    if(CHECKSUMS_PATH) {
+        CHECKSUMS = fopen(CHECKSUMS_PATH, "w");
+        if(!CHECKSUMS) {
+            fprintf(stderr, "Unable to open %s\n", CHECKSUMS_PATH);
+            return 1;
+        }
+
+        fprintf(CHECKSUMS, "# The last frame of each runner scene, rendered by the reference rasterizer\n");
+    }
+#endif
+
+    OUT = (output) ? fopen(output, "w") : stdout;
+    if(!OUT) {
+        fprintf(stderr, "Unable to open %s\n", output);
+        return 1;
+    }
+
+    glKosInit();
+
+    /* Each stage only takes a few microseconds per call, so time them in ns */
+    profiler_set_clock(profiler_clock_ns, 1000000000);
+    profiler_enable();
+
+    if(trace) {
+        profiler_timeline_enable(TRACE_EVENTS);
+    }
+
+    if(counters) {
+        const char* it = counters;
+        for(uint32_t c = 0; c < PROFILER_MAX_COUNTERS && *it; ++c) {
+            const char* comma = strchr(it, ',');
+            const size_t len = (comma) ? (size_t) (comma - it) : strlen(it);
+
+            COUNTERS_SELECTED[c] = parse_counter(it, len);
+            if(COUNTERS_SELECTED[c] == PROFILER_COUNTER_NONE) {
+                fprintf(stderr, "Unknown counter %.*s\n", (int) len, it);
+                return 1;
+            }
+
+            it += len + (comma != NULL);
+        }
+
+        const uint8_t started = profiler_set_counters(COUNTERS_SELECTED[0], COUNTERS_SELECTED[1]);
+        const uint8_t wanted = (COUNTERS_SELECTED[0] != PROFILER_COUNTER_NONE) + (COUNTERS_SELECTED[1] != PROFILER_COUNTER_NONE);
+        if(started < wanted) {
+            fprintf(stderr, "Only %d of %d counters could be started, the rest will read zero\n", started, wanted);
+        }
+    }
+
+    fprintf(OUT, "{\n");
+    fprintf(OUT, "  \"version\": 1,\n");
+    fprintf(OUT, "  \"results\": [\n");
+
+    int first = 1;
+    GLint allocations = 0;
+    int mismatches = 0;
+    for(uint32_t i = 0; i < SCENE_COUNT; ++i) {
+        if(!selected_count || selected[i]) {
+            allocations += run_scene(&SCENES[i], frames, polycnt, seed, first);
+            first = 0;
+
+#ifndef _arch_dreamcast
+            if(PPM_DIR || CHECKSUMS_PATH || COMPARE_PATH) {
+                mismatches += check_image(&SCENES[i]);
+            }
+#endif
+        }
+    }
+
+    fprintf(OUT, "\n  ]\n");
+    fprintf(OUT, "}\n");
+
+    if(OUT != stdout) {
+        fclose(OUT);
+    }
+
+#ifndef _arch_dreamcast
+    if(CHECKSUMS) {
+        fclose(CHECKSUMS);
+    }
+#endif
+
+    if(trace) {
+        FILE* f = fopen(trace, "w");
+        if(!f || !profiler_timeline_write_json(f)) {
+            fprintf(stderr, "Unable to write %s\n", trace);
+            return 1;
+        }
+
+        fclose(f);
+    }
+
+    if(STRICT && allocations) {
+        fprintf(stderr, "%d allocations and frees after warm-up\n", allocations);
+        return 1;
+    }
+
+    if(mismatches) {
+        fprintf(stderr, "%d scenes didn't match their reference checksums\n", mismatches);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+   GLdc AlignedVector benchmark
+
+   Pushes 32 byte elements (the size of a TA vertex) one at a time into an
+   empty AlignedVector, like the clipper does when it builds up a list, and
+   prints the cost per push as JSON. Each size is run with the original fixed
+   chunk growth (growth_percent 0) and with the default geometric growth, so
+   you can see that the cost per push stays flat as the vector gets large.
+
+   reallocations is how many times the capacity changed, and moves how many
+   of those the allocator couldn't do in place.
+
+   Usage: vectors [--output FILE]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <GL/gl.h>
+
+#include "../GL/platform.h"
+#include "../containers/aligned_vector.h"
+
+#ifdef _arch_dreamcast
+#define MAX_COUNT (1u << 18)
+#else
+#define MAX_COUNT (1u << 20)
+#endif
+
+/* Run each measurement over at least this many pushes so that the timer has
+ * something to measure */
+#define MIN_PUSHES_PER_MEASUREMENT (1u << 21)
+
+typedef struct {
+    uint32_t data[8];
+} Element;
+
+static FILE* OUT = NULL;
+static int FIRST_RESULT = 1;
+
+static void run(unsigned int growth_percent, unsigned int count) {
+    const unsigned int repeats = (count < MIN_PUSHES_PER_MEASUREMENT) ? MIN_PUSHES_PER_MEASUREMENT / count : 1;
+
+    Element element;
+    memset(&element, 0, sizeof(element));
+
+    unsigned int reallocations = 0;
+    unsigned int moves = 0;
+
+    aligned_vector_set_growth_percent(growth_percent);
+
+    const uint64_t start = timer_ns_gettime64();
+
+    for(unsigned int r = 0; r < repeats; ++r) {
+        AlignedVector vector;
+        aligned_vector_init(&vector, sizeof(Element));
+
+        for(unsigned int i = 0; i < count; ++i) {
+            const unsigned int capacity = vector.capacity;
+            const unsigned char* data = vector.data;
+
+            element.data[0] = i;
+            aligned_vector_push_back(&vector, &element, 1);
+
+            /* Only the first run is counted, they're all the same */
+            if(r == 0 && vector.capacity != capacity) {
+                reallocations++;
+                moves += (vector.data != data);
+            }
+        }
+
+        aligned_vector_cleanup(&vector);
+    }
+
+    const uint64_t elapsed = timer_ns_gettime64() - start;
+
+    fprintf(OUT, "%s    {\"growth_percent\": %u, \"count\": %u, \"ns_per_push\": %.2f, \"reallocations\": %u, \"moves\": %u}",
+        (FIRST_RESULT) ? "" : ",\n", growth_percent, count, (double) elapsed / ((double) repeats * count),
+        reallocations, moves);
+
+    FIRST_RESULT = 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* output = NULL;
+
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        }
+    }
+
+    OUT = (output) ? fopen(output, "w") : stdout;
+    if(!OUT) {
+        fprintf(stderr, "Unable to open %s\n", output);
+        return 1;
+    }
+
+    const unsigned int policies[] = {0, ALIGNED_VECTOR_DEFAULT_GROWTH_PERCENT};
+
+    fprintf(OUT, "{\n");
+    fprintf(OUT, "  \"version\": 1,\n");
+    fprintf(OUT, "  \"results\": [\n");
+
+    for(unsigned int p = 0; p < sizeof(policies) / sizeof(unsigned int); ++p) {
+        for(unsigned int count = 1024; count <= MAX_COUNT; count *= 4) {
+            run(policies[p], count);
+        }
+    }
+
+    fprintf(OUT, "\n  ]\n");
+    fprintf(OUT, "}\n");
+
+    if(OUT != stdout) {
+        fclose(OUT);
+    }
+
+    aligned_vector_set_growth_percent(ALIGNED_VECTOR_DEFAULT_GROWTH_PERCENT);
+
+    return 0;
+}
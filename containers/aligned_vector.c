@@ -4,26 +4,84 @@
 #include <assert.h>
 #include <stdio.h>
 
-#if defined(__APPLE__) || defined(__WIN32__)
-/* Linux + Kos define this, OSX does not, so just use malloc there */
-static inline void* memalign(size_t alignment, size_t size) {
-    return malloc(size);
-}
-#else
-    #include <malloc.h>
-#endif
+#include <stdint.h>
 
 #include "aligned_vector.h"
+#include "../GL/alloc.h"
+
+#define ALIGNMENT 0x20u
+
+static unsigned int GROWTH_PERCENT = ALIGNED_VECTOR_DEFAULT_GROWTH_PERCENT;
+
+void aligned_vector_set_growth_percent(unsigned int percent) {
+    GROWTH_PERCENT = percent;
+}
+
+/* Blocks come from realloc rather than memalign, so that the allocator can
+ * extend them in place (or remap them, for large blocks) instead of always
+ * copying. We overallocate by enough to align the data ourselves, and if the
+ * block moves to an address with a different alignment we shuffle the
+ * contents along within it. */
+static void reallocate(AlignedVector* vector, unsigned int byte_size, unsigned int used_byte_size) {
+    if(vector->arena) {
+        vector->data = (unsigned char*) arena_realloc(
+            vector->arena, vector->data, vector->capacity * vector->element_size, byte_size
+        );
+        return;
+    }
+
+    const uintptr_t old_offset = vector->data - vector->allocation;
+
+    unsigned char* allocation = (unsigned char*) GL_REALLOC(vector->allocation, byte_size + ALIGNMENT - 1);
+    assert(allocation);
+
+    const uintptr_t new_offset = (ALIGNMENT - ((uintptr_t) allocation & (ALIGNMENT - 1))) & (ALIGNMENT - 1);
+
+    if(vector->allocation && new_offset != old_offset && used_byte_size) {
+        memmove(allocation + new_offset, allocation + old_offset, used_byte_size);
+    }
+
+    vector->allocation = allocation;
+    vector->data = allocation + new_offset;
+}
 
 void aligned_vector_init(AlignedVector* vector, unsigned int element_size) {
     vector->size = vector->capacity = 0;
     vector->element_size = element_size;
     vector->data = NULL;
+    vector->allocation = NULL;
+    vector->arena = NULL;
+    vector->arena_generation = 0;
 
     /* Reserve some initial capacity */
     aligned_vector_reserve(vector, ALIGNED_VECTOR_CHUNK_SIZE);
 }
 
+void aligned_vector_init_arena(AlignedVector* vector, unsigned int element_size, Arena* arena) {
+    vector->size = vector->capacity = 0;
+    vector->element_size = element_size;
+    vector->data = NULL;
+    vector->allocation = NULL;
+    vector->arena = arena;
+    vector->arena_generation = arena->generation;
+}
+
+/* Returns the capacity the vector had if its arena has been reset since it
+ * last allocated, and empties it */
+static inline unsigned int release_stale_arena(AlignedVector* vector) {
+    if(!vector->arena || vector->arena_generation == vector->arena->generation) {
+        return 0;
+    }
+
+    const unsigned int previous_capacity = vector->capacity;
+
+    vector->arena_generation = vector->arena->generation;
+    vector->data = NULL;
+    vector->size = vector->capacity = 0;
+
+    return previous_capacity;
+}
+
 
 static inline unsigned int round_to_chunk_size(unsigned int val) {
     const unsigned int n = val;
@@ -38,25 +96,19 @@ void aligned_vector_reserve(AlignedVector* vector, unsigned int element_count) {
         return;
     }
 
+    const unsigned int previous_capacity = release_stale_arena(vector);
+    if(previous_capacity > element_count) {
+        element_count = previous_capacity;
+    }
+
     if(element_count <= vector->capacity) {
         return;
     }
 
-    unsigned int original_byte_size = vector->size * vector->element_size;
-
     /* We overallocate so that we don't make small allocations during push backs */
     element_count = round_to_chunk_size(element_count);
 
-    unsigned int new_byte_size = element_count * vector->element_size;
-    unsigned char* original_data = vector->data;
-
-    vector->data = (unsigned char*) memalign(0x20, new_byte_size);
-    assert(vector->data);
-
-    if(original_data) {
-        memcpy(vector->data, original_data, original_byte_size);
-        free(original_data);
-    }
+    reallocate(vector, element_count * vector->element_size, vector->size * vector->element_size);
 
     vector->capacity = element_count;
 }
@@ -80,6 +132,10 @@ void* aligned_vector_push_back(AlignedVector* vector, const void* objs, unsigned
 }
 
 void* aligned_vector_resize(AlignedVector* vector, const unsigned int element_count) {
+    if(vector->arena && vector->arena_generation != vector->arena->generation) {
+        aligned_vector_reserve(vector, element_count);
+    }
+
     unsigned int previousCount = vector->size;
 
     /* Don't change memory when resizing downwards, just change the size */
@@ -89,7 +145,9 @@ void* aligned_vector_resize(AlignedVector* vector, const unsigned int element_co
     }
 
     if(vector->capacity < element_count) {
-        aligned_vector_reserve(vector, element_count);
+        /* Grow geometrically, an explicit reserve gets exactly what it asks for */
+        const unsigned int grown = vector->capacity + (unsigned int) (((unsigned long long) vector->capacity * GROWTH_PERCENT) / 100);
+        aligned_vector_reserve(vector, (grown > element_count) ? grown : element_count);
     }
 
     vector->size = element_count;
@@ -121,20 +179,20 @@ void aligned_vector_clear(AlignedVector* vector) {
 }
 
 void aligned_vector_shrink_to_fit(AlignedVector* vector) {
-    if(vector->size == 0) {
-        free(vector->data);
+    if(vector->arena) {
+        /* Arena memory is only given back on reset */
+        if(vector->size == 0) {
+            vector->data = NULL;
+            vector->capacity = 0;
+        }
+    } else if(vector->size == 0) {
+        GL_FREE(vector->allocation);
+        vector->allocation = NULL;
         vector->data = NULL;
         vector->capacity = 0;
     } else {
         unsigned int new_byte_size = vector->size * vector->element_size;
-        unsigned char* original_data = vector->data;
-        vector->data = (unsigned char*) memalign(0x20, new_byte_size);
-
-        if(original_data) {
-            memcpy(vector->data, original_data, new_byte_size);
-            free(original_data);
-        }
-
+        reallocate(vector, new_byte_size, new_byte_size);
         vector->capacity = vector->size;
     }
 }
@@ -1,6 +1,8 @@
 #ifndef ALIGNED_VECTOR_H
 #define ALIGNED_VECTOR_H
 
+#include "arena.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -10,11 +12,35 @@ typedef struct {
     unsigned int capacity;
     unsigned char* data;
     unsigned int element_size;
+
+    /* The block returned by the allocator, data is the first 32 byte
+     * aligned address inside it */
+    unsigned char* allocation;
+
+    /* Set for vectors whose storage comes from an arena, see
+     * aligned_vector_init_arena */
+    Arena* arena;
+    unsigned int arena_generation;
 } AlignedVector;
 
 #define ALIGNED_VECTOR_CHUNK_SIZE 256u
 
+/* When a resize needs more room the capacity grows by at least this
+ * percentage of the current capacity (rounded up to the chunk size), so that
+ * repeated push backs stay amortised O(1). 0 grows by the requested amount
+ * only, which was the original behaviour. */
+#define ALIGNED_VECTOR_DEFAULT_GROWTH_PERCENT 50u
+
+void aligned_vector_set_growth_percent(unsigned int percent);
+
 void aligned_vector_init(AlignedVector* vector, unsigned int element_size);
+
+/* Takes the vector's storage from arena. Once the arena is reset the vector
+ * is empty, and the next resize or reserve allocates afresh with at least
+ * the capacity it had before, so a vector that's reused every frame settles
+ * at the size it needs. Nothing should be read from it between the reset and
+ * the next resize. */
+void aligned_vector_init_arena(AlignedVector* vector, unsigned int element_size, Arena* arena);
 void aligned_vector_reserve(AlignedVector* vector, unsigned int element_count);
 void* aligned_vector_push_back(AlignedVector* vector, const void* objs, unsigned int count);
 void* aligned_vector_resize(AlignedVector* vector, const unsigned int element_count);
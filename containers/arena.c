@@ -0,0 +1,150 @@
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "arena.h"
+#include "../GL/alloc.h"
+
+/* Keep the data in spill blocks aligned */
+#define BLOCK_HEADER_SIZE ((sizeof(ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+/* When the main block grows it's rounded up to this */
+#define GROWTH_GRANULARITY 4096u
+
+static inline unsigned int round_to_alignment(unsigned int size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+static inline unsigned char* block_data(ArenaBlock* block) {
+    return ((unsigned char*) block) + BLOCK_HEADER_SIZE;
+}
+
+void arena_init(Arena* arena, unsigned int capacity) {
+    arena->capacity = round_to_alignment(capacity);
+    arena->data = (arena->capacity) ? (unsigned char*) GL_MEMALIGN(ARENA_ALIGNMENT, arena->capacity) : NULL;
+    assert(arena->data || !arena->capacity);
+
+    arena->used = 0;
+    arena->spill = NULL;
+    arena->total = 0;
+    arena->high_water = 0;
+    arena->abandoned = 0;
+    arena->generation = 0;
+}
+
+static void* spill(Arena* arena, unsigned int size) {
+    ArenaBlock* block = arena->spill;
+
+    if(!block || block->used + size > block->capacity) {
+        const unsigned int capacity = (size > arena->capacity) ? size : arena->capacity;
+
+        block = (ArenaBlock*) GL_MEMALIGN(ARENA_ALIGNMENT, BLOCK_HEADER_SIZE + capacity);
+        assert(block);
+
+        block->next = arena->spill;
+        block->capacity = capacity;
+        block->used = 0;
+        arena->spill = block;
+    }
+
+    void* ret = block_data(block) + block->used;
+    block->used += size;
+    return ret;
+}
+
+void* arena_alloc(Arena* arena, unsigned int size) {
+    size = round_to_alignment(size);
+
+    void* ret;
+    if(arena->used + size <= arena->capacity) {
+        ret = arena->data + arena->used;
+        arena->used += size;
+    } else {
+        ret = spill(arena, size);
+    }
+
+    arena->total += size;
+    if(arena->total > arena->high_water) {
+        arena->high_water = arena->total;
+    }
+
+    return ret;
+}
+
+void* arena_realloc(Arena* arena, void* ptr, unsigned int old_size, unsigned int new_size) {
+    if(!ptr) {
+        return arena_alloc(arena, new_size);
+    }
+
+    old_size = round_to_alignment(old_size);
+    new_size = round_to_alignment(new_size);
+
+    /* If this was the last thing allocated from the block it came from, we
+     * can just move the top of the block */
+    unsigned int* used = NULL;
+    unsigned int capacity = 0;
+
+    if(!arena->spill && (unsigned char*) ptr + old_size == arena->data + arena->used) {
+        used = &arena->used;
+        capacity = arena->capacity;
+    } else if(arena->spill && (unsigned char*) ptr + old_size == block_data(arena->spill) + arena->spill->used) {
+        used = &arena->spill->used;
+        capacity = arena->spill->capacity;
+    }
+
+    if(used && *used - old_size + new_size <= capacity) {
+        *used = *used - old_size + new_size;
+        arena->total = arena->total - old_size + new_size;
+        if(arena->total > arena->high_water) {
+            arena->high_water = arena->total;
+        }
+
+        return ptr;
+    }
+
+    void* ret = arena_alloc(arena, new_size);
+    memcpy(ret, ptr, (old_size < new_size) ? old_size : new_size);
+    arena->abandoned += old_size;
+    return ret;
+}
+
+unsigned char arena_reset(Arena* arena) {
+    const unsigned char spilled = (arena->spill != NULL);
+
+    while(arena->spill) {
+        ArenaBlock* next = arena->spill->next;
+        GL_FREE(arena->spill);
+        arena->spill = next;
+    }
+
+    if(spilled) {
+        /* Anything that was moved by arena_realloc is assumed to be reallocated
+         * at its final size next time around, so only count what was live */
+        const unsigned int live = arena->total - arena->abandoned;
+        const unsigned int capacity = ((live + GROWTH_GRANULARITY - 1) / GROWTH_GRANULARITY) * GROWTH_GRANULARITY;
+
+        if(capacity > arena->capacity) {
+            /* Nothing is live, so there's nothing to copy */
+            GL_FREE(arena->data);
+
+            arena->capacity = capacity;
+            arena->data = (unsigned char*) GL_MEMALIGN(ARENA_ALIGNMENT, arena->capacity);
+            assert(arena->data);
+        }
+    }
+
+    arena->used = 0;
+    arena->total = 0;
+    arena->abandoned = 0;
+    arena->generation++;
+
+    return spilled;
+}
+
+void arena_cleanup(Arena* arena) {
+    arena_reset(arena);
+
+    GL_FREE(arena->data);
+    arena->data = NULL;
+    arena->capacity = 0;
+}
@@ -0,0 +1,58 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A bump allocator for memory which only lives until the next reset. All
+ * allocations are 32 byte aligned. Allocations come from a single main block
+ * while they fit, after that they spill into extra blocks. On reset the
+ * spill blocks are freed and, if anything spilled, the main block is grown
+ * to fit everything that was still in use so that the next cycle fits in
+ * one block. */
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    unsigned int capacity;
+    unsigned int used;
+} ArenaBlock;
+
+typedef struct {
+    unsigned char* data;
+    unsigned int capacity;
+    unsigned int used;
+
+    /* Most recently allocated spill block first */
+    ArenaBlock* spill;
+
+    /* Bytes allocated since the last reset, including spills */
+    unsigned int total;
+    unsigned int high_water;
+
+    /* Bytes left behind by arena_realloc moving an allocation */
+    unsigned int abandoned;
+
+    /* Changes on every reset, so that users can tell their
+     * allocations have gone away */
+    unsigned int generation;
+} Arena;
+
+#define ARENA_ALIGNMENT 0x20u
+
+void arena_init(Arena* arena, unsigned int capacity);
+void* arena_alloc(Arena* arena, unsigned int size);
+
+/* Resizes the allocation at ptr (of old_size bytes), in place if it's the
+ * most recent allocation and there's room, otherwise by copying it to a new
+ * allocation. */
+void* arena_realloc(Arena* arena, void* ptr, unsigned int old_size, unsigned int new_size);
+
+/* Returns 1 if anything spilled out of the main block since the last reset */
+unsigned char arena_reset(Arena* arena);
+void arena_cleanup(Arena* arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ARENA_H
@@ -1,83 +1,158 @@
 #include <stdlib.h>
-#include <math.h>
 #include <string.h>
 #include <assert.h>
 
-#ifndef __APPLE__
-#include <malloc.h>
-#else
-/* Linux + Kos define this, OSX does not, so just use malloc there */
-#define memalign(x, size) malloc((size))
-#endif
-
 #include "named_array.h"
+#include "../GL/alloc.h"
 
-void named_array_init(NamedArray* array, unsigned int element_size, unsigned int max_elements) {
-    array->element_size = element_size;
-    array->max_element_count = max_elements;
+#define PAGE_SHIFT 6
+#define MARKERS_PER_PAGE (NAMED_ARRAY_PAGE_SIZE / 32)
+
+static unsigned char add_page(NamedArray* array) {
+    if(array->capacity >= array->max_element_count) {
+        return 0;
+    }
 
-    float c = (float) max_elements / 8.0f;
-    array->marker_count = (unsigned char) ceil(c);
+    const unsigned int page_count = array->capacity / NAMED_ARRAY_PAGE_SIZE;
+
+    unsigned char** pages = (unsigned char**) GL_REALLOC(array->pages, sizeof(unsigned char*) * (page_count + 1));
+    if(!pages) {
+        return 0;
+    }
+
+    array->pages = pages;
+
+    uint32_t* markers = (uint32_t*) GL_REALLOC(array->used_markers, sizeof(uint32_t) * (array->marker_count + MARKERS_PER_PAGE));
+    if(!markers) {
+        return 0;
+    }
+
+    array->used_markers = markers;
 
 #ifdef _arch_dreamcast
     // Use 32-bit aligned memory on the Dreamcast
-    array->elements = (unsigned char*) memalign(0x20, element_size * max_elements);
-    array->used_markers = (unsigned char*) memalign(0x20, array->marker_count);
+    unsigned char* page = (unsigned char*) GL_MEMALIGN(0x20, array->element_size * NAMED_ARRAY_PAGE_SIZE);
 #else
-    array->elements = (unsigned char*) malloc(element_size * max_elements);
-    array->used_markers = (unsigned char*) malloc(array->marker_count);
+    unsigned char* page = (unsigned char*) GL_MALLOC(array->element_size * NAMED_ARRAY_PAGE_SIZE);
 #endif
-    memset(array->used_markers, 0, sizeof(unsigned char) * array->marker_count);
+
+    if(!page) {
+        return 0;
+    }
+
+    array->pages[page_count] = page;
+    memset(&array->used_markers[array->marker_count], 0, sizeof(uint32_t) * MARKERS_PER_PAGE);
+
+    array->marker_count += MARKERS_PER_PAGE;
+    array->capacity += NAMED_ARRAY_PAGE_SIZE;
+    return 1;
+}
+
+static void init(NamedArray* array, unsigned int element_size, unsigned int max_elements, unsigned char growable) {
+    array->element_size = element_size;
+    array->max_element_count = max_elements;
+    array->capacity = 0;
+    array->growable = growable;
+    array->pages = NULL;
+    array->used_markers = NULL;
+    array->marker_count = 0;
+    array->first_free_marker = 0;
+}
+
+void named_array_init(NamedArray* array, unsigned int element_size, unsigned int max_elements) {
+    init(array, element_size, max_elements, 0);
+
+    while(array->capacity < max_elements) {
+        if(!add_page(array)) {
+            assert(0 && "Unable to allocate named array");
+            break;
+        }
+    }
+}
+
+void named_array_init_growable(NamedArray* array, unsigned int element_size, unsigned int max_elements) {
+    init(array, element_size, max_elements, 1);
+    add_page(array);
+}
+
+static inline unsigned char* element(NamedArray* array, unsigned int id) {
+    return array->pages[id >> PAGE_SHIFT] + (id & (NAMED_ARRAY_PAGE_SIZE - 1)) * array->element_size;
 }
 
 char named_array_used(NamedArray* array, unsigned int id) {
-    unsigned int i = id / 8;
-    unsigned int j = id % 8;
+    if(id >= array->capacity) {
+        return 0;
+    }
+
+    return !!(array->used_markers[id / 32] & (1u << (id % 32)));
+}
+
+static void* mark_used(NamedArray* array, unsigned int id) {
+    array->used_markers[id / 32] |= (1u << (id % 32));
 
-    unsigned char v = array->used_markers[i] & (unsigned char) (1 << j);
-    return !!(v);
+    unsigned char* ptr = element(array, id);
+    memset(ptr, 0, array->element_size);
+    return ptr;
 }
 
 void* named_array_alloc(NamedArray* array, unsigned int* new_id) {
-    unsigned int i = 0, j = 0;
-    for(i = 0; i < array->marker_count; ++i) {
-        for(j = 0; j < 8; ++j) {
-            unsigned int id = (i * 8) + j;
-            if(!named_array_used(array, id)) {
-                array->used_markers[i] |= (unsigned char) 1 << j;
+    /* Always hands out the lowest free ID, but only has to look at one word
+     * unless the array is full */
+    for(;;) {
+        unsigned int i = array->first_free_marker;
+        for(; i < array->marker_count; ++i) {
+            const uint32_t markers = array->used_markers[i];
+            if(markers != 0xFFFFFFFF) {
+                const unsigned int id = (i * 32) + __builtin_ctz(~markers);
+                array->first_free_marker = i;
+
+                if(id >= array->max_element_count) {
+                    return NULL;
+                }
+
                 *new_id = id;
-                unsigned char* ptr = &array->elements[id * array->element_size];
-                memset(ptr, 0, array->element_size);
-                return ptr;
+                return mark_used(array, id);
             }
         }
-    }
 
-    return NULL;
+        array->first_free_marker = array->marker_count;
+
+        if(!array->growable || !add_page(array)) {
+            return NULL;
+        }
+    }
 }
 
 void* named_array_reserve(NamedArray* array, unsigned int id) {
-    if(!named_array_used(array, id)) {
-        unsigned int j = (id % 8);
-        unsigned int i = id / 8;
+    if(id >= array->max_element_count) {
+        return NULL;
+    }
 
-        assert(!named_array_used(array, id));
-        array->used_markers[i] |= (unsigned char) 1 << j;
-        assert(named_array_used(array, id));
+    while(id >= array->capacity) {
+        if(!array->growable || !add_page(array)) {
+            return NULL;
+        }
+    }
 
-        unsigned char* ptr = &array->elements[id * array->element_size];
-        memset(ptr, 0, array->element_size);
-        return ptr;
+    if(!named_array_used(array, id)) {
+        return mark_used(array, id);
     }
 
     return named_array_get(array, id);
 }
 
 void named_array_release(NamedArray* array, unsigned int new_id) {
-    unsigned int i = new_id / 8;
-    unsigned int j = new_id % 8;
+    if(new_id >= array->capacity) {
+        return;
+    }
 
-    array->used_markers[i] &= (unsigned char) ~(1 << j);
+    const unsigned int i = new_id / 32;
+
+    array->used_markers[i] &= ~(1u << (new_id % 32));
+
+    if(i < array->first_free_marker) {
+        array->first_free_marker = i;
+    }
 }
 
 void* named_array_get(NamedArray* array, unsigned int id) {
@@ -85,15 +160,18 @@ void* named_array_get(NamedArray* array, unsigned int id) {
         return NULL;
     }
 
-    return &array->elements[id * array->element_size];
+    return element(array, id);
 }
 
 void named_array_cleanup(NamedArray* array) {
-    free(array->elements);
-    free(array->used_markers);
-    array->elements = NULL;
+    for(unsigned int i = 0; i < array->capacity / NAMED_ARRAY_PAGE_SIZE; ++i) {
+        GL_FREE(array->pages[i]);
+    }
+
+    GL_FREE(array->pages);
+    GL_FREE(array->used_markers);
+    array->pages = NULL;
     array->used_markers = NULL;
-    array->element_size = array->max_element_count = 0;
-    array->marker_count = 0;
+    array->element_size = array->max_element_count = array->capacity = 0;
+    array->marker_count = array->first_free_marker = 0;
 }
-
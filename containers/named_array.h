@@ -5,17 +5,41 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
+/* Elements live in pages of this many, which never move once allocated so
+ * pointers to elements stay valid when the array grows */
+#define NAMED_ARRAY_PAGE_SIZE 64u
+
 typedef struct {
     unsigned int element_size;
+
+    /* IDs are always less than max_element_count */
     unsigned int max_element_count;
-    unsigned char* elements;
-    unsigned char* used_markers;
-    unsigned char marker_count;
+
+    /* How many elements the allocated pages hold */
+    unsigned int capacity;
+    unsigned char growable;
+
+    unsigned char** pages;
+
+    /* One bit per element, 32 to a word */
+    uint32_t* used_markers;
+    unsigned int marker_count;
+
+    /* Every word before this one is full */
+    unsigned int first_free_marker;
 } NamedArray;
 
+/* Allocates room for all max_elements up front */
 void named_array_init(NamedArray* array, unsigned int element_size, unsigned int max_elements);
+
+/* Starts with a single page and adds more as IDs are needed */
+void named_array_init_growable(NamedArray* array, unsigned int element_size, unsigned int max_elements);
+
 char named_array_used(NamedArray* array, unsigned int id);
 
+/* These return NULL if the array is full (or id is out of range) */
 void* named_array_alloc(NamedArray* array, unsigned int* new_id);
 void* named_array_reserve(NamedArray* array, unsigned int id);
 
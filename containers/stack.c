@@ -1,22 +1,14 @@
 #include <string.h>
 #include <stdlib.h>
 
-#if defined(__APPLE__) || defined(__WIN32__)
-/* Linux + Kos define this, OSX does not, so just use malloc there */
-static inline void* memalign(size_t alignment, size_t size) {
-    return malloc(size);
-}
-#else
-    #include <malloc.h>
-#endif
-
 #include "stack.h"
+#include "../GL/alloc.h"
 
 void init_stack(Stack* stack, unsigned int element_size, unsigned int capacity) {
     stack->size = 0;
     stack->capacity = capacity;
     stack->element_size = element_size;
-    stack->data = (unsigned char*) memalign(0x20, element_size * capacity);
+    stack->data = (unsigned char*) GL_MEMALIGN(0x20, element_size * capacity);
 }
 
 void* stack_top(Stack* stack) {
@@ -284,6 +284,14 @@ __BEGIN_DECLS
 #define GL_3_BYTES                              0x1408
 #define GL_4_BYTES                              0x1409
 
+/* Display lists */
+#define GL_COMPILE                              0x1300
+#define GL_COMPILE_AND_EXECUTE                  0x1301
+#define GL_LIST_BASE                            0x0B32
+#define GL_LIST_INDEX                           0x0B33
+#define GL_LIST_MODE                            0x0B30
+#define GL_MAX_LIST_NESTING                     0x0B31
+
 /* ErrorCode */
 #define GL_NO_ERROR                       0
 #define GL_INVALID_ENUM                   0x0500
@@ -555,10 +563,25 @@ GLAPI void APIENTRY glColorPointer(GLint size, GLenum type,
 /* Array Data Submission */
 GLAPI void APIENTRY glDrawArrays(GLenum mode, GLint first, GLsizei count);
 GLAPI void APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices);
+GLAPI void APIENTRY glDrawRangeElements(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid *indices);
 
 GLAPI void APIENTRY glEnableClientState(GLenum cap);
 GLAPI void APIENTRY glDisableClientState(GLenum cap);
 
+/* Display Lists - only draws (glDrawArrays, glDrawElements and glBegin/glEnd) are
+   recorded, already generated, along with the state their headers depend on (blending,
+   depth, culling, the bound textures...). Other calls made while compiling, including
+   matrix changes, take effect immediately and aren't replayed. glCallList only
+   lights, transforms, clips and divides the recorded vertices. */
+GLAPI GLuint APIENTRY glGenLists(GLsizei range);
+GLAPI void APIENTRY glDeleteLists(GLuint list, GLsizei range);
+GLAPI GLboolean APIENTRY glIsList(GLuint list);
+GLAPI void APIENTRY glNewList(GLuint list, GLenum mode);
+GLAPI void APIENTRY glEndList();
+GLAPI void APIENTRY glCallList(GLuint list);
+GLAPI void APIENTRY glCallLists(GLsizei n, GLenum type, const GLvoid *lists);
+GLAPI void APIENTRY glListBase(GLuint base);
+
 /* Transformation / Matrix Functions */
 
 GLAPI void APIENTRY glMatrixMode(GLenum mode);
@@ -9,6 +9,7 @@
 #define __GL_GLEXT_H
 
 #include <sys/cdefs.h>
+#include <stddef.h>
 __BEGIN_DECLS
 
 #define GL_TEXTURE0_ARB                   0x84C0
@@ -134,6 +135,51 @@ GLAPI void APIENTRY glGenerateMipmapEXT(GLenum target);
 GLAPI GLenum APIENTRY glCheckFramebufferStatusEXT(GLenum target);
 GLAPI GLboolean APIENTRY glIsFramebufferEXT(GLuint framebuffer);
 
+/* ARB_vertex_buffer_object */
+#define GLintptrARB   ptrdiff_t
+#define GLsizeiptrARB ptrdiff_t
+
+#define GL_BUFFER_SIZE_ARB                      0x8764
+#define GL_BUFFER_USAGE_ARB                     0x8765
+#define GL_ARRAY_BUFFER_ARB                     0x8892
+#define GL_ELEMENT_ARRAY_BUFFER_ARB             0x8893
+#define GL_ARRAY_BUFFER_BINDING_ARB             0x8894
+#define GL_ELEMENT_ARRAY_BUFFER_BINDING_ARB     0x8895
+#define GL_VERTEX_ARRAY_BUFFER_BINDING_ARB      0x8896
+#define GL_NORMAL_ARRAY_BUFFER_BINDING_ARB      0x8897
+#define GL_COLOR_ARRAY_BUFFER_BINDING_ARB       0x8898
+#define GL_TEXTURE_COORD_ARRAY_BUFFER_BINDING_ARB 0x889A
+#define GL_READ_ONLY_ARB                        0x88B8
+#define GL_WRITE_ONLY_ARB                       0x88B9
+#define GL_READ_WRITE_ARB                       0x88BA
+#define GL_BUFFER_ACCESS_ARB                    0x88BB
+#define GL_BUFFER_MAPPED_ARB                    0x88BC
+#define GL_BUFFER_MAP_POINTER_ARB               0x88BD
+#define GL_STREAM_DRAW_ARB                      0x88E0
+#define GL_STREAM_READ_ARB                      0x88E1
+#define GL_STREAM_COPY_ARB                      0x88E2
+#define GL_STATIC_DRAW_ARB                      0x88E4
+#define GL_STATIC_READ_ARB                      0x88E5
+#define GL_STATIC_COPY_ARB                      0x88E6
+#define GL_DYNAMIC_DRAW_ARB                     0x88E8
+#define GL_DYNAMIC_READ_ARB                     0x88E9
+#define GL_DYNAMIC_COPY_ARB                     0x88EA
+
+/* GL_STATIC_DRAW_ARB buffers are converted to the PVR vertex format the first
+ * time they're drawn from (and again whenever the data or the glXPointer
+ * layout changes), so drawing from them skips reading and converting the
+ * attributes. Every enabled attribute must come from the same buffer. */
+GLAPI void APIENTRY glGenBuffersARB(GLsizei n, GLuint* buffers);
+GLAPI void APIENTRY glDeleteBuffersARB(GLsizei n, const GLuint* buffers);
+GLAPI void APIENTRY glBindBufferARB(GLenum target, GLuint buffer);
+GLAPI GLboolean APIENTRY glIsBufferARB(GLuint buffer);
+GLAPI void APIENTRY glBufferDataARB(GLenum target, GLsizeiptrARB size, const GLvoid* data, GLenum usage);
+GLAPI void APIENTRY glBufferSubDataARB(GLenum target, GLintptrARB offset, GLsizeiptrARB size, const GLvoid* data);
+GLAPI void APIENTRY glGetBufferSubDataARB(GLenum target, GLintptrARB offset, GLsizeiptrARB size, GLvoid* data);
+GLAPI GLvoid* APIENTRY glMapBufferARB(GLenum target, GLenum access);
+GLAPI GLboolean APIENTRY glUnmapBufferARB(GLenum target);
+GLAPI void APIENTRY glGetBufferParameterivARB(GLenum target, GLenum pname, GLint* params);
+
 /* ext_paletted_texture */
 #define GL_COLOR_INDEX1_EXT                0x80E2
 #define GL_COLOR_INDEX2_EXT                0x80E3
@@ -187,6 +233,25 @@ GLAPI void APIENTRY glCompressedTexImage2DARB(GLenum target,
 #define glClientActiveTexture glClientActiveTextureARB
 #define glMultiTexCoord2f glMultiTexCoord2fARB
 
+#define GL_ARRAY_BUFFER GL_ARRAY_BUFFER_ARB
+#define GL_ELEMENT_ARRAY_BUFFER GL_ELEMENT_ARRAY_BUFFER_ARB
+#define GL_ARRAY_BUFFER_BINDING GL_ARRAY_BUFFER_BINDING_ARB
+#define GL_ELEMENT_ARRAY_BUFFER_BINDING GL_ELEMENT_ARRAY_BUFFER_BINDING_ARB
+#define GL_STREAM_DRAW GL_STREAM_DRAW_ARB
+#define GL_STATIC_DRAW GL_STATIC_DRAW_ARB
+#define GL_DYNAMIC_DRAW GL_DYNAMIC_DRAW_ARB
+
+#define glGenBuffers glGenBuffersARB
+#define glDeleteBuffers glDeleteBuffersARB
+#define glBindBuffer glBindBufferARB
+#define glIsBuffer glIsBufferARB
+#define glBufferData glBufferDataARB
+#define glBufferSubData glBufferSubDataARB
+#define glGetBufferSubData glGetBufferSubDataARB
+#define glMapBuffer glMapBufferARB
+#define glUnmapBuffer glUnmapBufferARB
+#define glGetBufferParameteriv glGetBufferParameterivARB
+
 #define glGenerateMipmap glGenerateMipmapEXT
 #define glCompressedTexImage2D glCompressedTexImage2DARB
 
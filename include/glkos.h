@@ -32,6 +32,12 @@ __BEGIN_DECLS
 
 #define GL_NEARZ_CLIPPING_KOS                       0xEEFA
 
+/* Pass to glEnable to remove triangles that the PVR wouldn't draw anything
+ * of (off screen, covering no pixel centres, or culled by GL_CULL_FACE)
+ * from the lists before they're sent, so that they don't use up TA
+ * bandwidth or vertex buffer space. Disabled by default. */
+#define GL_TRIANGLE_REJECTION_KOS                   0xEF2A
+
 #define GL_UNSIGNED_BYTE_TWID_KOS                   0xEEFB
 
 
@@ -50,6 +56,12 @@ typedef struct {
     GLuint initial_tr_capacity;
     GLuint initial_pt_capacity;
     GLuint initial_immediate_capacity;
+
+    /* Size in bytes of the block that each frame's vertex data (the lists,
+     * and scratch space for lighting and clipping) is taken from. It's reset
+     * by glKosSwapBuffers. If a frame needs more it spills into extra
+     * allocations, and the block is grown to fit at the next swap. */
+    GLuint frame_arena_size;
 } GLdcConfig;
 
 
@@ -108,5 +120,109 @@ GLAPI void APIENTRY glKosSwapBuffers();
 /* Pass to glTexParameteri to set the shared bank */
 #define GL_SHARED_TEXTURE_BANK_KOS                  0xEF00
 
+/*
+ * Counters
+ *
+ * Pass these to glGetIntegerv to find out what the pipeline has been doing
+ * since the last call to glKosResetCounters. The list counters are updated
+ * by glKosSwapBuffers, so a typical use is to read them after each swap and
+ * then reset.
+ */
+#define GL_DRAW_CALLS_KOS                           0xEF10
+#define GL_VERTICES_SUBMITTED_KOS                   0xEF11  /* Vertices passed to the draw calls */
+#define GL_VERTICES_GENERATED_KOS                   0xEF12  /* Vertices after expanding fans and polygons */
+#define GL_TRIANGLES_CLIPPED_KOS                    0xEF13  /* Triangles clipped against the near plane */
+#define GL_VERTICES_DEAD_KOS                        0xEF14  /* Vertices discarded by clipping but still submitted */
+#define GL_POLYGON_HEADERS_KOS                      0xEF15
+#define GL_OP_LIST_BYTES_KOS                        0xEF16
+#define GL_PT_LIST_BYTES_KOS                        0xEF17
+#define GL_TR_LIST_BYTES_KOS                        0xEF18
+#define GL_TEXTURE_UPLOADS_KOS                      0xEF19
+#define GL_TEXTURE_UPLOAD_BYTES_KOS                 0xEF1A
+#define GL_PALETTE_ENTRIES_KOS                      0xEF1B
+#define GL_OP_LIST_HIGH_WATER_KOS                   0xEF1C  /* Most entries in the list at any swap */
+#define GL_PT_LIST_HIGH_WATER_KOS                   0xEF1D
+#define GL_TR_LIST_HIGH_WATER_KOS                   0xEF1E
+#define GL_FRAME_ARENA_HIGH_WATER_KOS               0xEF1F  /* Most bytes used by any frame */
+#define GL_FRAME_ARENA_SPILLS_KOS                   0xEF20  /* Frames which outgrew the frame arena */
+#define GL_ALLOCATIONS_KOS                          0xEF21  /* Heap and texture memory allocations */
+#define GL_ALLOCATION_BYTES_KOS                     0xEF22
+#define GL_VERTICES_TRANSFORMED_KOS                 0xEF26  /* Including unused vertices in an indexed draw's range */
+#define GL_POLYGON_HEADERS_ELIDED_KOS               0xEF27  /* Draws appended to the previous draw's header */
+#define GL_POLYGON_HEADERS_COMPILED_KOS             0xEF28  /* Headers compiled rather than reused */
+#define GL_DRAWS_CULLED_KOS                         0xEF29  /* Draws skipped because their bounds were off screen */
+#define GL_TRIANGLES_REJECTED_OFFSCREEN_KOS         0xEF2B  /* Removed by GL_TRIANGLE_REJECTION_KOS */
+#define GL_TRIANGLES_REJECTED_SMALL_KOS             0xEF2C  /* Zero area or between pixel centres */
+#define GL_TRIANGLES_REJECTED_BACKFACING_KOS        0xEF2D
+#define GL_VERTICES_REJECTED_KOS                    0xEF2E  /* Fewer vertices sent, after splitting strips */
+#define GL_INDICES_SERVED_KOS                       0xEF2F  /* Indices gathered from a transformed range */
+#define GL_VERTICES_REFERENCED_KOS                  0xEF30  /* Distinct vertices of those ranges the indices used */
+#define GL_FREES_KOS                                0xEF31  /* Heap allocations freed */
+
+/* Heap allocations that haven't been freed yet and their bytes. These are
+ * totals, so glKosResetCounters doesn't reset them. */
+#define GL_LIVE_ALLOCATIONS_KOS                     0xEF32
+#define GL_LIVE_ALLOCATION_BYTES_KOS                0xEF33
+
+GLAPI void APIENTRY glKosResetCounters();
+
+/*
+ * Steady state
+ *
+ * Once an application has warmed up (uploaded its textures and drawn a
+ * frame or two) GLdc shouldn't need to allocate anything more. After calling
+ * glKosSetSteadyState(GL_STEADY_STATE_REPORT_KOS) any allocation GLdc makes
+ * (or free) is printed to stderr along with where it came from,
+ * GL_STEADY_STATE_ASSERT_KOS asserts instead (in debug builds) and
+ * GL_STEADY_STATE_OFF_KOS allows allocations again, e.g. while loading a
+ * level.
+ *
+ * glKosGetAllocationSite returns the number of allocations, and the bytes
+ * allocated, from each place in GLdc that allocates ("GL/texture.c:123")
+ * since the last glKosResetCounters. Returns GL_FALSE once index is past
+ * the last site. If there are too many sites to keep track of, the last
+ * one is "(other sites)" and counts the rest.
+ */
+#define GL_STEADY_STATE_OFF_KOS                     0xEF23
+#define GL_STEADY_STATE_REPORT_KOS                  0xEF24
+#define GL_STEADY_STATE_ASSERT_KOS                  0xEF25
+
+GLAPI void APIENTRY glKosSetSteadyState(GLenum mode);
+GLAPI GLboolean APIENTRY glKosGetAllocationSite(GLuint index, const char** site, GLuint* count, GLuint* bytes);
+
+/*
+ * Bounding volumes
+ *
+ * glKosBoundingBox and glKosBoundingSphere give the bounds, in object
+ * coordinates, of the next draw call (glDrawArrays, glDrawElements,
+ * glDrawRangeElements, glEnd or glCallList, which covers every draw in the
+ * list). They're tested against the frustum of the current projection and
+ * modelview matrices when that call is made. If they're entirely outside
+ * it the draw is skipped (and counted by GL_DRAWS_CULLED_KOS). If they're
+ * entirely in front of the near plane the draw isn't near-Z clipped.
+ *
+ * Nothing checks that the vertices really are inside the bounds. Bounds
+ * given while a list is being compiled are ignored, pass them to
+ * glCallList instead.
+ */
+GLAPI void APIENTRY glKosBoundingBox(GLfloat minx, GLfloat miny, GLfloat minz, GLfloat maxx, GLfloat maxy, GLfloat maxz);
+GLAPI void APIENTRY glKosBoundingSphere(GLfloat x, GLfloat y, GLfloat z, GLfloat radius);
+
+/*
+ * Recording
+ *
+ * glKosStartRecording writes everything sent to the PVR to a file: the OP, PT
+ * and TR lists of each frame (written by glKosSwapBuffers), texture uploads
+ * and palette changes. Textures and palettes which already exist when recording
+ * starts are written first. Recordings can be played back with
+ * benchmarks/replay.c.
+ *
+ * Returns GL_FALSE if the file couldn't be opened or written to, or a
+ * recording is already in progress. If a write fails later on (e.g. the disk
+ * is full) the recording stops there, with a message on stderr.
+ */
+GLAPI GLboolean APIENTRY glKosStartRecording(const char* filename);
+GLAPI void APIENTRY glKosStopRecording();
+
 __END_DECLS
 